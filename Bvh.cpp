@@ -0,0 +1,818 @@
+#include "Bvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cfloat>
+
+using namespace DirectX;
+
+// Cost of visiting a node, relative to testing one item
+#define TRAVERSAL_COST	1.0f
+
+// Marks a frustum query stack entry whose node is entirely inside
+#define INSIDE_FLAG		0x80000000u
+
+namespace
+{
+	// Plain compares, which (unlike fminf and fmaxf) always inline
+	inline float Min(float a, float b) { return a < b ? a : b; }
+	inline float Max(float a, float b) { return a > b ? a : b; }
+
+	float SurfaceArea(const XMFLOAT3& min, const XMFLOAT3& max)
+	{
+		float x = max.x - min.x;
+		float y = max.y - min.y;
+		float z = max.z - min.z;
+		return 2.0f * (x * y + y * z + z * x);
+	}
+
+	void Grow(XMFLOAT3& min, XMFLOAT3& max, const XMFLOAT3& otherMin, const XMFLOAT3& otherMax)
+	{
+		min.x = Min(min.x, otherMin.x); min.y = Min(min.y, otherMin.y); min.z = Min(min.z, otherMin.z);
+		max.x = Max(max.x, otherMax.x); max.y = Max(max.y, otherMax.y); max.z = Max(max.z, otherMax.z);
+	}
+
+	// Pushed out a hair, so rounding never leaves an item poking
+	// out of its node (which a query would then miss)
+	float Lower(float v) { return v - (fabsf(v) * 1e-6f + 1e-6f); }
+	float Raise(float v) { return v + (fabsf(v) * 1e-6f + 1e-6f); }
+
+	// The same test (and arithmetic) as the FrustumCull() kernel, so both cull the same boxes
+	template <typename T>
+	bool ItemInFrustum(const Frustum& frustum, const T& item)
+	{
+		for (int p = 0; p < 6; p++)
+		{
+			const XMFLOAT4& plane = frustum.Planes[p];
+			float distance = plane.x * item.CenterX + plane.y * item.CenterY + plane.z * item.CenterZ + plane.w;
+			float radius = fabsf(plane.x) * item.ExtentX + fabsf(plane.y) * item.ExtentY + fabsf(plane.z) * item.ExtentZ;
+			if (distance + radius < 0)
+				return false;
+		}
+		return true;
+	}
+
+	// Gap between the box and the point along one axis (0 inside)
+	float Gap(float center, float extent, float point)
+	{
+		return Max(fabsf(point - center) - extent, 0.0f);
+	}
+
+	template <typename T>
+	bool ItemInSphere(const T& item, const XMFLOAT3& center, float radius)
+	{
+		float x = Gap(item.CenterX, item.ExtentX, center.x);
+		float y = Gap(item.CenterY, item.ExtentY, center.y);
+		float z = Gap(item.CenterZ, item.ExtentZ, center.z);
+		return x * x + y * y + z * z <= radius * radius;
+	}
+
+	template <typename T>
+	bool ItemInBox(const T& item, const XMFLOAT3& min, const XMFLOAT3& max)
+	{
+		return
+			item.CenterX - item.ExtentX <= max.x && item.CenterX + item.ExtentX >= min.x &&
+			item.CenterY - item.ExtentY <= max.y && item.CenterY + item.ExtentY >= min.y &&
+			item.CenterZ - item.ExtentZ <= max.z && item.CenterZ + item.ExtentZ >= min.z;
+	}
+
+	// Slab test: where the ray enters the box, if it does before maxDistance
+	bool RayBox(const XMFLOAT3& origin, const XMFLOAT3& inverseDirection, const XMFLOAT3& min, const XMFLOAT3& max,
+		float maxDistance, float& enter)
+	{
+		float x1 = (min.x - origin.x) * inverseDirection.x, x2 = (max.x - origin.x) * inverseDirection.x;
+		float y1 = (min.y - origin.y) * inverseDirection.y, y2 = (max.y - origin.y) * inverseDirection.y;
+		float z1 = (min.z - origin.z) * inverseDirection.z, z2 = (max.z - origin.z) * inverseDirection.z;
+		float enterAt = Max(Max(Min(x1, x2), Min(y1, y2)), Max(Min(z1, z2), 0.0f));
+		float exitAt = Min(Min(Max(x1, x2), Max(y1, y2)), Min(Max(z1, z2), maxDistance));
+		enter = enterAt;
+		return enterAt <= exitAt;
+	}
+
+	template <typename T>
+	bool RayItem(const XMFLOAT3& origin, const XMFLOAT3& inverseDirection, const T& item, float maxDistance, float& enter)
+	{
+		XMFLOAT3 min(item.CenterX - item.ExtentX, item.CenterY - item.ExtentY, item.CenterZ - item.ExtentZ);
+		XMFLOAT3 max(item.CenterX + item.ExtentX, item.CenterY + item.ExtentY, item.CenterZ + item.ExtentZ);
+		return RayBox(origin, inverseDirection, min, max, maxDistance, enter);
+	}
+
+	XMFLOAT3 Inverse(const XMFLOAT3& direction)
+	{
+		return XMFLOAT3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	}
+}
+
+void Bvh::Build(const CullBoxes& boxes)
+{
+	unsigned int count = boxes.Count;
+	leafItems.resize(count);
+	itemOrder.resize(count);
+	itemSlots.resize(count);
+	itemLeaves.resize(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		Item& item = leafItems[i];
+		item.CenterX = boxes.CenterX[i]; item.CenterY = boxes.CenterY[i]; item.CenterZ = boxes.CenterZ[i];
+		item.ExtentX = boxes.ExtentX[i]; item.ExtentY = boxes.ExtentY[i]; item.ExtentZ = boxes.ExtentZ[i];
+		itemOrder[i] = i;
+	}
+
+	// A binary tree with at least one item per leaf never has more than this many nodes
+	nodes.clear();
+	parents.clear();
+	nodes.reserve(count > 0 ? count * 2 - 1 : 1);
+	parents.reserve(nodes.capacity());
+
+	BvhNode root = {};
+	root.LeftFirst = 0;
+	root.Count = count;
+	nodes.push_back(root);
+	parents.push_back(0);
+	if (count > 0)
+	{
+		UpdateBounds(0);
+		Subdivide();
+	}
+
+	for (unsigned int n = 0; n < nodes.size(); n++)
+	{
+		for (unsigned int slot = nodes[n].LeftFirst; slot < nodes[n].LeftFirst + nodes[n].Count; slot++)
+		{
+			itemSlots[itemOrder[slot]] = slot;
+			itemLeaves[itemOrder[slot]] = n;
+		}
+	}
+
+	dirty.assign(nodes.size(), false);
+	anyDirty = false;
+	lastRefitNodes = 0;
+	buildCost = cost = ComputeCost();
+}
+
+// --------------------------------------------------------
+// Splits nodes (starting with the root) until SAH says a leaf
+// is cheaper.  Each item's centroid goes in one of
+// BVH_SAH_BINS bins along each axis, and every boundary
+// between bins is tried as a split: cost is the traversal
+// plus each side's item count weighted by its surface area
+// (the chance a query reaching the node reaches that side)
+// --------------------------------------------------------
+void Bvh::Subdivide()
+{
+	struct Bin
+	{
+		XMFLOAT3 Min, Max;
+		unsigned int Count;
+	};
+
+	std::vector<std::pair<unsigned int, unsigned int>> work;	// Node and its depth
+	work.push_back(std::make_pair(0u, 0u));
+	while (!work.empty())
+	{
+		unsigned int n = work.back().first;
+		unsigned int depth = work.back().second;
+		work.pop_back();
+
+		unsigned int first = nodes[n].LeftFirst;
+		unsigned int count = nodes[n].Count;
+		if (count <= 1 || depth + 2 >= BVH_STACK_SIZE)
+			continue;
+
+		XMFLOAT3 centroidMin(FLT_MAX, FLT_MAX, FLT_MAX);
+		XMFLOAT3 centroidMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (unsigned int i = first; i < first + count; i++)
+		{
+			XMFLOAT3 c(leafItems[i].CenterX, leafItems[i].CenterY, leafItems[i].CenterZ);
+			Grow(centroidMin, centroidMax, c, c);
+		}
+
+		// Cheapest split over every axis
+		float bestCost = FLT_MAX;
+		int bestAxis = -1;
+		int bestSplit = 0;
+		const float* cMin = &centroidMin.x;
+		const float* cMax = &centroidMax.x;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float extent = cMax[axis] - cMin[axis];
+			if (extent <= 0)
+				continue;
+
+			Bin bins[BVH_SAH_BINS];
+			for (Bin& bin : bins)
+			{
+				bin.Min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+				bin.Max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+				bin.Count = 0;
+			}
+			float scale = BVH_SAH_BINS / extent;
+			for (unsigned int i = first; i < first + count; i++)
+			{
+				const Item& item = leafItems[i];
+				const float* center = &item.CenterX;
+				int b = std::min(BVH_SAH_BINS - 1, (int)((center[axis] - cMin[axis]) * scale));
+				bins[b].Count++;
+				Grow(bins[b].Min, bins[b].Max,
+					XMFLOAT3(item.CenterX - item.ExtentX, item.CenterY - item.ExtentY, item.CenterZ - item.ExtentZ),
+					XMFLOAT3(item.CenterX + item.ExtentX, item.CenterY + item.ExtentY, item.CenterZ + item.ExtentZ));
+			}
+
+			// Sweep from the left, then from the right, adding up each side
+			float leftArea[BVH_SAH_BINS - 1];
+			unsigned int leftCount[BVH_SAH_BINS - 1];
+			XMFLOAT3 min(FLT_MAX, FLT_MAX, FLT_MAX), max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			unsigned int sum = 0;
+			for (int b = 0; b < BVH_SAH_BINS - 1; b++)
+			{
+				sum += bins[b].Count;
+				if (bins[b].Count)
+					Grow(min, max, bins[b].Min, bins[b].Max);
+				leftCount[b] = sum;
+				leftArea[b] = sum ? SurfaceArea(min, max) : 0;
+			}
+			min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+			max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			sum = 0;
+			for (int b = BVH_SAH_BINS - 1; b > 0; b--)
+			{
+				sum += bins[b].Count;
+				if (bins[b].Count)
+					Grow(min, max, bins[b].Min, bins[b].Max);
+				if (leftCount[b - 1] == 0 || sum == 0)
+					continue;
+
+				float splitCost = leftCount[b - 1] * leftArea[b - 1] + sum * SurfaceArea(min, max);
+				if (splitCost < bestCost)
+				{
+					bestCost = splitCost;
+					bestAxis = axis;
+					bestSplit = b;
+				}
+			}
+		}
+
+		// Compare against leaving it a leaf (one test per item)
+		float area = SurfaceArea(nodes[n].Min, nodes[n].Max);
+		bool worthSplitting = bestAxis >= 0 && area > 0 && TRAVERSAL_COST + bestCost / area < count;
+		if (!worthSplitting && count <= BVH_MAX_LEAF_ITEMS)
+			continue;
+
+		// Items on the left of the split go first (or the first half, if there's no good split)
+		unsigned int leftCount = count / 2;
+		if (bestAxis >= 0)
+		{
+			float scale = BVH_SAH_BINS / (cMax[bestAxis] - cMin[bestAxis]);
+			unsigned int i = first;
+			unsigned int j = first + count;
+			while (i < j)
+			{
+				const float* center = &leafItems[i].CenterX;
+				int b = std::min(BVH_SAH_BINS - 1, (int)((center[bestAxis] - cMin[bestAxis]) * scale));
+				if (b < bestSplit)
+					i++;
+				else
+				{
+					j--;
+					std::swap(leafItems[i], leafItems[j]);
+					std::swap(itemOrder[i], itemOrder[j]);
+				}
+			}
+			leftCount = i - first;
+		}
+
+		unsigned int left = (unsigned int)nodes.size();
+		BvhNode child = {};
+		child.LeftFirst = first;
+		child.Count = leftCount;
+		nodes.push_back(child);
+		child.LeftFirst = first + leftCount;
+		child.Count = count - leftCount;
+		nodes.push_back(child);
+		parents.push_back(n);
+		parents.push_back(n);
+
+		nodes[n].LeftFirst = left;
+		nodes[n].Count = 0;
+		UpdateBounds(left);
+		UpdateBounds(left + 1);
+		work.push_back(std::make_pair(left, depth + 1));
+		work.push_back(std::make_pair(left + 1, depth + 1));
+	}
+}
+
+void Bvh::UpdateBounds(unsigned int n)
+{
+	BvhNode& node = nodes[n];
+	if (node.Count == 0)
+	{
+		const BvhNode& left = nodes[node.LeftFirst];
+		const BvhNode& right = nodes[node.LeftFirst + 1];
+		node.Min = left.Min;
+		node.Max = left.Max;
+		Grow(node.Min, node.Max, right.Min, right.Max);
+		return;
+	}
+
+	XMFLOAT3 min(FLT_MAX, FLT_MAX, FLT_MAX);
+	XMFLOAT3 max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (unsigned int i = node.LeftFirst; i < node.LeftFirst + node.Count; i++)
+	{
+		const Item& item = leafItems[i];
+		Grow(min, max,
+			XMFLOAT3(item.CenterX - item.ExtentX, item.CenterY - item.ExtentY, item.CenterZ - item.ExtentZ),
+			XMFLOAT3(item.CenterX + item.ExtentX, item.CenterY + item.ExtentY, item.CenterZ + item.ExtentZ));
+	}
+	node.Min = XMFLOAT3(Lower(min.x), Lower(min.y), Lower(min.z));
+	node.Max = XMFLOAT3(Raise(max.x), Raise(max.y), Raise(max.z));
+}
+
+float Bvh::ComputeCost() const
+{
+	float rootArea = nodes.empty() ? 0 : SurfaceArea(nodes[0].Min, nodes[0].Max);
+	if (rootArea <= 0)
+		return 0;
+
+	float sum = 0;
+	for (const BvhNode& node : nodes)
+		sum += SurfaceArea(node.Min, node.Max) * (node.Count ? (float)node.Count : TRAVERSAL_COST);
+	return sum / rootArea;
+}
+
+void Bvh::Update(unsigned int item, const XMFLOAT3& center, const XMFLOAT3& extents)
+{
+	Item& leafItem = leafItems[itemSlots[item]];
+	leafItem.CenterX = center.x; leafItem.CenterY = center.y; leafItem.CenterZ = center.z;
+	leafItem.ExtentX = extents.x; leafItem.ExtentY = extents.y; leafItem.ExtentZ = extents.z;
+
+	// Mark the leaf and everything above it, stopping where a
+	// previous update already did
+	unsigned int n = itemLeaves[item];
+	while (!dirty[n])
+	{
+		dirty[n] = true;
+		if (n == 0)
+			break;
+		n = parents[n];
+	}
+	anyDirty = true;
+}
+
+void Bvh::Refit(const CullBoxes& boxes)
+{
+	for (unsigned int i = 0; i < boxes.Count && i < itemSlots.size(); i++)
+	{
+		const Item& item = leafItems[itemSlots[i]];
+		if (item.CenterX != boxes.CenterX[i] || item.CenterY != boxes.CenterY[i] || item.CenterZ != boxes.CenterZ[i] ||
+			item.ExtentX != boxes.ExtentX[i] || item.ExtentY != boxes.ExtentY[i] || item.ExtentZ != boxes.ExtentZ[i])
+		{
+			Update(i,
+				XMFLOAT3(boxes.CenterX[i], boxes.CenterY[i], boxes.CenterZ[i]),
+				XMFLOAT3(boxes.ExtentX[i], boxes.ExtentY[i], boxes.ExtentZ[i]));
+		}
+	}
+	Refit();
+}
+
+// Children always come after their parent, so going backwards
+// re-bounds both children before the node above them
+void Bvh::Refit()
+{
+	lastRefitNodes = 0;
+	if (!anyDirty)
+		return;
+
+	for (unsigned int n = (unsigned int)nodes.size(); n-- > 0; )
+	{
+		if (!dirty[n])
+			continue;
+		UpdateBounds(n);
+		dirty[n] = false;
+		lastRefitNodes++;
+	}
+	anyDirty = false;
+	cost = ComputeCost();
+}
+
+float Bvh::GetCost() const
+{
+	return cost;
+}
+
+float Bvh::GetBuildCost() const
+{
+	return buildCost;
+}
+
+bool Bvh::NeedsRebuild() const
+{
+	return cost > buildCost * BVH_REBUILD_COST_RATIO;
+}
+
+unsigned int Bvh::GetItemCount() const
+{
+	return (unsigned int)leafItems.size();
+}
+
+unsigned int Bvh::GetNodeCount() const
+{
+	return (unsigned int)nodes.size();
+}
+
+unsigned int Bvh::GetLastRefitNodes() const
+{
+	return lastRefitNodes;
+}
+
+// --------------------------------------------------------
+// A node is out if it's entirely behind any plane (its corner
+// furthest along the plane's normal is behind it), and
+// entirely in if its nearest corner is in front of all six.
+// Everything below an entirely-in node is taken without
+// testing
+// --------------------------------------------------------
+void Bvh::QueryFrustum(const Frustum& frustum, std::vector<unsigned int>& results, BvhQueryStats* stats) const
+{
+	if (leafItems.empty())
+		return;
+
+	BvhQueryStats counts;
+	unsigned int stack[BVH_STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		unsigned int entry = stack[--top];
+		unsigned int n = entry & ~INSIDE_FLAG;
+		bool inside = (entry & INSIDE_FLAG) != 0;
+		const BvhNode& node = nodes[n];
+		counts.NodesVisited++;
+
+		if (!inside)
+		{
+			bool outside = false;
+			inside = true;
+			for (int p = 0; p < 6 && !outside; p++)
+			{
+				const XMFLOAT4& plane = frustum.Planes[p];
+				float farthest =
+					plane.x * (plane.x >= 0 ? node.Max.x : node.Min.x) +
+					plane.y * (plane.y >= 0 ? node.Max.y : node.Min.y) +
+					plane.z * (plane.z >= 0 ? node.Max.z : node.Min.z) + plane.w;
+				float nearest =
+					plane.x * (plane.x >= 0 ? node.Min.x : node.Max.x) +
+					plane.y * (plane.y >= 0 ? node.Min.y : node.Max.y) +
+					plane.z * (plane.z >= 0 ? node.Min.z : node.Max.z) + plane.w;
+				outside = farthest < 0;
+				inside = inside && nearest >= 0;
+			}
+			if (outside)
+				continue;
+		}
+
+		if (node.Count > 0)
+		{
+			for (unsigned int slot = node.LeftFirst; slot < node.LeftFirst + node.Count; slot++)
+			{
+				if (!inside)
+					counts.ItemsTested++;
+				if (inside || ItemInFrustum(frustum, leafItems[slot]))
+					results.push_back(itemOrder[slot]);
+			}
+			continue;
+		}
+
+		unsigned int flag = inside ? INSIDE_FLAG : 0;
+		stack[top++] = node.LeftFirst | flag;
+		stack[top++] = (node.LeftFirst + 1) | flag;
+	}
+
+	if (stats)
+		*stats = counts;
+}
+
+void Bvh::QuerySphere(const XMFLOAT3& center, float radius, std::vector<unsigned int>& results, BvhQueryStats* stats) const
+{
+	if (leafItems.empty())
+		return;
+
+	BvhQueryStats counts;
+	unsigned int stack[BVH_STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const BvhNode& node = nodes[stack[--top]];
+		counts.NodesVisited++;
+
+		float x = Max(Max(node.Min.x - center.x, center.x - node.Max.x), 0.0f);
+		float y = Max(Max(node.Min.y - center.y, center.y - node.Max.y), 0.0f);
+		float z = Max(Max(node.Min.z - center.z, center.z - node.Max.z), 0.0f);
+		if (x * x + y * y + z * z > radius * radius)
+			continue;
+
+		if (node.Count > 0)
+		{
+			counts.ItemsTested += node.Count;
+			for (unsigned int slot = node.LeftFirst; slot < node.LeftFirst + node.Count; slot++)
+			{
+				if (ItemInSphere(leafItems[slot], center, radius))
+					results.push_back(itemOrder[slot]);
+			}
+			continue;
+		}
+
+		stack[top++] = node.LeftFirst;
+		stack[top++] = node.LeftFirst + 1;
+	}
+
+	if (stats)
+		*stats = counts;
+}
+
+void Bvh::QueryBox(const XMFLOAT3& min, const XMFLOAT3& max, std::vector<unsigned int>& results, BvhQueryStats* stats) const
+{
+	if (leafItems.empty())
+		return;
+
+	BvhQueryStats counts;
+	unsigned int stack[BVH_STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const BvhNode& node = nodes[stack[--top]];
+		counts.NodesVisited++;
+
+		if (node.Min.x > max.x || node.Max.x < min.x ||
+			node.Min.y > max.y || node.Max.y < min.y ||
+			node.Min.z > max.z || node.Max.z < min.z)
+			continue;
+
+		if (node.Count > 0)
+		{
+			counts.ItemsTested += node.Count;
+			for (unsigned int slot = node.LeftFirst; slot < node.LeftFirst + node.Count; slot++)
+			{
+				if (ItemInBox(leafItems[slot], min, max))
+					results.push_back(itemOrder[slot]);
+			}
+			continue;
+		}
+
+		stack[top++] = node.LeftFirst;
+		stack[top++] = node.LeftFirst + 1;
+	}
+
+	if (stats)
+		*stats = counts;
+}
+
+// --------------------------------------------------------
+// Visits the nearer child first, and skips anything that
+// starts further away than the closest hit so far
+// --------------------------------------------------------
+bool Bvh::Raycast(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, BvhRayHit& hit, BvhQueryStats* stats) const
+{
+	if (leafItems.empty())
+		return false;
+
+	BvhQueryStats counts;
+	XMFLOAT3 inverseDirection = Inverse(direction);
+	float best = maxDistance;
+	bool found = false;
+
+	unsigned int stack[BVH_STACK_SIZE];
+	float stackEnter[BVH_STACK_SIZE];
+	int top = 0;
+	counts.NodesVisited++;
+	float enter;
+	if (RayBox(origin, inverseDirection, nodes[0].Min, nodes[0].Max, best, enter))
+	{
+		stack[top] = 0;
+		stackEnter[top++] = enter;
+	}
+
+	while (top > 0)
+	{
+		top--;
+		if (stackEnter[top] > best)
+			continue;
+		const BvhNode& node = nodes[stack[top]];
+
+		if (node.Count > 0)
+		{
+			counts.ItemsTested += node.Count;
+			for (unsigned int slot = node.LeftFirst; slot < node.LeftFirst + node.Count; slot++)
+			{
+				if (RayItem(origin, inverseDirection, leafItems[slot], best, enter) && (enter < best || !found))
+				{
+					best = enter;
+					hit.Item = itemOrder[slot];
+					hit.Distance = enter;
+					found = true;
+				}
+			}
+			continue;
+		}
+
+		float enterLeft, enterRight;
+		const BvhNode& left = nodes[node.LeftFirst];
+		const BvhNode& right = nodes[node.LeftFirst + 1];
+		bool hitLeft = RayBox(origin, inverseDirection, left.Min, left.Max, best, enterLeft);
+		bool hitRight = RayBox(origin, inverseDirection, right.Min, right.Max, best, enterRight);
+		counts.NodesVisited += 2;
+
+		// The nearer one goes on top
+		if (hitLeft && hitRight && enterLeft < enterRight)
+		{
+			stack[top] = node.LeftFirst + 1; stackEnter[top++] = enterRight;
+			stack[top] = node.LeftFirst; stackEnter[top++] = enterLeft;
+		}
+		else
+		{
+			if (hitLeft) { stack[top] = node.LeftFirst; stackEnter[top++] = enterLeft; }
+			if (hitRight) { stack[top] = node.LeftFirst + 1; stackEnter[top++] = enterRight; }
+		}
+	}
+
+	if (stats)
+		*stats = counts;
+	return found;
+}
+
+namespace
+{
+	float RandomRange(float min, float max)
+	{
+		return min + (max - min) * (float)rand() / RAND_MAX;
+	}
+
+	XMFLOAT3 RandomDirection()
+	{
+		XMFLOAT3 d;
+		XMStoreFloat3(&d, XMVector3Normalize(XMVectorSet(RandomRange(-1, 1), RandomRange(-1, 1), RandomRange(-1, 1), 0) + XMVectorSet(0, 0, 1e-3f, 0)));
+		return d;
+	}
+
+	double SecondsSince(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// The tree doesn't return things in index order
+	bool SameItems(std::vector<unsigned int> a, const std::vector<unsigned int>& sortedB)
+	{
+		std::sort(a.begin(), a.end());
+		return a == sortedB;
+	}
+}
+
+BvhBenchmarkResult BenchmarkBvh(unsigned int count, float movingFraction)
+{
+	const unsigned int frames = 60;
+	const float worldSize = 400;
+
+	BvhBenchmarkResult result;
+	result.Count = count;
+	result.Moving = (unsigned int)(count * movingFraction);
+	result.Identical = true;
+
+	srand(1234);
+	CullBoxes boxes;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		float half = worldSize / 2;
+		boxes.Add(
+			XMFLOAT3(RandomRange(-half, half), RandomRange(-half, half), RandomRange(-half, half)),
+			XMFLOAT3(RandomRange(0.25f, 2), RandomRange(0.25f, 2), RandomRange(0.25f, 2)));
+	}
+
+	Bvh bvh;
+	auto start = std::chrono::high_resolution_clock::now();
+	bvh.Build(boxes);
+	result.BuildSeconds = SecondsSince(start);
+	result.Nodes = bvh.GetNodeCount();
+
+	// Each moving item wanders a little every frame
+	double refitSeconds = 0;
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		unsigned int firstMoving = (frame * 7919u) % (count ? count : 1);
+		start = std::chrono::high_resolution_clock::now();
+		for (unsigned int m = 0; m < result.Moving; m++)
+		{
+			unsigned int i = (firstMoving + m) % count;
+			boxes.CenterX[i] += RandomRange(-2, 2);
+			boxes.CenterY[i] += RandomRange(-2, 2);
+			boxes.CenterZ[i] += RandomRange(-2, 2);
+			bvh.Update(i,
+				XMFLOAT3(boxes.CenterX[i], boxes.CenterY[i], boxes.CenterZ[i]),
+				XMFLOAT3(boxes.ExtentX[i], boxes.ExtentY[i], boxes.ExtentZ[i]));
+		}
+		bvh.Refit();
+		refitSeconds += SecondsSince(start);
+
+		if (bvh.GetBuildCost() > 0)
+			result.CostGrowth = Max(result.CostGrowth, bvh.GetCost() / bvh.GetBuildCost());
+		if (bvh.NeedsRebuild())
+		{
+			bvh.Build(boxes);
+			result.Rebuilds++;
+		}
+	}
+	result.RefitSeconds = refitSeconds / frames;
+
+	// Cameras looking every which way from inside the boxes
+	std::vector<unsigned int> found, expected;
+	result.FrustumQueries = 100;
+	for (unsigned int q = 0; q < result.FrustumQueries; q++)
+	{
+		XMFLOAT3 eye(RandomRange(-150, 150), RandomRange(-150, 150), RandomRange(-150, 150));
+		XMFLOAT3 look = RandomDirection();
+		XMVECTOR up = fabsf(look.y) > 0.99f ? XMVectorSet(1, 0, 0, 0) : XMVectorSet(0, 1, 0, 0);
+		XMFLOAT4X4 viewProjection;
+		XMStoreFloat4x4(&viewProjection,
+			XMMatrixLookToLH(XMLoadFloat3(&eye), XMLoadFloat3(&look), up) *
+			XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 100.0f));
+		Frustum frustum = MakeFrustum(viewProjection);
+
+		found.clear();
+		start = std::chrono::high_resolution_clock::now();
+		bvh.QueryFrustum(frustum, found);
+		result.FrustumSeconds += SecondsSince(start);
+
+		expected.clear();
+		start = std::chrono::high_resolution_clock::now();
+		FrustumCull(frustum, boxes, expected);
+		result.FrustumBruteSeconds += SecondsSince(start);
+		result.Identical = result.Identical && SameItems(found, expected);
+	}
+
+	// Brute force goes through the same item test as the tree's leaves
+	struct BoxView
+	{
+		float CenterX, CenterY, CenterZ, ExtentX, ExtentY, ExtentZ;
+	};
+	auto boxAt = [&](unsigned int i)
+	{
+		BoxView b = { boxes.CenterX[i], boxes.CenterY[i], boxes.CenterZ[i], boxes.ExtentX[i], boxes.ExtentY[i], boxes.ExtentZ[i] };
+		return b;
+	};
+
+	result.SphereQueries = 1000;
+	for (unsigned int q = 0; q < result.SphereQueries; q++)
+	{
+		XMFLOAT3 center(RandomRange(-200, 200), RandomRange(-200, 200), RandomRange(-200, 200));
+		float radius = RandomRange(5, 20);
+
+		found.clear();
+		start = std::chrono::high_resolution_clock::now();
+		bvh.QuerySphere(center, radius, found);
+		result.SphereSeconds += SecondsSince(start);
+
+		expected.clear();
+		start = std::chrono::high_resolution_clock::now();
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (ItemInSphere(boxAt(i), center, radius))
+				expected.push_back(i);
+		}
+		result.SphereBruteSeconds += SecondsSince(start);
+		result.Identical = result.Identical && SameItems(found, expected);
+	}
+
+	// Ties can pick different items, so only the distance has to match
+	result.RayQueries = 1000;
+	for (unsigned int q = 0; q < result.RayQueries; q++)
+	{
+		XMFLOAT3 origin(RandomRange(-200, 200), RandomRange(-200, 200), RandomRange(-200, 200));
+		XMFLOAT3 direction = RandomDirection();
+		const float maxDistance = 500;
+
+		BvhRayHit hit;
+		start = std::chrono::high_resolution_clock::now();
+		bool hitSomething = bvh.Raycast(origin, direction, maxDistance, hit);
+		result.RaySeconds += SecondsSince(start);
+
+		XMFLOAT3 inverseDirection = Inverse(direction);
+		float best = maxDistance;
+		bool bruteHit = false;
+		start = std::chrono::high_resolution_clock::now();
+		for (unsigned int i = 0; i < count; i++)
+		{
+			float enter;
+			if (RayItem(origin, inverseDirection, boxAt(i), best, enter) && (enter < best || !bruteHit))
+			{
+				best = enter;
+				bruteHit = true;
+			}
+		}
+		result.RayBruteSeconds += SecondsSince(start);
+		result.Identical = result.Identical && hitSomething == bruteHit && (!bruteHit || hit.Distance == best);
+	}
+
+	return result;
+}
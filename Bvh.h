@@ -0,0 +1,162 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+#include "FrustumCulling.h"
+
+// Leaves hold at most this many items, and split whenever SAH says it's worth it
+#define BVH_MAX_LEAF_ITEMS		8
+
+// Centroid bins per axis when looking for the cheapest split
+#define BVH_SAH_BINS			16
+
+// Refits let the tree get looser as things move; past this many
+// times its cost when built, NeedsRebuild() says so
+#define BVH_REBUILD_COST_RATIO	1.5f
+
+// Deepest traversal the fixed size query stacks allow
+#define BVH_STACK_SIZE			64
+
+// --------------------------------------------------------
+// A node of the flattened tree (32 bytes, two to a cache
+// line).  Interior nodes have Count 0, and their children are
+// next to each other at LeftFirst and LeftFirst + 1; leaves
+// hold items LeftFirst to LeftFirst + Count - 1 of the item
+// order
+// --------------------------------------------------------
+struct BvhNode
+{
+	DirectX::XMFLOAT3 Min;
+	unsigned int LeftFirst;
+	DirectX::XMFLOAT3 Max;
+	unsigned int Count;
+};
+
+// --------------------------------------------------------
+// How much of the tree one query touched
+// --------------------------------------------------------
+struct BvhQueryStats
+{
+	unsigned int NodesVisited = 0;
+	unsigned int ItemsTested = 0;
+};
+
+// --------------------------------------------------------
+// The closest item a ray hits, and how far along the ray
+// (in units of its direction's length)
+// --------------------------------------------------------
+struct BvhRayHit
+{
+	unsigned int Item = 0;
+	float Distance = 0;
+};
+
+// --------------------------------------------------------
+// A bounding volume hierarchy over a set of boxes (the same
+// CullBoxes the culling kernel takes), answering frustum,
+// sphere, box and ray queries without looking at every box
+//
+// Build() splits with a binned surface area heuristic.  When
+// boxes move, Update() or Refit() only re-bounds the nodes
+// above the items that changed, keeping the tree's shape; the
+// tree gets looser as things move away from where it was
+// built, so NeedsRebuild() compares its cost against what it
+// was after Build().
+//
+// Items are copied into leaf order, so a leaf's boxes are
+// contiguous, and queries walk the tree with a small fixed
+// stack rather than recursing.  Frustum queries stop testing
+// below any node that's entirely inside.  Query results are
+// item indices (the box's index in the CullBoxes), in tree
+// order rather than index order
+// --------------------------------------------------------
+class Bvh
+{
+public:
+	void Build(const CullBoxes& boxes);
+
+	// Moves one item's box, marking the nodes above it for the next Refit()
+	void Update(unsigned int item, const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents);
+
+	// Updates whatever's different in boxes (which must hold the same
+	// number of items as it was built with), then refits
+	void Refit(const CullBoxes& boxes);
+
+	// Re-bounds every node marked by Update() since the last refit
+	void Refit();
+
+	// Expected cost of a query (SAH), relative to testing the root once
+	float GetCost() const;
+	float GetBuildCost() const;
+	bool NeedsRebuild() const;
+
+	unsigned int GetItemCount() const;
+	unsigned int GetNodeCount() const;
+	unsigned int GetLastRefitNodes() const;		// Nodes re-bounded by the last Refit()
+
+	// Each appends the indices of the items it finds to results
+	void QueryFrustum(const Frustum& frustum, std::vector<unsigned int>& results, BvhQueryStats* stats = 0) const;
+	void QuerySphere(const DirectX::XMFLOAT3& center, float radius, std::vector<unsigned int>& results, BvhQueryStats* stats = 0) const;
+	void QueryBox(const DirectX::XMFLOAT3& min, const DirectX::XMFLOAT3& max, std::vector<unsigned int>& results, BvhQueryStats* stats = 0) const;
+
+	// The nearest item whose box the ray enters within maxDistance
+	// (or starts inside), false if there isn't one
+	bool Raycast(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction, float maxDistance,
+		BvhRayHit& hit, BvhQueryStats* stats = 0) const;
+
+private:
+	// An item's box as the culling kernel sees it
+	struct Item
+	{
+		float CenterX, CenterY, CenterZ;
+		float ExtentX, ExtentY, ExtentZ;
+	};
+
+	void Subdivide();
+	void UpdateBounds(unsigned int node);
+	float ComputeCost() const;
+
+	std::vector<BvhNode> nodes;
+	std::vector<Item> leafItems;			// In leaf order
+	std::vector<unsigned int> itemOrder;	// Item index of each leaf slot
+	std::vector<unsigned int> itemSlots;	// Leaf slot of each item
+	std::vector<unsigned int> itemLeaves;	// Leaf node of each item
+	std::vector<unsigned int> parents;
+	std::vector<bool> dirty;
+	bool anyDirty = false;
+
+	float buildCost = 0;
+	float cost = 0;
+	unsigned int lastRefitNodes = 0;
+};
+
+// --------------------------------------------------------
+// The tree vs testing every box, for the INFO window
+// --------------------------------------------------------
+struct BvhBenchmarkResult
+{
+	unsigned int Count = 0;
+	unsigned int Moving = 0;				// Items moved each frame
+	unsigned int Nodes = 0;
+	double BuildSeconds = 0;
+	double RefitSeconds = 0;				// Average per frame, including the updates
+	float CostGrowth = 0;					// Most the cost grew between rebuilds, relative to just built
+	unsigned int Rebuilds = 0;				// Times NeedsRebuild() asked for one while moving
+
+	unsigned int FrustumQueries = 0;
+	double FrustumSeconds = 0;
+	double FrustumBruteSeconds = 0;			// FrustumCull() over every box
+	unsigned int SphereQueries = 0;
+	double SphereSeconds = 0;
+	double SphereBruteSeconds = 0;
+	unsigned int RayQueries = 0;
+	double RaySeconds = 0;
+	double RayBruteSeconds = 0;
+
+	bool Identical = false;					// Every query found exactly what testing every box did
+};
+
+// Builds a tree over count random boxes, moves movingFraction of them
+// each frame for a while (refitting, and rebuilding when it asks to),
+// then times each kind of query against brute force
+BvhBenchmarkResult BenchmarkBvh(unsigned int count, float movingFraction);
@@ -107,3 +107,24 @@ Transform Camera::GetTransform()
 {
 	return transform;
 }
+DirectX::XMFLOAT3 Camera::GetPosition()
+{
+	return transform.GetPosition();
+}
+Frustum Camera::GetFrustum()
+{
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection, XMLoadFloat4x4(&viewMatrix) * XMLoadFloat4x4(&projMatrix));
+	return MakeFrustum(viewProjection);
+}
+
+// --------------------------------------------------------
+// Projects a world space error onto the screen
+//
+// _22 is cot(fov / 2), so an error at this distance covers
+// error * _22 / distance of the [-1, 1] clip space height
+// --------------------------------------------------------
+float Camera::GetScreenSpaceError(float worldError, float distance, float viewportHeight)
+{
+	return worldError * projMatrix._22 / distance * viewportHeight * 0.5f;
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "Transform.h"
+#include "FrustumCulling.h"
 
 class Camera
 {
@@ -14,6 +15,13 @@ public:
 	DirectX::XMFLOAT4X4 GetViewMatrix();
 	DirectX::XMFLOAT4X4 GetProjectionMatrix();
 	Transform GetTransform();
+	DirectX::XMFLOAT3 GetPosition();	// Without copying the whole Transform
+
+	// World space planes of what the camera sees
+	Frustum GetFrustum();
+
+	// Size in pixels of a world space distance seen from this far away
+	float GetScreenSpaceError(float worldError, float distance, float viewportHeight);
 
 private:
 	Transform transform;
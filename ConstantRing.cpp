@@ -0,0 +1,162 @@
+#include "ConstantRing.h"
+#include "StateCache.h"
+
+#include <cstring>
+
+ConstantRing::ConstantRing(Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	unsigned int size)
+	: allocator(size, CONSTANT_RING_ALIGNMENT)
+{
+	this->context = context;
+
+	// Offsets need 11.1, and appending needs NO_OVERWRITE on a constant buffer
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	if (FAILED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) ||
+		!options.ConstantBufferOffsetting || !options.MapNoOverwriteOnDynamicConstantBuffer ||
+		FAILED(context.As(&context1)))
+	{
+		context1.Reset();
+		return;
+	}
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.ByteWidth = allocator.GetCapacity();
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	if (FAILED(device->CreateBuffer(&desc, 0, buffer.GetAddressOf())))
+	{
+		context1.Reset();
+		return;
+	}
+
+	D3D11_QUERY_DESC queryDesc = {};
+	queryDesc.Query = D3D11_QUERY_EVENT;
+	for (auto& fence : fences)
+		device->CreateQuery(&queryDesc, fence.GetAddressOf());
+}
+
+bool ConstantRing::IsSupported()
+{
+	return context1 && buffer;
+}
+
+void ConstantRing::BeginFrame()
+{
+	frameBytes = 0;
+	frameBinds = 0;
+	frameFallbacks = 0;
+	if (!IsSupported())
+		return;
+
+	// Retire frames in order until one isn't done.  If every query is
+	// waiting, this frame needs the oldest one's, so wait for it
+	while (completedFence < nextFence)
+	{
+		ID3D11Query* fence = fences[completedFence % CONSTANT_RING_MAX_FRAMES].Get();
+		bool mustWait = nextFence - completedFence >= CONSTANT_RING_MAX_FRAMES;
+		HRESULT hr;
+		do
+		{
+			hr = context->GetData(fence, 0, 0, mustWait ? 0 : D3D11_ASYNC_GETDATA_DONOTFLUSH);
+		} while (hr == S_FALSE && mustWait);
+		if (hr != S_OK)
+			break;
+
+		allocator.Retire(completedFence);
+		completedFence++;
+	}
+}
+
+void ConstantRing::EndFrame()
+{
+	if (!IsSupported())
+		return;
+
+	allocator.EndFrame(nextFence);
+	context->End(fences[nextFence % CONSTANT_RING_MAX_FRAMES].Get());
+	nextFence++;
+}
+
+bool ConstantRing::Append(const SimpleConstantBuffer* cb, UINT& firstConstant, UINT& constantCount)
+{
+	if (!cb)
+		return false;
+
+	unsigned int offset = 0;
+	if (!allocator.Allocate(cb->Size, offset))
+		return false;
+
+	// Nothing the GPU could be reading is ever handed out again, so
+	// there's no need to discard (except to start the buffer off)
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	D3D11_MAP mapType = nextFence == 0 && frameBinds == 0 ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+	if (FAILED(context->Map(buffer.Get(), 0, mapType, 0, &mapped)))
+		return false;
+	memcpy((unsigned char*)mapped.pData + offset, cb->LocalDataBuffer, cb->Size);
+	context->Unmap(buffer.Get(), 0);
+
+	// In 16 byte constants, rounded up to the 16-constant steps binding needs
+	firstConstant = offset / 16;
+	constantCount = (cb->Size + CONSTANT_RING_ALIGNMENT - 1) / CONSTANT_RING_ALIGNMENT * (CONSTANT_RING_ALIGNMENT / 16);
+	frameBytes += cb->Size;
+	frameBinds++;
+	return true;
+}
+
+bool ConstantRing::BindVertexConstants(const SimpleConstantBuffer* cb)
+{
+	if (!IsSupported())
+		return false;
+
+	UINT firstConstant = 0;
+	UINT constantCount = 0;
+	if (!Append(cb, firstConstant, constantCount))
+	{
+		frameFallbacks++;
+		if (cb)
+			StateCache::GetInstance().SetConstantBuffer(STATE_STAGE_VERTEX, cb->BindIndex, cb->ConstantBuffer.Get());
+		return false;
+	}
+	StateCache::GetInstance().SetConstantBuffer(STATE_STAGE_VERTEX, cb->BindIndex, buffer.Get(), firstConstant, constantCount);
+	return true;
+}
+
+bool ConstantRing::BindPixelConstants(const SimpleConstantBuffer* cb)
+{
+	if (!IsSupported())
+		return false;
+
+	UINT firstConstant = 0;
+	UINT constantCount = 0;
+	if (!Append(cb, firstConstant, constantCount))
+	{
+		frameFallbacks++;
+		if (cb)
+			StateCache::GetInstance().SetConstantBuffer(STATE_STAGE_PIXEL, cb->BindIndex, cb->ConstantBuffer.Get());
+		return false;
+	}
+	StateCache::GetInstance().SetConstantBuffer(STATE_STAGE_PIXEL, cb->BindIndex, buffer.Get(), firstConstant, constantCount);
+	return true;
+}
+
+const RingAllocator& ConstantRing::GetAllocator()
+{
+	return allocator;
+}
+
+unsigned int ConstantRing::GetFrameBytes()
+{
+	return frameBytes;
+}
+
+unsigned int ConstantRing::GetFrameBinds()
+{
+	return frameBinds;
+}
+
+unsigned int ConstantRing::GetFrameFallbacks()
+{
+	return frameFallbacks;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <wrl/client.h>
+#include "RingAllocator.h"
+#include "SimpleShader.h"
+
+// Bytes in the ring (plenty for a few frames of the stress grid's PerObject blocks)
+#define CONSTANT_RING_SIZE			(8 * 1024 * 1024)
+
+// Offsets and sizes bound with *SetConstantBuffers1 are in
+// 16-constant (256 byte) steps
+#define CONSTANT_RING_ALIGNMENT		256
+
+// Frames the GPU can be behind before BeginFrame() waits for it
+#define CONSTANT_RING_MAX_FRAMES	4
+
+// --------------------------------------------------------
+// A large dynamic constant buffer that draws append their
+// per-object constants to (mapped NO_OVERWRITE), each bound
+// at its own offset with the D3D 11.1 *SetConstantBuffers1
+// calls, instead of every draw updating the same small buffer
+// and waiting its turn to.
+//
+// A RingAllocator does the bookkeeping; frames are fenced
+// with event queries, and their space is reused once the GPU
+// gets past them.  Needs an 11.1 context with constant buffer
+// offsetting and NO_OVERWRITE maps of constant buffers;
+// without them IsSupported() is false and nothing binds, and
+// if the ring fills up mid frame, the rest of the frame's
+// draws fail to bind too.  Either way, the caller goes back
+// to copying into the shader's own buffer
+// --------------------------------------------------------
+class ConstantRing
+{
+public:
+	ConstantRing(Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		unsigned int size = CONSTANT_RING_SIZE);
+
+	bool IsSupported();
+
+	// Frees whatever frames the GPU has finished with, waiting for
+	// the oldest if every fence is still in flight
+	void BeginFrame();
+	// Fences everything appended since BeginFrame()
+	void EndFrame();
+
+	// Appends a buffer's local data and binds it in its register.  False
+	// if it couldn't (the shader's own buffer is bound back in its place,
+	// in case an earlier draw left the ring there)
+	bool BindVertexConstants(const SimpleConstantBuffer* cb);
+	bool BindPixelConstants(const SimpleConstantBuffer* cb);
+
+	const RingAllocator& GetAllocator();
+	unsigned int GetFrameBytes();		// Appended since BeginFrame()
+	unsigned int GetFrameBinds();
+	unsigned int GetFrameFallbacks();	// Binds that failed since BeginFrame()
+
+private:
+	bool Append(const SimpleConstantBuffer* cb, UINT& firstConstant, UINT& constantCount);
+
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context1;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	Microsoft::WRL::ComPtr<ID3D11Query> fences[CONSTANT_RING_MAX_FRAMES];
+	RingAllocator allocator;
+
+	uint64_t nextFence = 0;			// Fence of the frame being recorded
+	uint64_t completedFence = 0;	// Every fence below this one is done
+	unsigned int frameBytes = 0;
+	unsigned int frameBinds = 0;
+	unsigned int frameFallbacks = 0;
+};
@@ -1,7 +1,7 @@
 #include "ShaderInclude.hlsli"
 
-//Colortint cbuffer
-cbuffer ExternalData : register(b0)
+//Colortint cbuffer, in the same slot as PixelShader.hlsl's material constants
+cbuffer PerMaterial : register(b1)
 {
 	float4 colorTint;
 }
@@ -0,0 +1,141 @@
+#include "DynamicResolution.h"
+
+#include <cmath>
+#include <cstdlib>
+
+// How much of each new frame time goes into the average, when it's slower or faster than the average
+#define SMOOTHING_SLOWER	0.5
+#define SMOOTHING_FASTER	0.1
+
+// A single frame counts as at most this many times the average, so
+// one hitch (a file load, a shader compile) can't halve the scale
+#define MAX_SPIKE			1.25
+
+// The scale aims for frames this fraction of the budget, so noise
+// around it stays under.  It only shrinks above SHRINK_ABOVE, and
+// only grows below GROW_BELOW
+#define AIM					0.9
+#define SHRINK_ABOVE		0.95
+#define GROW_BELOW			0.8
+
+// Fraction of the way to the scale that would fit that each frame moves, and the most it grows per frame
+#define SHRINK_GAIN			0.75f
+#define MAX_GROWTH			0.02f
+
+ResolutionController::ResolutionController(double targetSeconds, float minScale, float maxScale)
+{
+	this->targetSeconds = targetSeconds;
+	this->minScale = minScale;
+	this->maxScale = maxScale;
+	Reset();
+}
+
+float ResolutionController::Update(double frameSeconds)
+{
+	if (smoothedSeconds == 0)
+		smoothedSeconds = frameSeconds;
+	else if (frameSeconds > smoothedSeconds)
+		smoothedSeconds += (fmin(frameSeconds, smoothedSeconds * MAX_SPIKE) - smoothedSeconds) * SMOOTHING_SLOWER;
+	else
+		smoothedSeconds += (frameSeconds - smoothedSeconds) * SMOOTHING_FASTER;
+
+	float fit = scale * (float)sqrt(targetSeconds * AIM / smoothedSeconds);
+	float next = scale;
+	if (smoothedSeconds > targetSeconds * SHRINK_ABOVE)
+		next += (fit - scale) * SHRINK_GAIN;
+	else if (smoothedSeconds < targetSeconds * GROW_BELOW)
+		next += fminf(fit - scale, scale * MAX_GROWTH);
+	next = fmaxf(minScale, fminf(maxScale, next));
+
+	// The average is of frames at the old scale, so predict it at the
+	// new one.  Otherwise the lag keeps shrinking it past where it fits
+	smoothedSeconds *= (next * next) / (scale * scale);
+	scale = next;
+	return scale;
+}
+
+void ResolutionController::Reset()
+{
+	scale = maxScale;
+	smoothedSeconds = 0;
+}
+
+float ResolutionController::GetScale() const
+{
+	return scale;
+}
+
+double ResolutionController::GetSmoothedSeconds() const
+{
+	return smoothedSeconds;
+}
+
+double ResolutionController::GetTargetSeconds() const
+{
+	return targetSeconds;
+}
+
+void ResolutionController::SetTargetSeconds(double seconds)
+{
+	targetSeconds = seconds;
+}
+
+namespace
+{
+	// Scene load (1 = exactly the budget at full resolution) for a frame of each trace
+	float TraceLoad(int trace, unsigned int frame, unsigned int frames)
+	{
+		float noise = 0.05f * ((float)rand() / RAND_MAX * 2 - 1);
+		switch (trace)
+		{
+		case 0: return 0.8f + noise;												// Steady, under budget
+		case 1: return (frame >= frames / 4 && frame < frames * 3 / 4 ? 1.8f : 0.9f) + noise;	// Heavy scene for a while
+		case 2: return 0.6f + 1.4f * frame / frames + noise;							// Getting steadily heavier
+		default: return (frame % 60 == 59 ? 3.0f : 1.1f) + noise;					// Slightly over, with a hitch every second
+		}
+	}
+}
+
+void SimulateResolutionTraces(double targetSeconds, std::vector<ResolutionTraceResult>& results)
+{
+	const char* names[] = { "Steady", "Step", "Ramp", "Spikes" };
+	const unsigned int frames = 600;
+	const float constantCost = 0.15f;	// Part of a frame that doesn't shrink with the resolution
+
+	srand(1234);
+	for (int trace = 0; trace < 4; trace++)
+	{
+		ResolutionTraceResult result;
+		result.Name = names[trace];
+		result.Frames = frames;
+
+		ResolutionController controller(targetSeconds);
+		float scale = controller.GetScale();
+		float scaleSum = 0;
+		float lastDirection = 0;
+		for (unsigned int frame = 0; frame < frames; frame++)
+		{
+			float load = TraceLoad(trace, frame, frames);
+			double fixedSeconds = targetSeconds * load;
+			double dynamicSeconds = targetSeconds * load * (constantCost + (1 - constantCost) * scale * scale);
+			if (fixedSeconds > targetSeconds)
+				result.OverBudgetFixed++;
+			if (dynamicSeconds > targetSeconds)
+				result.OverBudgetDynamic++;
+
+			float next = controller.Update(dynamicSeconds);
+			float change = next - scale;
+			if (fabsf(change) > 0.001f)
+			{
+				if (change * lastDirection < 0)
+					result.Reversals++;
+				lastDirection = change;
+			}
+			scale = next;
+			scaleSum += scale;
+			result.MinScale = fminf(result.MinScale, scale);
+		}
+		result.AverageScale = scaleSum / frames;
+		results.push_back(result);
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+
+// Lowest render scale the controller will drop to, per axis
+#define DYNAMIC_RESOLUTION_MIN_SCALE	0.5f
+
+// --------------------------------------------------------
+// Picks the scene's render scale (per axis) from how long
+// frames are taking, aiming to keep them under a budget
+//
+// Frame times are smoothed first, rising quickly (though one
+// hitch only counts for so much) and falling slowly.  Pixel
+// cost goes with the square of the scale, so the scale that
+// would just fit is the current one times
+// sqrt(budget / frame time).  Over budget it moves most of the
+// way there at once; well under budget it creeps up a few
+// percent a frame, and in between it holds still so the scale
+// doesn't hunt back and forth.  Each change also rescales the
+// average to what it predicts at the new scale, so the
+// average's lag doesn't make it overshoot
+// --------------------------------------------------------
+class ResolutionController
+{
+public:
+	ResolutionController(double targetSeconds, float minScale = DYNAMIC_RESOLUTION_MIN_SCALE, float maxScale = 1.0f);
+
+	// Feeds in how long the last frame took, returns the scale for the next
+	float Update(double frameSeconds);
+
+	// Back to full scale with no history
+	void Reset();
+
+	float GetScale() const;
+	double GetSmoothedSeconds() const;
+	double GetTargetSeconds() const;
+	void SetTargetSeconds(double seconds);
+
+private:
+	double targetSeconds;
+	float minScale;
+	float maxScale;
+	float scale;
+	double smoothedSeconds;
+};
+
+// --------------------------------------------------------
+// How the controller handled one synthetic frame time trace,
+// compared to staying at full resolution
+// --------------------------------------------------------
+struct ResolutionTraceResult
+{
+	const char* Name = "";
+	unsigned int Frames = 0;
+	unsigned int OverBudgetFixed = 0;		// Frames over budget at full resolution
+	unsigned int OverBudgetDynamic = 0;		// Frames over budget with the controller
+	float MinScale = 1;
+	float AverageScale = 1;
+	unsigned int Reversals = 0;				// Times the scale changed direction
+};
+
+// Runs the controller against steady, stepped, ramped and spiky
+// loads, modelling a frame as a fixed cost plus a per-pixel one
+void SimulateResolutionTraces(double targetSeconds, std::vector<ResolutionTraceResult>& results);
@@ -0,0 +1,192 @@
+#include "FrustumCulling.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+using namespace DirectX;
+
+Frustum MakeFrustum(const XMFLOAT4X4& m)
+{
+	// Columns of the row-major matrix: clip.x = dot(p, column0), etc.
+	XMVECTOR c0 = XMVectorSet(m._11, m._21, m._31, m._41);
+	XMVECTOR c1 = XMVectorSet(m._12, m._22, m._32, m._42);
+	XMVECTOR c2 = XMVectorSet(m._13, m._23, m._33, m._43);
+	XMVECTOR c3 = XMVectorSet(m._14, m._24, m._34, m._44);
+	XMVECTOR planes[6] =
+	{
+		c3 + c0,	// Left
+		c3 - c0,	// Right
+		c3 + c1,	// Bottom
+		c3 - c1,	// Top
+		c2,			// Near (D3D clip z starts at 0)
+		c3 - c2		// Far
+	};
+
+	Frustum result;
+	for (int i = 0; i < 6; i++)
+		XMStoreFloat4(&result.Planes[i], XMPlaneNormalize(planes[i]));
+	return result;
+}
+
+void CullBoxes::Clear()
+{
+	CenterX.clear(); CenterY.clear(); CenterZ.clear();
+	ExtentX.clear(); ExtentY.clear(); ExtentZ.clear();
+	Count = 0;
+}
+
+void CullBoxes::Add(const XMFLOAT3& center, const XMFLOAT3& extents)
+{
+	if (Count % 4 == 0)
+	{
+		size_t size = Count + 4;
+		CenterX.resize(size, 0); CenterY.resize(size, 0); CenterZ.resize(size, 0);
+		ExtentX.resize(size, 0); ExtentY.resize(size, 0); ExtentZ.resize(size, 0);
+	}
+
+	CenterX[Count] = center.x;
+	CenterY[Count] = center.y;
+	CenterZ[Count] = center.z;
+	ExtentX[Count] = extents.x;
+	ExtentY[Count] = extents.y;
+	ExtentZ[Count] = extents.z;
+	Count++;
+}
+
+// --------------------------------------------------------
+// The center just transforms.  Each axis of the new box is as
+// long as the old half sizes stretched along the transformed
+// axes, so it's the rows of world (absolute values) weighted
+// by the half sizes
+// --------------------------------------------------------
+void CullBoxes::AddTransformed(const XMFLOAT3& localMin, const XMFLOAT3& localMax, const XMFLOAT4X4& world)
+{
+	XMMATRIX w = XMLoadFloat4x4(&world);
+	XMVECTOR localCenter = (XMLoadFloat3(&localMax) + XMLoadFloat3(&localMin)) * 0.5f;
+	XMVECTOR localExtents = (XMLoadFloat3(&localMax) - XMLoadFloat3(&localMin)) * 0.5f;
+
+	XMVECTOR extents =
+		XMVectorAbs(w.r[0]) * XMVectorSplatX(localExtents) +
+		XMVectorAbs(w.r[1]) * XMVectorSplatY(localExtents) +
+		XMVectorAbs(w.r[2]) * XMVectorSplatZ(localExtents);
+
+	XMFLOAT3 c, e;
+	XMStoreFloat3(&c, XMVector3Transform(localCenter, w));
+	XMStoreFloat3(&e, extents);
+	Add(c, e);
+}
+
+void FrustumCull(const Frustum& frustum, const CullBoxes& boxes, std::vector<unsigned int>& visible, FrustumCullStats* stats)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	size_t visibleBefore = visible.size();
+
+	// Every plane's components (and their absolute values) splatted once
+	XMVECTOR planeX[6], planeY[6], planeZ[6], planeW[6];
+	XMVECTOR absX[6], absY[6], absZ[6];
+	for (int p = 0; p < 6; p++)
+	{
+		XMVECTOR plane = XMLoadFloat4(&frustum.Planes[p]);
+		planeX[p] = XMVectorSplatX(plane);
+		planeY[p] = XMVectorSplatY(plane);
+		planeZ[p] = XMVectorSplatZ(plane);
+		planeW[p] = XMVectorSplatW(plane);
+		absX[p] = XMVectorAbs(planeX[p]);
+		absY[p] = XMVectorAbs(planeY[p]);
+		absZ[p] = XMVectorAbs(planeZ[p]);
+	}
+
+	XMVECTOR zero = XMVectorZero();
+	for (unsigned int first = 0; first < boxes.Count; first += 4)
+	{
+		XMVECTOR cx = XMLoadFloat4((const XMFLOAT4*)&boxes.CenterX[first]);
+		XMVECTOR cy = XMLoadFloat4((const XMFLOAT4*)&boxes.CenterY[first]);
+		XMVECTOR cz = XMLoadFloat4((const XMFLOAT4*)&boxes.CenterZ[first]);
+		XMVECTOR ex = XMLoadFloat4((const XMFLOAT4*)&boxes.ExtentX[first]);
+		XMVECTOR ey = XMLoadFloat4((const XMFLOAT4*)&boxes.ExtentY[first]);
+		XMVECTOR ez = XMLoadFloat4((const XMFLOAT4*)&boxes.ExtentZ[first]);
+
+		XMVECTOR outside = XMVectorFalseInt();
+		for (int p = 0; p < 6; p++)
+		{
+			XMVECTOR distance = planeX[p] * cx + planeY[p] * cy + planeZ[p] * cz + planeW[p];
+			XMVECTOR radius = absX[p] * ex + absY[p] * ey + absZ[p] * ez;
+			outside = XMVectorOrInt(outside, XMVectorLess(distance + radius, zero));
+		}
+
+		uint32_t lanes[4];
+		XMStoreInt4(lanes, outside);
+		unsigned int last = boxes.Count - first < 4 ? boxes.Count - first : 4;
+		for (unsigned int lane = 0; lane < last; lane++)
+		{
+			if (!lanes[lane])
+				visible.push_back(first + lane);
+		}
+	}
+
+	if (stats)
+	{
+		stats->Tested = boxes.Count;
+		stats->Visible = (unsigned int)(visible.size() - visibleBefore);
+		stats->Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+namespace
+{
+	float RandomRange(float min, float max)
+	{
+		return min + (max - min) * (float)rand() / RAND_MAX;
+	}
+}
+
+FrustumCullBenchmarkResult BenchmarkFrustumCulling(unsigned int count)
+{
+	FrustumCullBenchmarkResult result;
+	result.Count = count;
+
+	// A camera at the origin looking down +z, as Camera would make it
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection,
+		XMMatrixLookToLH(XMVectorZero(), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0)) *
+		XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 100.0f));
+	Frustum frustum = MakeFrustum(viewProjection);
+
+	CullBoxes boxes;
+	srand(1234);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		XMFLOAT3 center(RandomRange(-100, 100), RandomRange(-100, 100), RandomRange(-100, 100));
+		XMFLOAT3 extents(RandomRange(0.1f, 2), RandomRange(0.1f, 2), RandomRange(0.1f, 2));
+		boxes.Add(center, extents);
+	}
+
+	std::vector<unsigned int> scalarVisible;
+	scalarVisible.reserve(count);
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++)
+		{
+			const XMFLOAT4& plane = frustum.Planes[p];
+			float distance = plane.x * boxes.CenterX[i] + plane.y * boxes.CenterY[i] + plane.z * boxes.CenterZ[i] + plane.w;
+			float radius = fabsf(plane.x) * boxes.ExtentX[i] + fabsf(plane.y) * boxes.ExtentY[i] + fabsf(plane.z) * boxes.ExtentZ[i];
+			inside = distance + radius >= 0;
+		}
+		if (inside)
+			scalarVisible.push_back(i);
+	}
+	result.ScalarSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	std::vector<unsigned int> visible;
+	visible.reserve(count);
+	FrustumCullStats stats;
+	FrustumCull(frustum, boxes, visible, &stats);
+	result.SimdSeconds = stats.Seconds;
+	result.Visible = stats.Visible;
+	result.Identical = visible == scalarVisible;
+	return result;
+}
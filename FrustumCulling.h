@@ -0,0 +1,78 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+// --------------------------------------------------------
+// The six planes of a view volume, normalized and pointing
+// inwards:
+//   dot(plane.xyz, p) + plane.w >= 0 inside
+// --------------------------------------------------------
+struct Frustum
+{
+	DirectX::XMFLOAT4 Planes[6];	// Left, right, bottom, top, near, far
+};
+
+// Pulls the planes out of a view * projection matrix (Gribb &
+// Hartmann), perspective and orthographic alike.  m is row-major
+// (clip = p * m), so world * view * projection gives the planes in
+// that world's local space instead
+Frustum MakeFrustum(const DirectX::XMFLOAT4X4& m);
+
+// --------------------------------------------------------
+// World space bounding boxes as center and half size, stored
+// structure-of-arrays and padded to a multiple of four so the
+// culling kernel can always load four at a time
+// --------------------------------------------------------
+struct CullBoxes
+{
+	std::vector<float> CenterX, CenterY, CenterZ;
+	std::vector<float> ExtentX, ExtentY, ExtentZ;
+	unsigned int Count = 0;
+
+	void Clear();
+	void Add(const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents);
+
+	// The box around a local space box once it's transformed by world
+	void AddTransformed(const DirectX::XMFLOAT3& localMin, const DirectX::XMFLOAT3& localMax, const DirectX::XMFLOAT4X4& world);
+};
+
+// --------------------------------------------------------
+// What one culling pass did, for the INFO window
+// --------------------------------------------------------
+struct FrustumCullStats
+{
+	unsigned int Tested = 0;
+	unsigned int Visible = 0;
+	double Seconds = 0;
+
+	unsigned int Culled() const { return Tested - Visible; }
+};
+
+// --------------------------------------------------------
+// Tests four boxes at a time against all six planes, one box
+// per SIMD lane.  A box is out when it's entirely behind any
+// one plane: its center's distance is less than minus its
+// "radius" along the plane normal, |n.x| e.x + |n.y| e.y +
+// |n.z| e.z.  Boxes crossing a corner of the frustum outside
+// it can pass, which only means drawing something unseen.
+//
+// Appends the indices of the boxes that survive to visible, in
+// order
+// --------------------------------------------------------
+void FrustumCull(const Frustum& frustum, const CullBoxes& boxes, std::vector<unsigned int>& visible, FrustumCullStats* stats = 0);
+
+// --------------------------------------------------------
+// The kernel vs one box at a time, for the INFO window
+// --------------------------------------------------------
+struct FrustumCullBenchmarkResult
+{
+	unsigned int Count = 0;
+	unsigned int Visible = 0;
+	double ScalarSeconds = 0;		// One box and one plane at a time, stopping at the first plane it's behind
+	double SimdSeconds = 0;			// FrustumCull()
+	bool Identical = false;			// Same visible list both ways
+};
+
+// Times count random boxes scattered around a camera
+FrustumCullBenchmarkResult BenchmarkFrustumCulling(unsigned int count);
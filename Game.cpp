@@ -15,7 +15,12 @@
 #include "ImGui/imgui_impl_dx11.h"
 #include "ImGui/imgui_impl_win32.h"
 
+#include <algorithm>
 #include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
 using namespace std;
 
 // Needed for a helper function to load pre-compiled shader files
@@ -25,6 +30,18 @@ using namespace std;
 // For the DirectX Math library
 using namespace DirectX;
 
+// --------------------------------------------------------
+// Bytes CopyAllBufferData() sends for a shader: every one of
+// its constant buffers, whether or not anything changed
+// --------------------------------------------------------
+static size_t AllBufferBytes(std::shared_ptr<ISimpleShader> shader)
+{
+	size_t bytes = 0;
+	for (unsigned int i = 0; i < shader->GetBufferCount(); i++)
+		bytes += shader->GetBufferSize(i);
+	return bytes;
+}
+
 // --------------------------------------------------------
 // Constructor
 //
@@ -47,6 +64,36 @@ Game::Game(HINSTANCE hInstance)
 	CreateConsoleWindow(500, 120, 32, 120);
 	printf("Console window created successfully.  Feel free to printf() here.\n");
 #endif
+
+	//Load scene meshes with the compressed vertex layout
+	packedVertices = true;
+	lodPixelError = 1.0f;
+	clusterCulling = true;
+	frustumCulling = true;
+	bvhCulling = true;
+	bvhUpdateSeconds = 0;
+	bvhRebuilds = 0;
+	instancing = true;
+	shadowDrawCalls = 0;
+	opaqueDrawCalls = 0;
+	stressInstances = 0;
+	sceneEntityCount = 0;
+	frameConstantBytes = 0;
+	unsplitConstantBytes = 0;
+	frameUploads = 0;
+	frameUploadsSkipped = 0;
+	dynamicObjectBuffers = true;
+	ringConstants = true;
+	recordUploads = false;
+	dynamicResolution = false;
+	frameBudgetMS = 1000.0f / 60.0f;
+	renderScale = 1.0f;
+	resolutionController = std::make_shared<ResolutionController>(frameBudgetMS / 1000.0);
+	uploadBudgetKB = MESH_UPLOAD_BUDGET_BYTES / 1024;
+	launchTime = std::chrono::high_resolution_clock::now();
+	firstFrameSeconds = 0;
+	shaderLoadSeconds = 0;
+	allMeshesSeconds = 0;
 }
 
 // --------------------------------------------------------
@@ -78,6 +125,12 @@ void Game::Init()
 	// Helper methods for loading shaders, creating some basic
 	// geometry to draw and some simple camera matrices.
 	//  - You'll be expanding and/or replacing these later
+	GeometryArena::GetInstance().Initialize(device, context);
+	ShaderLibrary::GetInstance().Initialize(device, context);
+	StateCache::GetInstance().Initialize(context);
+	meshLoader = std::make_shared<MeshLoader>();
+	instanceBuffer = std::make_shared<InstanceBuffer>(device, context, (unsigned int)sizeof(TransformPacket));
+	constantRing = std::make_shared<ConstantRing>(device, context);
 	LoadShaders();
 	CreateGeometry();
 
@@ -92,12 +145,12 @@ void Game::Init()
 		// Tell the input assembler (IA) stage of the pipeline what kind of
 		// geometric primitives (points, lines or triangles) we want to draw.  
 		// Essentially: "What kind of shape should the GPU draw with our vertices?"
-		context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		StateCache::GetInstance().SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
 		// Ensure the pipeline knows how to interpret all the numbers stored in
 		// the vertex buffer. For this course, all of your vertices will probably
 		// have the same layout, so we can just set this once at startup.
-		context->IASetInputLayout(inputLayout.Get());
+		StateCache::GetInstance().SetInputLayout(inputLayout.Get());
 
 		// Set the active vertex and pixel shaders
 		//  - Once you start applying different shaders to different objects,
@@ -158,6 +211,16 @@ void Game::Init()
 
 	//Set up Shadow Map
 	PrepareShadowMap();
+
+	//Offscreen target for dynamic resolution, and the sampler that stretches it
+	CreateSceneTarget();
+	D3D11_SAMPLER_DESC upscaleSampDesc = {};
+	upscaleSampDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	upscaleSampDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	upscaleSampDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	upscaleSampDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	upscaleSampDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	device->CreateSamplerState(&upscaleSampDesc, upscaleSampler.GetAddressOf());
 }
 
 // --------------------------------------------------------
@@ -170,23 +233,30 @@ void Game::Init()
 // --------------------------------------------------------
 void Game::LoadShaders()
 {
-	//Create shader points using SimpleShader
+	//Create shader points using SimpleShader, each .cso loaded once by the
+	//library (with its reflection from the cache file next to it, if any)
+	auto shaderStart = std::chrono::high_resolution_clock::now();
+	ShaderLibrary& shaders = ShaderLibrary::GetInstance();
 	//Normal
-	vertexShader = make_shared<SimpleVertexShader>(device, context,
-		FixPath(L"VertexShader.cso").c_str());
-	pixelShader = make_shared<SimplePixelShader>(device, context,
-		FixPath(L"PixelShader.cso").c_str());
+	vertexShader = shaders.GetVertexShader(FixPath(L"VertexShader.cso"));
+	packedVertexShader = shaders.GetVertexShader(FixPath(L"PackedVertexShader.cso"));
+	instancedVertexShader = shaders.GetVertexShader(FixPath(L"InstancedVertexShader.cso"));
+	packedInstancedVertexShader = shaders.GetVertexShader(FixPath(L"PackedInstancedVertexShader.cso"));
+	pixelShader = shaders.GetPixelShader(FixPath(L"PixelShader.cso"));
 	//Cool Effect
-	customPixelShader = make_shared<SimplePixelShader>(device, context,
-		FixPath(L"CustomTestShader.cso").c_str());
+	customPixelShader = shaders.GetPixelShader(FixPath(L"CustomTestShader.cso"));
 	//Sky
-	skyVertexShader = make_shared<SimpleVertexShader>(device, context,
-		FixPath(L"SkyVertexShader.cso").c_str());
-	skyPixelShader = make_shared<SimplePixelShader>(device, context,
-		FixPath(L"SkyPixelShader.cso").c_str());
+	skyVertexShader = shaders.GetVertexShader(FixPath(L"SkyVertexShader.cso"));
+	skyPixelShader = shaders.GetPixelShader(FixPath(L"SkyPixelShader.cso"));
 	//Shadows
-	shadowVertexShader = make_shared<SimpleVertexShader>(device, context,
-		FixPath(L"ShadowVertexShader.cso").c_str());
+	shadowVertexShader = shaders.GetVertexShader(FixPath(L"ShadowVertexShader.cso"));
+	packedShadowVertexShader = shaders.GetVertexShader(FixPath(L"PackedShadowVertexShader.cso"));
+	instancedShadowVertexShader = shaders.GetVertexShader(FixPath(L"InstancedShadowVertexShader.cso"));
+	packedInstancedShadowVertexShader = shaders.GetVertexShader(FixPath(L"PackedInstancedShadowVertexShader.cso"));
+	upscaleVertexShader = shaders.GetVertexShader(FixPath(L"UpscaleVertexShader.cso"));
+	upscalePixelShader = shaders.GetPixelShader(FixPath(L"UpscalePixelShader.cso"));
+	shaderLoadSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - shaderStart).count();
+	SetObjectBuffersDynamic(dynamicObjectBuffers);
 
 	
 	//CREATE SKY TEXTURES
@@ -267,6 +337,8 @@ void Game::LoadShaders()
 	mat1->AddTextureSRV("RoughnessMap", bronzeRoughSRV);
 	mat1->AddTextureSRV("MetalnessMap", bronzeMetalSRV);
 	mat1->AddSampler("BasicSampler", samplerState);
+	mat1->SetPackedVertexShader(packedVertexShader);
+	mat1->SetInstancedVertexShaders(instancedVertexShader, packedInstancedVertexShader);
 
 	mat2 = make_shared<Material>(DirectX::XMFLOAT4(1, 1, 1, 1), pixelShader, vertexShader, 0.9f, DirectX::XMFLOAT2(1, 1));
 	mat2->AddTextureSRV("Albedo", paintColorSRV);
@@ -274,6 +346,8 @@ void Game::LoadShaders()
 	mat2->AddTextureSRV("RoughnessMap", paintRoughSRV);
 	mat2->AddTextureSRV("MetalnessMap", paintMetalSRV);
 	mat2->AddSampler("BasicSampler", samplerState);
+	mat2->SetPackedVertexShader(packedVertexShader);
+	mat2->SetInstancedVertexShaders(instancedVertexShader, packedInstancedVertexShader);
 
 	matFloor = make_shared<Material>(DirectX::XMFLOAT4(1, 1, 1, 1), pixelShader, vertexShader, 0.9f, DirectX::XMFLOAT2(4, 4));
 	matFloor->AddTextureSRV("Albedo", cobbleColorSRV);
@@ -281,12 +355,16 @@ void Game::LoadShaders()
 	matFloor->AddTextureSRV("RoughnessMap", cobbleRoughSRV);
 	matFloor->AddTextureSRV("MetalnessMap", cobbleMetalSRV);
 	matFloor->AddSampler("BasicSampler", samplerState);
+	matFloor->SetPackedVertexShader(packedVertexShader);
+	matFloor->SetInstancedVertexShaders(instancedVertexShader, packedInstancedVertexShader);
 
 	customMat = make_shared<Material>(DirectX::XMFLOAT4(1, 1, 1, 1), customPixelShader, vertexShader, 0.8, DirectX::XMFLOAT2(1, 1));
+	customMat->SetPackedVertexShader(packedVertexShader);
+	customMat->SetInstancedVertexShaders(instancedVertexShader, packedInstancedVertexShader);
 
-	//Sky Objects
-	cube = std::make_shared<Mesh>(R"(Assets/Mesh/cube.obj)", device, context);
-	sky = std::make_shared<Sky>(cube, skySRV, skyNightSRV, device, samplerState);
+	//Sky Objects (the cube is loaded right away, since it also stands in for scene meshes still loading)
+	skyCube = std::make_shared<Mesh>(R"(Assets/Mesh/cube.obj)", device, context);
+	sky = std::make_shared<Sky>(skyCube, skySRV, skyNightSRV, device, samplerState);
 }
 
 
@@ -326,13 +404,23 @@ void Game::CreateGeometry()
 	test = FixPath(L"../../Assets/Texture/bark_brown_02_diff_4k.jpg").c_str();
 	std::cout << "" R"(test)" << std::endl;
 
-	cube = std::make_shared<Mesh>(R"(Assets/Mesh/cube.obj)", device, context);
-	cylinder = std::make_shared<Mesh>(R"(Assets/Mesh/cylinder.obj)", device, context);
-	helix = std::make_shared<Mesh>(R"(Assets/Mesh/helix.obj)", device, context);
-	quad = std::make_shared<Mesh>(R"(Assets/Mesh/quad.obj)", device, context);
-	quaddouble = std::make_shared<Mesh>(R"(Assets/Mesh/quad_double_sided.obj)", device, context);
-	sphere = std::make_shared<Mesh>(R"(Assets/Mesh/sphere.obj)", device, context);
-	torus = std::make_shared<Mesh>(R"(Assets/Mesh/torus.obj)", device, context);
+	//These return right away and fill in over the next few frames (see Update())
+	//The unpacked cube is the sky's, so it's only loaded again for the packed layout
+	cube = packedVertices ? Mesh::LoadAsync(*meshLoader, R"(Assets/Mesh/cube.obj)", context, packedVertices) : skyCube;
+	cylinder = Mesh::LoadAsync(*meshLoader, R"(Assets/Mesh/cylinder.obj)", context, packedVertices);
+	helix = Mesh::LoadAsync(*meshLoader, R"(Assets/Mesh/helix.obj)", context, packedVertices);
+	quad = Mesh::LoadAsync(*meshLoader, R"(Assets/Mesh/quad.obj)", context, packedVertices);
+	quaddouble = Mesh::LoadAsync(*meshLoader, R"(Assets/Mesh/quad_double_sided.obj)", context, packedVertices);
+	sphere = Mesh::LoadAsync(*meshLoader, R"(Assets/Mesh/sphere.obj)", context, packedVertices);
+	torus = Mesh::LoadAsync(*meshLoader, R"(Assets/Mesh/torus.obj)", context, packedVertices);
+
+	meshes.push_back(cube);
+	meshes.push_back(cylinder);
+	meshes.push_back(helix);
+	meshes.push_back(quad);
+	meshes.push_back(quaddouble);
+	meshes.push_back(sphere);
+	meshes.push_back(torus);
 
 	//Game entities
 	std::shared_ptr<GameEntity> entity1 = std::make_shared<GameEntity>(cube, mat2);
@@ -362,6 +450,33 @@ void Game::CreateGeometry()
 	entities.push_back(entity6);
 	entities.push_back(entity7);
 	entities.push_back(entityFloor);
+
+	//Show a cube wherever a mesh is still loading
+	for (auto& e : entities)
+		e->SetPlaceholderMesh(skyCube);
+
+	//The stress grid (empty to begin with) goes after these
+	sceneEntityCount = (unsigned int)entities.size();
+}
+
+// --------------------------------------------------------
+// Replaces the stress grid with stressInstances entities
+// behind the scene, alternating cubes and spheres and two
+// materials, so there are four big groups to instance
+// --------------------------------------------------------
+void Game::RebuildStressGrid()
+{
+	entities.resize(sceneEntityCount);
+
+	unsigned int side = (unsigned int)ceil(sqrt((double)stressInstances));
+	for (int i = 0; i < stressInstances; i++)
+	{
+		std::shared_ptr<GameEntity> entity = std::make_shared<GameEntity>(i % 2 ? sphere : cube, (i / 2) % 2 ? mat1 : mat2);
+		entity->GetTransform()->SetPosition(((float)(i % side) - side * 0.5f) * 1.5f, 0, 4 + (i / side) * 1.5f);
+		entity->GetTransform()->SetScale(0.5f, 0.5f, 0.5f);
+		entity->SetPlaceholderMesh(skyCube);
+		entities.push_back(entity);
+	}
 }
 
 
@@ -381,6 +496,10 @@ void Game::OnResize()
 		camera->UpdateProjMatrix(float(windowWidth / windowHeight));
 	}
 
+	//The scene target matches the window
+	if (sceneRTV)
+		CreateSceneTarget();
+
 }
 
 // --------------------------------------------------------
@@ -388,12 +507,25 @@ void Game::OnResize()
 // --------------------------------------------------------
 void Game::Update(float deltaTime, float totalTime)
 {
+	//Create the buffers of meshes that finished loading, within this frame's budget
+	meshLoader->Update((size_t)uploadBudgetKB * 1024);
+	if (allMeshesSeconds == 0 && meshLoader->IsIdle())
+		allMeshesSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - launchTime).count();
+
 	//Call ImGui update
 	UpdateImGui(deltaTime);
 
+	//Resize the stress grid if the INFO window asked for a different one
+	if (entities.size() != sceneEntityCount + (unsigned int)stressInstances)
+		RebuildStressGrid();
+
 	//Call camera update
 	camera->Update(deltaTime);
 
+	//Pick this frame's resolution from how long the last one took
+	resolutionController->SetTargetSeconds(frameBudgetMS / 1000.0);
+	renderScale = dynamicResolution ? resolutionController->Update(deltaTime) : 1.0f;
+
 	// Example input checking: Quit if the escape key is pressed
 	if (Input::GetInstance().KeyDown(VK_ESCAPE))
 		Quit();
@@ -420,6 +552,9 @@ void Game::Update(float deltaTime, float totalTime)
 	directional2.direction = XMFLOAT3(0.0, -sin(totalTime + XM_PI), -cos(totalTime + XM_PI)); //Have moon be the inverse
 	//Update moon color so no blue is shown during the day (easier than adding a second shadow map)
 	directional2.color = XMFLOAT3(-sin(totalTime) / 8, -sin(totalTime) / 8, -sin(totalTime) / 3);
+
+	//Rebuild every matrix that moved this frame in one pass
+	TransformSystem::GetInstance().UpdateDirty();
 }
 
 // --------------------------------------------------------
@@ -437,54 +572,96 @@ void Game::Draw(float deltaTime, float totalTime)
 
 		// Clear the depth buffer (resets per-pixel occlusion information)
 		context->ClearDepthStencilView(depthBufferDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+		if (dynamicResolution)
+			context->ClearRenderTargetView(sceneRTV.Get(), bgColor);
+
+		// ImGui (and anything else) may have changed the input assembler since last frame
+		GeometryArena::GetInstance().BeginFrame();
+		StateCache::GetInstance().BeginFrame();
+
+		// Count this frame's constant uploads from zero
+		ISimpleShader::BytesUploaded = 0;
+		ISimpleShader::Uploads = 0;
+		ISimpleShader::UploadsSkipped = 0;
+		unsplitConstantBytes = 0;
+		uploadRecorder.Uploads.clear();
+		uploadRecorder.Skipped = 0;
+		ISimpleShader::Recorder = recordUploads ? &uploadRecorder : 0;
+		constantRing->BeginFrame();
+		Mesh::DrawCalls = 0;
 	}
 
+	//Work out what each pass can see, and what order to draw it in
+	CullEntities();
+	BuildRenderQueue();
+	BuildDrawBatches();
+
 	//Render a shadow map before any other objects
 	RenderShadowMap();
+	shadowDrawCalls = Mesh::DrawCalls;
+
+	//Everything the main pass shares
+	UploadFrameConstants();
 
-	for (auto& i : entities)
-	{
-		i->GetMaterial()->GetPixelShader()->SetFloat3("ambient", ambientColor); //Send world ambient to shader
-
-		//Send ShadowMap matricies to the vertex shader for calculations
-		vertexShader->SetMatrix4x4("shadowView", shadowView);
-		vertexShader->SetMatrix4x4("shadowProj", shadowProj);
-
-		//Send ShadowMap resources to pixel shader for sampling
-		pixelShader->SetShaderResourceView("ShadowMap", shadowSRV);
-		pixelShader->SetSamplerState("ShadowSampler", shadowSampler);
-
-		i->GetMaterial()->GetPixelShader()->SetData(
-			"dirLight1", // The name of the (eventual) variable in the shader
-			&directional1, // The address of the data to set
-			sizeof(Light)); // The size of the data (the whole struct!) to set
-		i->GetMaterial()->GetPixelShader()->SetData(
-			"dirLight2", // The name of the (eventual) variable in the shader
-			&directional2, // The address of the data to set
-			sizeof(Light)); // The size of the data (the whole struct!) to set
-		i->GetMaterial()->GetPixelShader()->SetData(
-			"dirLight3", // The name of the (eventual) variable in the shader
-			&directional3, // The address of the data to set
-			sizeof(Light)); // The size of the data (the whole struct!) to set
-		i->GetMaterial()->GetPixelShader()->SetData(
-			"pointLight1", // The name of the (eventual) variable in the shader
-			&point1, // The address of the data to set
-			sizeof(Light)); // The size of the data (the whole struct!) to set
-		i->GetMaterial()->GetPixelShader()->SetData(
-			"pointLight2", // The name of the (eventual) variable in the shader
-			&point2, // The address of the data to set
-			sizeof(Light)); // The size of the data (the whole struct!) to set
-		i->GetMaterial()->GetPixelShader()->SetData(
-			"pointLight3", // The name of the (eventual) variable in the shader
-			&point3, // The address of the data to set
-			sizeof(Light)); // The size of the data (the whole struct!) to set
-
-		i->Draw(context, camera);
+	//Sorted by shader, then material, so each is only set at the start of its run
+	std::shared_ptr<SimpleVertexShader> boundVS;
+	std::shared_ptr<SimplePixelShader> boundPS;
+	std::shared_ptr<Material> boundMaterial;
+	ObjectConstantHandles instancedHandles;
+	for (const DrawBatch& batch : opaqueBatches)
+	{
+		std::shared_ptr<GameEntity>& i = entities[batch.Entity];
+		std::shared_ptr<Material> material = i->GetMaterial();
+		std::shared_ptr<Mesh> mesh = i->GetDrawMesh();
+		std::shared_ptr<SimpleVertexShader> vs = batch.InstanceCount ?
+			material->GetInstancedVertexShader(mesh->HasPackedVertices()) : i->GetVertexShader();
+		if (vs != boundVS)
+		{
+			vs->SetShader();
+			boundVS = vs;
+		}
+		if (material->GetPixelShader() != boundPS)
+		{
+			boundPS = material->GetPixelShader();
+			boundPS->SetShader();
+		}
+		if (material != boundMaterial)
+		{
+			material->PrepareMaterial();
+			boundMaterial = material;
+		}
+		unsplitConstantBytes += (AllBufferBytes(i->GetVertexShader()) + AllBufferBytes(boundPS)) * (batch.InstanceCount ? batch.InstanceCount : 1);
+
+		if (!batch.InstanceCount)
+		{
+			i->DrawObject(camera, (float)windowHeight, lodPixelError, clusterCulling, ringConstants ? constantRing.get() : 0);
+			continue;
+		}
+
+		//The matrices are already in the instance buffer, so only the mesh's quantization goes up
+		if (mesh->HasPackedVertices())
+		{
+			instancedHandles.Resolve(vs.get());
+			vs->SetFloat3(instancedHandles.QuantizeOffset, mesh->GetQuantization().Offset);
+			vs->SetFloat3(instancedHandles.QuantizeScale, mesh->GetQuantization().Scale);
+			instancedHandles.Upload(ringConstants ? constantRing.get() : 0);
+		}
+		mesh->DrawInstanced(batch.Lod, batch.InstanceCount, batch.FirstInstance);
 	}
+	frameConstantBytes = ISimpleShader::BytesUploaded;
+	frameUploads = ISimpleShader::Uploads;
+	frameUploadsSkipped = ISimpleShader::UploadsSkipped;
+	ISimpleShader::Recorder = 0;
+	constantRing->EndFrame();
+	opaqueDrawCalls = Mesh::DrawCalls - shadowDrawCalls;
 
 	//Draw Sky
 	sky->Draw(context, skyVertexShader, skyPixelShader, camera, totalTime);
 
+	//Stretch the scene over the screen, under ImGui
+	if (dynamicResolution)
+		UpscaleScene();
+
 	// Draw ImGui
 	ImGui::Render();
 	ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
@@ -497,9 +674,13 @@ void Game::Draw(float deltaTime, float totalTime)
 		//  - Puts the results of what we've drawn onto the window
 		//  - Without this, the user never sees anything
 		swapChain->Present(vsync ? 1 : 0, 0);
+		if (firstFrameSeconds == 0)
+			firstFrameSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - launchTime).count();
 
 		// Must re-bind buffers after presenting, as they become unbound
-		context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthBufferDSV.Get());
+		// (without the cache knowing, so it has to forget them first)
+		StateCache::GetInstance().Invalidate();
+		StateCache::GetInstance().SetRenderTargets(1, backBufferRTV.GetAddressOf(), depthBufferDSV.Get());
 	}
 }
 
@@ -578,9 +759,10 @@ void Game::PrepareShadowMap()
 void Game::RenderShadowMap()
 {
 	// Set up render pipeline
-	context->OMSetRenderTargets(0, 0, shadowDSV.Get());
+	StateCache& stateCache = StateCache::GetInstance();
+	stateCache.SetRenderTargets(0, 0, shadowDSV.Get());
 	context->ClearDepthStencilView(shadowDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
-	context->RSSetState(shadowRasterizer.Get());
+	stateCache.SetRasterizerState(shadowRasterizer.Get());
 
 	//Create viewport using the defined resolution
 	D3D11_VIEWPORT viewport = {};
@@ -590,22 +772,51 @@ void Game::RenderShadowMap()
 	viewport.Height = (float)shadowResolution;
 	viewport.MinDepth = 0.0f;
 	viewport.MaxDepth = 1.0f;
-	context->RSSetViewports(1, &viewport);
+	stateCache.SetViewport(viewport);
 
-	//Activate the NEW vertex shader and send data to it
-	shadowVertexShader->SetShader();
-	shadowVertexShader->SetMatrix4x4("view", shadowView);
-	shadowVertexShader->SetMatrix4x4("projection", shadowProj);
-	context->PSSetShader(0, 0, 0); //Don't use pixel shader
+	//Send the light's matrices to the NEW vertex shaders, once for the whole pass
+	for (auto& vs : { shadowVertexShader, packedShadowVertexShader, instancedShadowVertexShader, packedInstancedShadowVertexShader })
+	{
+		vs->SetMatrix4x4("view", shadowView);
+		vs->SetMatrix4x4("projection", shadowProj);
+		vs->CopyBufferData("PerFrame");
+	}
+	stateCache.SetShader(STATE_STAGE_PIXEL, 0); //Don't use pixel shader
 
-	// Loop and draw all entities
-	for (auto& e : entities)
+	// Loop and draw every entity the light can see, sorted by vertex layout then mesh
+	std::shared_ptr<SimpleVertexShader> boundVS;
+	ObjectConstantHandles handles;
+	for (const DrawBatch& batch : shadowBatches)
 	{
-		shadowVertexShader->SetMatrix4x4("world", e->GetTransform()->GetWorldMatrix());
-		shadowVertexShader->CopyAllBufferData();
+		//Pick the shadow shader matching this mesh's vertex layout
+		std::shared_ptr<GameEntity>& e = entities[batch.Entity];
+		std::shared_ptr<Mesh> mesh = e->GetDrawMesh();
+		bool packed = mesh->HasPackedVertices();
+		std::shared_ptr<SimpleVertexShader> vs = batch.InstanceCount ?
+			(packed ? packedInstancedShadowVertexShader : instancedShadowVertexShader) :
+			(packed ? packedShadowVertexShader : shadowVertexShader);
+		if (vs != boundVS)
+		{
+			vs->SetShader();
+			boundVS = vs;
+			handles.Resolve(vs.get());
+		}
+		if (!batch.InstanceCount)
+			vs->SetData(handles.World, &e->GetTransform()->GetPacket().World, sizeof(TransformPacket::World));
+		if (packed)
+		{
+			vs->SetFloat3(handles.QuantizeOffset, mesh->GetQuantization().Offset);
+			vs->SetFloat3(handles.QuantizeScale, mesh->GetQuantization().Scale);
+		}
+		handles.Upload(ringConstants ? constantRing.get() : 0);	//Instanced, unpacked meshes have none
+		unsplitConstantBytes += AllBufferBytes(packed ? packedShadowVertexShader : shadowVertexShader) *
+			(batch.InstanceCount ? batch.InstanceCount : 1);
 
 		// Draw the mesh
-		e->GetMesh()->Draw();
+		if (batch.InstanceCount)
+			mesh->DrawInstanced(batch.Lod, batch.InstanceCount, batch.FirstInstance);
+		else
+			mesh->Draw();
 	}
 
 	//SpriteBatch TESTING
@@ -615,22 +826,341 @@ void Game::RenderShadowMap()
 	spriteBatch->End();
 	*/
 
-	//Return to the normal screen
-	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthBufferDSV.Get());
-	viewport.Width = (float)this->windowWidth;
-	viewport.Height = (float)this->windowHeight;
-	context->RSSetViewports(1, &viewport);
-	context->RSSetState(0);
+	//Return to the normal screen (or the scaled down one)
+	BindSceneTarget();
+	stateCache.SetRasterizerState(0);
+}
+
+// --------------------------------------------------------
+// Queues a draw for everything each pass can see, keyed on its
+// shaders, material, mesh and depth (where its origin lands in
+// that pass's clip space, so nearest first), then sorts them
+// --------------------------------------------------------
+void Game::BuildRenderQueue()
+{
+	XMFLOAT4X4 view = camera->GetViewMatrix();
+	XMFLOAT4X4 projection = camera->GetProjectionMatrix();
+	XMMATRIX cameraViewProj = XMLoadFloat4x4(&view) * XMLoadFloat4x4(&projection);
+	XMMATRIX shadowViewProj = XMLoadFloat4x4(&shadowView) * XMLoadFloat4x4(&shadowProj);
+	auto clipDepth = [&](unsigned int index, const XMMATRIX& viewProj)
+	{
+		XMFLOAT4X4 world = entities[index]->GetTransform()->GetWorldMatrix();
+		return XMVectorGetZ(XMVector3TransformCoord(XMVectorSet(world._41, world._42, world._43, 1), viewProj));
+	};
+
+	renderQueue.Clear();
+	for (unsigned int index : shadowVisible)
+	{
+		std::shared_ptr<Mesh> mesh = entities[index]->GetDrawMesh();
+		std::shared_ptr<SimpleVertexShader> vs = mesh->HasPackedVertices() ? packedShadowVertexShader : shadowVertexShader;
+		renderQueue.Add(RenderQueue::MakeKey(RENDER_PASS_SHADOW,
+			renderQueue.GetShaderId(vs.get(), 0), 0, renderQueue.GetMeshId(mesh.get()),
+			clipDepth(index, shadowViewProj)), index);
+	}
+	for (unsigned int index : cameraVisible)
+	{
+		std::shared_ptr<GameEntity>& e = entities[index];
+		renderQueue.Add(RenderQueue::MakeKey(RENDER_PASS_OPAQUE,
+			renderQueue.GetShaderId(e->GetVertexShader().get(), e->GetMaterial()->GetPixelShader().get()),
+			renderQueue.GetMaterialId(e->GetMaterial().get()),
+			renderQueue.GetMeshId(e->GetDrawMesh().get()),
+			clipDepth(index, cameraViewProj)), index);
+	}
+
+	renderQueueStats = RenderQueueStats();
+	auto start = std::chrono::high_resolution_clock::now();
+	renderQueue.Sort();
+	renderQueueStats.SortSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	renderQueue.CountSwitches(RENDER_PASS_SHADOW, renderQueueStats);
+	renderQueue.CountSwitches(RENDER_PASS_OPAQUE, renderQueueStats);
+}
+
+// --------------------------------------------------------
+// Turns each pass's sorted draws into draw calls.  Sorting put
+// entities with the same mesh and material next to each other,
+// so each such run (split by level of detail) becomes one
+// instanced batch and its transforms are copied into the
+// instance buffer.  Short runs, and materials without an
+// instanced shader, stay one draw per entity.  Instanced draws
+// don't cull clusters
+// --------------------------------------------------------
+void Game::BuildDrawBatches()
+{
+	instanceData.clear();
+	BuildPassBatches(RENDER_PASS_SHADOW, shadowBatches);
+	BuildPassBatches(RENDER_PASS_OPAQUE, opaqueBatches);
+
+	instanceBuffer->Upload(instanceData.data(), (unsigned int)instanceData.size());
+	instanceBuffer->Bind();
+}
+
+void Game::BuildPassBatches(unsigned int pass, std::vector<DrawBatch>& batches)
+{
+	batches.clear();
+	bool shadow = pass == RENDER_PASS_SHADOW;
+	const std::vector<RenderCommand>& commands = renderQueue.GetCommands();
+	std::vector<std::pair<unsigned int, unsigned int>> run;	// Level of detail and entity of each draw in a run
+
+	unsigned int end = renderQueue.FindPass(pass);
+	while (end < commands.size() && RenderQueue::GetPass(commands[end].Key) == pass)
+	{
+		//Find how far this mesh (and material, outside the shadow pass) carries on
+		unsigned int start = end;
+		std::shared_ptr<Mesh> mesh = entities[commands[start].Item]->GetDrawMesh();
+		std::shared_ptr<Material> material = entities[commands[start].Item]->GetMaterial();
+		for (end++; end < commands.size() && RenderQueue::GetPass(commands[end].Key) == pass; end++)
+		{
+			std::shared_ptr<GameEntity>& e = entities[commands[end].Item];
+			if (e->GetDrawMesh() != mesh || (!shadow && e->GetMaterial() != material))
+				break;
+		}
+
+		bool instanced = instancing && end - start >= INSTANCING_MIN_BATCH &&
+			(shadow || material->GetInstancedVertexShader(mesh->HasPackedVertices()));
+		if (!instanced)
+		{
+			for (unsigned int c = start; c < end; c++)
+			{
+				DrawBatch batch;
+				batch.Entity = commands[c].Item;
+				batches.push_back(batch);
+			}
+			continue;
+		}
+
+		//The shadow pass always draws full detail, like it does without instancing
+		run.clear();
+		for (unsigned int c = start; c < end; c++)
+		{
+			unsigned int item = commands[c].Item;
+			unsigned int lod = shadow ? 0 : entities[item]->PrepareInstance(camera, (float)windowHeight, lodPixelError);
+			run.push_back(std::make_pair(lod, item));
+		}
+		std::stable_sort(run.begin(), run.end(),
+			[](const std::pair<unsigned int, unsigned int>& a, const std::pair<unsigned int, unsigned int>& b) { return a.first < b.first; });
+
+		//One batch per level of detail
+		for (unsigned int r = 0; r < run.size(); r++)
+		{
+			if (r == 0 || run[r].first != run[r - 1].first)
+			{
+				DrawBatch batch;
+				batch.Entity = run[r].second;
+				batch.Lod = run[r].first;
+				batch.FirstInstance = (unsigned int)instanceData.size();
+				batches.push_back(batch);
+			}
+			batches.back().InstanceCount++;
+			instanceData.push_back(entities[run[r].second]->GetTransform()->GetPacket());
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Makes the offscreen scene texture, the same size and format
+// as the back buffer.  Lower resolutions only use its top left
+// corner, so it never needs remaking as the scale changes
+// --------------------------------------------------------
+void Game::CreateSceneTarget()
+{
+	sceneRTV.Reset();
+	sceneSRV.Reset();
+
+	D3D11_TEXTURE2D_DESC sceneDesc = {};
+	sceneDesc.Width = windowWidth;
+	sceneDesc.Height = windowHeight;
+	sceneDesc.ArraySize = 1;
+	sceneDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	sceneDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	sceneDesc.MipLevels = 1;
+	sceneDesc.SampleDesc.Count = 1;
+	sceneDesc.Usage = D3D11_USAGE_DEFAULT;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> sceneTexture;
+	device->CreateTexture2D(&sceneDesc, 0, sceneTexture.GetAddressOf());
+	if (!sceneTexture)
+		return;
+
+	device->CreateRenderTargetView(sceneTexture.Get(), 0, sceneRTV.GetAddressOf());
+	device->CreateShaderResourceView(sceneTexture.Get(), 0, sceneSRV.GetAddressOf());
+}
+
+XMFLOAT2 Game::GetSceneSize()
+{
+	return XMFLOAT2(
+		fmaxf(1.0f, floorf(windowWidth * renderScale)),
+		fmaxf(1.0f, floorf(windowHeight * renderScale)));
+}
+
+// --------------------------------------------------------
+// Binds where the scene draws this frame: the back buffer at
+// full size, or the scene texture's corner at renderScale.
+// The window's depth buffer works for both, since the corner
+// is never bigger than it
+// --------------------------------------------------------
+void Game::BindSceneTarget()
+{
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (float)windowWidth;
+	viewport.Height = (float)windowHeight;
+	viewport.MaxDepth = 1.0f;
+
+	if (dynamicResolution && sceneRTV)
+	{
+		viewport.Width = GetSceneSize().x;
+		viewport.Height = GetSceneSize().y;
+		StateCache::GetInstance().SetRenderTargets(1, sceneRTV.GetAddressOf(), depthBufferDSV.Get());
+	}
+	else
+	{
+		StateCache::GetInstance().SetRenderTargets(1, backBufferRTV.GetAddressOf(), depthBufferDSV.Get());
+	}
+	StateCache::GetInstance().SetViewport(viewport);
+}
+
+// --------------------------------------------------------
+// Draws one fullscreen triangle into the back buffer,
+// sampling the rendered corner of the scene texture
+// --------------------------------------------------------
+void Game::UpscaleScene()
+{
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (float)windowWidth;
+	viewport.Height = (float)windowHeight;
+	viewport.MaxDepth = 1.0f;
+	StateCache::GetInstance().SetRenderTargets(1, backBufferRTV.GetAddressOf(), 0);
+	StateCache::GetInstance().SetViewport(viewport);
+
+	upscaleVertexShader->SetShader();
+	upscalePixelShader->SetShader();
+	XMFLOAT2 sceneSize = GetSceneSize();
+	upscalePixelShader->SetFloat2("uvScale", XMFLOAT2(sceneSize.x / windowWidth, sceneSize.y / windowHeight));
+	upscalePixelShader->CopyAllBufferData();
+	upscalePixelShader->SetShaderResourceView("Scene", sceneSRV);
+	upscalePixelShader->SetSamplerState("LinearClamp", upscaleSampler);
+	context->Draw(3, 0);
+
+	//Unbind it, since it's a render target again next frame
+	upscalePixelShader->SetShaderResourceView("Scene", 0);
+}
+
+// --------------------------------------------------------
+// Sets the constants every main pass draw shares (camera,
+// shadow matrices and lights) in the PerFrame buffers of the
+// scene shaders, and uploads each buffer once.  Materials and
+// entities only ever touch their own blocks after this
+// --------------------------------------------------------
+void Game::UploadFrameConstants()
+{
+	for (auto& vs : { vertexShader, packedVertexShader, instancedVertexShader, packedInstancedVertexShader })
+	{
+		vs->SetMatrix4x4("view", camera->GetViewMatrix());
+		vs->SetMatrix4x4("projection", camera->GetProjectionMatrix());
+		vs->SetMatrix4x4("shadowView", shadowView);
+		vs->SetMatrix4x4("shadowProj", shadowProj);
+		vs->CopyBufferData("PerFrame");
+	}
+
+	pixelShader->SetFloat3("cameraPos", camera->GetPosition());
+	pixelShader->SetFloat3("ambient", ambientColor); //Send world ambient to shader
+	pixelShader->SetData("dirLight1", &directional1, sizeof(Light));
+	pixelShader->SetData("dirLight2", &directional2, sizeof(Light));
+	pixelShader->SetData("dirLight3", &directional3, sizeof(Light));
+	pixelShader->SetData("pointLight1", &point1, sizeof(Light));
+	pixelShader->SetData("pointLight2", &point2, sizeof(Light));
+	pixelShader->SetData("pointLight3", &point3, sizeof(Light));
+	pixelShader->CopyBufferData("PerFrame");
+
+	//Send ShadowMap resources to pixel shader for sampling
+	pixelShader->SetShaderResourceView("ShadowMap", shadowSRV);
+	pixelShader->SetSamplerState("ShadowSampler", shadowSampler);
+}
+
+// --------------------------------------------------------
+// Boxes every entity that has a mesh to draw, then culls them
+// against the camera and against the shadow light's
+// orthographic volume.  Entities still without a mesh (no
+// placeholder) aren't in either list
+// --------------------------------------------------------
+void Game::CullEntities()
+{
+	entityBounds.Clear();
+	boundedEntities.clear();
+	for (unsigned int i = 0; i < entities.size(); i++)
+	{
+		std::shared_ptr<Mesh> mesh = entities[i]->GetDrawMesh();
+		if (!mesh)
+			continue;
+		entityBounds.AddTransformed(mesh->GetBoundsMin(), mesh->GetBoundsMax(), entities[i]->GetTransform()->GetWorldMatrix());
+		boundedEntities.push_back(i);
+	}
+
+	XMFLOAT4X4 shadowViewProj;
+	XMStoreFloat4x4(&shadowViewProj, XMLoadFloat4x4(&shadowView) * XMLoadFloat4x4(&shadowProj));
+	if (frustumCulling && bvhCulling)
+		UpdateEntityBvh();
+	CullPass(camera->GetFrustum(), cameraVisible, cameraCullStats, cameraBvhStats);
+	CullPass(MakeFrustum(shadowViewProj), shadowVisible, shadowCullStats, shadowBvhStats);
 }
 
+void Game::CullPass(const Frustum& frustum, std::vector<unsigned int>& visible, FrustumCullStats& stats, BvhQueryStats& bvhStats)
+{
+	visible.clear();
+	bvhStats = BvhQueryStats();
+	if (!frustumCulling)
+	{
+		visible = boundedEntities;
+		stats = FrustumCullStats();
+		stats.Tested = stats.Visible = (unsigned int)visible.size();
+		return;
+	}
+
+	if (bvhCulling)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		entityBvh.QueryFrustum(frustum, visible, &bvhStats);
+		stats.Tested = entityBounds.Count;
+		stats.Visible = (unsigned int)visible.size();
+		stats.Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+	else
+	{
+		FrustumCull(frustum, entityBounds, visible, &stats);
+	}
+
+	//Box indices back to entity indices
+	for (unsigned int& index : visible)
+		index = boundedEntities[index];
+}
+
+// --------------------------------------------------------
+// Refits the BVH to this frame's boxes, or rebuilds it when
+// the number of boxes changed or refitting has let it get too
+// loose
+// --------------------------------------------------------
+void Game::UpdateEntityBvh()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	bool rebuild = entityBvh.GetItemCount() != entityBounds.Count;
+	if (!rebuild)
+	{
+		entityBvh.Refit(entityBounds);
+		rebuild = entityBvh.NeedsRebuild();
+	}
+	if (rebuild)
+	{
+		entityBvh.Build(entityBounds);
+		bvhRebuilds++;
+	}
+	bvhUpdateSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
 
 void Game::UpdateImGui(float deltaTime)
 {
 	// Get a reference to our custom input manager
 	Input& input = Input::GetInstance();
 
-	// Reset input manager's gui state so we dont
-	// taint our own input (youll uncomment later)
+	// Reset input manager's gui state so we dont
+	// taint our own input (youll uncomment later)
 	input.SetKeyboardCapture(false);
 	input.SetMouseCapture(false);
 
@@ -655,7 +1185,7 @@ void Game::UpdateImGui(float deltaTime)
 	ImGui_ImplWin32_NewFrame();
 	ImGui::NewFrame();
 
-	// Determine new input capture (youll uncomment later)
+	// Determine new input capture (youll uncomment later)
 	input.SetKeyboardCapture(io.WantCaptureKeyboard);
 	input.SetMouseCapture(io.WantCaptureMouse);
 
@@ -683,7 +1213,7 @@ void Game::UpdateImGui(float deltaTime)
 			XMFLOAT3 pos = entities[i]->GetTransform()->GetPosition();
 			if (ImGui::DragFloat3("Position", &pos.x, 0.05f))
 			{
-				// Something changed, so overwrite the transforms data
+				// Something changed, so overwrite the transforms data
 				entities[i]->GetTransform()->SetPosition(pos.x, pos.y, pos.z);
 			}
 
@@ -700,13 +1230,13 @@ void Game::UpdateImGui(float deltaTime)
 		XMFLOAT3 pos1 = point1.position;
 		if (ImGui::DragFloat3("Position##1", &pos1.x, 0.05f))
 		{
-			// Something changed, so overwrite the transforms data
+			// Something changed, so overwrite the transforms data
 			point1.position = XMFLOAT3(pos1.x, pos1.y, pos1.z);
 		}
 		XMFLOAT3 col1 = point1.color;
 		if (ImGui::DragFloat3("Color##1", &col1.x, 0.01f, 0.0f, 1.0f))
 		{
-			// Something changed, so overwrite the transforms data
+			// Something changed, so overwrite the transforms data
 			point1.color = XMFLOAT3(col1.x, col1.y, col1.z);
 		}
 
@@ -714,13 +1244,13 @@ void Game::UpdateImGui(float deltaTime)
 		XMFLOAT3 pos2 = point2.position;
 		if (ImGui::DragFloat3("Position##2", &pos2.x, 0.05f))
 		{
-			// Something changed, so overwrite the transforms data
+			// Something changed, so overwrite the transforms data
 			point2.position = XMFLOAT3(pos2.x, pos2.y, pos2.z);
 		}
 		XMFLOAT3 col2 = point2.color;
 		if (ImGui::DragFloat3("Color##2", &col2.x, 0.01f, 0.0f, 1.0f))
 		{
-			// Something changed, so overwrite the transforms data
+			// Something changed, so overwrite the transforms data
 			point2.color = XMFLOAT3(col2.x, col2.y, col2.z);
 		}
 
@@ -728,13 +1258,13 @@ void Game::UpdateImGui(float deltaTime)
 		XMFLOAT3 pos3 = point3.position;
 		if (ImGui::DragFloat3("Position##3", &pos3.x, 0.05f))
 		{
-			// Something changed, so overwrite the transforms data
+			// Something changed, so overwrite the transforms data
 			point3.position = XMFLOAT3(pos3.x, pos3.y, pos3.z);
 		}
 		XMFLOAT3 col3 = point3.color;
 		if (ImGui::DragFloat3("Color##3", &col3.x, 0.01f, 0.0f, 1.0f))
 		{
-			// Something changed, so overwrite the transforms data
+			// Something changed, so overwrite the transforms data
 			point3.color = XMFLOAT3(col3.x, col3.y, col3.z);
 		}
 	}
@@ -745,9 +1275,616 @@ void Game::UpdateImGui(float deltaTime)
 	ImGui::Text("Framerate: (%1.0f)", io.Framerate);
 	ImGui::Text("Number of Entities: (%d)", entities.size());
 	ImGui::Text("Mouse Position: (%.1f,%.1f)", io.MousePos.x, io.MousePos.y);
+
+	//How long each OBJ took to parse and how much welding saved
+	if (ImGui::CollapsingHeader("Mesh Loading"))
+	{
+		// First launch parses and cooks (cold), later launches map the cooked files (warm)
+		double totalSeconds = 0;
+		for (auto& m : meshes)
+		{
+			const MeshLoadStats& stats = m->GetLoadStats();
+			totalSeconds += stats.Seconds;
+			ImGui::Text("%s (%s, %.2f ms)", stats.Name.c_str(), stats.Cooked ? "cooked" : "parsed", stats.Seconds * 1000.0);
+			ImGui::Text("  Layout: %u B/vertex, %u-bit indices", stats.VertexStride, stats.IndexStride * 8);
+			if (stats.Packed)
+			{
+				ImGui::Text("  Packing error: %.1e pos, %.3f/%.3f deg normal/tangent, %.1e uv (%s)",
+					stats.PackingError.Position, stats.PackingError.NormalDegrees,
+					stats.PackingError.TangentDegrees, stats.PackingError.UV,
+					stats.PackingError.WithinBounds ? "within bounds" : "OVER BOUNDS");
+			}
+			if (stats.Cooked)
+				continue;
+
+			ImGui::Text("  Parse: %.2f ms, %.1f MB/s (%u chunks)",
+				stats.Parse.Seconds * 1000.0, stats.Parse.MegabytesPerSecond(), stats.Parse.ChunkCount);
+			ImGui::Text("  Verts: %u -> %u welded (%.1f KB saved)",
+				stats.Weld.SourceVertices, stats.Weld.WeldedVertices, stats.Weld.VertexBytesSaved() / 1024.0);
+			ImGui::Text("  ACMR: %.3f -> %.3f, ATVR: %.3f -> %.3f",
+				stats.Optimize.CacheBefore.ACMR, stats.Optimize.CacheAfter.ACMR,
+				stats.Optimize.CacheBefore.ATVR, stats.Optimize.CacheAfter.ATVR);
+			ImGui::Text("  Overdraw: %.3f -> %.3f (optimized in %.2f ms)",
+				stats.Optimize.OverdrawBefore.Overdraw, stats.Optimize.OverdrawAfter.Overdraw,
+				stats.Optimize.Seconds * 1000.0);
+		}
+		ImGui::Text("Total: %.2f ms", totalSeconds * 1000.0);
+
+		const char* sceneMeshes[] = { "cube", "cylinder", "helix", "quad", "quad_double_sided", "sphere", "torus" };
+
+		// The same files through both load paths, back to back
+		if (ImGui::Button("Run Benchmark##MeshLoad"))
+		{
+			meshLoadBenchmark.clear();
+			for (const char* name : sceneMeshes)
+				meshLoadBenchmark.push_back(BenchmarkMeshLoad((std::string("Assets/Mesh/") + name + ".obj").c_str(), packedVertices));
+		}
+		for (auto& r : meshLoadBenchmark)
+		{
+			if (!r.Succeeded)
+			{
+				ImGui::Text("%s: FAILED to load", r.Name.c_str());
+				continue;
+			}
+			ImGui::Text("%s (%s): OBJ %.2f ms, cooked %.3f ms (%.1fx)", r.Name.c_str(), r.Packed ? "packed" : "full precision",
+				r.SourceSeconds * 1000.0, r.CookedSeconds * 1000.0, r.CookedSeconds > 0 ? r.SourceSeconds / r.CookedSeconds : 0.0);
+			ImGui::Text("  %s buffers, %s from the mapped file", r.Identical ? "Identical" : "DIFFERENT", r.ZeroCopy ? "used straight" : "COPIED");
+		}
+
+		// Scene files, then text far bigger than any of them
+		if (ImGui::Button("Run Benchmark##ObjParse"))
+		{
+			objParseBenchmark.clear();
+			for (const char* name : sceneMeshes)
+				objParseBenchmark.push_back(BenchmarkObjFile((std::string("Assets/Mesh/") + name + ".obj").c_str()));
+			for (unsigned int faces : { 1000000u, 4000000u })
+				objParseBenchmark.push_back(BenchmarkObjGenerated(faces));
+		}
+		for (auto& r : objParseBenchmark)
+		{
+			ImGui::Text("%s (%.2f MB, %u tris)", r.Name.c_str(), r.Bytes / (1024.0 * 1024.0), r.Triangles);
+			ImGui::Text("  getline/sscanf_s %.2f ms (%.1f MB/s), parser %.2f ms (%.1f MB/s, %u chunks, %.2fx)",
+				r.ReferenceSeconds * 1000.0, r.ReferenceMegabytesPerSecond(),
+				r.ParseSeconds * 1000.0, r.MegabytesPerSecond(), r.ChunkCount,
+				r.ParseSeconds > 0 ? r.ReferenceSeconds / r.ParseSeconds : 0.0);
+			ImGui::Text("  %s faces, max error %.2g", r.Identical ? "Identical" : "DIFFERENT", r.MaxError);
+		}
+	}
+
+	//Startup time, and meshes still on their way
+	if (ImGui::CollapsingHeader("Async Loading"))
+	{
+		MeshLoaderStats stats = meshLoader->GetStats();
+		ImGui::Text("First frame: %.2f ms", firstFrameSeconds * 1000.0);
+		const ShaderLibraryStats& shaderStats = ShaderLibrary::GetInstance().GetStats();
+		ImGui::Text("Shaders: %u in %.2f ms, %u shared", shaderStats.Loaded, shaderLoadSeconds * 1000.0, shaderStats.Shared);
+		ImGui::Text("  Reflection: %u from cache (%.2f ms, saving %.2f ms), %u reflected (%.2f ms)",
+			shaderStats.CacheHits, shaderStats.CacheSeconds * 1000.0, (shaderStats.SavedSeconds - shaderStats.CacheSeconds) * 1000.0,
+			shaderStats.Reflected, shaderStats.ReflectSeconds * 1000.0);
+		if (allMeshesSeconds > 0)
+			ImGui::Text("All meshes ready: %.2f ms", allMeshesSeconds * 1000.0);
+		else
+			ImGui::Text("All meshes ready: still loading");
+		ImGui::SliderInt("Upload Budget", &uploadBudgetKB, 16, 4096, "%d KB/frame");
+		ImGui::Text("Threads: %u, queued %u, preparing %u, waiting to upload %u",
+			stats.ThreadCount, stats.Queued, stats.Preparing, stats.WaitingUpload);
+		ImGui::Text("Uploaded: %u meshes, %.1f KB (%u, %.1f KB last frame)",
+			stats.Uploaded, stats.TotalBytes / 1024.0, stats.FrameUploads, stats.FrameBytes / 1024.0);
+
+		for (auto& m : meshes)
+		{
+			const MeshLoadStats& load = m->GetLoadStats();
+			if (!m->IsReady())
+				ImGui::Text("%s: loading", load.Name.c_str());
+			else if (load.Async)
+				ImGui::Text("%s: %.2f ms prepare, %.2f ms waiting, %.2f ms upload", load.Name.c_str(),
+					(load.Seconds - load.WaitSeconds - load.UploadSeconds) * 1000.0, load.WaitSeconds * 1000.0, load.UploadSeconds * 1000.0);
+		}
+	}
+
+	//How full the shared geometry buffers are, and how often they were set this frame
+	if (ImGui::CollapsingHeader("Geometry Arena"))
+	{
+		GeometryArena& arena = GeometryArena::GetInstance();
+		unsigned int binds = arena.GetLastFrameBinds();
+		unsigned int avoided = arena.GetLastFrameBindsAvoided();
+		ImGui::Text("IA binds: %u of %u draws (%u avoided)", binds, binds + avoided, avoided);
+
+		for (unsigned int i = 0; i < arena.GetPoolCount(); i++)
+		{
+			GeometryPoolStats pool = arena.GetPoolStats(i);
+			ImGui::Text("Pool %u: %u B/vertex, %u-bit indices", i, pool.VertexStride, pool.IndexFormat == DXGI_FORMAT_R16_UINT ? 16 : 32);
+			ImGui::Text("  Vertices: %u of %u in %u meshes, %u free blocks (%.0f%% fragmented)",
+				pool.Vertices.Used, pool.Vertices.Capacity, pool.Vertices.Allocations,
+				pool.Vertices.FreeBlocks, pool.Vertices.Fragmentation() * 100.0f);
+			ImGui::Text("  Indices: %u of %u, %u free blocks (%.0f%% fragmented)",
+				pool.Indices.Used, pool.Indices.Capacity, pool.Indices.FreeBlocks, pool.Indices.Fragmentation() * 100.0f);
+		}
+		if (ImGui::Button("Defragment"))
+			arena.Defragment();
+	}
+
+	//Load-time tangents from each parsed mesh, and the old loop vs the new one
+	if (ImGui::CollapsingHeader("Tangents"))
+	{
+		for (auto& m : meshes)
+		{
+			const MeshLoadStats& stats = m->GetLoadStats();
+			if (stats.Cooked)
+				ImGui::Text("%s: cooked", stats.Name.c_str());
+			else
+				ImGui::Text("%s: %.3f ms on %u thread(s), %u degenerate", stats.Name.c_str(),
+					stats.Tangents.Seconds * 1000.0, stats.Tangents.ThreadCount, stats.Tangents.DegenerateVertices);
+		}
+
+		if (ImGui::Button("Run Benchmark"))
+			RunTangentBenchmark();
+		for (auto& r : tangentBenchmark)
+		{
+			ImGui::Text("%s (%u tris)", r.Name.c_str(), r.Triangles);
+			ImGui::Text("  Scalar %.3f ms, 1 thread %.3f ms, %u threads %.3f ms (%.2fx)",
+				r.ScalarSeconds * 1000.0, r.OneThreadSeconds * 1000.0, r.ThreadCount, r.AllThreadsSeconds * 1000.0,
+				r.AllThreadsSeconds > 0 ? r.ScalarSeconds / r.AllThreadsSeconds : 0.0);
+			ImGui::Text("  %s across threads, max %.4f deg from scalar", r.Identical ? "Identical" : "DIFFERENT", r.MaxDegrees);
+		}
+	}
+
+	//Matrix rebuilds, batched over every dirty transform
+	if (ImGui::CollapsingHeader("Transforms"))
+	{
+		TransformSystem& transforms = TransformSystem::GetInstance();
+		const TransformUpdateStats& stats = transforms.GetLastUpdateStats();
+		ImGui::Text("Transforms: %u (%u bytes of constants each, down from 128)", transforms.GetCount(),
+			(unsigned int)(sizeof(TransformPacket::World) + sizeof(TransformPacket::Normal)));
+		ImGui::Text("Last update: %u local, %u world (%u levels deep) in %.3f ms",
+			stats.Transforms, stats.Worlds, stats.Depth, stats.Seconds * 1000.0);
+
+		if (ImGui::Button("Run Benchmark##Transforms"))
+		{
+			transformBenchmark.clear();
+			for (unsigned int count : { 10000u, 100000u, 1000000u })
+				transformBenchmark.push_back(BenchmarkTransforms(count));
+
+			hierarchyBenchmark.clear();
+			BenchmarkHierarchies(100000, hierarchyBenchmark);
+
+			basisBenchmark.clear();
+			basisBenchmark.push_back(BenchmarkBasisVectors(100000));
+		}
+		for (auto& r : transformBenchmark)
+		{
+			ImGui::Text("%u: per object %.3f ms, batched %.3f ms (%.2fx), error %.2g",
+				r.Count, r.PerObjectSeconds * 1000.0, r.BatchSeconds * 1000.0,
+				r.BatchSeconds > 0 ? r.PerObjectSeconds / r.BatchSeconds : 0.0, r.MaxError);
+		}
+		for (auto& r : hierarchyBenchmark)
+		{
+			ImGui::Text("%s (%u, %u deep), %u moved -> %u worlds per frame", r.Name, r.Count, r.Depth, r.Moved, r.Worlds);
+			ImGui::Text("  Recursive %.3f ms, incremental %.3f ms (%.2fx), error %.2g",
+				r.RecursiveSeconds * 1000.0, r.IncrementalSeconds * 1000.0,
+				r.IncrementalSeconds > 0 ? r.RecursiveSeconds / r.IncrementalSeconds : 0.0, r.MaxError);
+		}
+		for (auto& r : basisBenchmark)
+		{
+			ImGui::Text("Right/up/forward x %u: rebuilt %.3f ms, cached %.3f ms (%.2fx), error %.2g",
+				r.Count, r.RebuiltSeconds * 1000.0, r.CachedSeconds * 1000.0,
+				r.CachedSeconds > 0 ? r.RebuiltSeconds / r.CachedSeconds : 0.0, r.MaxError);
+		}
+	}
+
+	//Entities skipped by each pass this frame
+	if (ImGui::CollapsingHeader("Frustum Culling"))
+	{
+		ImGui::Checkbox("Enabled##Frustum", &frustumCulling);
+		ImGui::Text("Camera: %u visible, %u culled in %.4f ms",
+			cameraCullStats.Visible, cameraCullStats.Culled(), cameraCullStats.Seconds * 1000.0);
+		ImGui::Text("Shadow: %u visible, %u culled in %.4f ms",
+			shadowCullStats.Visible, shadowCullStats.Culled(), shadowCullStats.Seconds * 1000.0);
+
+		if (ImGui::Button("Run Benchmark##Frustum"))
+		{
+			cullBenchmark.clear();
+			cullBenchmark.push_back(BenchmarkFrustumCulling(1000000));
+		}
+		for (auto& r : cullBenchmark)
+		{
+			ImGui::Text("%u boxes (%u visible): one at a time %.3f ms, SIMD %.3f ms (%.2fx)",
+				r.Count, r.Visible, r.ScalarSeconds * 1000.0, r.SimdSeconds * 1000.0,
+				r.SimdSeconds > 0 ? r.ScalarSeconds / r.SimdSeconds : 0.0);
+			ImGui::Text("  %s visible lists", r.Identical ? "Identical" : "DIFFERENT");
+		}
+
+		ImGui::Checkbox("Use BVH##Frustum", &bvhCulling);
+		if (bvhCulling)
+		{
+			ImGui::Text("BVH: %u nodes, cost %.2f (%.2f when built), %u rebuilds",
+				entityBvh.GetNodeCount(), entityBvh.GetCost(), entityBvh.GetBuildCost(), bvhRebuilds);
+			ImGui::Text("Refit: %u nodes in %.4f ms", entityBvh.GetLastRefitNodes(), bvhUpdateSeconds * 1000.0);
+			ImGui::Text("Camera query: %u nodes, %u boxes tested", cameraBvhStats.NodesVisited, cameraBvhStats.ItemsTested);
+			ImGui::Text("Shadow query: %u nodes, %u boxes tested", shadowBvhStats.NodesVisited, shadowBvhStats.ItemsTested);
+		}
+
+		if (ImGui::Button("Run Benchmark##Bvh"))
+		{
+			bvhBenchmark.clear();
+			bvhBenchmark.push_back(BenchmarkBvh(100000, 0.1f));
+		}
+		for (auto& r : bvhBenchmark)
+		{
+			ImGui::Text("%u boxes, %u nodes: built in %.2f ms", r.Count, r.Nodes, r.BuildSeconds * 1000.0);
+			ImGui::Text("  %u moving: refit %.3f ms per frame, cost grew to %.2fx, %u rebuilds",
+				r.Moving, r.RefitSeconds * 1000.0, r.CostGrowth, r.Rebuilds);
+			ImGui::Text("  %u frustums: BVH %.3f ms, every box %.3f ms", r.FrustumQueries, r.FrustumSeconds * 1000.0, r.FrustumBruteSeconds * 1000.0);
+			ImGui::Text("  %u spheres: BVH %.3f ms, every box %.3f ms", r.SphereQueries, r.SphereSeconds * 1000.0, r.SphereBruteSeconds * 1000.0);
+			ImGui::Text("  %u rays: BVH %.3f ms, every box %.3f ms", r.RayQueries, r.RaySeconds * 1000.0, r.RayBruteSeconds * 1000.0);
+			ImGui::Text("  %s results", r.Identical ? "Identical" : "DIFFERENT");
+		}
+	}
+
+	//What the scene passes sent to constant buffers last frame
+	if (ImGui::CollapsingHeader("Constant Buffers"))
+	{
+		if (ImGui::Checkbox("Dynamic PerObject buffers", &dynamicObjectBuffers))
+			SetObjectBuffersDynamic(dynamicObjectBuffers);
+		ImGui::Checkbox("PerObject ring (D3D 11.1)", &ringConstants);
+		if (!constantRing->IsSupported())
+			ImGui::Text("  Not supported here, so every draw copies into its shader's buffer");
+		else
+		{
+			const RingAllocator& ring = constantRing->GetAllocator();
+			ImGui::Text("  %u draws bound at an offset, %u bytes, %u fell back", constantRing->GetFrameBinds(),
+				constantRing->GetFrameBytes(), constantRing->GetFrameFallbacks());
+			ImGui::Text("  %u of %u KB in use over %u frames in flight, %u wraps",
+				ring.GetUsed() / 1024, ring.GetCapacity() / 1024, ring.GetFramesInFlight(), ring.GetWraps());
+		}
+		ImGui::Text("Uploaded: %u bytes per frame in %u copies, %u skipped (unchanged)",
+			(unsigned int)frameConstantBytes, frameUploads, frameUploadsSkipped);
+		ImGui::Text("Every buffer for every draw (as before): %u bytes", (unsigned int)unsplitConstantBytes);
+		ImGui::Text("PerObject block: %u bytes (main pass), %u bytes (shadow pass)",
+			vertexShader->GetBufferInfo("PerObject") ? vertexShader->GetBufferInfo("PerObject")->Size : 0,
+			shadowVertexShader->GetBufferInfo("PerObject") ? shadowVertexShader->GetBufferInfo("PerObject")->Size : 0);
+
+		ImGui::Checkbox("Record uploads", &recordUploads);
+		if (recordUploads)
+		{
+			size_t bytes = 0;
+			unsigned int discards = 0;
+			unsigned int partial = 0;
+			for (const SimpleUploadRecord& r : uploadRecorder.Uploads)
+			{
+				bytes += r.Size;
+				discards += r.Discard ? 1 : 0;
+				partial += r.Size < r.Buffer->Size ? 1 : 0;
+			}
+			ImGui::Text("Recorded: %u copies (%u discards, %u partial), %u bytes, %u skipped",
+				(unsigned int)uploadRecorder.Uploads.size(), discards, partial, (unsigned int)bytes, uploadRecorder.Skipped);
+			ImGui::Text("  %s the counters", uploadRecorder.Uploads.size() == frameUploads && bytes == frameConstantBytes &&
+				uploadRecorder.Skipped == frameUploadsSkipped ? "Matches" : "DOESN'T MATCH");
+		}
+
+		if (ImGui::Button("Run Benchmark##Setters"))
+			RunSetterBenchmark();
+		for (auto& r : setterBenchmark)
+		{
+			ImGui::Text("%u draws x %u sets: by name %.3f ms, by handle %.3f ms (%.1fx), %s",
+				r.Draws, r.SetsPerDraw, r.NameSeconds * 1000.0, r.HandleSeconds * 1000.0,
+				r.HandleSeconds > 0 ? r.NameSeconds / r.HandleSeconds : 0.0, r.Identical ? "identical" : "DIFFERENT");
+		}
+	}
+
+	//Binding calls that reached the context last frame, and the ones dropped as already bound
+	if (ImGui::CollapsingHeader("State Cache"))
+	{
+		StateCache& stateCache = StateCache::GetInstance();
+		bool enabled = stateCache.IsEnabled();
+		if (ImGui::Checkbox("Drop redundant calls##StateCache", &enabled))
+			stateCache.SetEnabled(enabled);
+
+		const char* kinds[STATE_CALL_COUNT] = { "Shaders", "Constant buffers", "SRVs", "Samplers", "Input assembler", "Render targets", "Viewports", "Pipeline states" };
+		const StateCacheStats& stats = stateCache.GetLastFrameStats();
+		unsigned int issued = 0;
+		unsigned int filtered = 0;
+		for (unsigned int i = 0; i < STATE_CALL_COUNT; i++)
+		{
+			ImGui::Text("%s: %u issued, %u dropped", kinds[i], stats.Issued[i], stats.Filtered[i]);
+			issued += stats.Issued[i];
+			filtered += stats.Filtered[i];
+		}
+		ImGui::Text("Total: %u of %u calls issued (%.0f%% dropped)", issued, issued + filtered,
+			issued + filtered ? filtered * 100.0f / (issued + filtered) : 0.0f);
+	}
+
+	//How much sorting saved this frame
+	if (ImGui::CollapsingHeader("Render Queue"))
+	{
+		const RenderQueueStats& stats = renderQueueStats;
+		ImGui::Text("Draws: %u (both passes), sorted in %.4f ms", stats.Draws, stats.SortSeconds * 1000.0);
+		ImGui::Text("Shader switches: %u (%u unsorted)", stats.ShaderSwitches, stats.UnsortedShaderSwitches);
+		ImGui::Text("Material switches: %u (%u unsorted)", stats.MaterialSwitches, stats.UnsortedMaterialSwitches);
+		ImGui::Text("Mesh switches: %u (%u unsorted)", stats.MeshSwitches, stats.UnsortedMeshSwitches);
+
+		if (ImGui::Button("Run Benchmark##RenderQueue"))
+		{
+			renderQueueBenchmark.clear();
+			renderQueueBenchmark.push_back(BenchmarkRenderQueue(100000));
+		}
+		for (auto& r : renderQueueBenchmark)
+		{
+			ImGui::Text("%u draws: std::stable_sort %.3f ms, radix %.3f ms in %u passes (%.2fx), %s",
+				r.Count, r.StdSortSeconds * 1000.0, r.RadixSeconds * 1000.0, r.RadixPasses,
+				r.RadixSeconds > 0 ? r.StdSortSeconds / r.RadixSeconds : 0.0, r.Identical ? "identical" : "DIFFERENT");
+		}
+	}
+
+	//Draw calls saved by drawing entities that share a mesh and material together
+	if (ImGui::CollapsingHeader("Instancing"))
+	{
+		ImGui::Checkbox("Enabled##Instancing", &instancing);
+		ImGui::SliderInt("Stress Grid", &stressInstances, 0, 10000);
+
+		unsigned int batches = 0;
+		unsigned int instances = 0;
+		for (auto* passBatches : { &shadowBatches, &opaqueBatches })
+		{
+			for (const DrawBatch& batch : *passBatches)
+			{
+				if (batch.InstanceCount)
+				{
+					batches++;
+					instances += batch.InstanceCount;
+				}
+			}
+		}
+		ImGui::Text("Main pass: %u entities in %u draw calls", (unsigned int)cameraVisible.size(), opaqueDrawCalls);
+		ImGui::Text("Shadow pass: %u entities in %u draw calls", (unsigned int)shadowVisible.size(), shadowDrawCalls);
+		ImGui::Text("Instanced: %u entities in %u draw calls (not cluster culled)", instances, batches);
+		ImGui::Text("Instance buffer: %u of %u slots, %u bytes each",
+			(unsigned int)instanceData.size(), instanceBuffer->GetCapacity(), instanceBuffer->GetStride());
+	}
+
+	//Render scale, and how the controller copes with made up loads
+	if (ImGui::CollapsingHeader("Dynamic Resolution"))
+	{
+		if (ImGui::Checkbox("Enabled##Resolution", &dynamicResolution))
+			resolutionController->Reset();
+		ImGui::SliderFloat("Frame Budget", &frameBudgetMS, 4.0f, 50.0f, "%.1f ms");
+		ImGui::Text("Scale: %.0f%% (%.0f x %.0f), smoothed frame %.2f ms", renderScale * 100.0f,
+			GetSceneSize().x, GetSceneSize().y, resolutionController->GetSmoothedSeconds() * 1000.0);
+
+		if (ImGui::Button("Simulate##Resolution"))
+		{
+			resolutionTraces.clear();
+			SimulateResolutionTraces(frameBudgetMS / 1000.0, resolutionTraces);
+		}
+		for (auto& r : resolutionTraces)
+		{
+			ImGui::Text("%s: %u/%u frames over budget at full res, %u scaled (min %.0f%%, avg %.0f%%, %u reversals)",
+				r.Name, r.OverBudgetFixed, r.Frames, r.OverBudgetDynamic, r.MinScale * 100.0f, r.AverageScale * 100.0f, r.Reversals);
+		}
+	}
+
+	//Triangles in each level of detail, and which ones are on screen
+	if (ImGui::CollapsingHeader("Levels of Detail"))
+	{
+		ImGui::SliderFloat("Max Pixel Error", &lodPixelError, 0.25f, 16.0f, "%.2f px");
+
+		unsigned int drawnTriangles = 0;
+		unsigned int fullTriangles = 0;
+		for (unsigned int index : cameraVisible)
+		{
+			drawnTriangles += entities[index]->GetMesh()->GetLod(entities[index]->GetLastLod()).IndexCount / 3;
+			fullTriangles += entities[index]->GetMesh()->GetLod(0).IndexCount / 3;
+		}
+		ImGui::Text("Drawn: %u of %u triangles", drawnTriangles, fullTriangles);
+
+		for (auto& m : meshes)
+		{
+			ImGui::Text("%s (built in %.2f ms)", m->GetLoadStats().Name.c_str(), m->GetLoadStats().LodSeconds * 1000.0);
+			for (unsigned int i = 0; i < m->GetLodCount(); i++)
+				ImGui::Text("  LOD %u: %u tris, error %.4f", i, m->GetLod(i).IndexCount / 3, m->GetLod(i).Error);
+		}
+	}
+
+	//How many clusters were skipped this frame, and why
+	if (ImGui::CollapsingHeader("Cluster Culling"))
+	{
+		ImGui::Checkbox("Enabled", &clusterCulling);
+
+		ClusterCullStats frame;
+		for (unsigned int index : cameraVisible)
+			frame.Add(entities[index]->GetLastCullStats());
+		ImGui::Text("Clusters: %u tested, %u backfacing, %u off screen",
+			frame.Clusters, frame.Backfacing, frame.OutsideFrustum);
+		ImGui::Text("Submitted: %u triangles in %u draw calls", frame.Triangles, frame.DrawCalls);
+
+		for (auto& m : meshes)
+		{
+			ImGui::Text("%s: %u clusters (built in %.2f ms)", m->GetLoadStats().Name.c_str(),
+				m->GetClusterCount(), m->GetLoadStats().ClusterSeconds * 1000.0);
+		}
+	}
 	ImGui::End();
 }
 
+// --------------------------------------------------------
+// Times the scalar Mesh::CalculateTangents against
+// GenerateTangents on one thread and on all of them, using the
+// scene's OBJ files plus big synthetic grids.  Also checks the
+// new output doesn't depend on the thread count
+// --------------------------------------------------------
+void Game::RunTangentBenchmark()
+{
+	std::vector<std::pair<std::string, MeshData>> inputs;
+	const char* files[] = { "helix", "sphere", "torus" };
+	for (const char* name : files)
+	{
+		ObjData obj;
+		MeshData data;
+		std::string path = std::string("Assets/Mesh/") + name + ".obj";
+		if (ParseObjFile(path.c_str(), obj) && BuildMeshData(obj, data))
+			inputs.push_back(std::make_pair(std::string(name), data));
+	}
+
+	// Wavy grids, big enough to be worth threading
+	const unsigned int gridSizes[] = { 256, 1024 };
+	for (unsigned int size : gridSizes)
+	{
+		MeshData data;
+		for (unsigned int y = 0; y <= size; y++)
+		{
+			for (unsigned int x = 0; x <= size; x++)
+			{
+				Vertex v = {};
+				float u = x / (float)size;
+				float w = y / (float)size;
+				v.Position = XMFLOAT3(u, sinf(u * 6.0f) * 0.1f, w);
+				v.Normal = XMFLOAT3(0, 1, 0);
+				v.UV = XMFLOAT2(u, w);
+				data.Vertices.push_back(v);
+			}
+		}
+		for (unsigned int y = 0; y < size; y++)
+		{
+			for (unsigned int x = 0; x < size; x++)
+			{
+				unsigned int a = y * (size + 1) + x;
+				unsigned int quadIndices[6] = { a, a + size + 1, a + 1, a + 1, a + size + 1, a + size + 2 };
+				data.Indices.insert(data.Indices.end(), quadIndices, quadIndices + 6);
+			}
+		}
+		inputs.push_back(std::make_pair("grid " + std::to_string(size) + "x" + std::to_string(size), data));
+	}
+
+	tangentBenchmark.clear();
+	for (auto& input : inputs)
+	{
+		MeshData& data = input.second;
+		TangentBenchmarkResult result = {};
+		result.Name = input.first;
+		result.Triangles = (unsigned int)data.Indices.size() / 3;
+
+		std::vector<Vertex> scalar = data.Vertices;
+		auto start = std::chrono::high_resolution_clock::now();
+		Mesh::CalculateTangents(&scalar[0], (int)scalar.size(), &data.Indices[0], (int)data.Indices.size());
+		result.ScalarSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		TangentStats stats;
+		std::vector<Vertex> single = data.Vertices;
+		GenerateTangents(&single[0], single.size(), &data.Indices[0], data.Indices.size(), 1, &stats);
+		result.OneThreadSeconds = stats.Seconds;
+
+		// Every hardware thread, even on meshes too small to bother with
+		std::vector<Vertex> threaded = data.Vertices;
+		unsigned int threadCount = std::thread::hardware_concurrency();
+		GenerateTangents(&threaded[0], threaded.size(), &data.Indices[0], data.Indices.size(), threadCount > 0 ? threadCount : 1, &stats);
+		result.AllThreadsSeconds = stats.Seconds;
+		result.ThreadCount = stats.ThreadCount;
+
+		result.Identical = memcmp(&single[0], &threaded[0], single.size() * sizeof(Vertex)) == 0;
+		for (size_t i = 0; i < single.size(); i++)
+		{
+			// The scalar loop gives NaNs for triangles with no UV area
+			float d = XMVectorGetX(XMVector3Dot(XMLoadFloat3(&scalar[i].Tangent), XMLoadFloat3(&single[i].Tangent)));
+			if (d != d)
+				continue;
+			float degrees = XMConvertToDegrees(acosf(d < 1.0f ? d : 1.0f));
+			if (degrees > result.MaxDegrees)
+				result.MaxDegrees = degrees;
+		}
+		tangentBenchmark.push_back(result);
+	}
+}
+
+// --------------------------------------------------------
+// Switches every scene vertex shader's PerObject buffer
+// between dynamic and default usage
+// --------------------------------------------------------
+void Game::SetObjectBuffersDynamic(bool dynamic)
+{
+	for (auto& vs : { vertexShader, packedVertexShader, instancedVertexShader, packedInstancedVertexShader,
+		shadowVertexShader, packedShadowVertexShader, instancedShadowVertexShader, packedInstancedShadowVertexShader })
+	{
+		vs->SetBufferDynamic(vs->GetBufferHandle("PerObject"), dynamic);
+	}
+}
+
+// --------------------------------------------------------
+// Times setting what a packed mesh's draw sets (its PerObject
+// block and its material's constants) through the name-based
+// setters, then through handles, without uploading anything.
+// Leaves the local buffers as it found them
+// --------------------------------------------------------
+void Game::RunSetterBenchmark()
+{
+	const unsigned int draws = 100000;
+	std::shared_ptr<SimpleVertexShader> vs = packedVertexShader;
+	std::shared_ptr<SimplePixelShader> ps = pixelShader;
+	const SimpleConstantBuffer* perObject = vs->GetBufferInfo("PerObject");
+	const SimpleConstantBuffer* perMaterial = ps->GetBufferInfo("PerMaterial");
+	if (!perObject || !perMaterial)
+		return;
+
+	std::vector<unsigned char> savedObject(perObject->LocalDataBuffer, perObject->LocalDataBuffer + perObject->Size);
+	std::vector<unsigned char> savedMaterial(perMaterial->LocalDataBuffer, perMaterial->LocalDataBuffer + perMaterial->Size);
+
+	// Different values every draw, so neither loop can skip any
+	TransformPacket packet = {};
+	XMFLOAT3 offset(0, 0, 0);
+	XMFLOAT3 scale(1, 1, 1);
+	XMFLOAT4 tint(1, 1, 1, 1);
+	XMFLOAT2 uvScale(1, 1);
+
+	SetterBenchmarkResult result = {};
+	result.Draws = draws;
+	result.SetsPerDraw = 7;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < draws; i++)
+	{
+		packet.World._14 = offset.x = tint.x = (float)i;
+		vs->SetData("world", &packet.World, sizeof(packet.World));
+		vs->SetData("normalMatrix", &packet.Normal, TRANSFORM_NORMAL_MATRIX_BYTES);
+		vs->SetFloat3("quantizeOffset", offset);
+		vs->SetFloat3("quantizeScale", scale);
+		ps->SetFloat4("colorTint", tint);
+		ps->SetFloat2("uvScale", uvScale);
+		ps->SetFloat("roughness", (float)i);
+	}
+	result.NameSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	std::vector<unsigned char> nameObject(perObject->LocalDataBuffer, perObject->LocalDataBuffer + perObject->Size);
+	std::vector<unsigned char> nameMaterial(perMaterial->LocalDataBuffer, perMaterial->LocalDataBuffer + perMaterial->Size);
+	memset(perObject->LocalDataBuffer, 0, perObject->Size);
+	memset(perMaterial->LocalDataBuffer, 0, perMaterial->Size);
+
+	// Looking the handles up is part of the cost, once
+	start = std::chrono::high_resolution_clock::now();
+	ObjectConstantHandles handles;
+	handles.Resolve(vs.get());
+	SimpleVariableHandle tintHandle = ps->GetVariableHandle("colorTint");
+	SimpleVariableHandle uvScaleHandle = ps->GetVariableHandle("uvScale");
+	SimpleVariableHandle roughnessHandle = ps->GetVariableHandle("roughness");
+	for (unsigned int i = 0; i < draws; i++)
+	{
+		packet.World._14 = offset.x = tint.x = (float)i;
+		vs->SetData(handles.World, &packet.World, sizeof(packet.World));
+		vs->SetData(handles.NormalMatrix, &packet.Normal, TRANSFORM_NORMAL_MATRIX_BYTES);
+		vs->SetFloat3(handles.QuantizeOffset, offset);
+		vs->SetFloat3(handles.QuantizeScale, scale);
+		ps->SetFloat4(tintHandle, tint);
+		ps->SetFloat2(uvScaleHandle, uvScale);
+		ps->SetFloat(roughnessHandle, (float)i);
+	}
+	result.HandleSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	result.Identical =
+		memcmp(&nameObject[0], perObject->LocalDataBuffer, perObject->Size) == 0 &&
+		memcmp(&nameMaterial[0], perMaterial->LocalDataBuffer, perMaterial->Size) == 0;
+
+	memcpy(perObject->LocalDataBuffer, &savedObject[0], perObject->Size);
+	memcpy(perMaterial->LocalDataBuffer, &savedMaterial[0], perMaterial->Size);
+	setterBenchmark.clear();
+	setterBenchmark.push_back(result);
+}
+
 // --------------------------------------------------------
 // Author: Chris Cascioli
 // Purpose: Creates a cube map on the GPU from 6 individual textures
@@ -756,9 +1893,9 @@ void Game::UpdateImGui(float deltaTime)
 //   for assignments, given that you clearly cite that this is not
 //   code of your own design.
 //
-// - Note: This code assumes youre putting the function in Game.cpp, 
-//   youve included WICTextureLoader.h and you have an ID3D11Device 
-//   ComPtr called device.  Make any adjustments necessary for
+// - Note: This code assumes youre putting the function in Game.cpp, 
+//   youve included WICTextureLoader.h and you have an ID3D11Device 
+//   ComPtr called device.  Make any adjustments necessary for
 //   your own implementation.
 // --------------------------------------------------------
 
@@ -16,7 +16,18 @@
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
 #include <iostream>
 #include <vector>
+#include <chrono>
 #include "SimpleShader.h"
+#include "MeshLoader.h"
+#include "TransformSystem.h"
+#include "FrustumCulling.h"
+#include "Bvh.h"
+#include "DynamicResolution.h"
+#include "RenderQueue.h"
+#include "Instancing.h"
+#include "ConstantRing.h"
+#include "StateCache.h"
+#include "ShaderLibrary.h"
 #include "SpriteBatch.h"
 
 class Game 
@@ -34,6 +45,8 @@ public:
 	void Update(float deltaTime, float totalTime);
 	void Draw(float deltaTime, float totalTime);
 	void UpdateImGui(float deltaTime);
+	void RunTangentBenchmark();
+	void RunSetterBenchmark();
 
 private:
 
@@ -53,8 +66,99 @@ private:
 	// Shaders and shader-related constructs
 	std::shared_ptr<SimplePixelShader> pixelShader;
 	std::shared_ptr<SimpleVertexShader> vertexShader;
+	std::shared_ptr<SimpleVertexShader> packedVertexShader;
+	std::shared_ptr<SimpleVertexShader> instancedVertexShader;
+	std::shared_ptr<SimpleVertexShader> packedInstancedVertexShader;
 	Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout;
 
+	//Scene meshes use the 20 byte PackedVertex instead of Vertex
+	bool packedVertices;
+
+	//Coarser levels of detail are used while their error stays under this many pixels
+	float lodPixelError;
+
+	//Skip mesh clusters that face away from the camera or are off screen
+	bool clusterCulling;
+
+	//Skip whole entities outside the camera's (or the shadow light's) view
+	bool frustumCulling;
+	CullBoxes entityBounds;							// World space, one per entity with something to draw
+	std::vector<unsigned int> boundedEntities;		// Which entity each box belongs to
+	std::vector<unsigned int> cameraVisible;		// Entities drawn by each pass this frame
+	std::vector<unsigned int> shadowVisible;
+	FrustumCullStats cameraCullStats;
+	FrustumCullStats shadowCullStats;
+	void CullEntities();
+	void CullPass(const Frustum& frustum, std::vector<unsigned int>& visible, FrustumCullStats& stats, BvhQueryStats& bvhStats);
+
+	//Both passes query a BVH over entityBounds instead of testing every box
+	bool bvhCulling;
+	Bvh entityBvh;
+	double bvhUpdateSeconds;		// Refitting (or rebuilding) it this frame
+	unsigned int bvhRebuilds;
+	BvhQueryStats cameraBvhStats;
+	BvhQueryStats shadowBvhStats;
+	void UpdateEntityBvh();
+
+	//Both passes' draws, sorted so shaders and materials are only set when they change
+	RenderQueue renderQueue;
+	RenderQueueStats renderQueueStats;
+	std::vector<RenderQueueBenchmarkResult> renderQueueBenchmark;
+	void BuildRenderQueue();
+
+	//Runs of sorted draws sharing a mesh and material become one instanced draw
+	//call, their transforms going into instanceBuffer instead of PerObject blocks
+	bool instancing;
+	std::shared_ptr<InstanceBuffer> instanceBuffer;
+	std::vector<TransformPacket> instanceData;		// This frame's, both passes
+	std::vector<DrawBatch> shadowBatches;
+	std::vector<DrawBatch> opaqueBatches;
+	unsigned int shadowDrawCalls;
+	unsigned int opaqueDrawCalls;
+	void BuildDrawBatches();
+	void BuildPassBatches(unsigned int pass, std::vector<DrawBatch>& batches);
+
+	//A grid of extra cubes and spheres behind the scene, to stress the draw loop
+	int stressInstances;
+	unsigned int sceneEntityCount;		// Entities before the grid
+	void RebuildStressGrid();
+
+	//Camera, light and shadow constants go up once per frame, then each draw only sends its PerObject block
+	void UploadFrameConstants();
+	size_t frameConstantBytes;			// Actually uploaded by the scene passes
+	size_t unsplitConstantBytes;		// Had every draw uploaded all of its shaders' buffers
+	unsigned int frameUploads;			// Buffers copied, and copies skipped as nothing had changed
+	unsigned int frameUploadsSkipped;
+
+	//PerObject blocks change for nearly every draw, so they can be mapped with WRITE_DISCARD instead
+	bool dynamicObjectBuffers;
+	void SetObjectBuffersDynamic(bool dynamic);
+
+	//Or appended to one big buffer and bound at an offset (D3D 11.1 only)
+	bool ringConstants;
+	std::shared_ptr<ConstantRing> constantRing;
+
+	//Writes down the scene passes' uploads, to check the counters against
+	bool recordUploads;
+	SimpleUploadRecorder uploadRecorder;
+
+	//Dynamic resolution: the scene renders into the top left of a window-sized
+	//target, scaled to keep frames in budget, then gets stretched over the back buffer
+	bool dynamicResolution;
+	float frameBudgetMS;
+	float renderScale;
+	std::shared_ptr<ResolutionController> resolutionController;
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> sceneRTV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> sceneSRV;
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> upscaleSampler;
+	std::shared_ptr<SimpleVertexShader> upscaleVertexShader;
+	std::shared_ptr<SimplePixelShader> upscalePixelShader;
+	std::vector<ResolutionTraceResult> resolutionTraces;
+	void CreateSceneTarget();
+	DirectX::XMFLOAT2 GetSceneSize();		// In pixels, at renderScale
+	void BindSceneTarget();
+	void UpscaleScene();
+
 	std::shared_ptr<SimplePixelShader> skyPixelShader;
 	std::shared_ptr<SimpleVertexShader> skyVertexShader;
 
@@ -72,6 +176,9 @@ private:
 
 	//Variables for Shadow Mapping
 	std::shared_ptr<SimpleVertexShader> shadowVertexShader;
+	std::shared_ptr<SimpleVertexShader> packedShadowVertexShader;
+	std::shared_ptr<SimpleVertexShader> instancedShadowVertexShader;
+	std::shared_ptr<SimpleVertexShader> packedInstancedShadowVertexShader;
 	DirectX::XMFLOAT4X4 shadowView;
 	DirectX::XMFLOAT4X4 shadowProj;
 	int shadowResolution;
@@ -97,6 +204,7 @@ private:
 	std::shared_ptr<Material> customMat;
 	std::shared_ptr<Material> matFloor;
 
+	std::shared_ptr<Mesh> skyCube;
 	std::shared_ptr<Mesh> cube;
 	std::shared_ptr<Mesh> cylinder;
 	std::shared_ptr<Mesh> helix;
@@ -105,6 +213,59 @@ private:
 	std::shared_ptr<Mesh> sphere;
 	std::shared_ptr<Mesh> torus;
 
+	//Every mesh loaded from disk, for the stats window
+	std::vector<std::shared_ptr<Mesh>> meshes;
+
+	//The old getline/sscanf_s loop vs ParseObjText, run from the INFO window
+	std::vector<ObjParseBenchmarkResult> objParseBenchmark;
+
+	//Each scene mesh from its OBJ vs from its cooked file, run from the INFO window
+	std::vector<MeshLoadBenchmarkResult> meshLoadBenchmark;
+
+	//Scene meshes load on worker threads, and only this many KB of buffers are created per frame
+	std::shared_ptr<MeshLoader> meshLoader;
+	int uploadBudgetKB;
+
+	//Startup timing, from the constructor to the first Present() and to the last mesh upload
+	std::chrono::high_resolution_clock::time_point launchTime;
+	double firstFrameSeconds;
+	double allMeshesSeconds;
+	double shaderLoadSeconds;	//Just the shaders in LoadShaders()
+
+	//Mesh::CalculateTangents vs GenerateTangents, run from the INFO window
+	struct TangentBenchmarkResult
+	{
+		std::string Name;
+		unsigned int Triangles;
+		double ScalarSeconds;
+		double OneThreadSeconds;
+		double AllThreadsSeconds;
+		unsigned int ThreadCount;
+		bool Identical;			// Same bits on one thread and on all of them
+		float MaxDegrees;		// Furthest from the scalar result
+	};
+	std::vector<TangentBenchmarkResult> tangentBenchmark;
+
+	//Per-object matrices vs the batched TransformSystem pass, run from the INFO window
+	std::vector<TransformBenchmarkResult> transformBenchmark;
+	std::vector<HierarchyBenchmarkResult> hierarchyBenchmark;
+	std::vector<BasisBenchmarkResult> basisBenchmark;
+
+	//One box at a time vs the SIMD culling kernel, run from the INFO window
+	std::vector<FrustumCullBenchmarkResult> cullBenchmark;
+	std::vector<BvhBenchmarkResult> bvhBenchmark;
+
+	//A draw's constants set by name vs through handles, run from the INFO window
+	struct SetterBenchmarkResult
+	{
+		unsigned int Draws;
+		unsigned int SetsPerDraw;
+		double NameSeconds;
+		double HandleSeconds;
+		bool Identical;			// Same bytes in the local buffers either way
+	};
+	std::vector<SetterBenchmarkResult> setterBenchmark;
+
 	std::shared_ptr<SimplePixelShader> customPixelShader;
 
 	DirectX::XMFLOAT3 ambientColor;
@@ -2,6 +2,26 @@
 #include <DirectXMath.h>
 using namespace DirectX;
 
+void ObjectConstantHandles::Resolve(SimpleVertexShader* vs)
+{
+	if (vs == Shader)
+		return;
+	Shader = vs;
+	World = vs->GetVariableHandle("world");
+	NormalMatrix = vs->GetVariableHandle("normalMatrix");
+	QuantizeOffset = vs->GetVariableHandle("quantizeOffset");
+	QuantizeScale = vs->GetVariableHandle("quantizeScale");
+	PerObject = vs->GetBufferHandle("PerObject");
+}
+
+void ObjectConstantHandles::Upload(ConstantRing* constantRing)
+{
+	if (!PerObject.IsValid())
+		return;
+	if (!constantRing || !constantRing->BindVertexConstants(Shader->GetBufferInfo(PerObject.Index)))
+		Shader->CopyBufferData(PerObject);
+}
+
 GameEntity::GameEntity(std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> material)
 {
 	this->mesh = mesh;
@@ -17,6 +37,20 @@ std::shared_ptr<Mesh> GameEntity::GetMesh()
 	return mesh;
 }
 
+void GameEntity::SetPlaceholderMesh(std::shared_ptr<Mesh> placeholder)
+{
+	this->placeholder = placeholder;
+}
+
+std::shared_ptr<Mesh> GameEntity::GetDrawMesh()
+{
+	if (mesh->IsReady())
+		return mesh;
+	if (placeholder && placeholder->IsReady())
+		return placeholder;
+	return nullptr;
+}
+
 Transform* GameEntity::GetTransform()
 {
 	return &transform;
@@ -32,36 +66,131 @@ void GameEntity::SetMaterial(std::shared_ptr<Material>)
 	this->material = material;
 }
 
-void GameEntity::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext,
-	std::shared_ptr<Camera> camera)
+unsigned int GameEntity::GetLastLod()
+{
+	return lastLod;
+}
+
+const ClusterCullStats& GameEntity::GetLastCullStats()
+{
+	return lastCullStats;
+}
+
+// --------------------------------------------------------
+// Picks a level of detail from the mesh's screen space error
+//
+// The mesh bounds become a world space sphere, and the error of
+// each level is projected from the sphere's closest point to the
+// camera, so nothing gets coarser than it looks
+// --------------------------------------------------------
+unsigned int GameEntity::SelectLod(std::shared_ptr<Camera> camera, float viewportHeight, float maxPixelError)
 {
-	//Activate the Shaders for this material
-	material->GetVertexShader()->SetShader();
-	material->GetPixelShader()->SetShader();
+	if (viewportHeight <= 0 || mesh->GetLodCount() <= 1)
+		return 0;
+
+	XMFLOAT3 boundsCenter = mesh->GetBoundsCenter();
+	XMFLOAT4X4 world = transform.GetWorldMatrix();
+	XMVECTOR center = XMVector3Transform(XMLoadFloat3(&boundsCenter), XMLoadFloat4x4(&world));
+
+	// Errors scale with the entity, so use the largest axis
+	XMFLOAT3 scale = transform.GetScale();
+	XMVECTOR absScale = XMVectorAbs(XMLoadFloat3(&scale));
+	float maxScale = XMVectorGetX(XMVectorMax(absScale, XMVectorMax(XMVectorSplatY(absScale), XMVectorSplatZ(absScale))));
+	float radius = mesh->GetBoundsRadius() * maxScale;
+
+	XMFLOAT3 cameraPos = camera->GetPosition();
+	float distance = XMVectorGetX(XMVector3Length(center - XMLoadFloat3(&cameraPos))) - radius;
+	if (distance < 0.1f)
+		distance = 0.1f;	// Near plane
+
+	unsigned int lod = 0;
+	for (unsigned int i = 1; i < mesh->GetLodCount(); i++)
+	{
+		if (camera->GetScreenSpaceError(mesh->GetLod(i).Error * maxScale, distance, viewportHeight) > maxPixelError)
+			break;
+		lod = i;
+	}
+	return lod;
+}
+
+unsigned int GameEntity::PrepareInstance(std::shared_ptr<Camera> camera, float viewportHeight, float maxPixelError)
+{
+	lastCullStats = ClusterCullStats();
+	lastLod = GetDrawMesh() == mesh ? SelectLod(camera, viewportHeight, maxPixelError) : 0;
+	return lastLod;
+}
 
-	//Set up material with texture
-	material->PrepareMaterial();
+std::shared_ptr<SimpleVertexShader> GameEntity::GetVertexShader()
+{
+	std::shared_ptr<Mesh> drawMesh = GetDrawMesh();
+	return drawMesh ? material->GetVertexShader(drawMesh->HasPackedVertices()) : 0;
+}
 
+void GameEntity::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext,
+	std::shared_ptr<Camera> camera,
+	float viewportHeight,
+	float maxPixelError,
+	bool cullClusters)
+{
 	//Define what the shaders will do, now using SimpleShader and our Material!
-	std::shared_ptr<SimpleVertexShader> vs = material->GetVertexShader();
-	std::shared_ptr<SimplePixelShader> ps = material->GetPixelShader();
+	std::shared_ptr<SimpleVertexShader> vs = GetVertexShader();
+	if (vs)
+	{
+		//Activate the Shaders for this material
+		vs->SetShader();
+		material->GetPixelShader()->SetShader();
+
+		//Set up material with texture (and its constants, if they changed)
+		material->PrepareMaterial();
+	}
+
+	DrawObject(camera, viewportHeight, maxPixelError, cullClusters);
+}
+
+void GameEntity::DrawObject(std::shared_ptr<Camera> camera,
+	float viewportHeight,
+	float maxPixelError,
+	bool cullClusters,
+	ConstantRing* constantRing)
+{
+	//Meshes still loading draw their placeholder, or nothing
+	std::shared_ptr<Mesh> drawMesh = GetDrawMesh();
+	lastLod = 0;
+	lastCullStats = ClusterCullStats();
+	if (!drawMesh)
+		return;
 
-	//Pixel Shader References
-	ps->SetFloat4("colorTint", material->GetColorTint()); // Strings here MUST
-	ps->SetFloat3("cameraPos", camera->GetTransform().GetPosition());
-	ps->SetFloat("roughness", material->GetRoughness());
-	ps->SetFloat2("uvScale", material->GetUVScale());
+	std::shared_ptr<SimpleVertexShader> vs = material->GetVertexShader(drawMesh->HasPackedVertices());
+	objectHandles.Resolve(vs.get());
 
-	//Vertex Shader References
-	vs->SetMatrix4x4("world", transform.GetWorldMatrix());
-	vs->SetMatrix4x4("view", camera->GetViewMatrix());
-	vs->SetMatrix4x4("projection", camera->GetProjectionMatrix());
-	vs->SetMatrix4x4("worldInvTranspose", transform.GetInveseTranspose());
+	//Camera and lights are already in the PerFrame buffers, so only this object's block goes up
+	const TransformPacket& packet = transform.GetPacket();
+	vs->SetData(objectHandles.World, &packet.World, sizeof(packet.World));
+	vs->SetData(objectHandles.NormalMatrix, &packet.Normal, TRANSFORM_NORMAL_MATRIX_BYTES);
+	if (drawMesh->HasPackedVertices())
+	{
+		vs->SetFloat3(objectHandles.QuantizeOffset, drawMesh->GetQuantization().Offset);
+		vs->SetFloat3(objectHandles.QuantizeScale, drawMesh->GetQuantization().Scale);
+	}
+	objectHandles.Upload(constantRing);
 
-	//Map resource to the GPU itself
-	vs->CopyAllBufferData();
-	ps->CopyAllBufferData();
+	//Placeholders are just a stand-in, so skip the extras
+	if (drawMesh != mesh)
+	{
+		drawMesh->Draw();
+		return;
+	}
 
 	//Call draw functions on Mesh Class
-	mesh->Draw();
+	lastLod = SelectLod(camera, viewportHeight, maxPixelError);
+	if (cullClusters)
+	{
+		ClusterCullView view = MakeClusterCullView(transform.GetWorldMatrix(),
+			camera->GetViewMatrix(), camera->GetProjectionMatrix(), camera->GetPosition());
+		mesh->DrawClusters(lastLod, view, &lastCullStats);
+	}
+	else
+	{
+		mesh->Draw(lastLod);
+	}
 }
@@ -3,8 +3,30 @@
 #include "Mesh.h"
 #include "Camera.h"
 #include "Material.h"
+#include "ConstantRing.h"
 #include <iostream>
 
+// --------------------------------------------------------
+// The PerObject constants of one vertex shader, looked up by
+// name once instead of on every draw
+// --------------------------------------------------------
+struct ObjectConstantHandles
+{
+	SimpleVertexShader* Shader = 0;
+	SimpleVariableHandle World;
+	SimpleVariableHandle NormalMatrix;
+	SimpleVariableHandle QuantizeOffset;
+	SimpleVariableHandle QuantizeScale;
+	SimpleBufferHandle PerObject;
+
+	// Does nothing if they're already vs's
+	void Resolve(SimpleVertexShader* vs);
+
+	// Sends the PerObject block through the ring (when there is one and
+	// it has room), or copies it into the shader's own buffer
+	void Upload(ConstantRing* constantRing);
+};
+
 class GameEntity
 {
 public:
@@ -12,16 +34,55 @@ public:
 	~GameEntity();
 
 	std::shared_ptr<Mesh> GetMesh();
+
+	// Drawn instead of the mesh until it finishes loading (null draws nothing)
+	void SetPlaceholderMesh(std::shared_ptr<Mesh> placeholder);
+	// Whichever of the two Draw() would use right now (may be null)
+	std::shared_ptr<Mesh> GetDrawMesh();
 	Transform* GetTransform();
 	std::shared_ptr<Material> GetMaterial();
 	void SetMaterial(std::shared_ptr<Material>);
 
+	// Draws the coarsest level of detail whose error stays under
+	// maxPixelError on screen (viewportHeight 0 always uses full detail),
+	// optionally skipping clusters that face away or are off screen
 	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext,
-		std::shared_ptr<Camera> camera);
+		std::shared_ptr<Camera> camera,
+		float viewportHeight = 0,
+		float maxPixelError = 1.0f,
+		bool cullClusters = false);
+
+	// Same as Draw(), but leaves setting the shaders and preparing the
+	// material to the caller (a render queue that only does it when they change)
+	void DrawObject(std::shared_ptr<Camera> camera,
+		float viewportHeight = 0,
+		float maxPixelError = 1.0f,
+		bool cullClusters = false,
+		ConstantRing* constantRing = 0);
+
+	// Picks the level of detail for a draw the caller makes itself (one
+	// instance of many), so GetLastLod() still reports it.  Placeholders
+	// always use level 0
+	unsigned int PrepareInstance(std::shared_ptr<Camera> camera, float viewportHeight, float maxPixelError);
+
+	// The vertex shader for the mesh Draw() would use right now (null if there's none)
+	std::shared_ptr<SimpleVertexShader> GetVertexShader();
+
+	unsigned int SelectLod(std::shared_ptr<Camera> camera, float viewportHeight, float maxPixelError);
+	unsigned int GetLastLod();
+	const ClusterCullStats& GetLastCullStats();
 
 private:
 	Transform transform;
 	std::shared_ptr<Mesh> mesh;
+	std::shared_ptr<Mesh> placeholder;
 	std::shared_ptr<Material> material;
+
+	// Level of detail picked and clusters culled by the last Draw()
+	unsigned int lastLod = 0;
+	ClusterCullStats lastCullStats;
+
+	// For whichever vertex shader drew it last
+	ObjectConstantHandles objectHandles;
 };
 
@@ -0,0 +1,170 @@
+#include "GeometryAllocator.h"
+
+#include <algorithm>
+
+GeometryAllocator::GeometryAllocator(unsigned int capacity)
+{
+	this->capacity = capacity;
+	this->used = 0;
+	if (capacity > 0)
+	{
+		Block all = { 0, capacity };
+		freeBlocks.push_back(all);
+	}
+}
+
+unsigned int GeometryAllocator::Allocate(unsigned int size)
+{
+	if (size == 0)
+		return GEOMETRY_INVALID_ALLOCATION;
+
+	// Best fit
+	size_t best = freeBlocks.size();
+	for (size_t i = 0; i < freeBlocks.size(); i++)
+	{
+		if (freeBlocks[i].Size >= size && (best == freeBlocks.size() || freeBlocks[i].Size < freeBlocks[best].Size))
+		{
+			best = i;
+			if (freeBlocks[i].Size == size)
+				break;
+		}
+	}
+	if (best == freeBlocks.size())
+		return GEOMETRY_INVALID_ALLOCATION;
+
+	Block allocation = { freeBlocks[best].Offset, size };
+	freeBlocks[best].Offset += size;
+	freeBlocks[best].Size -= size;
+	if (freeBlocks[best].Size == 0)
+		freeBlocks.erase(freeBlocks.begin() + best);
+	used += size;
+
+	unsigned int handle;
+	if (!freeHandles.empty())
+	{
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+		allocations[handle] = allocation;
+	}
+	else
+	{
+		handle = (unsigned int)allocations.size();
+		allocations.push_back(allocation);
+	}
+	return handle;
+}
+
+void GeometryAllocator::Free(unsigned int allocation)
+{
+	if (allocation >= allocations.size() || allocations[allocation].Size == 0)
+		return;
+
+	Block block = allocations[allocation];
+	allocations[allocation].Size = 0;
+	freeHandles.push_back(allocation);
+	used -= block.Size;
+
+	// Find where it goes, then merge with whichever neighbours it touches
+	auto next = std::lower_bound(freeBlocks.begin(), freeBlocks.end(), block,
+		[](const Block& a, const Block& b) { return a.Offset < b.Offset; });
+	bool touchesNext = next != freeBlocks.end() && block.Offset + block.Size == next->Offset;
+	bool touchesPrevious = next != freeBlocks.begin() && (next - 1)->Offset + (next - 1)->Size == block.Offset;
+
+	if (touchesPrevious && touchesNext)
+	{
+		(next - 1)->Size += block.Size + next->Size;
+		freeBlocks.erase(next);
+	}
+	else if (touchesPrevious)
+	{
+		(next - 1)->Size += block.Size;
+	}
+	else if (touchesNext)
+	{
+		next->Offset = block.Offset;
+		next->Size += block.Size;
+	}
+	else
+	{
+		freeBlocks.insert(next, block);
+	}
+}
+
+unsigned int GeometryAllocator::GetOffset(unsigned int allocation) const
+{
+	return allocations[allocation].Offset;
+}
+
+unsigned int GeometryAllocator::GetSize(unsigned int allocation) const
+{
+	return allocations[allocation].Size;
+}
+
+unsigned int GeometryAllocator::GetCapacity() const
+{
+	return capacity;
+}
+
+void GeometryAllocator::Grow(unsigned int newCapacity)
+{
+	if (newCapacity <= capacity)
+		return;
+
+	if (!freeBlocks.empty() && freeBlocks.back().Offset + freeBlocks.back().Size == capacity)
+	{
+		freeBlocks.back().Size += newCapacity - capacity;
+	}
+	else
+	{
+		Block added = { capacity, newCapacity - capacity };
+		freeBlocks.push_back(added);
+	}
+	capacity = newCapacity;
+}
+
+void GeometryAllocator::Defragment(std::vector<GeometryMove>& moves)
+{
+	moves.clear();
+
+	// Live handles in offset order
+	std::vector<unsigned int> live;
+	for (unsigned int i = 0; i < allocations.size(); i++)
+	{
+		if (allocations[i].Size > 0)
+			live.push_back(i);
+	}
+	std::sort(live.begin(), live.end(),
+		[this](unsigned int a, unsigned int b) { return allocations[a].Offset < allocations[b].Offset; });
+
+	unsigned int offset = 0;
+	for (unsigned int handle : live)
+	{
+		Block& allocation = allocations[handle];
+		if (allocation.Offset != offset)
+		{
+			GeometryMove move = { handle, allocation.Offset, offset, allocation.Size };
+			moves.push_back(move);
+			allocation.Offset = offset;
+		}
+		offset += allocation.Size;
+	}
+
+	freeBlocks.clear();
+	if (offset < capacity)
+	{
+		Block rest = { offset, capacity - offset };
+		freeBlocks.push_back(rest);
+	}
+}
+
+GeometryAllocatorStats GeometryAllocator::GetStats() const
+{
+	GeometryAllocatorStats stats;
+	stats.Capacity = capacity;
+	stats.Used = used;
+	stats.Allocations = (unsigned int)(allocations.size() - freeHandles.size());
+	stats.FreeBlocks = (unsigned int)freeBlocks.size();
+	for (const Block& block : freeBlocks)
+		stats.LargestFreeBlock = std::max(stats.LargestFreeBlock, block.Size);
+	return stats;
+}
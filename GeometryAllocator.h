@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+
+// Returned when an allocation doesn't fit
+#define GEOMETRY_INVALID_ALLOCATION	0xFFFFFFFF
+
+// --------------------------------------------------------
+// One allocation moved by GeometryAllocator::Defragment()
+// --------------------------------------------------------
+struct GeometryMove
+{
+	unsigned int Allocation;
+	unsigned int OldOffset;
+	unsigned int NewOffset;
+	unsigned int Size;
+};
+
+// --------------------------------------------------------
+// Numbers for the INFO window
+// --------------------------------------------------------
+struct GeometryAllocatorStats
+{
+	unsigned int Capacity = 0;
+	unsigned int Used = 0;
+	unsigned int Allocations = 0;
+	unsigned int FreeBlocks = 0;
+	unsigned int LargestFreeBlock = 0;
+
+	// 0 when all free space is one block, towards 1 as it splinters
+	float Fragmentation() const
+	{
+		unsigned int free = Capacity - Used;
+		return free > 0 ? 1.0f - (float)LargestFreeBlock / free : 0.0f;
+	}
+};
+
+// --------------------------------------------------------
+// Hands out ranges of [0, capacity) - elements of a big GPU
+// buffer, though nothing here knows that
+//
+// Free space is a list of blocks sorted by offset, so freeing
+// merges with both neighbours in one pass.  Allocations take
+// the smallest block they fit in (best fit keeps big blocks
+// whole for big meshes).  Allocations are identified by a
+// handle rather than their offset, since Defragment() moves
+// them
+// --------------------------------------------------------
+class GeometryAllocator
+{
+public:
+	GeometryAllocator(unsigned int capacity = 0);
+
+	// Returns a handle, or GEOMETRY_INVALID_ALLOCATION if no block is big enough
+	unsigned int Allocate(unsigned int size);
+	void Free(unsigned int allocation);
+
+	unsigned int GetOffset(unsigned int allocation) const;
+	unsigned int GetSize(unsigned int allocation) const;
+	unsigned int GetCapacity() const;
+
+	// Adds space to the end (the new space joins the last free block if it touches it)
+	void Grow(unsigned int newCapacity);
+
+	// Slides every allocation down to close the gaps, keeping their
+	// order, and reports what moved (lowest offsets first, so copying
+	// in that order never overwrites data still to be copied)
+	void Defragment(std::vector<GeometryMove>& moves);
+
+	GeometryAllocatorStats GetStats() const;
+
+private:
+	struct Block
+	{
+		unsigned int Offset;
+		unsigned int Size;
+	};
+
+	unsigned int capacity;
+	unsigned int used;
+	std::vector<Block> freeBlocks;			// Sorted by offset, never touching
+	std::vector<Block> allocations;			// By handle (Size 0 when the handle is free)
+	std::vector<unsigned int> freeHandles;
+};
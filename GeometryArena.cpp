@@ -0,0 +1,228 @@
+#include "GeometryArena.h"
+#include "StateCache.h"
+
+GeometryArena* GeometryArena::instance;
+
+void GeometryArena::Initialize(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	this->device = device;
+	this->context = context;
+}
+
+GeometryRange GeometryArena::Allocate(
+	const void* vertexData,
+	unsigned int vertexCount,
+	unsigned int vertexStride,
+	const void* indexData,
+	unsigned int indexCount,
+	DXGI_FORMAT indexFormat)
+{
+	GeometryRange range;
+	if (vertexCount == 0 || indexCount == 0)
+		return range;
+
+	range.Pool = FindPool(vertexStride, indexFormat);
+	Pool& pool = pools[range.Pool];
+	range.Vertices = AllocateIn(pool.Vertices, pool.VertexBuffer, pool.VertexStride, D3D11_BIND_VERTEX_BUFFER, vertexCount);
+	range.Indices = AllocateIn(pool.Indices, pool.IndexBuffer, pool.IndexStride, D3D11_BIND_INDEX_BUFFER, indexCount);
+
+	Write(pool.VertexBuffer.Get(), pool.Vertices.GetOffset(range.Vertices) * pool.VertexStride, vertexData, vertexCount * pool.VertexStride);
+	Write(pool.IndexBuffer.Get(), pool.Indices.GetOffset(range.Indices) * pool.IndexStride, indexData, indexCount * pool.IndexStride);
+	return range;
+}
+
+void GeometryArena::Free(GeometryRange& range)
+{
+	if (!range.IsValid())
+		return;
+
+	pools[range.Pool].Vertices.Free(range.Vertices);
+	pools[range.Pool].Indices.Free(range.Indices);
+	range = GeometryRange();
+}
+
+unsigned int GeometryArena::GetBaseVertex(const GeometryRange& range)
+{
+	return pools[range.Pool].Vertices.GetOffset(range.Vertices);
+}
+
+unsigned int GeometryArena::GetFirstIndex(const GeometryRange& range)
+{
+	return pools[range.Pool].Indices.GetOffset(range.Indices);
+}
+
+Microsoft::WRL::ComPtr<ID3D11Buffer> GeometryArena::GetVertexBuffer(const GeometryRange& range)
+{
+	return range.IsValid() ? pools[range.Pool].VertexBuffer : nullptr;
+}
+
+Microsoft::WRL::ComPtr<ID3D11Buffer> GeometryArena::GetIndexBuffer(const GeometryRange& range)
+{
+	return range.IsValid() ? pools[range.Pool].IndexBuffer : nullptr;
+}
+
+void GeometryArena::Bind(Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext, const GeometryRange& range)
+{
+	if (range.Pool == boundPool)
+	{
+		bindsAvoided++;
+		return;
+	}
+
+	Pool& pool = pools[range.Pool];
+	StateCache& stateCache = StateCache::GetInstance();
+	stateCache.SetVertexBuffer(0, pool.VertexBuffer.Get(), pool.VertexStride, 0);
+	stateCache.SetIndexBuffer(pool.IndexBuffer.Get(), pool.IndexFormat, 0);
+	boundPool = range.Pool;
+	binds++;
+}
+
+void GeometryArena::BeginFrame()
+{
+	lastFrameBinds = binds;
+	lastFrameBindsAvoided = bindsAvoided;
+	binds = 0;
+	bindsAvoided = 0;
+	boundPool = GEOMETRY_INVALID_ALLOCATION;
+}
+
+void GeometryArena::Defragment()
+{
+	for (Pool& pool : pools)
+	{
+		DefragmentBuffer(pool.Vertices, pool.VertexBuffer, pool.VertexStride);
+		DefragmentBuffer(pool.Indices, pool.IndexBuffer, pool.IndexStride);
+	}
+}
+
+unsigned int GeometryArena::GetPoolCount()
+{
+	return (unsigned int)pools.size();
+}
+
+GeometryPoolStats GeometryArena::GetPoolStats(unsigned int pool)
+{
+	GeometryPoolStats stats;
+	stats.VertexStride = pools[pool].VertexStride;
+	stats.IndexFormat = pools[pool].IndexFormat;
+	stats.Vertices = pools[pool].Vertices.GetStats();
+	stats.Indices = pools[pool].Indices.GetStats();
+	return stats;
+}
+
+unsigned int GeometryArena::GetLastFrameBinds()
+{
+	return lastFrameBinds;
+}
+
+unsigned int GeometryArena::GetLastFrameBindsAvoided()
+{
+	return lastFrameBindsAvoided;
+}
+
+unsigned int GeometryArena::FindPool(unsigned int vertexStride, DXGI_FORMAT indexFormat)
+{
+	for (unsigned int i = 0; i < pools.size(); i++)
+	{
+		if (pools[i].VertexStride == vertexStride && pools[i].IndexFormat == indexFormat)
+			return i;
+	}
+
+	Pool pool;
+	pool.VertexStride = vertexStride;
+	pool.IndexFormat = indexFormat;
+	pool.IndexStride = indexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4;
+	pool.Vertices = GeometryAllocator(GEOMETRY_ARENA_VERTICES);
+	pool.Indices = GeometryAllocator(GEOMETRY_ARENA_INDICES);
+	pool.VertexBuffer = CreateBuffer(GEOMETRY_ARENA_VERTICES * vertexStride, D3D11_BIND_VERTEX_BUFFER);
+	pool.IndexBuffer = CreateBuffer(GEOMETRY_ARENA_INDICES * pool.IndexStride, D3D11_BIND_INDEX_BUFFER);
+	pools.push_back(pool);
+	return (unsigned int)pools.size() - 1;
+}
+
+// --------------------------------------------------------
+// Allocates from one of a pool's buffers.  When nothing fits,
+// compacting is tried first if there's enough free space in
+// total, then the buffer doubles (or more, for huge meshes)
+// and the old contents are copied across on the GPU
+// --------------------------------------------------------
+unsigned int GeometryArena::AllocateIn(
+	GeometryAllocator& allocator,
+	Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer,
+	unsigned int stride,
+	UINT bindFlags,
+	unsigned int count)
+{
+	unsigned int allocation = allocator.Allocate(count);
+	if (allocation != GEOMETRY_INVALID_ALLOCATION)
+		return allocation;
+
+	GeometryAllocatorStats stats = allocator.GetStats();
+	if (stats.Capacity - stats.Used >= count)
+	{
+		DefragmentBuffer(allocator, buffer, stride);
+		return allocator.Allocate(count);
+	}
+
+	unsigned int oldCapacity = allocator.GetCapacity();
+	unsigned int newCapacity = oldCapacity * 2 > stats.Used + count ? oldCapacity * 2 : stats.Used + count;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> grown = CreateBuffer(newCapacity * stride, bindFlags);
+	D3D11_BOX box = { 0, 0, 0, oldCapacity * stride, 1, 1 };
+	context->CopySubresourceRegion(grown.Get(), 0, 0, 0, 0, buffer.Get(), 0, &box);
+	buffer = grown;
+	allocator.Grow(newCapacity);
+
+	// The old buffer might be the bound one
+	boundPool = GEOMETRY_INVALID_ALLOCATION;
+	return allocator.Allocate(count);
+}
+
+// --------------------------------------------------------
+// Slides everything down to close the gaps.  Copies within one
+// resource can't overlap, so the moves read from a snapshot
+// of the buffer and write back into it (which also means the
+// buffer itself, and any binding of it, stays the same)
+// --------------------------------------------------------
+void GeometryArena::DefragmentBuffer(GeometryAllocator& allocator, Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer, unsigned int stride)
+{
+	std::vector<GeometryMove> moves;
+	allocator.Defragment(moves);
+	if (moves.empty())
+		return;
+
+	D3D11_BUFFER_DESC desc;
+	buffer->GetDesc(&desc);
+	Microsoft::WRL::ComPtr<ID3D11Buffer> snapshot = CreateBuffer(desc.ByteWidth, desc.BindFlags);
+	context->CopyResource(snapshot.Get(), buffer.Get());
+
+	for (const GeometryMove& move : moves)
+	{
+		D3D11_BOX box = { move.OldOffset * stride, 0, 0, (move.OldOffset + move.Size) * stride, 1, 1 };
+		context->CopySubresourceRegion(buffer.Get(), 0, move.NewOffset * stride, 0, 0, snapshot.Get(), 0, &box);
+	}
+}
+
+// --------------------------------------------------------
+// Pool buffers are DEFAULT rather than IMMUTABLE, since meshes
+// are written into them one range at a time
+// --------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3D11Buffer> GeometryArena::CreateBuffer(unsigned int bytes, UINT bindFlags)
+{
+	D3D11_BUFFER_DESC desc = {};
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.ByteWidth = bytes;
+	desc.BindFlags = bindFlags;
+	desc.CPUAccessFlags = 0;
+	desc.MiscFlags = 0;
+	desc.StructureByteStride = 0;
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	device->CreateBuffer(&desc, 0, buffer.GetAddressOf());
+	return buffer;
+}
+
+void GeometryArena::Write(ID3D11Buffer* buffer, unsigned int offsetBytes, const void* data, unsigned int bytes)
+{
+	D3D11_BOX box = { offsetBytes, 0, 0, offsetBytes + bytes, 1, 1 };
+	context->UpdateSubresource(buffer, 0, &box, data, 0, 0);
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <wrl/client.h>
+#include <d3d11.h>
+#include <vector>
+#include "GeometryAllocator.h"
+
+// Starting size of each pool, in vertices and indices (pools grow as needed)
+#define GEOMETRY_ARENA_VERTICES	(64 * 1024)
+#define GEOMETRY_ARENA_INDICES	(256 * 1024)
+
+// --------------------------------------------------------
+// Where one mesh's geometry lives within the arena
+// --------------------------------------------------------
+struct GeometryRange
+{
+	unsigned int Pool = GEOMETRY_INVALID_ALLOCATION;
+	unsigned int Vertices = GEOMETRY_INVALID_ALLOCATION;
+	unsigned int Indices = GEOMETRY_INVALID_ALLOCATION;
+
+	bool IsValid() const { return Pool != GEOMETRY_INVALID_ALLOCATION; }
+};
+
+// --------------------------------------------------------
+// One vertex layout's shared buffers, for the INFO window
+// --------------------------------------------------------
+struct GeometryPoolStats
+{
+	unsigned int VertexStride;
+	DXGI_FORMAT IndexFormat;
+	GeometryAllocatorStats Vertices;
+	GeometryAllocatorStats Indices;
+};
+
+// --------------------------------------------------------
+// Every mesh's vertices and indices, sub-allocated from a few
+// big buffers
+//
+// There's one pool (a vertex buffer and an index buffer) per
+// vertex stride and index format, and a mesh is just a range
+// of each.  Draws pass the range's start as the base vertex
+// and first index, so consecutive draws from the same pool
+// never touch the input assembler.  Binding is tracked from
+// BeginFrame() on, since anything else (ImGui, SpriteBatch)
+// may bind its own buffers between frames
+// --------------------------------------------------------
+class GeometryArena
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static GeometryArena& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new GeometryArena();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	GeometryArena(GeometryArena const&) = delete;
+	void operator=(GeometryArena const&) = delete;
+
+private:
+	static GeometryArena* instance;
+	GeometryArena() {};
+#pragma endregion
+
+public:
+	void Initialize(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// Copies the geometry into the pool for its layout (creating or
+	// growing the pool if needed)
+	GeometryRange Allocate(
+		const void* vertexData,
+		unsigned int vertexCount,
+		unsigned int vertexStride,
+		const void* indexData,
+		unsigned int indexCount,
+		DXGI_FORMAT indexFormat);
+	void Free(GeometryRange& range);
+
+	unsigned int GetBaseVertex(const GeometryRange& range);
+	unsigned int GetFirstIndex(const GeometryRange& range);
+	Microsoft::WRL::ComPtr<ID3D11Buffer> GetVertexBuffer(const GeometryRange& range);
+	Microsoft::WRL::ComPtr<ID3D11Buffer> GetIndexBuffer(const GeometryRange& range);
+
+	// Sets the range's pool on the input assembler, unless it's already there
+	void Bind(Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext, const GeometryRange& range);
+	void BeginFrame();
+
+	// Closes the gaps left by freed meshes in every pool
+	void Defragment();
+
+	unsigned int GetPoolCount();
+	GeometryPoolStats GetPoolStats(unsigned int pool);
+	unsigned int GetLastFrameBinds();
+	unsigned int GetLastFrameBindsAvoided();
+
+private:
+	struct Pool
+	{
+		unsigned int VertexStride;
+		DXGI_FORMAT IndexFormat;
+		unsigned int IndexStride;
+		Microsoft::WRL::ComPtr<ID3D11Buffer> VertexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer> IndexBuffer;
+		GeometryAllocator Vertices;
+		GeometryAllocator Indices;
+	};
+
+	unsigned int FindPool(unsigned int vertexStride, DXGI_FORMAT indexFormat);
+	unsigned int AllocateIn(
+		GeometryAllocator& allocator,
+		Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer,
+		unsigned int stride,
+		UINT bindFlags,
+		unsigned int count);
+	void DefragmentBuffer(GeometryAllocator& allocator, Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer, unsigned int stride);
+	Microsoft::WRL::ComPtr<ID3D11Buffer> CreateBuffer(unsigned int bytes, UINT bindFlags);
+	void Write(ID3D11Buffer* buffer, unsigned int offsetBytes, const void* data, unsigned int bytes);
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::vector<Pool> pools;
+
+	unsigned int boundPool = GEOMETRY_INVALID_ALLOCATION;
+	unsigned int binds = 0;
+	unsigned int bindsAvoided = 0;
+	unsigned int lastFrameBinds = 0;
+	unsigned int lastFrameBindsAvoided = 0;
+};
@@ -0,0 +1,3 @@
+// Same as ShadowVertexShader.hlsl, with each instance's matrix from the instance buffer
+#define INSTANCED
+#include "ShadowVertexShader.hlsl"
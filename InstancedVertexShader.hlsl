@@ -0,0 +1,3 @@
+// Same as VertexShader.hlsl, with each instance's matrices from the instance buffer
+#define INSTANCED
+#include "VertexShader.hlsl"
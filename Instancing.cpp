@@ -0,0 +1,63 @@
+#include "Instancing.h"
+#include "StateCache.h"
+
+#include <cstring>
+
+InstanceBuffer::InstanceBuffer(Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	unsigned int stride)
+{
+	this->device = device;
+	this->context = context;
+	this->stride = stride;
+	capacity = 0;
+}
+
+void InstanceBuffer::Upload(const void* data, unsigned int count)
+{
+	if (count == 0)
+		return;
+
+	if (count > capacity)
+	{
+		unsigned int newCapacity = capacity ? capacity : 256;
+		while (newCapacity < count)
+			newCapacity *= 2;
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.ByteWidth = newCapacity * stride;
+		desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		buffer.Reset();
+		if (FAILED(device->CreateBuffer(&desc, 0, buffer.GetAddressOf())))
+		{
+			capacity = 0;
+			return;
+		}
+		capacity = newCapacity;
+	}
+
+	// Discarding hands back fresh memory, so the GPU can still be
+	// reading last frame's instances while these are written
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+	memcpy(mapped.pData, data, (size_t)count * stride);
+	context->Unmap(buffer.Get(), 0);
+}
+
+void InstanceBuffer::Bind()
+{
+	StateCache::GetInstance().SetVertexBuffer(1, buffer.Get(), stride, 0);
+}
+
+unsigned int InstanceBuffer::GetCapacity()
+{
+	return capacity;
+}
+
+unsigned int InstanceBuffer::GetStride()
+{
+	return stride;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+
+// Runs shorter than this are drawn one entity at a time
+#define INSTANCING_MIN_BATCH	2
+
+// --------------------------------------------------------
+// One draw call's worth of a pass: either a single entity
+// (InstanceCount 0, drawn with its own PerObject block), or
+// InstanceCount entities sharing the first one's mesh, level
+// of detail and material, whose transforms start at
+// FirstInstance in the instance buffer
+// --------------------------------------------------------
+struct DrawBatch
+{
+	unsigned int Entity = 0;
+	unsigned int Lod = 0;
+	unsigned int FirstInstance = 0;
+	unsigned int InstanceCount = 0;
+};
+
+// --------------------------------------------------------
+// A dynamic vertex buffer of per-instance data, refilled once
+// a frame and bound to the second input slot, where the
+// "_PER_INSTANCE" inputs of the instanced shaders read from.
+// It grows (to the next power of two) when a frame needs more
+// than it holds, and never shrinks
+// --------------------------------------------------------
+class InstanceBuffer
+{
+public:
+	InstanceBuffer(Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		unsigned int stride);
+
+	// Replaces the contents with count instances (discarding the old ones)
+	void Upload(const void* data, unsigned int count);
+
+	// Sets the buffer on input slot 1 (slot 0 is the mesh's vertices)
+	void Bind();
+
+	unsigned int GetCapacity();
+	unsigned int GetStride();
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	unsigned int stride;
+	unsigned int capacity;
+};
@@ -0,0 +1,75 @@
+#include "MappedFile.h"
+
+MappedFile::MappedFile() :
+	file(INVALID_HANDLE_VALUE),
+	mapping(0),
+	data(0),
+	size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+// --------------------------------------------------------
+// Maps the whole file for reading
+//
+// Returns false if the file could not be opened or is empty
+// (an empty file cannot be mapped)
+// --------------------------------------------------------
+bool MappedFile::Open(const char* filename)
+{
+	Close();
+
+	file = CreateFileA(
+		filename,
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		0,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+		0);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+	if (mapping == 0)
+	{
+		Close();
+		return false;
+	}
+
+	data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == 0)
+	{
+		Close();
+		return false;
+	}
+
+	size = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+// --------------------------------------------------------
+// Unmaps the view and releases the OS handles
+// --------------------------------------------------------
+void MappedFile::Close()
+{
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+
+	file = INVALID_HANDLE_VALUE;
+	mapping = 0;
+	data = 0;
+	size = 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <Windows.h>
+
+// --------------------------------------------------------
+// Read-only view of an entire file on disk
+//
+// The file is mapped into the address space rather than
+// copied, so the bytes are paged in by the OS on demand.
+// The view stays valid for the lifetime of this object.
+// --------------------------------------------------------
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	// Not copyable, since the object owns OS handles
+	MappedFile(MappedFile const&) = delete;
+	void operator=(MappedFile const&) = delete;
+
+	bool Open(const char* filename);
+	void Close();
+
+	bool IsOpen() { return data != 0; }
+	const char* GetData() { return data; }
+	size_t GetSize() { return size; }
+
+private:
+	HANDLE file;
+	HANDLE mapping;
+	const char* data;
+	size_t size;
+};
@@ -3,6 +3,8 @@
 
 using namespace std;
 
+Material* Material::uploadedMaterial = 0;
+
 Material::Material(DirectX::XMFLOAT4 colorTint, 
 	shared_ptr<SimplePixelShader> pixelShader,
 	shared_ptr<SimpleVertexShader> vertexShader,
@@ -14,10 +16,13 @@ Material::Material(DirectX::XMFLOAT4 colorTint,
 	this->vertexShader = vertexShader;
 	this->roughness = roughness;
 	this->uvScale = uvScale;
+	ResolveHandles();
 }
 
 Material::~Material()
 {
+	if (uploadedMaterial == this)
+		uploadedMaterial = 0;
 }
 
 std::shared_ptr<SimplePixelShader> Material::GetPixelShader()
@@ -30,6 +35,17 @@ std::shared_ptr<SimpleVertexShader> Material::GetVertexShader()
 	return vertexShader;
 }
 
+//Picks the vertex shader that matches the mesh's vertex layout
+std::shared_ptr<SimpleVertexShader> Material::GetVertexShader(bool packedVertices)
+{
+	return packedVertices && packedVertexShader ? packedVertexShader : vertexShader;
+}
+
+std::shared_ptr<SimpleVertexShader> Material::GetInstancedVertexShader(bool packedVertices)
+{
+	return packedVertices ? packedInstancedVertexShader : instancedVertexShader;
+}
+
 DirectX::XMFLOAT4 Material::GetColorTint()
 {
 	return colorTint;
@@ -48,6 +64,9 @@ DirectX::XMFLOAT2 Material::GetUVScale()
 void Material::SetPixelShader(shared_ptr<SimplePixelShader> pixelShader)
 {
 	this->pixelShader = pixelShader;
+	ResolveHandles();
+	if (uploadedMaterial == this)
+		uploadedMaterial = 0;
 }
 
 void Material::SetVertexShader(shared_ptr<SimpleVertexShader> vertexShader)
@@ -55,28 +74,69 @@ void Material::SetVertexShader(shared_ptr<SimpleVertexShader> vertexShader)
 	this->vertexShader = vertexShader;
 }
 
+void Material::SetPackedVertexShader(shared_ptr<SimpleVertexShader> packedVertexShader)
+{
+	this->packedVertexShader = packedVertexShader;
+}
+
+void Material::SetInstancedVertexShaders(shared_ptr<SimpleVertexShader> instancedVertexShader,
+	shared_ptr<SimpleVertexShader> packedInstancedVertexShader)
+{
+	this->instancedVertexShader = instancedVertexShader;
+	this->packedInstancedVertexShader = packedInstancedVertexShader;
+}
+
 void Material::SetColorTint(DirectX::XMFLOAT4 colorTint)
 {
 	this->colorTint = colorTint;
+	if (uploadedMaterial == this)
+		uploadedMaterial = 0;
 }
 
 void Material::SetUVScale(DirectX::XMFLOAT2 uvScale)
 {
 	this->uvScale = uvScale;
+	if (uploadedMaterial == this)
+		uploadedMaterial = 0;
 }
 
 void Material::AddTextureSRV(string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
 {
 	textureSRVs.insert({name, srv});
+	ResolveHandles();
 }
 
 void Material::AddSampler(string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler)
 {
 	samplers.insert({name, sampler});
+	ResolveHandles();
 }
+
+//Looks the names up once here, so preparing the material doesn't
+void Material::ResolveHandles()
+{
+	boundSRVs.clear();
+	boundSamplers.clear();
+	for (auto& t : textureSRVs) { boundSRVs.push_back({ pixelShader->GetShaderResourceViewHandle(t.first), t.second }); }
+	for (auto& s : samplers) { boundSamplers.push_back({ pixelShader->GetSamplerHandle(s.first), s.second }); }
+	colorTintHandle = pixelShader->GetVariableHandle("colorTint");
+	uvScaleHandle = pixelShader->GetVariableHandle("uvScale");
+	roughnessHandle = pixelShader->GetVariableHandle("roughness");
+	perMaterialHandle = pixelShader->GetBufferHandle("PerMaterial");
+}
+
 //Bind these resources to the pixel shader
 void Material::PrepareMaterial()
 {
-	for (auto& t : textureSRVs) { pixelShader->SetShaderResourceView(t.first.c_str(), t.second); }
-	for (auto& s : samplers) { pixelShader->SetSamplerState(s.first.c_str(), s.second); }
+	for (auto& t : boundSRVs) { pixelShader->SetShaderResourceView(t.first, t.second); }
+	for (auto& s : boundSamplers) { pixelShader->SetSamplerState(s.first, s.second); }
+
+	//Materials sharing a pixel shader share its buffer, so only the last one uploaded is still there
+	if (uploadedMaterial == this)
+		return;
+	pixelShader->SetFloat4(colorTintHandle, colorTint);
+	pixelShader->SetFloat2(uvScaleHandle, uvScale);
+	pixelShader->SetFloat(roughnessHandle, roughness);
+	pixelShader->CopyBufferData(perMaterialHandle);
+	uploadedMaterial = this;
 }
@@ -17,29 +17,52 @@ public:
 
 	std::shared_ptr<SimplePixelShader> GetPixelShader();
 	std::shared_ptr<SimpleVertexShader> GetVertexShader();
+	std::shared_ptr<SimpleVertexShader> GetVertexShader(bool packedVertices);
+	//Null if the material has no instanced variant for that layout
+	std::shared_ptr<SimpleVertexShader> GetInstancedVertexShader(bool packedVertices);
 	DirectX::XMFLOAT4 GetColorTint();
 	float GetRoughness();
 	DirectX::XMFLOAT2 GetUVScale();
 
 	void SetPixelShader(std::shared_ptr<SimplePixelShader> pixelShader);
 	void SetVertexShader(std::shared_ptr<SimpleVertexShader> vertexShader);
+	void SetPackedVertexShader(std::shared_ptr<SimpleVertexShader> packedVertexShader);
+	void SetInstancedVertexShaders(std::shared_ptr<SimpleVertexShader> instancedVertexShader,
+		std::shared_ptr<SimpleVertexShader> packedInstancedVertexShader);
 	void SetColorTint(DirectX::XMFLOAT4 colorTint);
 	void SetUVScale(DirectX::XMFLOAT2 uvScale);
 
 	void AddTextureSRV(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	void AddSampler(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler);
 
+	//Binds the textures and samplers, and uploads the PerMaterial
+	//constants unless they're what the pixel shader already has
 	void PrepareMaterial();
 
 private:
+	//Whose constants were uploaded last (cleared when that material changes)
+	static Material* uploadedMaterial;
+
 	DirectX::XMFLOAT4 colorTint;
 	std::shared_ptr<SimplePixelShader> pixelShader;
 	std::shared_ptr<SimpleVertexShader> vertexShader;
+	std::shared_ptr<SimpleVertexShader> packedVertexShader; //Variant for meshes with packed vertices
+	std::shared_ptr<SimpleVertexShader> instancedVertexShader; //Variants taking their matrices from an instance buffer
+	std::shared_ptr<SimpleVertexShader> packedInstancedVertexShader;
 	DirectX::XMFLOAT2 uvScale;
 	float roughness;
 
 	//Will use strings as keys to reference various textures/samplers a given material will need
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textureSRVs;
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11SamplerState>> samplers;
+
+	//The same, and the constants, looked up in the pixel shader whenever it or they change
+	std::vector<std::pair<SimpleSRVHandle, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>>> boundSRVs;
+	std::vector<std::pair<SimpleSamplerHandle, Microsoft::WRL::ComPtr<ID3D11SamplerState>>> boundSamplers;
+	SimpleVariableHandle colorTintHandle;
+	SimpleVariableHandle uvScaleHandle;
+	SimpleVariableHandle roughnessHandle;
+	SimpleBufferHandle perMaterialHandle;
+	void ResolveHandles();
 };
 
@@ -2,12 +2,25 @@
 #include <d3d11.h>
 #include "Vertex.h"
 #include "Mesh.h"
+#include "ObjParser.h"
+#include "MeshData.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "VertexPacking.h"
+#include "MeshSimplifier.h"
+#include "MeshClusters.h"
+#include "MeshTangents.h"
+#include "MeshLoader.h"
+#include "GeometryArena.h"
 #include <vector>
 #include <iostream>
-#include <fstream>
+#include <chrono>
+#include <cmath>
 
 using namespace DirectX;
 
+unsigned int Mesh::DrawCalls = 0;
+
 //Constructor
 Mesh::Mesh(
 	Vertex* vertexArray,
@@ -16,321 +29,198 @@ Mesh::Mesh(
 	int indexCounter,
 	Microsoft::WRL::ComPtr<ID3D11Device> device,
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext) 
+	: Mesh(deviceContext, "", false)
 {
-	this->deviceContext = deviceContext;
+	PreparedMesh prepared;
+	prepared.Stats.Name = "(hand made)";
 
-	// Create a VERTEX BUFFER
-	// - This holds the vertex data of triangles for a single object
-	// - This buffer is created on the GPU, which is where the data needs to
-	//    be if we want the GPU to act on it (as in: draw it to the screen)
-	D3D11_BUFFER_DESC vbd = {};
-	vbd.Usage = D3D11_USAGE_IMMUTABLE;	// Will NEVER change
-	vbd.ByteWidth = sizeof(Vertex) * verticies;       //number of vertices in the buffer
-	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER; // Tells Direct3D this is a vertex buffer
-	vbd.CPUAccessFlags = 0;	// Note: We cannot access the data from C++ (this is good)
-	vbd.MiscFlags = 0;
-	vbd.StructureByteStride = 0;
-	// Create the proper struct to hold the initial vertex data
-	D3D11_SUBRESOURCE_DATA initialVertexData = {};
-	initialVertexData.pSysMem = vertexArray; // pSysMem = Pointer to System Memory
-	// Actually create the buffer on the GPU with the initial data
-	device->CreateBuffer(&vbd, &initialVertexData, vertexBuffer.GetAddressOf());
-
-	// Create an INDEX BUFFER
-	// - This holds indices to elements in the vertex buffer
-	// - This is most useful when vertices are shared among neighboring triangles
-	// - This buffer is created on the GPU, which is where the data needs to
-	D3D11_BUFFER_DESC ibd = {};
-	ibd.Usage = D3D11_USAGE_IMMUTABLE;	// Will NEVER change
-	ibd.ByteWidth = sizeof(unsigned int) * indexCounter;	//number of indices in the buffer
-	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;	// Tells Direct3D this is an index buffer
-	ibd.CPUAccessFlags = 0;	// Note: We cannot access the data from C++ (this is good)
-	ibd.MiscFlags = 0;
-	ibd.StructureByteStride = 0;
-	// Specify the initial data for this buffer, similar to above
-	D3D11_SUBRESOURCE_DATA initialIndexData = {};
-	initialIndexData.pSysMem = indexArray; // pSysMem = Pointer to System Memory
-	// Actually create the buffer with the initial data
-	device->CreateBuffer(&ibd, &initialIndexData, indexBuffer.GetAddressOf());
+	//Hand made meshes only have the one level of detail
+	MeshLod lod = { 0, (unsigned int)indexCounter, 0.0f };
+	prepared.Lods.push_back(lod);
+
+	if (verticies > 0)
+	{
+		XMVECTOR minV = XMLoadFloat3(&vertexArray[0].Position);
+		XMVECTOR maxV = minV;
+		for (int i = 1; i < verticies; i++)
+		{
+			minV = XMVectorMin(minV, XMLoadFloat3(&vertexArray[i].Position));
+			maxV = XMVectorMax(maxV, XMLoadFloat3(&vertexArray[i].Position));
+		}
+		XMStoreFloat3(&prepared.BoundsMin, minV);
+		XMStoreFloat3(&prepared.BoundsMax, maxV);
+
+		XMVECTOR center = (minV + maxV) * 0.5f;
+		XMVECTOR maxLengthSq = XMVectorZero();
+		for (int i = 0; i < verticies; i++)
+			maxLengthSq = XMVectorMax(maxLengthSq, XMVector3LengthSq(XMLoadFloat3(&vertexArray[i].Position) - center));
+		prepared.BoundsRadius = sqrtf(XMVectorGetX(maxLengthSq));
+	}
+
+	PrepareGeometry(prepared, vertexArray, verticies, indexArray, indexCounter, sizeof(uint32_t), false);
+	Upload(prepared);
 }
 
 Mesh::Mesh(
 	const char* filename, 
 	Microsoft::WRL::ComPtr<ID3D11Device> device, 
-	Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext)
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext,
+	bool packVertices)
+	: Mesh(deviceContext, filename, packVertices)
 {
+	PreparedMesh prepared;
+	if (PrepareMesh(filename, packVertices, prepared))
+		Upload(prepared);
+}
 
-	// Author: Chris Cascioli
-// Purpose: Basic .OBJ 3D model loading, supporting positions, uvs and normals
-// 
-// - You are allowed to directly copy/paste this into your code base
-//   for assignments, given that you clearly cite that this is not
-//   code of your own design.
-//
-// - NOTE: You'll need to #include <fstream>
-
-
-// File input object
-	std::ifstream obj(filename);
-
-	// Check for successful open
-	if (!obj.is_open())
-		return;
-
-	// Variables used while reading the file
-	std::vector<XMFLOAT3> positions;	// Positions from the file
-	std::vector<XMFLOAT3> normals;		// Normals from the file
-	std::vector<XMFLOAT2> uvs;		// UVs from the file
-	std::vector<Vertex> verts;		// Verts we're assembling
-	std::vector<UINT> indices;		// Indices of these verts
-	int vertCounter = 0;			// Count of vertices
-	int indexCounter = 0;			// Count of indices
-	char chars[100];			// String for line reading
-
-	//Set class variables
+// --------------------------------------------------------
+// An empty mesh that draws nothing until Upload()
+// --------------------------------------------------------
+Mesh::Mesh(
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext,
+	const char* name,
+	bool packVertices)
+{
 	this->deviceContext = deviceContext;
+	this->indexCounter = 0;
+	this->vertexStride = sizeof(Vertex);
+	this->indexFormat = DXGI_FORMAT_R32_UINT;
+	this->packedVertices = packVertices;
+	this->ready = false;
+	this->boundsMin = XMFLOAT3(0, 0, 0);
+	this->boundsMax = XMFLOAT3(0, 0, 0);
+	this->boundsRadius = 0;
+	loadStats.Name = name;
+}
 
-	// Still have data left?
-	while (obj.good())
+// --------------------------------------------------------
+// Starts loading a mesh on the loader's threads and returns
+// it straight away.  It draws nothing until a later
+// MeshLoader::Update() creates its buffers
+// --------------------------------------------------------
+std::shared_ptr<Mesh> Mesh::LoadAsync(
+	MeshLoader& loader,
+	const char* filename,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext,
+	bool packVertices)
+{
+	std::shared_ptr<Mesh> mesh(new Mesh(deviceContext, filename, packVertices));
+
+	// Meshes dropped before they finish loading just never upload
+	std::weak_ptr<Mesh> pending = mesh;
+	loader.Load(filename, packVertices, [pending](PreparedMesh& prepared)
 	{
-		// Get the line (100 characters should be more than enough)
-		obj.getline(chars, 100);
+		std::shared_ptr<Mesh> mesh = pending.lock();
+		if (mesh && prepared.Succeeded)
+			mesh->Upload(prepared);
+	});
+	return mesh;
+}
 
-		// Check the type of line
-		if (chars[0] == 'v' && chars[1] == 'n')
-		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			XMFLOAT3 norm;
-			sscanf_s(
-				chars,
-				"vn %f %f %f",
-				&norm.x, &norm.y, &norm.z);
-
-			// Add to the list of normals
-			normals.push_back(norm);
-		}
-		else if (chars[0] == 'v' && chars[1] == 't')
-		{
-			// Read the 2 numbers directly into an XMFLOAT2
-			XMFLOAT2 uv;
-			sscanf_s(
-				chars,
-				"vt %f %f",
-				&uv.x, &uv.y);
-
-			// Add to the list of uv's
-			uvs.push_back(uv);
-		}
-		else if (chars[0] == 'v')
-		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			XMFLOAT3 pos;
-			sscanf_s(
-				chars,
-				"v %f %f %f",
-				&pos.x, &pos.y, &pos.z);
-
-			// Add to the positions
-			positions.push_back(pos);
-		}
-		else if (chars[0] == 'f')
-		{
-			// Read the face indices into an array
-			// NOTE: This assumes the given obj file contains
-			//  vertex positions, uv coordinates AND normals.
-			unsigned int i[12];
-			int numbersRead = sscanf_s(
-				chars,
-				"f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d",
-				&i[0], &i[1], &i[2],
-				&i[3], &i[4], &i[5],
-				&i[6], &i[7], &i[8],
-				&i[9], &i[10], &i[11]);
-
-			// If we only got the first number, chances are the OBJ
-			// file has no UV coordinates.  This isn't great, but we
-			// still want to load the model without crashing, so we
-			// need to re-read a different pattern (in which we assume
-			// there are no UVs denoted for any of the vertices)
-			if (numbersRead == 1)
-			{
-				// Re-read with a different pattern
-				numbersRead = sscanf_s(
-					chars,
-					"f %d//%d %d//%d %d//%d %d//%d",
-					&i[0], &i[2],
-					&i[3], &i[5],
-					&i[6], &i[8],
-					&i[9], &i[11]);
-
-				// The following indices are where the UVs should 
-				// have been, so give them a valid value
-				i[1] = 1;
-				i[4] = 1;
-				i[7] = 1;
-				i[10] = 1;
-
-				// If we have no UVs, create a single UV coordinate
-				// that will be used for all vertices
-				if (uvs.size() == 0)
-					uvs.push_back(XMFLOAT2(0, 0));
-			}
+// --------------------------------------------------------
+// Takes on everything the CPU side of loading worked out, and
+// copies the geometry to the GPU.  This is the only part of
+// loading that needs the device
+// --------------------------------------------------------
+void Mesh::Upload(PreparedMesh& prepared)
+{
+	lods = prepared.Lods;
+	clusters = prepared.Clusters;
+	boundsMin = prepared.BoundsMin;
+	boundsMax = prepared.BoundsMax;
+	boundsRadius = prepared.BoundsRadius;
+	packedVertices = prepared.Packed;
+	quantization = prepared.Quantization;
+	loadStats = prepared.Stats;
+
+	auto uploadStart = std::chrono::high_resolution_clock::now();
+	CreateBuffers(prepared.VertexData, prepared.VertexCount, prepared.VertexStride,
+		prepared.IndexData, prepared.IndexCount,
+		prepared.IndexStride == sizeof(uint16_t) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT);
+	loadStats.UploadSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - uploadStart).count();
+	loadStats.Seconds += loadStats.WaitSeconds + loadStats.UploadSeconds;
+	ready = true;
+}
 
-			// - Create the verts by looking up
-			//    corresponding data from vectors
-			// - OBJ File indices are 1-based, so
-			//    they need to be adusted
-			Vertex v1;
-			v1.Position = positions[i[0] - 1];
-			v1.UV = uvs[i[1] - 1];
-			v1.Normal = normals[i[2] - 1];
-
-			Vertex v2;
-			v2.Position = positions[i[3] - 1];
-			v2.UV = uvs[i[4] - 1];
-			v2.Normal = normals[i[5] - 1];
-
-			Vertex v3;
-			v3.Position = positions[i[6] - 1];
-			v3.UV = uvs[i[7] - 1];
-			v3.Normal = normals[i[8] - 1];
-
-			// The model is most likely in a right-handed space,
-			// especially if it came from Maya.  We want to convert
-			// to a left-handed space for DirectX.  This means we 
-			// need to:
-			//  - Invert the Z position
-			//  - Invert the normal's Z
-			//  - Flip the winding order
-			// We also need to flip the UV coordinate since DirectX
-			// defines (0,0) as the top left of the texture, and many
-			// 3D modeling packages use the bottom left as (0,0)
-
-			// Flip the UV's since they're probably "upside down"
-			v1.UV.y = 1.0f - v1.UV.y;
-			v2.UV.y = 1.0f - v2.UV.y;
-			v3.UV.y = 1.0f - v3.UV.y;
-
-			// Flip Z (LH vs. RH)
-			v1.Position.z *= -1.0f;
-			v2.Position.z *= -1.0f;
-			v3.Position.z *= -1.0f;
-
-			// Flip normal's Z
-			v1.Normal.z *= -1.0f;
-			v2.Normal.z *= -1.0f;
-			v3.Normal.z *= -1.0f;
-
-			// Add the verts to the vector (flipping the winding order)
-			verts.push_back(v1);
-			verts.push_back(v3);
-			verts.push_back(v2);
-			vertCounter += 3;
-
-			// Add three more indices
-			indices.push_back(indexCounter); indexCounter += 1;
-			indices.push_back(indexCounter); indexCounter += 1;
-			indices.push_back(indexCounter); indexCounter += 1;
-
-			// Was there a 4th face?
-			// - 12 numbers read means 4 faces WITH uv's
-			// - 8 numbers read means 4 faces WITHOUT uv's
-			if (numbersRead == 12 || numbersRead == 8)
-			{
-				// Make the last vertex
-				Vertex v4;
-				v4.Position = positions[i[9] - 1];
-				v4.UV = uvs[i[10] - 1];
-				v4.Normal = normals[i[11] - 1];
-
-				// Flip the UV, Z pos and normal's Z
-				v4.UV.y = 1.0f - v4.UV.y;
-				v4.Position.z *= -1.0f;
-				v4.Normal.z *= -1.0f;
-
-				// Add a whole triangle (flipping the winding order)
-				verts.push_back(v1);
-				verts.push_back(v4);
-				verts.push_back(v3);
-				vertCounter += 3;
-
-				// Add three more indices
-				indices.push_back(indexCounter); indexCounter += 1;
-				indices.push_back(indexCounter); indexCounter += 1;
-				indices.push_back(indexCounter); indexCounter += 1;
-			}
-		}
-	}
+// --------------------------------------------------------
+// Copies the geometry into the shared arena and remembers how
+// many indices to draw
+// --------------------------------------------------------
+void Mesh::CreateBuffers(
+	const void* vertexData,
+	int verticies,
+	unsigned int vertexStride,
+	const void* indexData,
+	int indexCounter,
+	DXGI_FORMAT indexFormat)
+{
+	// Instead of a vertex and index buffer per mesh, every mesh with the
+	// same layout shares one of each, so drawing one after another
+	// doesn't need the buffers set again (see GeometryArena)
+	geometry = GeometryArena::GetInstance().Allocate(vertexData, verticies, vertexStride, indexData, indexCounter, indexFormat);
 
-	// Close the file and create the actual buffers
-	obj.close();
-
-	// - At this point, "verts" is a vector of Vertex structs, and can be used
-	//    directly to create a vertex buffer:  &verts[0] is the address of the first vert
-	//
-	// - The vector "indices" is similar. It's a vector of unsigned ints and
-	//    can be used directly for the index buffer: &indices[0] is the address of the first int
-	//
-	// - "vertCounter" is the number of vertices
-	// - "indexCounter" is the number of indices
-	// - Yes, these are effectively the same since OBJs do not index entire vertices!  This means
-	//    an index buffer isn't doing much for us.  We could try to optimize the mesh ourselves
-	//    and detect duplicate vertices, but at that point it would be better to use a more
-	//    sophisticated model loading library like TinyOBJLoader or The Open Asset Importer Library
-
-	// Create a VERTEX BUFFER
-	// - This holds the vertex data of triangles for a single object
-	// - This buffer is created on the GPU, which is where the data needs to
-	//    be if we want the GPU to act on it (as in: draw it to the screen)
-	D3D11_BUFFER_DESC vbd = {};
-	vbd.Usage = D3D11_USAGE_IMMUTABLE;	// Will NEVER change
-	vbd.ByteWidth = sizeof(Vertex) * vertCounter;       //number of vertices in the buffer
-	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER; // Tells Direct3D this is a vertex buffer
-	vbd.CPUAccessFlags = 0;	// Note: We cannot access the data from C++ (this is good)
-	vbd.MiscFlags = 0;
-	vbd.StructureByteStride = 0;
-	// Create the proper struct to hold the initial vertex data
-	D3D11_SUBRESOURCE_DATA initialVertexData = {};
-	initialVertexData.pSysMem = &verts[0]; // pSysMem = Pointer to System Memory
-	// Actually create the buffer on the GPU with the initial data
-	device->CreateBuffer(&vbd, &initialVertexData, vertexBuffer.GetAddressOf());
-
-	// Create an INDEX BUFFER
-	// - This holds indices to elements in the vertex buffer
-	// - This is most useful when vertices are shared among neighboring triangles
-	// - This buffer is created on the GPU, which is where the data needs to
-	D3D11_BUFFER_DESC ibd = {};
-	ibd.Usage = D3D11_USAGE_IMMUTABLE;	// Will NEVER change
-	ibd.ByteWidth = sizeof(unsigned int) * indexCounter;	//number of indices in the buffer
-	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;	// Tells Direct3D this is an index buffer
-	ibd.CPUAccessFlags = 0;	// Note: We cannot access the data from C++ (this is good)
-	ibd.MiscFlags = 0;
-	ibd.StructureByteStride = 0;
-	// Specify the initial data for this buffer, similar to above
-	D3D11_SUBRESOURCE_DATA initialIndexData = {};
-	initialIndexData.pSysMem = &indices[0]; // pSysMem = Pointer to System Memory
-	// Actually create the buffer with the initial data
-	device->CreateBuffer(&ibd, &initialIndexData, indexBuffer.GetAddressOf());
-
-	//Set class index count
+	//Set class index count and layout
 	this->indexCounter = indexCounter;
+	this->vertexStride = vertexStride;
+	this->indexFormat = indexFormat;
 }
 
+
 //Destructor
 Mesh::~Mesh() {
-
+	GeometryArena::GetInstance().Free(geometry);
 }
 
 //Return Methods
 Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetVertexBuffer() {
-	return vertexBuffer;
+	return GeometryArena::GetInstance().GetVertexBuffer(geometry);
 }
 Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetIndexBuffer() {
-	return indexBuffer;
+	return GeometryArena::GetInstance().GetIndexBuffer(geometry);
 }
 unsigned int Mesh::GetIndexCount() {
 	return indexCounter;
 };
+unsigned int Mesh::GetLodCount() {
+	return (unsigned int)lods.size();
+}
+const MeshLod& Mesh::GetLod(unsigned int lod) {
+	//Meshes that failed to load draw nothing
+	static const MeshLod empty = { 0, 0, 0.0f };
+	if (lods.empty())
+		return empty;
+	return lods[lod < lods.size() ? lod : lods.size() - 1];
+}
+unsigned int Mesh::GetClusterCount() {
+	return (unsigned int)clusters.size();
+}
+XMFLOAT3 Mesh::GetBoundsMin() {
+	return boundsMin;
+}
+XMFLOAT3 Mesh::GetBoundsMax() {
+	return boundsMax;
+}
+XMFLOAT3 Mesh::GetBoundsCenter() {
+	return XMFLOAT3(
+		(boundsMin.x + boundsMax.x) * 0.5f,
+		(boundsMin.y + boundsMax.y) * 0.5f,
+		(boundsMin.z + boundsMax.z) * 0.5f);
+}
+float Mesh::GetBoundsRadius() {
+	return boundsRadius;
+}
+const MeshLoadStats& Mesh::GetLoadStats() {
+	return loadStats;
+}
+bool Mesh::IsReady() {
+	return ready;
+}
+bool Mesh::HasPackedVertices() {
+	return packedVertices;
+}
+const VertexQuantization& Mesh::GetQuantization() {
+	return quantization;
+}
 
 // --------------------------------------------------------
 // Author: Chris Cascioli
@@ -427,18 +317,21 @@ void Mesh::CalculateTangents(
 }
 
 //Draw Meshes
-void Mesh::Draw() {
+void Mesh::Draw(unsigned int lod) {
+
+	//Still loading (or failed to)
+	if (!ready)
+		return;
+
+	//Each level of detail is its own range of the index buffer
+	const MeshLod& range = GetLod(lod);
 
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
 	{
 		// Set buffers in the input assembler (IA) stage
-		//  - Do this ONCE PER OBJECT, since each object may have different geometry
-		//  - For this demo, this step *could* simply be done once during Init()
-		//  - However, this needs to be done between EACH DrawIndexed() call
-		//     when drawing different geometry, so it's here as an example
-		deviceContext->IASetVertexBuffers(0, 1, GetVertexBuffer().GetAddressOf(), &stride, &offset);
-		deviceContext->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+		//  - All meshes with this layout share the buffers, so this only
+		//     does anything when the last draw used a different layout
+		GeometryArena& arena = GeometryArena::GetInstance();
+		arena.Bind(deviceContext, geometry);
 
 		// Tell Direct3D to draw
 		//  - Begins the rendering pipeline on the GPU
@@ -447,9 +340,103 @@ void Mesh::Draw() {
 		//  - DrawIndexed() uses the currently set INDEX BUFFER to look up corresponding
 		//     vertices in the currently set VERTEX BUFFER
 		deviceContext->DrawIndexed(
-			GetIndexCount(),     // The number of indices to use (we could draw a subset if we wanted)
-			0,     // Offset to the first index we want to use
-			0);    // Offset to add to each index when looking up vertices
+			range.IndexCount,     // The number of indices to use (just this level of detail)
+			arena.GetFirstIndex(geometry) + range.IndexStart,     // Offset to the first index we want to use
+			arena.GetBaseVertex(geometry));    // Offset to add to each index when looking up vertices
+		DrawCalls++;
 	}
 };
 
+void Mesh::DrawInstanced(unsigned int lod, unsigned int instanceCount, unsigned int firstInstance)
+{
+	if (!ready || instanceCount == 0)
+		return;
+
+	const MeshLod& range = GetLod(lod);
+	GeometryArena& arena = GeometryArena::GetInstance();
+	arena.Bind(deviceContext, geometry);
+	deviceContext->DrawIndexedInstanced(
+		range.IndexCount,
+		instanceCount,
+		arena.GetFirstIndex(geometry) + range.IndexStart,
+		arena.GetBaseVertex(geometry),
+		firstInstance);
+	DrawCalls++;
+}
+
+// --------------------------------------------------------
+// Draws the clusters of a level that survive culling
+//
+// Clusters are contiguous in the index buffer, so neighbouring
+// survivors are merged into a single DrawIndexed() call.  A
+// level without clusters is drawn whole
+// --------------------------------------------------------
+void Mesh::DrawClusters(unsigned int lod, const ClusterCullView& view, ClusterCullStats* stats)
+{
+	if (!ready)
+		return;
+
+	const MeshLod& range = GetLod(lod);
+	if (range.ClusterCount == 0)
+	{
+		Draw(lod);
+		if (stats)
+		{
+			stats->DrawCalls++;
+			stats->Triangles += range.IndexCount / 3;
+		}
+		return;
+	}
+
+	GeometryArena& arena = GeometryArena::GetInstance();
+	arena.Bind(deviceContext, geometry);
+	unsigned int firstIndex = arena.GetFirstIndex(geometry);
+	int baseVertex = arena.GetBaseVertex(geometry);
+
+	ClusterCullStats frame;
+	unsigned int runStart = 0;
+	unsigned int runCount = 0;
+	for (unsigned int i = range.ClusterStart; i < range.ClusterStart + range.ClusterCount; i++)
+	{
+		const MeshCluster& cluster = clusters[i];
+		frame.Clusters++;
+
+		bool culled = true;
+		if (IsClusterBackfacing(cluster, view))
+			frame.Backfacing++;
+		else if (IsClusterOutsideFrustum(cluster, view))
+			frame.OutsideFrustum++;
+		else
+			culled = false;
+
+		if (!culled)
+		{
+			// Extend the current run, or start a new one
+			if (runCount > 0 && runStart + runCount == cluster.IndexStart)
+			{
+				runCount += cluster.IndexCount;
+				continue;
+			}
+			if (runCount > 0)
+			{
+				deviceContext->DrawIndexed(runCount, firstIndex + runStart, baseVertex);
+				DrawCalls++;
+				frame.DrawCalls++;
+				frame.Triangles += runCount / 3;
+			}
+			runStart = cluster.IndexStart;
+			runCount = cluster.IndexCount;
+		}
+	}
+
+	if (runCount > 0)
+	{
+		deviceContext->DrawIndexed(runCount, firstIndex + runStart, baseVertex);
+		DrawCalls++;
+		frame.DrawCalls++;
+		frame.Triangles += runCount / 3;
+	}
+
+	if (stats)
+		stats->Add(frame);
+}
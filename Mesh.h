@@ -2,14 +2,24 @@
 
 #include <wrl/client.h>
 #include <d3d11.h>
+#include <memory>
+#include <string>
 #include "Vertex.h"
+#include "ObjParser.h"
+#include "MeshData.h"
+#include "MeshOptimizer.h"
+#include "VertexPacking.h"
+#include "MeshSimplifier.h"
+#include "MeshClusters.h"
+#include "MeshTangents.h"
+#include "MeshLoader.h"
+#include "GeometryArena.h"
 
 class Mesh
 {
 private:
-	//Buffers to hold vertex and index data
-	Microsoft::WRL::ComPtr<ID3D11Buffer> vertexBuffer;
-	Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer;
+	//Where the vertex and index data live within the shared GeometryArena buffers
+	GeometryRange geometry;
 
 	//Used for draw commands
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext;
@@ -17,6 +27,42 @@ private:
 	//Number of indices in index buffer
 	int indexCounter;
 
+	//Levels of detail within the index buffer (level 0 is full detail)
+	std::vector<MeshLod> lods;
+
+	//Clusters of each level, for culling parts of the mesh on the CPU
+	std::vector<MeshCluster> clusters;
+
+	//Local space bounding box and sphere (around the box's center), for culling and sizing the mesh on screen
+	DirectX::XMFLOAT3 boundsMin;
+	DirectX::XMFLOAT3 boundsMax;
+	float boundsRadius;
+
+	//Layout of the buffers, since meshes can be packed and/or use 16-bit indices
+	unsigned int vertexStride;
+	DXGI_FORMAT indexFormat;
+	bool packedVertices;
+	VertexQuantization quantization;
+
+	//How long loading from disk took
+	MeshLoadStats loadStats;
+
+	//False until the GPU buffers exist (async loads start out empty)
+	bool ready;
+
+	Mesh(
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext,
+		const char* name,
+		bool packVertices);
+	void Upload(PreparedMesh& prepared);
+	void CreateBuffers(
+		const void* vertexData,
+		int verticies,
+		unsigned int vertexStride,
+		const void* indexData,
+		int indexCounter,
+		DXGI_FORMAT indexFormat);
+
 public:
 	Mesh(
 		Vertex* vertexArray,		//My verticies for this mesh
@@ -29,16 +75,42 @@ public:
 	Mesh(
 		const char* filename,		//My verticies for this mesh
 		Microsoft::WRL::ComPtr<ID3D11Device> device,
-		Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext,
+		bool packVertices = false	//Use the 20 byte PackedVertex (needs the Packed* vertex shaders)
 	);
 	~Mesh();
 
+	//Draw calls made by every mesh since this was last reset (nothing resets it but the caller)
+	static unsigned int DrawCalls;
+
+	//Returns at once, and draws nothing until loader.Update() uploads it
+	static std::shared_ptr<Mesh> LoadAsync(
+		MeshLoader& loader,
+		const char* filename,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext,
+		bool packVertices = false);
+
 	//Methods
 	Microsoft::WRL::ComPtr<ID3D11Buffer> GetVertexBuffer();
 	Microsoft::WRL::ComPtr<ID3D11Buffer> GetIndexBuffer();
 	unsigned int GetIndexCount();
-	void Draw();
-	void CalculateTangents(
+	unsigned int GetLodCount();
+	const MeshLod& GetLod(unsigned int lod);
+	unsigned int GetClusterCount();
+	DirectX::XMFLOAT3 GetBoundsMin();
+	DirectX::XMFLOAT3 GetBoundsMax();
+	DirectX::XMFLOAT3 GetBoundsCenter();
+	float GetBoundsRadius();
+	const MeshLoadStats& GetLoadStats();
+	bool IsReady();
+	bool HasPackedVertices();
+	const VertexQuantization& GetQuantization();
+	void Draw(unsigned int lod = 0);
+	//Draws instanceCount copies of a level, reading their data from
+	//firstInstance on in whatever is bound to the second vertex buffer slot
+	void DrawInstanced(unsigned int lod, unsigned int instanceCount, unsigned int firstInstance);
+	void DrawClusters(unsigned int lod, const ClusterCullView& view, ClusterCullStats* stats = 0);
+	static void CalculateTangents(
 		Vertex* verts,
 		int numVerts,
 		unsigned int* indices,
@@ -0,0 +1,372 @@
+#include "MeshCache.h"
+
+#include <d3d11.h>
+#include <fstream>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// --------------------------------------------------------
+// Size and last write time of a file, without opening it
+// --------------------------------------------------------
+static bool GetSourceStamp(const char* filename, uint64_t& size, uint64_t& writeTime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA info = {};
+	if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &info))
+		return false;
+
+	size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+	writeTime = ((uint64_t)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+static uint64_t HashFile(const char* filename)
+{
+	MappedFile source;
+	if (!source.Open(filename))
+		return 0;
+	return HashBytes(source.GetData(), source.GetSize());
+}
+
+static inline uint64_t AlignOffset(uint64_t offset)
+{
+	return (offset + COOKED_MESH_ALIGNMENT - 1) & ~(uint64_t)(COOKED_MESH_ALIGNMENT - 1);
+}
+
+uint64_t HashBytes(const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+std::string GetCookedMeshPath(const char* sourceFile)
+{
+	std::string path = sourceFile;
+	size_t dot = path.find_last_of('.');
+	size_t slash = path.find_last_of("/\\");
+	if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+		path.erase(dot);
+	return path + ".mesh";
+}
+
+CookedMesh::CookedMesh() :
+	header(0),
+	vertices(0),
+	packedVertices(0),
+	indices(0),
+	lods(0),
+	clusters(0),
+	vertexCount(0),
+	indexCount(0),
+	indexStride(0),
+	lodCount(0),
+	clusterCount(0)
+{
+}
+
+// --------------------------------------------------------
+// Maps a cooked file and checks it is still usable
+//
+// The file is rejected if the format doesn't match this build,
+// or if the source file has changed since it was cooked.  A
+// matching size and write time is trusted as-is; a matching
+// size with a new write time falls back to hashing the source
+// (which catches files that were just touched or re-copied).
+// A missing source is fine, so cooked files can ship alone.
+// --------------------------------------------------------
+bool CookedMesh::Open(const char* cookedFile, const char* sourceFile)
+{
+	Close();
+
+	if (!file.Open(cookedFile) || file.GetSize() < sizeof(CookedMeshHeader))
+	{
+		Close();
+		return false;
+	}
+
+	const CookedMeshHeader* h = (const CookedMeshHeader*)file.GetData();
+	if (h->Magic != COOKED_MESH_MAGIC ||
+		h->Version != COOKED_MESH_VERSION ||
+		h->HeaderSize != sizeof(CookedMeshHeader) ||
+		h->SectionCount > COOKED_MESH_MAX_SECTIONS ||
+		h->VertexStride != sizeof(Vertex))
+	{
+		Close();
+		return false;
+	}
+
+	uint64_t sourceSize = 0;
+	uint64_t sourceWriteTime = 0;
+	if (sourceFile && GetSourceStamp(sourceFile, sourceSize, sourceWriteTime))
+	{
+		if (sourceSize != h->SourceSize ||
+			(sourceWriteTime != h->SourceWriteTime && HashFile(sourceFile) != h->SourceHash))
+		{
+			Close();
+			return false;
+		}
+	}
+
+	// Every section has to actually fit in the file.  Count * Stride
+	// could overflow, so the count is checked against what fits instead
+	for (uint32_t i = 0; i < h->SectionCount; i++)
+	{
+		const CookedMeshSection& s = h->Sections[i];
+		if (s.Offset % COOKED_MESH_ALIGNMENT != 0 ||
+			s.Offset > file.GetSize() ||
+			(s.Stride != 0 && s.Count > (file.GetSize() - s.Offset) / s.Stride))
+		{
+			Close();
+			return false;
+		}
+	}
+
+	header = h;
+	const CookedMeshSection* vertexSection = FindSection(COOKED_SECTION_VERTICES);
+	const CookedMeshSection* indexSection = FindSection(COOKED_SECTION_INDICES);
+	if (!vertexSection || !indexSection ||
+		vertexSection->Stride != sizeof(Vertex) ||
+		(indexSection->Stride != sizeof(uint16_t) && indexSection->Stride != sizeof(uint32_t)) ||
+		vertexSection->Count == 0 ||
+		indexSection->Count == 0)
+	{
+		Close();
+		return false;
+	}
+
+	vertices = (const Vertex*)(file.GetData() + vertexSection->Offset);
+	vertexCount = (unsigned int)vertexSection->Count;
+	indices = file.GetData() + indexSection->Offset;
+	indexCount = (unsigned int)indexSection->Count;
+	indexStride = indexSection->Stride;
+
+	// The packed copy is optional, but has to cover every vertex
+	const CookedMeshSection* packedSection = FindSection(COOKED_SECTION_PACKED_VERTICES);
+	if (packedSection)
+	{
+		if (packedSection->Stride != sizeof(PackedVertex) || packedSection->Count != vertexSection->Count)
+		{
+			Close();
+			return false;
+		}
+
+		packedVertices = (const PackedVertex*)(file.GetData() + packedSection->Offset);
+	}
+
+	// Levels of detail are optional, but have to stay within the indices
+	const CookedMeshSection* lodSection = FindSection(COOKED_SECTION_LODS);
+	if (lodSection)
+	{
+		if (lodSection->Stride != sizeof(MeshLod))
+		{
+			Close();
+			return false;
+		}
+
+		lods = (const MeshLod*)(file.GetData() + lodSection->Offset);
+		lodCount = (unsigned int)lodSection->Count;
+	}
+
+	// So are clusters, which have to stay within the indices too
+	const CookedMeshSection* clusterSection = FindSection(COOKED_SECTION_CLUSTERS);
+	if (clusterSection)
+	{
+		if (clusterSection->Stride != sizeof(MeshCluster))
+		{
+			Close();
+			return false;
+		}
+
+		clusters = (const MeshCluster*)(file.GetData() + clusterSection->Offset);
+		clusterCount = (unsigned int)clusterSection->Count;
+		for (unsigned int i = 0; i < clusterCount; i++)
+		{
+			if (clusters[i].IndexStart > indexCount ||
+				clusters[i].IndexCount > indexCount - clusters[i].IndexStart)
+			{
+				Close();
+				return false;
+			}
+		}
+	}
+
+	for (unsigned int i = 0; i < lodCount; i++)
+	{
+		if (lods[i].IndexStart > indexCount ||
+			lods[i].IndexCount > indexCount - lods[i].IndexStart ||
+			lods[i].ClusterStart > clusterCount ||
+			lods[i].ClusterCount > clusterCount - lods[i].ClusterStart)
+		{
+			Close();
+			return false;
+		}
+	}
+	return true;
+}
+
+void CookedMesh::Close()
+{
+	file.Close();
+	header = 0;
+	vertices = 0;
+	packedVertices = 0;
+	indices = 0;
+	lods = 0;
+	clusters = 0;
+	vertexCount = 0;
+	indexCount = 0;
+	indexStride = 0;
+	lodCount = 0;
+	clusterCount = 0;
+}
+
+VertexPackingError CookedMesh::GetPackingError()
+{
+	VertexPackingError error;
+	if (!header)
+		return error;
+
+	error.Position = header->PackingError[0];
+	error.NormalDegrees = header->PackingError[1];
+	error.TangentDegrees = header->PackingError[2];
+	error.UV = header->PackingError[3];
+	error.WithinBounds = header->PackingWithinBounds != 0;
+	return error;
+}
+
+const CookedMeshSection* CookedMesh::FindSection(uint32_t type)
+{
+	if (!header)
+		return 0;
+
+	for (uint32_t i = 0; i < header->SectionCount; i++)
+	{
+		if (header->Sections[i].Type == type)
+			return &header->Sections[i];
+	}
+	return 0;
+}
+
+// --------------------------------------------------------
+// Writes the cooked file next to a temp name first and then
+// swaps it in, so a crash mid-write never leaves a truncated
+// file that looks valid
+// --------------------------------------------------------
+bool WriteCookedMesh(const char* cookedFile, const char* sourceFile, const MeshData& mesh)
+{
+	if (mesh.Vertices.empty() || mesh.Indices.empty())
+		return false;
+
+	CookedMeshHeader header = {};
+	header.Magic = COOKED_MESH_MAGIC;
+	header.Version = COOKED_MESH_VERSION;
+	header.HeaderSize = sizeof(CookedMeshHeader);
+
+	if (!GetSourceStamp(sourceFile, header.SourceSize, header.SourceWriteTime))
+		return false;
+	header.SourceHash = HashFile(sourceFile);
+
+	header.BoundsMin[0] = mesh.BoundsMin.x;
+	header.BoundsMin[1] = mesh.BoundsMin.y;
+	header.BoundsMin[2] = mesh.BoundsMin.z;
+	header.BoundsMax[0] = mesh.BoundsMax.x;
+	header.BoundsMax[1] = mesh.BoundsMax.y;
+	header.BoundsMax[2] = mesh.BoundsMax.z;
+	header.BoundsRadius = mesh.BoundsRadius;
+
+	// Describe the vertex so a reader doesn't have to know the struct
+	const struct { const char* Semantic; DXGI_FORMAT Format; uint32_t Offset; } layout[] =
+	{
+		{ "POSITION", DXGI_FORMAT_R32G32B32_FLOAT, offsetof(Vertex, Position) },
+		{ "NORMAL", DXGI_FORMAT_R32G32B32_FLOAT, offsetof(Vertex, Normal) },
+		{ "TEXCOORD", DXGI_FORMAT_R32G32_FLOAT, offsetof(Vertex, UV) },
+		{ "TANGENT", DXGI_FORMAT_R32G32B32_FLOAT, offsetof(Vertex, Tangent) },
+	};
+	header.VertexStride = sizeof(Vertex);
+	header.AttributeCount = sizeof(layout) / sizeof(layout[0]);
+
+	// Narrow the indices now so loading never has to
+	std::vector<uint16_t> shortIndices;
+	bool use16BitIndices = CanUse16BitIndices(mesh.Vertices.size());
+	if (use16BitIndices)
+		NarrowIndices(&mesh.Indices[0], mesh.Indices.size(), shortIndices);
+	header.IndexFormat = use16BitIndices ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+	for (uint32_t i = 0; i < header.AttributeCount; i++)
+	{
+		strncpy_s(header.Attributes[i].Semantic, layout[i].Semantic, _TRUNCATE);
+		header.Attributes[i].Format = layout[i].Format;
+		header.Attributes[i].Offset = layout[i].Offset;
+	}
+
+	// Packed the same way PrepareGeometry() would, against the bounds
+	VertexQuantization quantization = GetVertexQuantization(mesh.BoundsMin, mesh.BoundsMax);
+	std::vector<PackedVertex> packedVertices(mesh.Vertices.size());
+	PackVertices(&mesh.Vertices[0], mesh.Vertices.size(), quantization, &packedVertices[0]);
+	VertexPackingError packingError = MeasurePackingError(&mesh.Vertices[0], mesh.Vertices.size(), quantization);
+	header.PackingError[0] = packingError.Position;
+	header.PackingError[1] = packingError.NormalDegrees;
+	header.PackingError[2] = packingError.TangentDegrees;
+	header.PackingError[3] = packingError.UV;
+	header.PackingWithinBounds = packingError.WithinBounds ? 1 : 0;
+
+	// Lay the sections out one after another
+	const void* sectionData[COOKED_MESH_MAX_SECTIONS] = {};
+	uint64_t offset = AlignOffset(sizeof(CookedMeshHeader));
+	auto addSection = [&](uint32_t type, uint32_t stride, uint64_t count, const void* data)
+	{
+		if (count == 0)
+			return;
+
+		sectionData[header.SectionCount] = data;
+		CookedMeshSection& section = header.Sections[header.SectionCount++];
+		section.Type = type;
+		section.Stride = stride;
+		section.Offset = offset;
+		section.Count = count;
+		offset = AlignOffset(offset + (uint64_t)stride * count);
+	};
+	addSection(COOKED_SECTION_VERTICES, sizeof(Vertex), mesh.Vertices.size(), &mesh.Vertices[0]);
+	addSection(COOKED_SECTION_INDICES, use16BitIndices ? sizeof(uint16_t) : sizeof(uint32_t), mesh.Indices.size(),
+		use16BitIndices ? (const void*)&shortIndices[0] : (const void*)&mesh.Indices[0]);
+	addSection(COOKED_SECTION_LODS, sizeof(MeshLod), mesh.Lods.size(), mesh.Lods.empty() ? 0 : &mesh.Lods[0]);
+	addSection(COOKED_SECTION_CLUSTERS, sizeof(MeshCluster), mesh.Clusters.size(), mesh.Clusters.empty() ? 0 : &mesh.Clusters[0]);
+	addSection(COOKED_SECTION_PACKED_VERTICES, sizeof(PackedVertex), packedVertices.size(), &packedVertices[0]);
+
+	std::string tempFile = std::string(cookedFile) + ".tmp";
+	{
+		std::ofstream out(tempFile, std::ios::binary | std::ios::trunc);
+		if (!out.is_open())
+			return false;
+
+		// Each section is padded up to its aligned offset first
+		const char zeros[COOKED_MESH_ALIGNMENT] = {};
+		out.write((const char*)&header, sizeof(header));
+		uint64_t written = sizeof(header);
+		for (uint32_t i = 0; i < header.SectionCount; i++)
+		{
+			const CookedMeshSection& section = header.Sections[i];
+			out.write(zeros, section.Offset - written);
+			out.write((const char*)sectionData[i], section.Stride * section.Count);
+			written = section.Offset + section.Stride * section.Count;
+		}
+		if (!out.good())
+		{
+			out.close();
+			DeleteFileA(tempFile.c_str());
+			return false;
+		}
+	}
+
+	if (!MoveFileExA(tempFile.c_str(), cookedFile, MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileA(tempFile.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <string>
+#include "MappedFile.h"
+#include "MeshData.h"
+#include "VertexPacking.h"
+
+// --------------------------------------------------------
+// Cooked mesh file layout (.mesh)
+//
+//  [CookedMeshHeader]  magic, version, source stamp, bounds,
+//                      vertex layout and a section table
+//  [section data]      each section starts on a 16 byte boundary
+//
+// Everything is stored exactly as the GPU wants it, so loading
+// is just mapping the file and pointing pSysMem at the bytes.
+// That includes a packed copy of the vertices, quantized to the
+// header's bounds, so packed loads don't pack again either
+// --------------------------------------------------------
+#define COOKED_MESH_MAGIC		0x4853454D	// "MESH" when read as bytes
+#define COOKED_MESH_VERSION		8
+#define COOKED_MESH_ALIGNMENT	16
+#define COOKED_MESH_MAX_ATTRIBUTES	8
+#define COOKED_MESH_MAX_SECTIONS	8
+
+enum CookedMeshSectionType
+{
+	COOKED_SECTION_VERTICES = 1,
+	COOKED_SECTION_INDICES = 2,
+	COOKED_SECTION_LODS = 3,	// MeshLod ranges within the indices (optional)
+	COOKED_SECTION_CLUSTERS = 4,	// MeshCluster ranges within the levels (optional)
+	COOKED_SECTION_PACKED_VERTICES = 5	// PackedVertex copies of the vertices (optional)
+};
+
+// One element of the vertex layout (mirrors D3D11_INPUT_ELEMENT_DESC)
+struct CookedMeshAttribute
+{
+	char Semantic[16];
+	uint32_t SemanticIndex;
+	uint32_t Format;		// DXGI_FORMAT
+	uint32_t Offset;		// Byte offset within a vertex
+	uint32_t Padding;
+};
+
+// Where a block of data lives in the file
+struct CookedMeshSection
+{
+	uint32_t Type;			// CookedMeshSectionType
+	uint32_t Stride;		// Bytes per element
+	uint64_t Offset;		// From the start of the file
+	uint64_t Count;			// Number of elements
+};
+
+struct CookedMeshHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t HeaderSize;
+	uint32_t SectionCount;
+
+	// Identifies the source file this was cooked from
+	uint64_t SourceSize;
+	uint64_t SourceWriteTime;
+	uint64_t SourceHash;
+	uint64_t Padding;
+
+	float BoundsMin[4];
+	float BoundsMax[4];
+
+	uint32_t VertexStride;
+	uint32_t AttributeCount;
+	uint32_t IndexFormat;	// DXGI_FORMAT
+	float BoundsRadius;		// Of the sphere around the middle of the box
+	CookedMeshAttribute Attributes[COOKED_MESH_MAX_ATTRIBUTES];
+
+	// MeasurePackingError() of the packed vertices, when cooked
+	float PackingError[4];	// Position, normal degrees, tangent degrees, uv
+	uint32_t PackingWithinBounds;
+	uint32_t PackingPadding[3];
+
+	CookedMeshSection Sections[COOKED_MESH_MAX_SECTIONS];
+};
+
+// --------------------------------------------------------
+// A cooked mesh mapped straight from disk
+//
+// The vertex and index pointers point into the mapped file,
+// so they are only valid while this object is alive
+// --------------------------------------------------------
+class CookedMesh
+{
+public:
+	CookedMesh();
+
+	bool Open(const char* cookedFile, const char* sourceFile);
+	void Close();
+
+	const CookedMeshHeader* GetHeader() { return header; }	// Also the start of the mapped file
+	size_t GetFileSize() { return file.GetSize(); }
+	const CookedMeshSection* FindSection(uint32_t type);
+
+	const Vertex* GetVertices() { return vertices; }
+	const PackedVertex* GetPackedVertices() { return packedVertices; }	// 0 if the file has none
+	unsigned int GetVertexCount() { return vertexCount; }
+	VertexPackingError GetPackingError();
+	const void* GetIndices() { return indices; }
+	unsigned int GetIndexCount() { return indexCount; }
+	unsigned int GetIndexStride() { return indexStride; }	// 2 or 4 bytes
+	const MeshLod* GetLods() { return lods; }
+	unsigned int GetLodCount() { return lodCount; }	// 0 if the file has no levels of detail
+	const MeshCluster* GetClusters() { return clusters; }
+	unsigned int GetClusterCount() { return clusterCount; }
+
+private:
+	MappedFile file;
+	const CookedMeshHeader* header;
+	const Vertex* vertices;
+	const PackedVertex* packedVertices;
+	const void* indices;
+	const MeshLod* lods;
+	const MeshCluster* clusters;
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	unsigned int indexStride;
+	unsigned int lodCount;
+	unsigned int clusterCount;
+};
+
+// Where the cooked version of a source file lives ("x.obj" -> "x.mesh")
+std::string GetCookedMeshPath(const char* sourceFile);
+
+// Writes mesh data as a cooked file stamped with the source file's identity
+// (indices are stored as 16-bit whenever the vertex count allows, and the
+// vertices are packed against the mesh bounds for packed loads)
+bool WriteCookedMesh(const char* cookedFile, const char* sourceFile, const MeshData& mesh);
+
+// 64-bit FNV-1a, used to detect source changes that keep the same size
+uint64_t HashBytes(const void* data, size_t size);
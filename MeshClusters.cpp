@@ -0,0 +1,292 @@
+#include "MeshClusters.h"
+#include "FrustumCulling.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+// Marks a vertex that isn't in the cluster being built
+static const unsigned int NoCluster = 0xFFFFFFFF;
+
+// Triangles facing further than this (cos 30 degrees) from the
+// cluster's average don't join it.  Narrow cones cull far more
+// often, at the cost of some smaller clusters
+#define CLUSTER_FACING_LIMIT	0.866f
+
+// --------------------------------------------------------
+// Bounding sphere and normal cone of one cluster
+// --------------------------------------------------------
+static void CalculateClusterBounds(
+	MeshCluster& cluster,
+	const Vertex* vertices,
+	const unsigned int* indices)
+{
+	XMVECTOR boundsMin = XMLoadFloat3(&vertices[indices[0]].Position);
+	XMVECTOR boundsMax = boundsMin;
+	for (unsigned int i = 1; i < cluster.IndexCount; i++)
+	{
+		XMVECTOR p = XMLoadFloat3(&vertices[indices[i]].Position);
+		boundsMin = XMVectorMin(boundsMin, p);
+		boundsMax = XMVectorMax(boundsMax, p);
+	}
+
+	XMVECTOR center = (boundsMin + boundsMax) * 0.5f;
+	float radius = 0;
+	for (unsigned int i = 0; i < cluster.IndexCount; i++)
+	{
+		XMVECTOR p = XMLoadFloat3(&vertices[indices[i]].Position);
+		radius = std::max(radius, XMVectorGetX(XMVector3Length(p - center)));
+	}
+	XMStoreFloat3(&cluster.Center, center);
+	cluster.Radius = radius;
+
+	// The cone axis is the average facing, and its width is the
+	// normal furthest from it
+	XMVECTOR axis = XMVectorZero();
+	std::vector<XMFLOAT3> normals;
+	normals.reserve(cluster.IndexCount / 3);
+	for (unsigned int t = 0; t < cluster.IndexCount; t += 3)
+	{
+		XMVECTOR p0 = XMLoadFloat3(&vertices[indices[t]].Position);
+		XMVECTOR p1 = XMLoadFloat3(&vertices[indices[t + 1]].Position);
+		XMVECTOR p2 = XMLoadFloat3(&vertices[indices[t + 2]].Position);
+		XMVECTOR normal = XMVector3Cross(p1 - p0, p2 - p0);
+		if (XMVectorGetX(XMVector3LengthSq(normal)) == 0)
+			continue;	// Degenerate triangles never face anything
+
+		normal = XMVector3Normalize(normal);
+		axis += normal;
+
+		XMFLOAT3 n;
+		XMStoreFloat3(&n, normal);
+		normals.push_back(n);
+	}
+
+	cluster.ConeAxis = XMFLOAT3(0, 0, 0);
+	cluster.ConeCutoff = 1.0f;
+	if (normals.empty() || XMVectorGetX(XMVector3LengthSq(axis)) == 0)
+		return;
+
+	axis = XMVector3Normalize(axis);
+	float minDot = 1.0f;
+	for (const XMFLOAT3& n : normals)
+		minDot = std::min(minDot, XMVectorGetX(XMVector3Dot(axis, XMLoadFloat3(&n))));
+	XMStoreFloat3(&cluster.ConeAxis, axis);
+
+	// Widening the cone by 90 degrees gives the directions every
+	// triangle faces away from: its half angle is acos(minDot) + 90,
+	// so the cutoff is -cos(acos(minDot) + 90) = sin(acos(minDot))
+	if (minDot > 0)
+		cluster.ConeCutoff = sqrtf(1.0f - minDot * minDot);
+}
+
+// --------------------------------------------------------
+// Builds the clusters of one index range and rewrites the
+// range so each cluster is contiguous
+// --------------------------------------------------------
+static void BuildRangeClusters(
+	MeshData& mesh,
+	unsigned int indexStart,
+	unsigned int indexCount,
+	unsigned int maxVertices,
+	unsigned int maxTriangles,
+	std::vector<MeshCluster>& clusters)
+{
+	const unsigned int* indices = &mesh.Indices[indexStart];
+	const Vertex* vertices = &mesh.Vertices[0];
+	size_t vertexCount = mesh.Vertices.size();
+	size_t triangleCount = indexCount / 3;
+
+	// Triangles around each vertex
+	std::vector<unsigned int> adjacencyStart(vertexCount + 1, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		adjacencyStart[indices[i] + 1]++;
+	for (size_t v = 0; v < vertexCount; v++)
+		adjacencyStart[v + 1] += adjacencyStart[v];
+	std::vector<unsigned int> adjacency(triangleCount * 3);
+	{
+		std::vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; i++)
+			adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+	}
+
+	// Unit face normals, to keep clusters facing one way
+	std::vector<XMFLOAT3> faceNormals(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		XMVECTOR p0 = XMLoadFloat3(&vertices[indices[t * 3]].Position);
+		XMVECTOR p1 = XMLoadFloat3(&vertices[indices[t * 3 + 1]].Position);
+		XMVECTOR p2 = XMLoadFloat3(&vertices[indices[t * 3 + 2]].Position);
+		XMVECTOR normal = XMVector3Cross(p1 - p0, p2 - p0);
+		if (XMVectorGetX(XMVector3LengthSq(normal)) > 0)
+			normal = XMVector3Normalize(normal);
+		XMStoreFloat3(&faceNormals[t], normal);
+	}
+
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> vertexCluster(vertexCount, NoCluster);
+	std::vector<unsigned int> clusterVertices;
+	std::vector<unsigned int> output;
+	output.reserve(triangleCount * 3);
+	size_t seed = 0;
+
+	while (output.size() < triangleCount * 3)
+	{
+		while (emitted[seed])
+			seed++;
+
+		unsigned int id = (unsigned int)clusters.size();
+		unsigned int clusterTriangles = 0;
+		size_t clusterStart = output.size();
+		XMVECTOR facing = XMVectorZero();
+		clusterVertices.clear();
+
+		size_t next = seed;
+		for (;;)
+		{
+			// Add the chosen triangle
+			emitted[next] = true;
+			clusterTriangles++;
+			for (int c = 0; c < 3; c++)
+			{
+				unsigned int v = indices[next * 3 + c];
+				output.push_back(v);
+				if (vertexCluster[v] != id)
+				{
+					vertexCluster[v] = id;
+					clusterVertices.push_back(v);
+				}
+			}
+			facing += XMLoadFloat3(&faceNormals[next]);
+			if (clusterTriangles == maxTriangles)
+				break;
+
+			// Find the neighbour that adds the fewest new vertices
+			// (then the one facing most like the cluster)
+			XMVECTOR direction = XMVector3Normalize(facing);
+			size_t best = triangleCount;
+			unsigned int bestNew = 4;
+			float bestDot = -2.0f;
+			for (unsigned int v : clusterVertices)
+			{
+				for (unsigned int a = adjacencyStart[v]; a < adjacencyStart[v + 1]; a++)
+				{
+					unsigned int t = adjacency[a];
+					if (emitted[t])
+						continue;
+
+					unsigned int newVertices =
+						(vertexCluster[indices[t * 3]] != id) +
+						(vertexCluster[indices[t * 3 + 1]] != id) +
+						(vertexCluster[indices[t * 3 + 2]] != id);
+					if (clusterVertices.size() + newVertices > maxVertices || newVertices > bestNew)
+						continue;
+
+					float d = XMVectorGetX(XMVector3Dot(direction, XMLoadFloat3(&faceNormals[t])));
+					if (d < CLUSTER_FACING_LIMIT)
+						continue;
+					if (newVertices < bestNew || d > bestDot)
+					{
+						best = t;
+						bestNew = newVertices;
+						bestDot = d;
+					}
+				}
+			}
+
+			if (best == triangleCount)
+				break;
+			next = best;
+		}
+
+		MeshCluster cluster = {};
+		cluster.IndexStart = indexStart + (unsigned int)clusterStart;
+		cluster.IndexCount = clusterTriangles * 3;
+		CalculateClusterBounds(cluster, vertices, &output[clusterStart]);
+		clusters.push_back(cluster);
+	}
+
+	std::copy(output.begin(), output.end(), mesh.Indices.begin() + indexStart);
+}
+
+void BuildMeshClusters(MeshData& mesh, unsigned int maxVertices, unsigned int maxTriangles)
+{
+	mesh.Clusters.clear();
+	if (mesh.Indices.empty())
+		return;
+
+	if (mesh.Lods.empty())
+	{
+		MeshLod lod = { 0, (unsigned int)mesh.Indices.size(), 0.0f };
+		mesh.Lods.push_back(lod);
+	}
+
+	for (MeshLod& lod : mesh.Lods)
+	{
+		lod.ClusterStart = (unsigned int)mesh.Clusters.size();
+		BuildRangeClusters(mesh, lod.IndexStart, lod.IndexCount, maxVertices, maxTriangles, mesh.Clusters);
+		lod.ClusterCount = (unsigned int)mesh.Clusters.size() - lod.ClusterStart;
+
+		// Growing by adjacency loses the cache order, so restore it
+		// within each cluster (which keeps the clusters themselves)
+		for (unsigned int c = lod.ClusterStart; c < lod.ClusterStart + lod.ClusterCount; c++)
+		{
+			const MeshCluster& cluster = mesh.Clusters[c];
+			OptimizeVertexCache(&mesh.Indices[cluster.IndexStart], cluster.IndexCount, mesh.Vertices.size());
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Pulls the frustum planes out of world * view * projection
+// (Gribb & Hartmann), which puts them straight into the
+// mesh's local space.  The eye goes through the inverse world
+// --------------------------------------------------------
+ClusterCullView MakeClusterCullView(
+	const XMFLOAT4X4& world,
+	const XMFLOAT4X4& view,
+	const XMFLOAT4X4& projection,
+	const XMFLOAT3& eye)
+{
+	XMMATRIX w = XMLoadFloat4x4(&world);
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, w * XMLoadFloat4x4(&view) * XMLoadFloat4x4(&projection));
+
+	Frustum frustum = MakeFrustum(m);
+	ClusterCullView result;
+	for (int i = 0; i < 6; i++)
+		result.Planes[i] = frustum.Planes[i];
+
+	XMVECTOR localEye = XMVector3Transform(XMLoadFloat3(&eye), XMMatrixInverse(0, w));
+	XMStoreFloat3(&result.Eye, localEye);
+	return result;
+}
+
+// --------------------------------------------------------
+// Signs of dot(normal, p - eye) survive any (non-mirroring)
+// affine transform, so the local space test matches what the
+// rasterizer's back face culling will do in world space
+// --------------------------------------------------------
+bool IsClusterBackfacing(const MeshCluster& cluster, const ClusterCullView& view)
+{
+	if (cluster.ConeCutoff >= 1.0f)
+		return false;
+
+	XMVECTOR toCenter = XMLoadFloat3(&cluster.Center) - XMLoadFloat3(&view.Eye);
+	float distance = XMVectorGetX(XMVector3Length(toCenter));
+	float d = XMVectorGetX(XMVector3Dot(toCenter, XMLoadFloat3(&cluster.ConeAxis)));
+	return d >= cluster.ConeCutoff * distance + cluster.Radius;
+}
+
+bool IsClusterOutsideFrustum(const MeshCluster& cluster, const ClusterCullView& view)
+{
+	XMVECTOR center = XMVectorSetW(XMLoadFloat3(&cluster.Center), 1.0f);
+	for (int i = 0; i < 6; i++)
+	{
+		if (XMVectorGetX(XMVector4Dot(XMLoadFloat4(&view.Planes[i]), center)) < -cluster.Radius)
+			return true;
+	}
+	return false;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+#include "MeshData.h"
+
+// Size limits of one cluster (the usual mesh shader meshlet limits)
+#define MESH_CLUSTER_MAX_VERTICES	64
+#define MESH_CLUSTER_MAX_TRIANGLES	124
+
+// --------------------------------------------------------
+// Splits every level of detail into clusters
+//
+// Clusters grow from a seed triangle by adding the neighbour
+// that brings in the fewest new vertices (then the one facing
+// most like the cluster so far).  Triangles facing too far
+// away start a new cluster, which keeps the normal cones
+// narrow enough to actually cull.  Each level's triangles are
+// rewritten so every cluster is a contiguous index range, and
+// each cluster is reordered for the vertex cache on its own.
+//
+// Run this after BuildLodChain() (a mesh without levels is
+// treated as one level covering all of its indices)
+// --------------------------------------------------------
+void BuildMeshClusters(
+	MeshData& mesh,
+	unsigned int maxVertices = MESH_CLUSTER_MAX_VERTICES,
+	unsigned int maxTriangles = MESH_CLUSTER_MAX_TRIANGLES);
+
+// --------------------------------------------------------
+// The camera as seen from a mesh's local space, so clusters
+// can be tested without transforming them
+//
+// Planes are normalized and point inwards:
+//   dot(plane.xyz, p) + plane.w >= 0 inside the frustum
+// --------------------------------------------------------
+struct ClusterCullView
+{
+	DirectX::XMFLOAT3 Eye;
+	DirectX::XMFLOAT4 Planes[6];
+};
+
+ClusterCullView MakeClusterCullView(
+	const DirectX::XMFLOAT4X4& world,
+	const DirectX::XMFLOAT4X4& view,
+	const DirectX::XMFLOAT4X4& projection,
+	const DirectX::XMFLOAT3& eye);
+
+bool IsClusterBackfacing(const MeshCluster& cluster, const ClusterCullView& view);
+bool IsClusterOutsideFrustum(const MeshCluster& cluster, const ClusterCullView& view);
+
+// --------------------------------------------------------
+// What cluster culling did, for the INFO window
+// --------------------------------------------------------
+struct ClusterCullStats
+{
+	unsigned int Clusters = 0;			// Tested
+	unsigned int Backfacing = 0;		// Culled by their normal cone
+	unsigned int OutsideFrustum = 0;	// Culled by their bounding sphere
+	unsigned int DrawCalls = 0;			// After merging neighbouring survivors
+	unsigned int Triangles = 0;			// Submitted
+
+	void Add(const ClusterCullStats& other)
+	{
+		Clusters += other.Clusters;
+		Backfacing += other.Backfacing;
+		OutsideFrustum += other.OutsideFrustum;
+		DrawCalls += other.DrawCalls;
+		Triangles += other.Triangles;
+	}
+};
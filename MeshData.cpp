@@ -0,0 +1,159 @@
+#include "MeshData.h"
+
+#include <cmath>
+#include <cstdint>
+
+using namespace DirectX;
+
+// Marks an empty slot in the weld table
+static const unsigned int EmptySlot = 0xFFFFFFFF;
+
+// --------------------------------------------------------
+// Hashes an OBJ index triple for the weld table
+// --------------------------------------------------------
+static inline uint32_t HashFaceVertex(const ObjFaceVertex& fv)
+{
+	uint32_t h = (uint32_t)fv.Position * 73856093u;
+	h ^= (uint32_t)fv.UV * 19349663u;
+	h ^= (uint32_t)fv.Normal * 83492791u;
+	h ^= h >> 16;
+	return h;
+}
+
+static inline bool SameFaceVertex(const ObjFaceVertex& a, const ObjFaceVertex& b)
+{
+	return a.Position == b.Position && a.UV == b.UV && a.Normal == b.Normal;
+}
+
+// --------------------------------------------------------
+// Creates the actual vertex for an OBJ corner
+// --------------------------------------------------------
+static Vertex MakeVertex(const ObjData& obj, const ObjFaceVertex& fv)
+{
+	// Missing UVs or normals fall back to zero
+	Vertex v = {};
+	if (fv.Position >= 0 && fv.Position < (int)obj.Positions.size()) v.Position = obj.Positions[fv.Position];
+	if (fv.UV >= 0 && fv.UV < (int)obj.UVs.size()) v.UV = obj.UVs[fv.UV];
+	if (fv.Normal >= 0 && fv.Normal < (int)obj.Normals.size()) v.Normal = obj.Normals[fv.Normal];
+
+	// The model is most likely in a right-handed space,
+	// especially if it came from Maya.  We want to convert
+	// to a left-handed space for DirectX.  This means we
+	// need to:
+	//  - Invert the Z position
+	//  - Invert the normal's Z
+	//  - Flip the winding order (done by the caller)
+	// We also need to flip the UV coordinate since DirectX
+	// defines (0,0) as the top left of the texture, and many
+	// 3D modeling packages use the bottom left as (0,0)
+	v.UV.y = 1.0f - v.UV.y;
+	v.Position.z *= -1.0f;
+	v.Normal.z *= -1.0f;
+	return v;
+}
+
+// --------------------------------------------------------
+// Welds OBJ corners into unique vertices
+//
+// Uses an open-addressed hash table sized to twice the corner
+// count, storing the index of the vertex each key produced.
+// Vertices are emitted in order of first use, so the output
+// is fully deterministic.
+// --------------------------------------------------------
+bool BuildMeshData(const ObjData& obj, MeshData& mesh, MeshWeldStats* stats)
+{
+	mesh.Vertices.clear();
+	mesh.Indices.clear();
+	mesh.Lods.clear();
+	mesh.Clusters.clear();
+
+	size_t cornerCount = obj.Triangles.size() - obj.Triangles.size() % 3;
+	if (cornerCount == 0)
+		return false;
+
+	// Power of two capacity so we can mask instead of mod
+	size_t capacity = 16;
+	while (capacity < cornerCount * 2) capacity <<= 1;
+	size_t mask = capacity - 1;
+
+	std::vector<unsigned int> table(capacity, EmptySlot);
+	std::vector<ObjFaceVertex> keys; // Key that produced each output vertex
+	keys.reserve(cornerCount / 2);
+	mesh.Vertices.reserve(cornerCount / 2);
+	mesh.Indices.resize(cornerCount);
+
+	for (size_t t = 0; t < cornerCount; t += 3)
+	{
+		// Flip the winding order (LH vs. RH) while we're here
+		const size_t order[3] = { 0, 2, 1 };
+		for (int c = 0; c < 3; c++)
+		{
+			const ObjFaceVertex& fv = obj.Triangles[t + order[c]];
+
+			// Linear probe until we find the key or an empty slot
+			size_t slot = HashFaceVertex(fv) & mask;
+			while (table[slot] != EmptySlot && !SameFaceVertex(keys[table[slot]], fv))
+				slot = (slot + 1) & mask;
+
+			if (table[slot] == EmptySlot)
+			{
+				table[slot] = (unsigned int)mesh.Vertices.size();
+				keys.push_back(fv);
+				mesh.Vertices.push_back(MakeVertex(obj, fv));
+			}
+
+			mesh.Indices[t + c] = table[slot];
+		}
+	}
+
+	CalculateBounds(mesh);
+
+	if (stats)
+	{
+		stats->SourceVertices = (unsigned int)cornerCount;
+		stats->WeldedVertices = (unsigned int)mesh.Vertices.size();
+	}
+
+	return true;
+}
+
+// --------------------------------------------------------
+// Recalculates the local space bounding box of the mesh, then
+// the bounding sphere centered on it (a second pass, since the
+// center isn't known until the box is)
+// --------------------------------------------------------
+void CalculateBounds(MeshData& mesh)
+{
+	if (mesh.Vertices.empty())
+	{
+		mesh.BoundsMin = XMFLOAT3(0, 0, 0);
+		mesh.BoundsMax = XMFLOAT3(0, 0, 0);
+		mesh.BoundsRadius = 0;
+		return;
+	}
+
+	XMVECTOR minV = XMLoadFloat3(&mesh.Vertices[0].Position);
+	XMVECTOR maxV = minV;
+	for (const Vertex& v : mesh.Vertices)
+	{
+		XMVECTOR p = XMLoadFloat3(&v.Position);
+		minV = XMVectorMin(minV, p);
+		maxV = XMVectorMax(maxV, p);
+	}
+
+	XMStoreFloat3(&mesh.BoundsMin, minV);
+	XMStoreFloat3(&mesh.BoundsMax, maxV);
+
+	XMVECTOR center = (minV + maxV) * 0.5f;
+	XMVECTOR maxLengthSq = XMVectorZero();
+	for (const Vertex& v : mesh.Vertices)
+		maxLengthSq = XMVectorMax(maxLengthSq, XMVector3LengthSq(XMLoadFloat3(&v.Position) - center));
+	mesh.BoundsRadius = sqrtf(XMVectorGetX(maxLengthSq));
+}
+
+void NarrowIndices(const unsigned int* indices, size_t indexCount, std::vector<uint16_t>& out)
+{
+	out.resize(indexCount);
+	for (size_t i = 0; i < indexCount; i++)
+		out[i] = (uint16_t)indices[i];
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "Vertex.h"
+#include "ObjParser.h"
+
+// --------------------------------------------------------
+// One level of detail: a range of the index buffer, and how far
+// (in local space units) it strays from the full detail mesh
+//
+// If the mesh has clusters, the level's range is split into
+// Clusters[ClusterStart] to Clusters[ClusterStart + ClusterCount]
+// --------------------------------------------------------
+struct MeshLod
+{
+	unsigned int IndexStart;
+	unsigned int IndexCount;
+	float Error;
+	unsigned int ClusterStart;
+	unsigned int ClusterCount;
+};
+
+// --------------------------------------------------------
+// A small, contiguous run of triangles (a "meshlet") that can
+// be culled on its own, in local space
+//
+// - Center/Radius: bounding sphere of its vertices
+// - ConeAxis/ConeCutoff: every triangle normal is within the
+//   cone, so the whole cluster faces away from any viewer where
+//     dot(Center - eye, ConeAxis) >= ConeCutoff * |Center - eye| + Radius
+//   A cutoff of 1 or more means the cone is too wide to ever cull
+// --------------------------------------------------------
+struct MeshCluster
+{
+	unsigned int IndexStart;
+	unsigned int IndexCount;
+	DirectX::XMFLOAT3 Center;
+	float Radius;
+	DirectX::XMFLOAT3 ConeAxis;
+	float ConeCutoff;
+};
+
+// --------------------------------------------------------
+// CPU-side copy of a mesh, ready to become GPU buffers
+//
+// Everything that prepares geometry before CreateBuffer()
+// works on this, so it can run (and be checked) without
+// a Direct3D device
+// --------------------------------------------------------
+struct MeshData
+{
+	std::vector<Vertex> Vertices;
+	std::vector<unsigned int> Indices;
+
+	// Levels of detail within Indices (empty means just the whole thing)
+	std::vector<MeshLod> Lods;
+
+	// Clusters of each level (empty means no cluster culling)
+	std::vector<MeshCluster> Clusters;
+
+	// Local space bounding box of all vertices, and the smallest sphere
+	// around the box's middle that holds them all
+	DirectX::XMFLOAT3 BoundsMin = DirectX::XMFLOAT3(0, 0, 0);
+	DirectX::XMFLOAT3 BoundsMax = DirectX::XMFLOAT3(0, 0, 0);
+	float BoundsRadius = 0;
+};
+
+// --------------------------------------------------------
+// Result of welding duplicate OBJ corners together
+// --------------------------------------------------------
+struct MeshWeldStats
+{
+	unsigned int SourceVertices = 0;	// One per triangle corner, as the OBJ describes them
+	unsigned int WeldedVertices = 0;	// Unique (position, uv, normal) combinations
+
+	size_t VertexBytesSaved() const
+	{
+		return (size_t)(SourceVertices - WeldedVertices) * sizeof(Vertex);
+	}
+};
+
+// --------------------------------------------------------
+// Turns parsed OBJ data into indexed, left-handed geometry
+//
+// Corners that share the same (position, uv, normal) index
+// triple become a single vertex, so the index buffer holds
+// real sharing information
+// --------------------------------------------------------
+bool BuildMeshData(const ObjData& obj, MeshData& mesh, MeshWeldStats* stats = 0);
+
+// Recalculates BoundsMin/BoundsMax/BoundsRadius from the vertices
+void CalculateBounds(MeshData& mesh);
+
+// --------------------------------------------------------
+// 16-bit indices halve the index buffer, and work as long
+// as every vertex can be addressed by one
+// --------------------------------------------------------
+inline bool CanUse16BitIndices(size_t vertexCount)
+{
+	return vertexCount <= 0x10000;
+}
+
+// Copies 32-bit indices into 16-bit ones (caller checks they fit)
+void NarrowIndices(const unsigned int* indices, size_t indexCount, std::vector<uint16_t>& out);
@@ -0,0 +1,320 @@
+#include "MeshLoader.h"
+#include "MeshSimplifier.h"
+#include "MeshClusters.h"
+
+#include <cstring>
+
+using namespace DirectX;
+
+void PrepareGeometry(
+	PreparedMesh& result,
+	const Vertex* vertices,
+	unsigned int vertexCount,
+	const void* indices,
+	unsigned int indexCount,
+	unsigned int indexStride,
+	bool packVertices,
+	const PackedVertex* packedVertices)
+{
+	result.VertexData = vertices;
+	result.VertexCount = vertexCount;
+	result.VertexStride = sizeof(Vertex);
+	result.IndexData = indices;
+	result.IndexCount = indexCount;
+	result.IndexStride = indexStride;
+
+	result.Succeeded = vertexCount > 0 && indexCount > 0;
+	if (!result.Succeeded)
+		return;
+
+	if (indexStride == sizeof(uint32_t) && CanUse16BitIndices(vertexCount))
+	{
+		NarrowIndices((const unsigned int*)indices, indexCount, result.ShortIndices);
+		result.IndexData = &result.ShortIndices[0];
+		result.IndexStride = sizeof(uint16_t);
+	}
+
+	result.Packed = packVertices;
+	if (packVertices && packedVertices)
+	{
+		result.Quantization = GetVertexQuantization(result.BoundsMin, result.BoundsMax);
+		result.VertexData = packedVertices;
+		result.VertexStride = sizeof(PackedVertex);
+	}
+	else if (packVertices)
+	{
+		result.Quantization = GetVertexQuantization(result.BoundsMin, result.BoundsMax);
+		result.Stats.PackingError = MeasurePackingError(vertices, vertexCount, result.Quantization);
+
+		result.PackedVertices.resize(vertexCount);
+		PackVertices(vertices, vertexCount, result.Quantization, &result.PackedVertices[0]);
+		result.VertexData = &result.PackedVertices[0];
+		result.VertexStride = sizeof(PackedVertex);
+	}
+
+	result.Stats.VertexStride = result.VertexStride;
+	result.Stats.IndexStride = result.IndexStride;
+	result.Stats.Packed = result.Packed;
+}
+
+bool PrepareMesh(const char* filename, bool packVertices, PreparedMesh& result)
+{
+	return PrepareCookedMesh(filename, packVertices, result) ||
+		PrepareSourceMesh(filename, packVertices, result);
+}
+
+bool PrepareCookedMesh(const char* filename, bool packVertices, PreparedMesh& result)
+{
+	result.Stats.Name = filename;
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	// Use the cooked version if it's still up to date.  Its bytes are
+	// already laid out like the GPU buffers, packed ones included, so
+	// they go straight from the mapped file into CreateBuffer() with
+	// no parsing or copying
+	std::string cookedFile = GetCookedMeshPath(filename);
+	if (!result.Cooked.Open(cookedFile.c_str(), filename))
+		return false;
+
+	CookedMesh& cooked = result.Cooked;
+	const CookedMeshHeader* header = cooked.GetHeader();
+	result.BoundsMin = XMFLOAT3(header->BoundsMin);
+	result.BoundsMax = XMFLOAT3(header->BoundsMax);
+	result.BoundsRadius = header->BoundsRadius;
+	result.Lods.assign(cooked.GetLods(), cooked.GetLods() + cooked.GetLodCount());
+	result.Clusters.assign(cooked.GetClusters(), cooked.GetClusters() + cooked.GetClusterCount());
+	if (result.Lods.empty())
+	{
+		MeshLod lod = { 0, cooked.GetIndexCount(), 0.0f };
+		result.Lods.push_back(lod);
+	}
+
+	PrepareGeometry(result, cooked.GetVertices(), cooked.GetVertexCount(),
+		cooked.GetIndices(), cooked.GetIndexCount(), cooked.GetIndexStride(), packVertices, cooked.GetPackedVertices());
+	if (packVertices && cooked.GetPackedVertices())
+		result.Stats.PackingError = cooked.GetPackingError();
+	result.Stats.Cooked = true;
+	result.Stats.Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+	return result.Succeeded;
+}
+
+bool PrepareSourceMesh(const char* filename, bool packVertices, PreparedMesh& result, bool cook)
+{
+	result.Stats.Name = filename;
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	// Map and parse the whole file up front (in parallel for big files)
+	ObjData obj;
+	if (!ParseObjFile(filename, obj, &result.Stats.Parse))
+		return false;
+
+	// Weld identical corners so the index buffer actually shares vertices
+	MeshData& data = result.Data;
+	if (!BuildMeshData(obj, data, &result.Stats.Weld))
+		return false;
+
+	// Tangents for normal mapping (before reordering, so the sums
+	// come out the same however the optimizer shuffles things)
+	GenerateTangents(data, &result.Stats.Tangents);
+
+	// Reorder for the vertex cache, overdraw and vertex fetch
+	OptimizeMeshData(data, &result.Stats.Optimize);
+
+	// Append simplified versions to the index buffer for distant draws
+	auto lodStart = std::chrono::high_resolution_clock::now();
+	BuildLodChain(data);
+	result.Stats.LodSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - lodStart).count();
+
+	// Split every level into clusters that can be culled on their own
+	auto clusterStart = std::chrono::high_resolution_clock::now();
+	BuildMeshClusters(data);
+	result.Stats.ClusterSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - clusterStart).count();
+	result.Lods = data.Lods;
+	result.Clusters = data.Clusters;
+	result.BoundsMin = data.BoundsMin;
+	result.BoundsMax = data.BoundsMax;
+	result.BoundsRadius = data.BoundsRadius;
+
+	// Cook it for next time (failing to write just means we parse again)
+	if (cook)
+		WriteCookedMesh(GetCookedMeshPath(filename).c_str(), filename, data);
+
+	PrepareGeometry(result, &data.Vertices[0], (unsigned int)data.Vertices.size(),
+		&data.Indices[0], (unsigned int)data.Indices.size(), sizeof(uint32_t), packVertices);
+	result.Stats.Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+	return result.Succeeded;
+}
+
+// --------------------------------------------------------
+// The source path cooks, so the cooked runs that follow it
+// always have an up to date file to map
+// --------------------------------------------------------
+MeshLoadBenchmarkResult BenchmarkMeshLoad(const char* filename, bool packVertices)
+{
+	MeshLoadBenchmarkResult result;
+	result.Name = filename;
+	result.Packed = packVertices;
+
+	std::unique_ptr<PreparedMesh> source;
+	std::unique_ptr<PreparedMesh> cooked;
+	for (int run = 0; run < MESH_LOAD_BENCHMARK_RUNS; run++)
+	{
+		source.reset(new PreparedMesh());
+		if (!PrepareSourceMesh(filename, packVertices, *source))
+			return result;
+		if (run == 0 || source->Stats.Seconds < result.SourceSeconds)
+			result.SourceSeconds = source->Stats.Seconds;
+	}
+	for (int run = 0; run < MESH_LOAD_BENCHMARK_RUNS; run++)
+	{
+		cooked.reset(new PreparedMesh());
+		if (!PrepareCookedMesh(filename, packVertices, *cooked))
+			return result;
+		if (run == 0 || cooked->Stats.Seconds < result.CookedSeconds)
+			result.CookedSeconds = cooked->Stats.Seconds;
+	}
+	result.Succeeded = true;
+
+	// Pointing into the mapped file, rather than at a copy
+	const char* mappedBegin = (const char*)cooked->Cooked.GetHeader();
+	const char* mappedEnd = mappedBegin + cooked->Cooked.GetFileSize();
+	const char* vertexData = (const char*)cooked->VertexData;
+	const char* indexData = (const char*)cooked->IndexData;
+	result.ZeroCopy =
+		vertexData >= mappedBegin && vertexData < mappedEnd &&
+		indexData >= mappedBegin && indexData < mappedEnd;
+
+	result.Identical =
+		source->VertexCount == cooked->VertexCount &&
+		source->VertexStride == cooked->VertexStride &&
+		source->IndexCount == cooked->IndexCount &&
+		source->IndexStride == cooked->IndexStride &&
+		memcmp(source->VertexData, cooked->VertexData, (size_t)source->VertexCount * source->VertexStride) == 0 &&
+		memcmp(source->IndexData, cooked->IndexData, (size_t)source->IndexCount * source->IndexStride) == 0;
+	return result;
+}
+
+MeshLoader::MeshLoader(unsigned int threadCount)
+{
+	preparing = 0;
+	stopping = false;
+
+	if (threadCount == 0)
+	{
+		threadCount = std::thread::hardware_concurrency();
+		threadCount = threadCount > 1 ? threadCount - 1 : 1;
+	}
+	stats.ThreadCount = threadCount;
+	for (unsigned int i = 0; i < threadCount; i++)
+		workers.push_back(std::thread(&MeshLoader::WorkerMain, this));
+}
+
+// --------------------------------------------------------
+// Meshes still queued are dropped, and ones being prepared
+// are finished but never uploaded
+// --------------------------------------------------------
+MeshLoader::~MeshLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		queued.clear();
+	}
+	wake.notify_all();
+	for (auto& w : workers)
+		w.join();
+}
+
+void MeshLoader::Load(const char* filename, bool packVertices, UploadCallback upload)
+{
+	std::unique_ptr<Job> job(new Job());
+	job->Filename = filename;
+	job->PackVertices = packVertices;
+	job->Upload = upload;
+	job->QueueTime = std::chrono::high_resolution_clock::now();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queued.push_back(std::move(job));
+	}
+	wake.notify_one();
+}
+
+void MeshLoader::WorkerMain()
+{
+	for (;;)
+	{
+		std::unique_ptr<Job> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this]() { return stopping || !queued.empty(); });
+			if (stopping)
+				return;
+
+			job = std::move(queued.front());
+			queued.pop_front();
+			preparing++;
+		}
+
+		// Failures still go back, so whoever asked finds out
+		job->Result.reset(new PreparedMesh());
+		PrepareMesh(job->Filename.c_str(), job->PackVertices, *job->Result);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		preparing--;
+		prepared.push_back(std::move(job));
+	}
+}
+
+unsigned int MeshLoader::Update(size_t budgetBytes)
+{
+	stats.FrameUploads = 0;
+	stats.FrameBytes = 0;
+
+	for (;;)
+	{
+		std::unique_ptr<Job> job;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (prepared.empty())
+				break;
+
+			// Always take one, then only what still fits
+			size_t bytes = prepared.front()->Result->GetUploadBytes();
+			if (stats.FrameUploads > 0 && stats.FrameBytes + bytes > budgetBytes)
+				break;
+
+			job = std::move(prepared.front());
+			prepared.pop_front();
+		}
+
+		// Callbacks run without the lock, so they're free to Load() more
+		PreparedMesh& result = *job->Result;
+		double sinceQueued = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - job->QueueTime).count();
+		result.Stats.Async = true;
+		result.Stats.WaitSeconds = sinceQueued - result.Stats.Seconds;
+		job->Upload(result);
+
+		stats.FrameUploads++;
+		stats.FrameBytes += result.GetUploadBytes();
+		stats.TotalBytes += result.GetUploadBytes();
+		stats.Uploaded++;
+	}
+	return stats.FrameUploads;
+}
+
+bool MeshLoader::IsIdle()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return queued.empty() && preparing == 0 && prepared.empty();
+}
+
+MeshLoaderStats MeshLoader::GetStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	MeshLoaderStats result = stats;
+	result.Queued = (unsigned int)queued.size();
+	result.Preparing = preparing;
+	result.WaitingUpload = (unsigned int)prepared.size();
+	return result;
+}
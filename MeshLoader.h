@@ -0,0 +1,209 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Vertex.h"
+#include "ObjParser.h"
+#include "MeshData.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshTangents.h"
+#include "VertexPacking.h"
+
+// Bytes of vertex and index buffers created per frame by default
+#define MESH_UPLOAD_BUDGET_BYTES	(256 * 1024)
+
+// --------------------------------------------------------
+// Load-time numbers for a mesh, shown in the INFO window
+// --------------------------------------------------------
+struct MeshLoadStats
+{
+	std::string Name;
+	bool Cooked = false;		// Loaded straight from a .mesh file
+	bool Async = false;			// Prepared on a MeshLoader thread
+	double Seconds = 0;			// Total time from filename to GPU buffers
+	double WaitSeconds = 0;		// Async only: queued for a thread, then for an upload slot
+	double UploadSeconds = 0;	// Creating the GPU buffers
+	ObjParseStats Parse;
+	MeshWeldStats Weld;
+	MeshOptimizeStats Optimize;
+	TangentStats Tangents;
+	double LodSeconds = 0;		// Building the level of detail chain
+	double ClusterSeconds = 0;	// Splitting the levels into clusters
+
+	// What the GPU buffers ended up as
+	unsigned int VertexStride = 0;
+	unsigned int IndexStride = 0;
+	bool Packed = false;
+	VertexPackingError PackingError;
+};
+
+// --------------------------------------------------------
+// Everything about a mesh except its GPU buffers
+//
+// The vertex and index pointers are exactly what goes into
+// CreateBuffer().  They point into the mapped cooked file,
+// into Data, or into the packed/narrowed copies, so this
+// must stay put (it's always handled by pointer) until the
+// buffers exist
+// --------------------------------------------------------
+struct PreparedMesh
+{
+	bool Succeeded = false;
+
+	const void* VertexData = 0;
+	unsigned int VertexCount = 0;
+	unsigned int VertexStride = 0;
+	const void* IndexData = 0;
+	unsigned int IndexCount = 0;
+	unsigned int IndexStride = 0;	// 2 or 4 bytes
+
+	bool Packed = false;
+	VertexQuantization Quantization;
+	DirectX::XMFLOAT3 BoundsMin = DirectX::XMFLOAT3(0, 0, 0);
+	DirectX::XMFLOAT3 BoundsMax = DirectX::XMFLOAT3(0, 0, 0);
+	float BoundsRadius = 0;
+	std::vector<MeshLod> Lods;
+	std::vector<MeshCluster> Clusters;
+	MeshLoadStats Stats;
+
+	// Backing storage for the pointers above
+	CookedMesh Cooked;
+	MeshData Data;
+	std::vector<PackedVertex> PackedVertices;
+	std::vector<uint16_t> ShortIndices;
+
+	size_t GetUploadBytes() const
+	{
+		return (size_t)VertexCount * VertexStride + (size_t)IndexCount * IndexStride;
+	}
+};
+
+// --------------------------------------------------------
+// Packs the vertices if requested and narrows 32-bit indices
+// to 16-bit whenever the vertex count allows, filling in the
+// buffer pointers of the prepared mesh.  The inputs must
+// outlive it (or be its own Cooked/Data)
+//
+// packedVertices, if given, are the vertices already packed
+// against result's bounds (from a cooked file), and are used
+// as they are instead of packing again
+// --------------------------------------------------------
+void PrepareGeometry(
+	PreparedMesh& result,
+	const Vertex* vertices,
+	unsigned int vertexCount,
+	const void* indices,
+	unsigned int indexCount,
+	unsigned int indexStride,
+	bool packVertices,
+	const PackedVertex* packedVertices = 0);
+
+// --------------------------------------------------------
+// All the CPU work of loading a mesh file: maps the cooked
+// version if it's up to date, otherwise parses, welds,
+// generates tangents, optimizes, builds levels of detail and
+// clusters, and cooks it for next time.  Safe to call from
+// any thread, since nothing here touches the device
+// --------------------------------------------------------
+bool PrepareMesh(const char* filename, bool packVertices, PreparedMesh& result);
+
+// The two halves of PrepareMesh().  The cooked one fails if
+// there's no up to date .mesh file; the source one always
+// parses, and only writes the .mesh if cook is set
+bool PrepareCookedMesh(const char* filename, bool packVertices, PreparedMesh& result);
+bool PrepareSourceMesh(const char* filename, bool packVertices, PreparedMesh& result, bool cook = true);
+
+// Runs of each path in BenchmarkMeshLoad(), keeping the fastest
+#define MESH_LOAD_BENCHMARK_RUNS	5
+
+// --------------------------------------------------------
+// Loading one mesh from its OBJ vs from its cooked file, for
+// the INFO window.  CPU side only, up to the buffer pointers
+// --------------------------------------------------------
+struct MeshLoadBenchmarkResult
+{
+	std::string Name;
+	bool Packed = false;
+	bool Succeeded = false;
+	double SourceSeconds = 0;	// Parsing and processing the OBJ (and cooking it)
+	double CookedSeconds = 0;	// Mapping the .mesh
+	bool ZeroCopy = false;		// Cooked vertices and indices used straight from the mapped file
+	bool Identical = false;		// Same vertex and index bytes either way
+};
+
+MeshLoadBenchmarkResult BenchmarkMeshLoad(const char* filename, bool packVertices);
+
+// --------------------------------------------------------
+// What a MeshLoader has done so far, for the INFO window
+// --------------------------------------------------------
+struct MeshLoaderStats
+{
+	unsigned int ThreadCount = 0;
+	unsigned int Queued = 0;			// Waiting for a thread
+	unsigned int Preparing = 0;			// On a thread right now
+	unsigned int WaitingUpload = 0;		// Prepared, waiting for Update()
+	unsigned int Uploaded = 0;			// Total handed to upload callbacks
+	unsigned int FrameUploads = 0;		// By the last Update()
+	size_t FrameBytes = 0;
+	size_t TotalBytes = 0;
+};
+
+// --------------------------------------------------------
+// Prepares meshes on worker threads and hands them back to
+// the thread that owns the device, a few at a time
+//
+// Load() returns immediately.  Update() runs on the owning
+// thread (once a frame) and calls the upload callback of each
+// finished mesh, in the order they finished, until the byte
+// budget is spent.  At least one mesh goes up per call so a
+// mesh bigger than the budget can't stall forever.
+//
+// Nothing here knows about D3D: the callback does the actual
+// CreateBuffer() calls, so any stand-in works for timing
+// --------------------------------------------------------
+class MeshLoader
+{
+public:
+	typedef std::function<void(PreparedMesh&)> UploadCallback;
+
+	// threadCount 0 leaves one hardware thread for rendering
+	MeshLoader(unsigned int threadCount = 0);
+	~MeshLoader();
+
+	void Load(const char* filename, bool packVertices, UploadCallback upload);
+	unsigned int Update(size_t budgetBytes = MESH_UPLOAD_BUDGET_BYTES);
+
+	bool IsIdle();
+	MeshLoaderStats GetStats();
+
+private:
+	struct Job
+	{
+		std::string Filename;
+		bool PackVertices;
+		UploadCallback Upload;
+		std::chrono::high_resolution_clock::time_point QueueTime;
+		std::unique_ptr<PreparedMesh> Result;
+	};
+
+	void WorkerMain();
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<std::unique_ptr<Job>> queued;
+	std::deque<std::unique_ptr<Job>> prepared;
+	unsigned int preparing;
+	bool stopping;
+	MeshLoaderStats stats;
+};
@@ -0,0 +1,537 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+
+using namespace DirectX;
+
+// Tuning values from Forsyth's original write-up
+#define FORSYTH_CACHE_SIZE			32
+#define FORSYTH_MAX_VALENCE			32
+#define FORSYTH_CACHE_DECAY_POWER	1.5f
+#define FORSYTH_LAST_TRI_SCORE		0.75f
+#define FORSYTH_VALENCE_BOOST_SCALE	2.0f
+#define FORSYTH_VALENCE_BOOST_POWER	0.5f
+
+// Resolution of each view in the overdraw rasterizer
+#define OVERDRAW_VIEW_SIZE			256
+
+// --------------------------------------------------------
+// Precomputed parts of a Forsyth vertex score
+// --------------------------------------------------------
+struct ForsythScoreTable
+{
+	float Cache[FORSYTH_CACHE_SIZE];
+	float Valence[FORSYTH_MAX_VALENCE];
+
+	ForsythScoreTable()
+	{
+		for (int i = 0; i < FORSYTH_CACHE_SIZE; i++)
+		{
+			// The three verts of the last triangle get a fixed score so
+			// we don't just keep fanning around the same vertex
+			if (i < 3)
+				Cache[i] = FORSYTH_LAST_TRI_SCORE;
+			else
+				Cache[i] = powf(1.0f - (i - 3) / float(FORSYTH_CACHE_SIZE - 3), FORSYTH_CACHE_DECAY_POWER);
+		}
+
+		// Verts with few triangles left get a boost so they're finished
+		// off instead of being left as lone triangles for later
+		Valence[0] = 0;
+		for (int i = 1; i < FORSYTH_MAX_VALENCE; i++)
+			Valence[i] = FORSYTH_VALENCE_BOOST_SCALE * powf((float)i, -FORSYTH_VALENCE_BOOST_POWER);
+	}
+
+	float Score(int cachePosition, unsigned int remainingTriangles) const
+	{
+		if (remainingTriangles == 0)
+			return -1.0f;
+
+		float score = cachePosition >= 0 ? Cache[cachePosition] : 0.0f;
+		return score + Valence[std::min(remainingTriangles, (unsigned int)FORSYTH_MAX_VALENCE - 1)];
+	}
+};
+
+void OptimizeMeshData(MeshData& mesh, MeshOptimizeStats* stats)
+{
+	unsigned int* indices = &mesh.Indices[0];
+	size_t indexCount = mesh.Indices.size();
+	size_t vertexCount = mesh.Vertices.size();
+
+	if (stats)
+	{
+		stats->CacheBefore = AnalyzeVertexCache(indices, indexCount, vertexCount);
+		stats->OverdrawBefore = AnalyzeOverdraw(indices, indexCount, &mesh.Vertices[0], vertexCount);
+	}
+
+	// Only the optimizing is timed, not the analysis on either side
+	auto startTime = std::chrono::high_resolution_clock::now();
+	OptimizeVertexCache(indices, indexCount, vertexCount);
+	OptimizeOverdraw(indices, indexCount, &mesh.Vertices[0], vertexCount);
+	OptimizeVertexFetch(mesh.Vertices, mesh.Indices);
+
+	if (stats)
+	{
+		stats->Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+		stats->CacheAfter = AnalyzeVertexCache(&mesh.Indices[0], mesh.Indices.size(), mesh.Vertices.size());
+		stats->OverdrawAfter = AnalyzeOverdraw(&mesh.Indices[0], mesh.Indices.size(), &mesh.Vertices[0], mesh.Vertices.size());
+	}
+}
+
+void OptimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount)
+{
+	static const ForsythScoreTable scoreTable;
+
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0 || vertexCount == 0)
+		return;
+
+	// Build the vertex -> triangle adjacency.  The first "remaining"
+	// entries of each vertex's list are the triangles not yet emitted
+	std::vector<unsigned int> remaining(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		remaining[indices[i]]++;
+
+	std::vector<unsigned int> adjacencyStart(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		adjacencyStart[v + 1] = adjacencyStart[v] + remaining[v];
+
+	std::vector<unsigned int> adjacency(triangleCount * 3);
+	{
+		std::vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++)
+			for (int c = 0; c < 3; c++)
+				adjacency[fill[indices[t * 3 + c]]++] = (unsigned int)t;
+	}
+
+	// Initial scores, with nothing in the cache
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		vertexScore[v] = scoreTable.Score(-1, remaining[v]);
+
+	std::vector<bool> emitted(triangleCount, false);
+
+	std::vector<unsigned int> output(triangleCount * 3);
+	unsigned int cache[FORSYTH_CACHE_SIZE + 3];
+	unsigned int newCache[FORSYTH_CACHE_SIZE + 3];
+	int cacheCount = 0;
+
+	size_t scanCursor = 0;
+	int bestTriangle = -1;
+	for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		// Nothing in the cache is useful, so move on to the next triangle
+		// in input order (keeps this linear instead of rescanning everything)
+		if (bestTriangle < 0)
+		{
+			while (emitted[scanCursor]) scanCursor++;
+			bestTriangle = (int)scanCursor;
+		}
+
+		const unsigned int* tri = &indices[bestTriangle * 3];
+		output[emittedCount * 3 + 0] = tri[0];
+		output[emittedCount * 3 + 1] = tri[1];
+		output[emittedCount * 3 + 2] = tri[2];
+		emitted[bestTriangle] = true;
+
+		// Take the triangle out of its vertices' remaining lists
+		for (int c = 0; c < 3; c++)
+		{
+			unsigned int v = tri[c];
+			unsigned int* list = &adjacency[adjacencyStart[v]];
+			for (unsigned int i = 0; i < remaining[v]; i++)
+			{
+				if (list[i] == (unsigned int)bestTriangle)
+				{
+					std::swap(list[i], list[remaining[v] - 1]);
+					remaining[v]--;
+					break;
+				}
+			}
+		}
+
+		// The new triangle's verts go to the front of the LRU cache
+		int newCount = 0;
+		newCache[newCount++] = tri[0];
+		newCache[newCount++] = tri[1];
+		newCache[newCount++] = tri[2];
+		for (int i = 0; i < cacheCount; i++)
+		{
+			unsigned int v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				newCache[newCount++] = v;
+		}
+
+		// Rescore everything that moved (including what fell out) and
+		// pick the best triangle touching the cache for next time
+		for (int i = 0; i < newCount; i++)
+		{
+			unsigned int v = newCache[i];
+			cachePosition[v] = i < FORSYTH_CACHE_SIZE ? i : -1;
+			vertexScore[v] = scoreTable.Score(cachePosition[v], remaining[v]);
+		}
+
+		bestTriangle = -1;
+		float bestScore = -FLT_MAX;
+		for (int i = 0; i < newCount; i++)
+		{
+			unsigned int v = newCache[i];
+			const unsigned int* list = &adjacency[adjacencyStart[v]];
+			for (unsigned int j = 0; j < remaining[v]; j++)
+			{
+				unsigned int t = list[j];
+				float score =
+					vertexScore[indices[t * 3 + 0]] +
+					vertexScore[indices[t * 3 + 1]] +
+					vertexScore[indices[t * 3 + 2]];
+
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = (int)t;
+				}
+			}
+		}
+
+		cacheCount = std::min(newCount, FORSYTH_CACHE_SIZE);
+		std::copy(newCache, newCache + cacheCount, cache);
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+// --------------------------------------------------------
+// Number of cache misses for each triangle in a FIFO cache,
+// starting empty at the first triangle
+// --------------------------------------------------------
+static void SimulateFifoMisses(
+	const unsigned int* indices,
+	size_t triangleStart,
+	size_t triangleEnd,
+	std::vector<unsigned int>& timestamps,
+	unsigned int& time,
+	unsigned char* missesOut)
+{
+	for (size_t t = triangleStart; t < triangleEnd; t++)
+	{
+		unsigned char misses = 0;
+		for (int c = 0; c < 3; c++)
+		{
+			unsigned int v = indices[t * 3 + c];
+			if (time - timestamps[v] > VERTEX_CACHE_FIFO_SIZE)
+			{
+				timestamps[v] = ++time;
+				misses++;
+			}
+		}
+		missesOut[t] = misses;
+	}
+}
+
+void OptimizeOverdraw(
+	unsigned int* indices,
+	size_t indexCount,
+	const Vertex* vertices,
+	size_t vertexCount,
+	float threshold)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Hard boundaries: triangles that miss on all three verts are
+	// where the cache order effectively starts over anyway
+	std::vector<unsigned char> misses(triangleCount);
+	std::vector<unsigned int> timestamps(vertexCount, 0);
+	unsigned int time = VERTEX_CACHE_FIFO_SIZE + 1;
+	SimulateFifoMisses(indices, 0, triangleCount, timestamps, time, &misses[0]);
+
+	std::vector<size_t> hardClusters;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if (t == 0 || misses[t] == 3)
+			hardClusters.push_back(t);
+	}
+	hardClusters.push_back(triangleCount);
+
+	// Soft boundaries: within each hard cluster, cut again whenever
+	// the ACMR so far is already as good as the cluster as a whole
+	// (within threshold), since restarting there costs almost nothing
+	std::vector<size_t> clusters;
+	for (size_t h = 0; h + 1 < hardClusters.size(); h++)
+	{
+		size_t start = hardClusters[h];
+		size_t end = hardClusters[h + 1];
+
+		time += VERTEX_CACHE_FIFO_SIZE + 1;
+		SimulateFifoMisses(indices, start, end, timestamps, time, &misses[0]);
+
+		unsigned int clusterMisses = 0;
+		for (size_t t = start; t < end; t++)
+			clusterMisses += misses[t];
+		float clusterThreshold = threshold * clusterMisses / float(end - start);
+
+		clusters.push_back(start);
+		time += VERTEX_CACHE_FIFO_SIZE + 1;
+		unsigned int runningMisses = 0;
+		size_t runningStart = start;
+		for (size_t t = start; t < end; t++)
+		{
+			SimulateFifoMisses(indices, t, t + 1, timestamps, time, &misses[0]);
+			runningMisses += misses[t];
+
+			if (t + 1 < end && runningMisses <= clusterThreshold * (t + 1 - runningStart))
+			{
+				clusters.push_back(t + 1);
+				time += VERTEX_CACHE_FIFO_SIZE + 1;
+				runningMisses = 0;
+				runningStart = t + 1;
+			}
+		}
+	}
+	clusters.push_back(triangleCount);
+
+	// Area weighted centroid of the whole mesh
+	XMVECTOR meshCentroid = XMVectorZero();
+	float meshArea = 0;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		XMVECTOR p0 = XMLoadFloat3(&vertices[indices[t * 3 + 0]].Position);
+		XMVECTOR p1 = XMLoadFloat3(&vertices[indices[t * 3 + 1]].Position);
+		XMVECTOR p2 = XMLoadFloat3(&vertices[indices[t * 3 + 2]].Position);
+		float area = XMVectorGetX(XMVector3Length(XMVector3Cross(p1 - p0, p2 - p0)));
+		meshCentroid += (p0 + p1 + p2) * (area / 3.0f);
+		meshArea += area;
+	}
+	meshCentroid = meshArea > 0 ? meshCentroid / meshArea : meshCentroid;
+
+	// Sort key: how far the cluster faces away from the mesh center.
+	// Clusters on the outside facing out are the likely occluders
+	struct ClusterKey { float Key; size_t Cluster; };
+	std::vector<ClusterKey> keys(clusters.size() - 1);
+	for (size_t c = 0; c + 1 < clusters.size(); c++)
+	{
+		XMVECTOR centroid = XMVectorZero();
+		XMVECTOR normal = XMVectorZero();
+		float area = 0;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+		{
+			XMVECTOR p0 = XMLoadFloat3(&vertices[indices[t * 3 + 0]].Position);
+			XMVECTOR p1 = XMLoadFloat3(&vertices[indices[t * 3 + 1]].Position);
+			XMVECTOR p2 = XMLoadFloat3(&vertices[indices[t * 3 + 2]].Position);
+			XMVECTOR cross = XMVector3Cross(p1 - p0, p2 - p0);
+			float triArea = XMVectorGetX(XMVector3Length(cross));
+			centroid += (p0 + p1 + p2) * (triArea / 3.0f);
+			normal += cross;
+			area += triArea;
+		}
+		centroid = area > 0 ? centroid / area : centroid;
+		normal = XMVector3Normalize(normal);
+
+		keys[c].Key = XMVectorGetX(XMVector3Dot(centroid - meshCentroid, normal));
+		keys[c].Cluster = c;
+	}
+
+	std::stable_sort(keys.begin(), keys.end(),
+		[](const ClusterKey& a, const ClusterKey& b) { return a.Key > b.Key; });
+
+	std::vector<unsigned int> output;
+	output.reserve(triangleCount * 3);
+	for (const ClusterKey& k : keys)
+	{
+		output.insert(output.end(),
+			indices + clusters[k.Cluster] * 3,
+			indices + clusters[k.Cluster + 1] * 3);
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	const unsigned int unused = 0xFFFFFFFF;
+	std::vector<unsigned int> remap(vertices.size(), unused);
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+
+	for (unsigned int& index : indices)
+	{
+		if (remap[index] == unused)
+		{
+			remap[index] = (unsigned int)reordered.size();
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	vertices.swap(reordered);
+}
+
+VertexCacheStats AnalyzeVertexCache(
+	const unsigned int* indices,
+	size_t indexCount,
+	size_t vertexCount,
+	unsigned int cacheSize)
+{
+	VertexCacheStats stats;
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return stats;
+
+	// A vertex is still cached if fewer than cacheSize misses happened
+	// since it was last loaded
+	std::vector<unsigned int> timestamps(vertexCount, 0);
+	std::vector<bool> used(vertexCount, false);
+	unsigned int time = cacheSize + 1;
+	unsigned int uniqueVertices = 0;
+
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		unsigned int v = indices[i];
+		if (time - timestamps[v] > cacheSize)
+		{
+			timestamps[v] = ++time;
+			stats.Transforms++;
+		}
+		if (!used[v])
+		{
+			used[v] = true;
+			uniqueVertices++;
+		}
+	}
+
+	stats.ACMR = stats.Transforms / float(triangleCount);
+	stats.ATVR = uniqueVertices > 0 ? stats.Transforms / float(uniqueVertices) : 0;
+	return stats;
+}
+
+// --------------------------------------------------------
+// Depth tested rasterization of one triangle, counting every
+// fragment that passes as a pixel shader invocation
+// --------------------------------------------------------
+static void RasterizeOverdraw(
+	const XMFLOAT3& a,
+	const XMFLOAT3& b,
+	const XMFLOAT3& c,
+	float* depth,
+	unsigned int& shaded)
+{
+	// Make the winding consistent for the edge tests
+	float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if (area == 0)
+		return;
+	const XMFLOAT3& p0 = a;
+	const XMFLOAT3& p1 = area > 0 ? b : c;
+	const XMFLOAT3& p2 = area > 0 ? c : b;
+	area = fabsf(area);
+
+	int minX = std::max(0, (int)floorf(std::min(p0.x, std::min(p1.x, p2.x))));
+	int minY = std::max(0, (int)floorf(std::min(p0.y, std::min(p1.y, p2.y))));
+	int maxX = std::min(OVERDRAW_VIEW_SIZE - 1, (int)ceilf(std::max(p0.x, std::max(p1.x, p2.x))));
+	int maxY = std::min(OVERDRAW_VIEW_SIZE - 1, (int)ceilf(std::max(p0.y, std::max(p1.y, p2.y))));
+
+	for (int y = minY; y <= maxY; y++)
+	{
+		for (int x = minX; x <= maxX; x++)
+		{
+			// Sample at the pixel center
+			float px = x + 0.5f;
+			float py = y + 0.5f;
+			float w0 = (p2.x - p1.x) * (py - p1.y) - (p2.y - p1.y) * (px - p1.x);
+			float w1 = (p0.x - p2.x) * (py - p2.y) - (p0.y - p2.y) * (px - p2.x);
+			float w2 = (p1.x - p0.x) * (py - p0.y) - (p1.y - p0.y) * (px - p0.x);
+			if (w0 < 0 || w1 < 0 || w2 < 0)
+				continue;
+
+			float z = (w0 * p0.z + w1 * p1.z + w2 * p2.z) / area;
+			float& stored = depth[y * OVERDRAW_VIEW_SIZE + x];
+			if (z < stored)
+			{
+				stored = z;
+				shaded++;
+			}
+		}
+	}
+}
+
+OverdrawStats AnalyzeOverdraw(
+	const unsigned int* indices,
+	size_t indexCount,
+	const Vertex* vertices,
+	size_t vertexCount)
+{
+	OverdrawStats stats;
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0 || vertexCount == 0)
+		return stats;
+
+	// Fit the mesh into the view with a uniform scale
+	XMVECTOR minV = XMLoadFloat3(&vertices[0].Position);
+	XMVECTOR maxV = minV;
+	for (size_t v = 1; v < vertexCount; v++)
+	{
+		XMVECTOR p = XMLoadFloat3(&vertices[v].Position);
+		minV = XMVectorMin(minV, p);
+		maxV = XMVectorMax(maxV, p);
+	}
+	XMFLOAT3 boundsMin, extent;
+	XMStoreFloat3(&boundsMin, minV);
+	XMStoreFloat3(&extent, maxV - minV);
+	float largest = std::max(extent.x, std::max(extent.y, extent.z));
+	float scale = largest > 0 ? (OVERDRAW_VIEW_SIZE - 1) / largest : 0;
+
+	std::vector<float> depth(OVERDRAW_VIEW_SIZE * OVERDRAW_VIEW_SIZE);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		for (int direction = -1; direction <= 1; direction += 2)
+		{
+			std::fill(depth.begin(), depth.end(), FLT_MAX);
+
+			for (size_t t = 0; t < triangleCount; t++)
+			{
+				const XMFLOAT3* p[3] =
+				{
+					&vertices[indices[t * 3 + 0]].Position,
+					&vertices[indices[t * 3 + 1]].Position,
+					&vertices[indices[t * 3 + 2]].Position,
+				};
+
+				// Project onto the plane of the other two axes, with depth
+				// measured along the view direction
+				XMFLOAT3 s[3];
+				for (int i = 0; i < 3; i++)
+				{
+					const float* f = &p[i]->x;
+					const float* m = &boundsMin.x;
+					s[i].x = (f[(axis + 1) % 3] - m[(axis + 1) % 3]) * scale;
+					s[i].y = (f[(axis + 2) % 3] - m[(axis + 2) % 3]) * scale;
+					s[i].z = f[axis] * direction;
+				}
+
+				// Back face culling, same as the default rasterizer state.
+				// Front faces are clockwise in a left-handed space, so their
+				// cross product points back towards the viewer
+				XMVECTOR p0 = XMLoadFloat3(p[0]);
+				XMFLOAT3 cross;
+				XMStoreFloat3(&cross, XMVector3Cross(XMLoadFloat3(p[1]) - p0, XMLoadFloat3(p[2]) - p0));
+				if ((&cross.x)[axis] * direction >= 0)
+					continue;
+
+				RasterizeOverdraw(s[0], s[1], s[2], &depth[0], stats.PixelsShaded);
+			}
+
+			for (float d : depth)
+			{
+				if (d != FLT_MAX)
+					stats.PixelsCovered++;
+			}
+		}
+	}
+
+	stats.Overdraw = stats.PixelsCovered > 0 ? stats.PixelsShaded / float(stats.PixelsCovered) : 0;
+	return stats;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vector>
+#include "Vertex.h"
+#include "MeshData.h"
+
+// --------------------------------------------------------
+// How well an index order reuses the post-transform vertex
+// cache, measured with a simulated FIFO cache
+//
+// - ACMR: vertex shader runs per triangle (0.5 is ideal on
+//   large regular grids, 3.0 is no reuse at all)
+// - ATVR: vertex shader runs per unique vertex (1.0 is ideal)
+// --------------------------------------------------------
+struct VertexCacheStats
+{
+	unsigned int Transforms = 0;
+	float ACMR = 0;
+	float ATVR = 0;
+};
+
+// --------------------------------------------------------
+// How many times each covered pixel gets shaded, measured by
+// rasterizing the mesh in software from the six axis views
+// (1.0 means no pixel was shaded more than once)
+// --------------------------------------------------------
+struct OverdrawStats
+{
+	unsigned int PixelsCovered = 0;
+	unsigned int PixelsShaded = 0;
+	float Overdraw = 0;
+};
+
+// --------------------------------------------------------
+// Before/after numbers for one pass of OptimizeMeshData()
+// --------------------------------------------------------
+struct MeshOptimizeStats
+{
+	VertexCacheStats CacheBefore;
+	VertexCacheStats CacheAfter;
+	OverdrawStats OverdrawBefore;
+	OverdrawStats OverdrawAfter;
+	double Seconds = 0;
+};
+
+// Size of the FIFO cache used for analysis and cluster splitting
+#define VERTEX_CACHE_FIFO_SIZE	16
+
+// --------------------------------------------------------
+// Runs every optimization below in the order they're meant
+// to be used: vertex cache, then overdraw, then vertex fetch
+// --------------------------------------------------------
+void OptimizeMeshData(MeshData& mesh, MeshOptimizeStats* stats = 0);
+
+// --------------------------------------------------------
+// Reorders triangles to maximize vertex cache hits
+//
+// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation":
+// greedily emits the best scoring triangle that touches the
+// simulated cache, falling back to the next unused triangle
+// in the original order when the cache has nothing left
+// --------------------------------------------------------
+void OptimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount);
+
+// --------------------------------------------------------
+// Reorders clusters of triangles so outward facing ones are
+// drawn first, which lets early-Z reject more of what's
+// behind them
+//
+// Clusters are cut where the cache order already restarts
+// (so the vertex cache isn't hurt), and then further wherever
+// splitting keeps ACMR within threshold of the original.
+// Run this AFTER OptimizeVertexCache().
+// --------------------------------------------------------
+void OptimizeOverdraw(
+	unsigned int* indices,
+	size_t indexCount,
+	const Vertex* vertices,
+	size_t vertexCount,
+	float threshold = 1.05f);
+
+// --------------------------------------------------------
+// Reorders vertices into the order the index buffer first
+// uses them, for better memory locality when fetching.
+// Unused vertices are dropped.  Run this LAST.
+// --------------------------------------------------------
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+// Measures an index order against a FIFO cache of the given size
+VertexCacheStats AnalyzeVertexCache(
+	const unsigned int* indices,
+	size_t indexCount,
+	size_t vertexCount,
+	unsigned int cacheSize = VERTEX_CACHE_FIFO_SIZE);
+
+// Measures overdraw of an index order (depth tested, back faces culled)
+OverdrawStats AnalyzeOverdraw(
+	const unsigned int* indices,
+	size_t indexCount,
+	const Vertex* vertices,
+	size_t vertexCount);
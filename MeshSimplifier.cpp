@@ -0,0 +1,515 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+using namespace DirectX;
+
+// Vertex normals further apart than this (cos 60 degrees) never merge
+#define SIMPLIFY_NORMAL_LIMIT	0.5f
+
+// Marks an empty slot in the position table
+static const unsigned int EmptySlot = 0xFFFFFFFF;
+
+// --------------------------------------------------------
+// Sum of squared distances to a set of planes, stored as the
+// upper half of a symmetric 4x4 matrix.  Planes are weighted by
+// triangle area, and dividing by the total weight turns the sum
+// back into a (mean squared) distance
+// --------------------------------------------------------
+struct Quadric
+{
+	double A00, A01, A02, A03;
+	double A11, A12, A13;
+	double A22, A23;
+	double A33;
+	double Weight;
+};
+
+static void QuadricAddPlane(Quadric& q, double a, double b, double c, double d, double w)
+{
+	q.A00 += w * a * a; q.A01 += w * a * b; q.A02 += w * a * c; q.A03 += w * a * d;
+	q.A11 += w * b * b; q.A12 += w * b * c; q.A13 += w * b * d;
+	q.A22 += w * c * c; q.A23 += w * c * d;
+	q.A33 += w * d * d;
+	q.Weight += w;
+}
+
+static void QuadricAdd(Quadric& q, const Quadric& other)
+{
+	q.A00 += other.A00; q.A01 += other.A01; q.A02 += other.A02; q.A03 += other.A03;
+	q.A11 += other.A11; q.A12 += other.A12; q.A13 += other.A13;
+	q.A22 += other.A22; q.A23 += other.A23;
+	q.A33 += other.A33;
+	q.Weight += other.Weight;
+}
+
+static double QuadricError(const Quadric& q, const XMFLOAT3& p)
+{
+	double x = p.x, y = p.y, z = p.z;
+	double e =
+		q.A00 * x * x + q.A11 * y * y + q.A22 * z * z + q.A33 +
+		2 * (q.A01 * x * y + q.A02 * x * z + q.A12 * y * z + q.A03 * x + q.A13 * y + q.A23 * z);
+	return q.Weight > 0 ? fabs(e) / q.Weight : 0;
+}
+
+static inline uint32_t HashPosition(const XMFLOAT3& p)
+{
+	uint32_t x, y, z;
+	memcpy(&x, &p.x, 4);
+	memcpy(&y, &p.y, 4);
+	memcpy(&z, &p.z, 4);
+	uint32_t h = (x * 73856093u) ^ (y * 19349663u) ^ (z * 83492791u);
+	return h ^ (h >> 16);
+}
+
+// --------------------------------------------------------
+// Maps every vertex to the first vertex with the same position,
+// so split vertices (seams, hard edges) act as one while
+// simplifying
+// --------------------------------------------------------
+static void BuildPositionRemap(
+	const Vertex* vertices,
+	size_t vertexCount,
+	std::vector<unsigned int>& remap)
+{
+	size_t capacity = 16;
+	while (capacity < vertexCount * 2) capacity <<= 1;
+	size_t mask = capacity - 1;
+	std::vector<unsigned int> table(capacity, EmptySlot);
+
+	remap.resize(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		const XMFLOAT3& p = vertices[v].Position;
+		size_t slot = HashPosition(p) & mask;
+		while (table[slot] != EmptySlot)
+		{
+			const XMFLOAT3& other = vertices[table[slot]].Position;
+			if (other.x == p.x && other.y == p.y && other.z == p.z)
+				break;
+			slot = (slot + 1) & mask;
+		}
+
+		if (table[slot] == EmptySlot)
+			table[slot] = (unsigned int)v;
+
+		remap[v] = table[slot];
+	}
+}
+
+// --------------------------------------------------------
+// Finds (canonical) vertices that must not be removed: anything
+// on an open border or on a non-manifold edge
+// --------------------------------------------------------
+static void FindLockedVertices(
+	const std::vector<unsigned int>& indices,
+	const std::vector<unsigned int>& remap,
+	std::vector<bool>& locked)
+{
+	locked.assign(remap.size(), false);
+
+	// Every interior edge shows up exactly once in each direction
+	std::vector<uint64_t> edges;
+	edges.reserve(indices.size());
+	for (size_t t = 0; t < indices.size(); t += 3)
+	{
+		for (int e = 0; e < 3; e++)
+		{
+			uint64_t a = remap[indices[t + e]];
+			uint64_t b = remap[indices[t + (e + 1) % 3]];
+			edges.push_back((a << 32) | b);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	for (size_t i = 0; i < edges.size(); i++)
+	{
+		uint64_t a = edges[i] >> 32;
+		uint64_t b = edges[i] & 0xFFFFFFFF;
+		bool duplicate = (i > 0 && edges[i - 1] == edges[i]) || (i + 1 < edges.size() && edges[i + 1] == edges[i]);
+		bool hasTwin = std::binary_search(edges.begin(), edges.end(), (b << 32) | a);
+		if (duplicate || !hasTwin)
+		{
+			locked[(size_t)a] = true;
+			locked[(size_t)b] = true;
+		}
+	}
+}
+
+static inline XMVECTOR TriangleNormal(const XMFLOAT3& p0, const XMFLOAT3& p1, const XMFLOAT3& p2)
+{
+	XMVECTOR v0 = XMLoadFloat3(&p0);
+	return XMVector3Cross(XMLoadFloat3(&p1) - v0, XMLoadFloat3(&p2) - v0);
+}
+
+static inline float Dot3(XMVECTOR a, XMVECTOR b)
+{
+	return XMVectorGetX(XMVector3Dot(a, b));
+}
+
+static inline float Distance(XMVECTOR a, XMVECTOR b)
+{
+	return XMVectorGetX(XMVector3Length(a - b));
+}
+
+// --------------------------------------------------------
+// Distance from p to the closest point of triangle abc
+// (Ericson, Real-Time Collision Detection, 5.1.5)
+// --------------------------------------------------------
+static float PointTriangleDistance(XMVECTOR p, XMVECTOR a, XMVECTOR b, XMVECTOR c)
+{
+	XMVECTOR ab = b - a;
+	XMVECTOR ac = c - a;
+	float d1 = Dot3(ab, p - a);
+	float d2 = Dot3(ac, p - a);
+	if (d1 <= 0 && d2 <= 0)
+		return Distance(p, a);
+
+	float d3 = Dot3(ab, p - b);
+	float d4 = Dot3(ac, p - b);
+	if (d3 >= 0 && d4 <= d3)
+		return Distance(p, b);
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0 && d1 >= 0 && d3 <= 0)
+		return Distance(p, a + ab * (d1 / (d1 - d3)));
+
+	float d5 = Dot3(ab, p - c);
+	float d6 = Dot3(ac, p - c);
+	if (d6 >= 0 && d5 <= d6)
+		return Distance(p, c);
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0 && d2 >= 0 && d6 <= 0)
+		return Distance(p, a + ac * (d2 / (d2 - d6)));
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+		return Distance(p, b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))));
+
+	float denom = va + vb + vc;
+	if (denom == 0)
+		return Distance(p, a);
+	return Distance(p, a + ab * (vb / denom) + ac * (vc / denom));
+}
+
+// --------------------------------------------------------
+// Lists the triangles around each (canonical) vertex:
+// triangles[start[v]] to triangles[start[v + 1]]
+// --------------------------------------------------------
+static void BuildTriangleAdjacency(
+	const std::vector<unsigned int>& indices,
+	const std::vector<unsigned int>& remap,
+	std::vector<unsigned int>& start,
+	std::vector<unsigned int>& triangles)
+{
+	size_t vertexCount = remap.size();
+	start.assign(vertexCount + 1, 0);
+	for (unsigned int index : indices)
+		start[remap[index] + 1]++;
+	for (size_t v = 0; v < vertexCount; v++)
+		start[v + 1] += start[v];
+
+	triangles.resize(indices.size());
+	std::vector<unsigned int> fill(start.begin(), start.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++)
+		triangles[fill[remap[indices[i]]]++] = (unsigned int)(i / 3);
+}
+
+struct EdgeCollapse
+{
+	unsigned int From;	// Position being removed (canonical vertex)
+	unsigned int To;	// Position it merges into
+	float Cost;			// Quadric error, squared distance
+};
+
+struct WedgePair
+{
+	unsigned int From;
+	unsigned int To;
+};
+
+float SimplifyMesh(
+	const Vertex* vertices,
+	size_t vertexCount,
+	const unsigned int* indices,
+	size_t indexCount,
+	size_t targetIndexCount,
+	float maxError,
+	std::vector<unsigned int>& result)
+{
+	result.assign(indices, indices + indexCount - indexCount % 3);
+	if (result.size() <= targetIndexCount || vertexCount == 0)
+		return 0;
+
+	std::vector<unsigned int> remap;
+	std::vector<bool> locked;
+	BuildPositionRemap(vertices, vertexCount, remap);
+	FindLockedVertices(result, remap, locked);
+
+	// Every position starts with the planes of the triangles around it
+	std::vector<Quadric> quadrics(vertexCount);
+	memset(&quadrics[0], 0, sizeof(Quadric) * vertexCount);
+	for (size_t t = 0; t < result.size(); t += 3)
+	{
+		XMVECTOR normal = TriangleNormal(
+			vertices[result[t]].Position,
+			vertices[result[t + 1]].Position,
+			vertices[result[t + 2]].Position);
+		float length = XMVectorGetX(XMVector3Length(normal));
+		if (length == 0)
+			continue;
+
+		XMFLOAT3 n;
+		XMStoreFloat3(&n, normal / length);
+		const XMFLOAT3& p = vertices[result[t]].Position;
+		double d = -(n.x * p.x + n.y * p.y + n.z * p.z);
+		for (int c = 0; c < 3; c++)
+			QuadricAddPlane(quadrics[remap[result[t + c]]], n.x, n.y, n.z, d, length * 0.5);
+	}
+
+	// Where each vertex ends up, to measure the error afterwards
+	std::vector<unsigned int> destination(vertexCount);
+	std::vector<bool> used(vertexCount, false);
+	for (size_t v = 0; v < vertexCount; v++)
+		destination[v] = (unsigned int)v;
+	for (unsigned int index : result)
+		used[index] = true;
+
+	std::vector<unsigned int> collapse(vertexCount);
+	std::vector<unsigned int> adjacencyStart;
+	std::vector<unsigned int> adjacency;
+	std::vector<bool> touched(vertexCount);
+	std::vector<EdgeCollapse> candidates;
+	std::vector<WedgePair> pairs;
+	std::vector<unsigned int> next;
+	double maxErrorSq = (double)maxError * maxError;
+
+	while (result.size() > targetIndexCount)
+	{
+		size_t triangleCount = result.size() / 3;
+		BuildTriangleAdjacency(result, remap, adjacencyStart, adjacency);
+
+		// Cheapest allowed direction for every edge
+		candidates.clear();
+		for (size_t t = 0; t < result.size(); t += 3)
+		{
+			for (int e = 0; e < 3; e++)
+			{
+				unsigned int c0 = remap[result[t + e]];
+				unsigned int c1 = remap[result[t + (e + 1) % 3]];
+
+				// Interior edges are seen twice, so only look from one side
+				if (c0 >= c1)
+					continue;
+
+				Quadric q = quadrics[c0];
+				QuadricAdd(q, quadrics[c1]);
+
+				EdgeCollapse best = { 0, 0, FLT_MAX };
+				if (!locked[c0])
+					best = { c0, c1, (float)QuadricError(q, vertices[c1].Position) };
+				if (!locked[c1])
+				{
+					float cost = (float)QuadricError(q, vertices[c0].Position);
+					if (cost < best.Cost)
+						best = { c1, c0, cost };
+				}
+
+				if (best.Cost != FLT_MAX)
+					candidates.push_back(best);
+			}
+		}
+
+		std::sort(candidates.begin(), candidates.end(),
+			[](const EdgeCollapse& a, const EdgeCollapse& b) { return a.Cost < b.Cost; });
+
+		// Each collapse removes about two triangles
+		size_t collapseGoal = std::max((size_t)1, (triangleCount - targetIndexCount / 3) / 2);
+		size_t collapses = 0;
+		for (size_t v = 0; v < vertexCount; v++)
+			collapse[v] = (unsigned int)v;
+		std::fill(touched.begin(), touched.end(), false);
+
+		for (const EdgeCollapse& c : candidates)
+		{
+			if (collapses >= collapseGoal || c.Cost > maxErrorSq)
+				break;
+			if (touched[c.From] || touched[c.To])
+				continue;
+
+			// Pair every wedge of "from" with the wedge of "to" across the
+			// edge.  A seam vertex can only slide along its own seam, where
+			// each side has a partner; anywhere else a wedge is left without
+			// one and the seam would tear
+			bool valid = true;
+			pairs.clear();
+			for (unsigned int a = adjacencyStart[c.From]; a < adjacencyStart[c.From + 1] && valid; a++)
+			{
+				const unsigned int* tri = &result[adjacency[a] * 3];
+				unsigned int corners[3] = { collapse[tri[0]], collapse[tri[1]], collapse[tri[2]] };
+				unsigned int wedgeFrom = 0, wedgeTo = 0;
+				bool hasTo = false;
+				for (int k = 0; k < 3; k++)
+				{
+					if (remap[corners[k]] == c.From) wedgeFrom = corners[k];
+					if (remap[corners[k]] == c.To) { wedgeTo = corners[k]; hasTo = true; }
+				}
+				if (!hasTo)
+					continue;
+
+				bool found = false;
+				for (const WedgePair& p : pairs)
+				{
+					if (p.From == wedgeFrom || p.To == wedgeTo)
+					{
+						valid = p.From == wedgeFrom && p.To == wedgeTo;
+						found = true;
+						break;
+					}
+				}
+
+				// Keep creases: don't merge vertices facing different ways
+				if (!found)
+				{
+					XMVECTOR nFrom = XMVector3Normalize(XMLoadFloat3(&vertices[wedgeFrom].Normal));
+					XMVECTOR nTo = XMVector3Normalize(XMLoadFloat3(&vertices[wedgeTo].Normal));
+					valid = Dot3(nFrom, nTo) >= SIMPLIFY_NORMAL_LIMIT;
+					pairs.push_back({ wedgeFrom, wedgeTo });
+				}
+			}
+
+			// Every other triangle around "from" must have a partner and
+			// must not flip over
+			for (unsigned int a = adjacencyStart[c.From]; a < adjacencyStart[c.From + 1] && valid; a++)
+			{
+				const unsigned int* tri = &result[adjacency[a] * 3];
+				unsigned int corners[3] = { collapse[tri[0]], collapse[tri[1]], collapse[tri[2]] };
+				unsigned int r[3] = { remap[corners[0]], remap[corners[1]], remap[corners[2]] };
+				if (r[0] == c.To || r[1] == c.To || r[2] == c.To)
+					continue;
+
+				// Already gone because of an earlier collapse in this pass
+				if (r[0] == r[1] || r[1] == r[2] || r[2] == r[0])
+					continue;
+
+				XMFLOAT3 p[3] = { vertices[corners[0]].Position, vertices[corners[1]].Position, vertices[corners[2]].Position };
+				XMVECTOR before = TriangleNormal(p[0], p[1], p[2]);
+				for (int k = 0; k < 3; k++)
+				{
+					if (r[k] != c.From)
+						continue;
+
+					p[k] = vertices[c.To].Position;
+					valid = false;
+					for (const WedgePair& pair : pairs)
+						valid |= pair.From == corners[k];
+				}
+				XMVECTOR after = TriangleNormal(p[0], p[1], p[2]);
+				valid = valid && Dot3(before, after) > 0;
+			}
+
+			if (!valid || pairs.empty())
+				continue;
+
+			for (const WedgePair& pair : pairs)
+				collapse[pair.From] = pair.To;
+			QuadricAdd(quadrics[c.To], quadrics[c.From]);
+			touched[c.From] = true;
+			touched[c.To] = true;
+			collapses++;
+		}
+
+		if (collapses == 0)
+			break;
+
+		// Apply the collapses and drop the triangles that vanished
+		next.clear();
+		for (size_t t = 0; t < result.size(); t += 3)
+		{
+			unsigned int a = collapse[result[t]];
+			unsigned int b = collapse[result[t + 1]];
+			unsigned int c = collapse[result[t + 2]];
+			if (remap[a] == remap[b] || remap[b] == remap[c] || remap[c] == remap[a])
+				continue;
+
+			next.push_back(a);
+			next.push_back(b);
+			next.push_back(c);
+		}
+		result.swap(next);
+
+		for (size_t v = 0; v < vertexCount; v++)
+			destination[v] = collapse[destination[v]];
+	}
+
+	// The quadrics only approximate the error, so measure how far each
+	// removed vertex is from the triangles around where it ended up
+	BuildTriangleAdjacency(result, remap, adjacencyStart, adjacency);
+	float error = 0;
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		if (!used[v] || remap[destination[v]] == remap[v])
+			continue;
+
+		unsigned int d = remap[destination[v]];
+		XMVECTOR p = XMLoadFloat3(&vertices[v].Position);
+		float closest = FLT_MAX;
+		for (unsigned int a = adjacencyStart[d]; a < adjacencyStart[d + 1]; a++)
+		{
+			const unsigned int* tri = &result[adjacency[a] * 3];
+			closest = std::min(closest, PointTriangleDistance(p,
+				XMLoadFloat3(&vertices[tri[0]].Position),
+				XMLoadFloat3(&vertices[tri[1]].Position),
+				XMLoadFloat3(&vertices[tri[2]].Position)));
+		}
+
+		if (closest != FLT_MAX)
+			error = std::max(error, closest);
+	}
+
+	return error;
+}
+
+void BuildLodChain(MeshData& mesh, unsigned int maxLevels)
+{
+	mesh.Lods.clear();
+	if (mesh.Indices.empty())
+		return;
+
+	// Level 0 is the mesh itself
+	MeshLod base = { 0, (unsigned int)mesh.Indices.size(), 0.0f };
+	mesh.Lods.push_back(base);
+
+	// Each level starts from the full detail mesh, so its error is
+	// measured against the real surface rather than the level before
+	std::vector<unsigned int> source(mesh.Indices);
+	std::vector<unsigned int> simplified;
+	size_t previousCount = source.size();
+	float error = 0;
+	for (unsigned int level = 1; level < maxLevels; level++)
+	{
+		size_t target = (source.size() >> level) / 3 * 3;
+		float levelError = SimplifyMesh(
+			&mesh.Vertices[0], mesh.Vertices.size(),
+			&source[0], source.size(),
+			target, FLT_MAX, simplified);
+
+		// Not worth a level if it barely got simpler
+		if (simplified.empty() || simplified.size() > previousCount * 9 / 10)
+			break;
+
+		OptimizeVertexCache(&simplified[0], simplified.size(), mesh.Vertices.size());
+
+		error = std::max(error, levelError);
+		MeshLod lod = { (unsigned int)mesh.Indices.size(), (unsigned int)simplified.size(), error };
+		mesh.Lods.push_back(lod);
+		mesh.Indices.insert(mesh.Indices.end(), simplified.begin(), simplified.end());
+		previousCount = simplified.size();
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include "Vertex.h"
+#include "MeshData.h"
+
+// Most levels (including the full detail one) BuildLodChain() makes
+#define MAX_MESH_LODS	5
+
+// --------------------------------------------------------
+// Simplifies a triangle list with quadric error metric edge
+// collapses (Garland & Heckbert), reusing the original vertices
+//
+// - Vertices on a UV seam or hard normal edge may only slide
+//   along it, so the split stays intact.  Vertices on an open
+//   border or non-manifold edge never move
+// - Collapses that would flip a triangle, or merge vertices whose
+//   normals differ by more than 60 degrees, are rejected
+//
+// Stops once the triangle count reaches targetIndexCount / 3 or
+// no collapse is cheaper than maxError.  Returns the largest
+// distance (local space) from a removed vertex to the simplified
+// surface around where it ended up
+// --------------------------------------------------------
+float SimplifyMesh(
+	const Vertex* vertices,
+	size_t vertexCount,
+	const unsigned int* indices,
+	size_t indexCount,
+	size_t targetIndexCount,
+	float maxError,
+	std::vector<unsigned int>& result);
+
+// --------------------------------------------------------
+// Builds up to MAX_MESH_LODS levels of detail, each aiming for
+// half the triangles of the one before it
+//
+// Every level's indices are appended to mesh.Indices (sharing
+// the same vertices) and described in mesh.Lods.  Levels that
+// barely reduce the triangle count end the chain early
+// --------------------------------------------------------
+void BuildLodChain(MeshData& mesh, unsigned int maxLevels = MAX_MESH_LODS);
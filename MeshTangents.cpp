@@ -0,0 +1,187 @@
+#include "MeshTangents.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <chrono>
+#include <thread>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Tangents of triangles [first, first + 4), one per SIMD lane
+//
+// Lanes past the last triangle repeat it, so the output only
+// needs padding to a multiple of four.  The results are
+// transposed back to one XMFLOAT4 per triangle, so summing
+// them later is a single load each
+// --------------------------------------------------------
+static void TriangleTangents4(
+	const Vertex* vertices,
+	const unsigned int* indices,
+	size_t first,
+	size_t triangleCount,
+	XMFLOAT4* tangents)
+{
+	// Gather AoS vertices into SoA: [corner][lane]
+	XMFLOAT4 px[3], py[3], pz[3], u[3], v[3];
+	for (int lane = 0; lane < 4; lane++)
+	{
+		size_t t = std::min(first + lane, triangleCount - 1);
+		for (int c = 0; c < 3; c++)
+		{
+			const Vertex& vertex = vertices[indices[t * 3 + c]];
+			(&px[c].x)[lane] = vertex.Position.x;
+			(&py[c].x)[lane] = vertex.Position.y;
+			(&pz[c].x)[lane] = vertex.Position.z;
+			(&u[c].x)[lane] = vertex.UV.x;
+			(&v[c].x)[lane] = vertex.UV.y;
+		}
+	}
+
+	// Edges relative to the first corner, in position and UV space
+	XMVECTOR x1 = XMVectorSubtract(XMLoadFloat4(&px[1]), XMLoadFloat4(&px[0]));
+	XMVECTOR y1 = XMVectorSubtract(XMLoadFloat4(&py[1]), XMLoadFloat4(&py[0]));
+	XMVECTOR z1 = XMVectorSubtract(XMLoadFloat4(&pz[1]), XMLoadFloat4(&pz[0]));
+	XMVECTOR x2 = XMVectorSubtract(XMLoadFloat4(&px[2]), XMLoadFloat4(&px[0]));
+	XMVECTOR y2 = XMVectorSubtract(XMLoadFloat4(&py[2]), XMLoadFloat4(&py[0]));
+	XMVECTOR z2 = XMVectorSubtract(XMLoadFloat4(&pz[2]), XMLoadFloat4(&pz[0]));
+	XMVECTOR s1 = XMVectorSubtract(XMLoadFloat4(&u[1]), XMLoadFloat4(&u[0]));
+	XMVECTOR t1 = XMVectorSubtract(XMLoadFloat4(&v[1]), XMLoadFloat4(&v[0]));
+	XMVECTOR s2 = XMVectorSubtract(XMLoadFloat4(&u[2]), XMLoadFloat4(&u[0]));
+	XMVECTOR t2 = XMVectorSubtract(XMLoadFloat4(&v[2]), XMLoadFloat4(&v[0]));
+
+	// Triangles with no UV area get no say in the tangent
+	XMVECTOR det = XMVectorSubtract(XMVectorMultiply(s1, t2), XMVectorMultiply(s2, t1));
+	XMVECTOR degenerate = XMVectorLess(XMVectorAbs(det), XMVectorReplicate(FLT_MIN));
+	XMVECTOR r = XMVectorSelect(XMVectorReciprocal(det), XMVectorZero(), degenerate);
+
+	XMMATRIX soa;
+	soa.r[0] = XMVectorMultiply(XMVectorSubtract(XMVectorMultiply(t2, x1), XMVectorMultiply(t1, x2)), r);
+	soa.r[1] = XMVectorMultiply(XMVectorSubtract(XMVectorMultiply(t2, y1), XMVectorMultiply(t1, y2)), r);
+	soa.r[2] = XMVectorMultiply(XMVectorSubtract(XMVectorMultiply(t2, z1), XMVectorMultiply(t1, z2)), r);
+	soa.r[3] = XMVectorZero();
+
+	XMMATRIX aos = XMMatrixTranspose(soa);
+	for (int lane = 0; lane < 4; lane++)
+		XMStoreFloat4(&tangents[lane], aos.r[lane]);
+}
+
+// --------------------------------------------------------
+// Makes the summed tangents of vertices [first, last)
+// perpendicular to their normals.  Returns how many had
+// nothing to go on
+// --------------------------------------------------------
+static unsigned int OrthonormalizeTangents(
+	Vertex* vertices,
+	const XMFLOAT4* sums,
+	size_t first,
+	size_t last)
+{
+	unsigned int degenerateCount = 0;
+	for (size_t i = first; i < last; i++)
+	{
+		// Gram-Schmidt against the normal
+		XMVECTOR sum = XMLoadFloat4(&sums[i]);
+		XMVECTOR normal = XMLoadFloat3(&vertices[i].Normal);
+		XMVECTOR tangent = XMVectorSubtract(sum, XMVectorMultiply(normal, XMVector3Dot(normal, sum)));
+		if (XMVectorGetX(XMVector3LengthSq(tangent)) <= FLT_MIN)
+		{
+			// Any direction along the surface beats NaNs in the shader
+			XMVECTOR axis = fabsf(vertices[i].Normal.x) < 0.9f ? XMVectorSet(1, 0, 0, 0) : XMVectorSet(0, 1, 0, 0);
+			tangent = XMVectorSubtract(axis, XMVectorMultiply(normal, XMVector3Dot(normal, axis)));
+			degenerateCount++;
+		}
+
+		XMStoreFloat3(&vertices[i].Tangent, XMVector3Normalize(tangent));
+	}
+	return degenerateCount;
+}
+
+void GenerateTangents(
+	Vertex* vertices,
+	size_t vertexCount,
+	const unsigned int* indices,
+	size_t indexCount,
+	unsigned int threadCount,
+	TangentStats* stats)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	size_t triangleCount = indexCount / 3;
+	if (vertexCount == 0)
+		return;
+
+	// Small meshes aren't worth splitting up
+	if (threadCount == 0)
+	{
+		threadCount = std::thread::hardware_concurrency();
+		if (threadCount == 0) threadCount = 1;
+		size_t useful = triangleCount / TANGENT_MIN_TRIANGLES_PER_THREAD;
+		if (useful < threadCount) threadCount = useful > 0 ? (unsigned int)useful : 1;
+	}
+
+	// Per-triangle tangents, padded for the last group of four
+	size_t groupCount = (triangleCount + 3) / 4;
+	std::vector<XMFLOAT4> triangleTangents(groupCount * 4);
+	auto triangleWork = [&](unsigned int thread)
+	{
+		size_t begin = groupCount * thread / threadCount;
+		size_t end = groupCount * (thread + 1) / threadCount;
+		for (size_t g = begin; g < end; g++)
+			TriangleTangents4(vertices, indices, g * 4, triangleCount, &triangleTangents[g * 4]);
+	};
+
+	std::vector<unsigned int> degenerate(threadCount, 0);
+	std::vector<XMFLOAT4> sums(vertexCount, XMFLOAT4(0, 0, 0, 0));
+	auto vertexWork = [&](unsigned int thread)
+	{
+		size_t begin = vertexCount * thread / threadCount;
+		size_t end = vertexCount * (thread + 1) / threadCount;
+		degenerate[thread] = OrthonormalizeTangents(vertices, &sums[0], begin, end);
+	};
+
+	// The heavy math runs on every thread (the calling one takes the first slice)
+	{
+		std::vector<std::thread> workers;
+		for (unsigned int i = 1; i < threadCount; i++)
+			workers.push_back(std::thread(triangleWork, i));
+		triangleWork(0);
+		for (auto& w : workers) w.join();
+	}
+
+	// The scatter is one add per corner and stays on this thread, in
+	// triangle order, so every sum is taken in the same order no
+	// matter how many threads did the rest
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		XMFLOAT4& sum = sums[indices[i]];
+		XMStoreFloat4(&sum, XMVectorAdd(XMLoadFloat4(&sum), XMLoadFloat4(&triangleTangents[i / 3])));
+	}
+
+	{
+		std::vector<std::thread> workers;
+		for (unsigned int i = 1; i < threadCount; i++)
+			workers.push_back(std::thread(vertexWork, i));
+		vertexWork(0);
+		for (auto& w : workers) w.join();
+	}
+
+	if (stats)
+	{
+		stats->ThreadCount = threadCount;
+		stats->DegenerateVertices = 0;
+		for (unsigned int count : degenerate)
+			stats->DegenerateVertices += count;
+		stats->Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+	}
+}
+
+void GenerateTangents(MeshData& mesh, TangentStats* stats)
+{
+	if (mesh.Vertices.empty())
+		return;
+
+	GenerateTangents(&mesh.Vertices[0], mesh.Vertices.size(),
+		mesh.Indices.empty() ? 0 : &mesh.Indices[0], mesh.Indices.size(), 0, stats);
+}
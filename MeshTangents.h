@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include "Vertex.h"
+#include "MeshData.h"
+
+// Meshes with fewer triangles per thread than this stay on fewer
+// threads, since starting workers would cost more than the work
+#define TANGENT_MIN_TRIANGLES_PER_THREAD	16384
+
+// --------------------------------------------------------
+// How a GenerateTangents() call went
+// --------------------------------------------------------
+struct TangentStats
+{
+	unsigned int ThreadCount = 0;
+	unsigned int DegenerateVertices = 0;	// No usable UVs, given any tangent perpendicular to the normal
+	double Seconds = 0;
+};
+
+// --------------------------------------------------------
+// Calculates per-vertex tangents from positions and UVs
+//
+// Same math as Mesh::CalculateTangents (Lengyel), restructured:
+//
+// 1. Triangles are processed four at a time in SoA form, one
+//    triangle per SIMD lane, split across threads
+// 2. Each triangle's tangent is added to its three corners, in
+//    triangle order, on the calling thread
+// 3. Each vertex orthonormalizes its sum against its normal,
+//    split across threads
+//
+// Threads never write the same memory, and the sums are always
+// taken in the same order, so the output is bit-identical for
+// any thread count.  Triangles with no UV area contribute
+// nothing, instead of NaNs.
+//
+// threadCount 0 uses every hardware thread (mesh size permitting)
+// --------------------------------------------------------
+void GenerateTangents(
+	Vertex* vertices,
+	size_t vertexCount,
+	const unsigned int* indices,
+	size_t indexCount,
+	unsigned int threadCount = 0,
+	TangentStats* stats = 0);
+
+void GenerateTangents(MeshData& mesh, TangentStats* stats = 0);
@@ -0,0 +1,668 @@
+#include "ObjParser.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <istream>
+#include <streambuf>
+#include <thread>
+
+using namespace DirectX;
+
+// Files smaller than this are parsed on the calling thread, since
+// spinning up workers would cost more than the parse itself
+static const size_t MinChunkBytes = 64 * 1024;
+
+// --------------------------------------------------------
+// A face index that was written relative to the end of the
+// list ("f -1/-1/-1").  It can only be resolved once we know
+// how many elements came before this chunk.
+// --------------------------------------------------------
+struct ObjRelativeIndex
+{
+	size_t Corner;		// Which entry of the chunk's Triangles
+	int Component;		// 0 = position, 1 = uv, 2 = normal
+};
+
+// --------------------------------------------------------
+// Everything parsed from one line-aligned slice of the file
+// --------------------------------------------------------
+struct ObjChunk
+{
+	const char* Begin = 0;
+	const char* End = 0;
+
+	std::vector<XMFLOAT3> Positions;
+	std::vector<XMFLOAT3> Normals;
+	std::vector<XMFLOAT2> UVs;
+	std::vector<ObjFaceVertex> Triangles;
+	std::vector<ObjRelativeIndex> RelativeIndices;
+};
+
+// Powers of ten that are exactly representable as doubles
+static const double PowersOfTen[] =
+{
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+static inline bool IsBlank(char c) { return c == ' ' || c == '\t'; }
+
+// --------------------------------------------------------
+// Locale-independent float parser in the spirit of from_chars
+//
+// Accumulates up to 19 significant digits into an integer and
+// applies the decimal exponent once at the end, which is exact
+// for everything an OBJ exporter writes in practice.
+//
+// Returns a pointer past the number, or the input pointer if
+// no number was found
+// --------------------------------------------------------
+static const char* ParseFloat(const char* p, const char* end, float& out)
+{
+	while (p < end && IsBlank(*p)) p++;
+	const char* start = p;
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = (*p == '-');
+		p++;
+	}
+
+	uint64_t mantissa = 0;
+	int significantDigits = 0;
+	int exponent = 0;
+	bool anyDigits = false;
+
+	// Whole part
+	for (; p < end && IsDigit(*p); p++)
+	{
+		anyDigits = true;
+		if (significantDigits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa) significantDigits++;
+		}
+		else exponent++;
+	}
+
+	// Fractional part
+	if (p < end && *p == '.')
+	{
+		for (p++; p < end && IsDigit(*p); p++)
+		{
+			anyDigits = true;
+			if (significantDigits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa) significantDigits++;
+				exponent--;
+			}
+		}
+	}
+
+	if (!anyDigits)
+	{
+		out = 0;
+		return start;
+	}
+
+	// Exponent
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char* e = p + 1;
+		bool negativeExp = false;
+		if (e < end && (*e == '-' || *e == '+'))
+		{
+			negativeExp = (*e == '-');
+			e++;
+		}
+		if (e < end && IsDigit(*e))
+		{
+			int value = 0;
+			for (; e < end && IsDigit(*e); e++)
+				if (value < 10000) value = value * 10 + (*e - '0');
+			exponent += negativeExp ? -value : value;
+			p = e;
+		}
+	}
+
+	double result = (double)mantissa;
+	if (exponent < 0)
+		result = (exponent >= -22) ? result / PowersOfTen[-exponent] : result * std::pow(10.0, exponent);
+	else if (exponent > 0)
+		result = (exponent <= 22) ? result * PowersOfTen[exponent] : result * std::pow(10.0, exponent);
+
+	out = (float)(negative ? -result : result);
+	return p;
+}
+
+// --------------------------------------------------------
+// Parses a (possibly negative) integer, returning a pointer
+// past it or the input pointer if there wasn't one
+// --------------------------------------------------------
+static const char* ParseInt(const char* p, const char* end, int& out)
+{
+	const char* start = p;
+	bool negative = false;
+	if (p < end && *p == '-')
+	{
+		negative = true;
+		p++;
+	}
+
+	if (p >= end || !IsDigit(*p))
+	{
+		out = 0;
+		return start;
+	}
+
+	int value = 0;
+	for (; p < end && IsDigit(*p); p++)
+		value = value * 10 + (*p - '0');
+
+	out = negative ? -value : value;
+	return p;
+}
+
+// --------------------------------------------------------
+// A face corner as it was read, before triangulation
+// --------------------------------------------------------
+struct ObjCorner
+{
+	ObjFaceVertex Indices;
+	bool Relative[3];	// Was each index written relative to the end of its list?
+};
+
+// --------------------------------------------------------
+// Turns a raw 1-based (or negative, end-relative) OBJ index
+// into a 0-based one.  Relative indices are made chunk-local
+// and flagged so the merge step can finish them off.
+// --------------------------------------------------------
+static int ResolveIndex(int raw, size_t localCount, bool& relative)
+{
+	relative = (raw < 0);
+	if (raw > 0) return raw - 1;
+	if (raw < 0) return (int)localCount + raw;
+	return -1;
+}
+
+// --------------------------------------------------------
+// Adds a triangle corner to the chunk, remembering any
+// indices that still need the chunk's base offset
+// --------------------------------------------------------
+static void AddCorner(ObjChunk& chunk, const ObjCorner& corner)
+{
+	size_t slot = chunk.Triangles.size();
+	chunk.Triangles.push_back(corner.Indices);
+
+	for (int c = 0; c < 3; c++)
+		if (corner.Relative[c])
+			chunk.RelativeIndices.push_back({ slot, c });
+}
+
+// --------------------------------------------------------
+// Parses every line in [chunk.Begin, chunk.End)
+// --------------------------------------------------------
+static void ParseChunk(ObjChunk& chunk)
+{
+	const char* p = chunk.Begin;
+	const char* end = chunk.End;
+
+	// Scratch space for the corners of the current face
+	std::vector<ObjCorner> corners;
+
+	while (p < end)
+	{
+		// Find the end of this line
+		const char* lineEnd = p;
+		while (lineEnd < end && *lineEnd != '\n') lineEnd++;
+
+		// Skip any indentation
+		while (p < lineEnd && IsBlank(*p)) p++;
+
+		if (lineEnd - p >= 2 && p[0] == 'v' && p[1] == 'n')
+		{
+			XMFLOAT3 norm;
+			p = ParseFloat(p + 2, lineEnd, norm.x);
+			p = ParseFloat(p, lineEnd, norm.y);
+			p = ParseFloat(p, lineEnd, norm.z);
+			chunk.Normals.push_back(norm);
+		}
+		else if (lineEnd - p >= 2 && p[0] == 'v' && p[1] == 't')
+		{
+			XMFLOAT2 uv;
+			p = ParseFloat(p + 2, lineEnd, uv.x);
+			p = ParseFloat(p, lineEnd, uv.y);
+			chunk.UVs.push_back(uv);
+		}
+		else if (lineEnd - p >= 2 && p[0] == 'v' && IsBlank(p[1]))
+		{
+			XMFLOAT3 pos;
+			p = ParseFloat(p + 1, lineEnd, pos.x);
+			p = ParseFloat(p, lineEnd, pos.y);
+			p = ParseFloat(p, lineEnd, pos.z);
+			chunk.Positions.push_back(pos);
+		}
+		else if (lineEnd - p >= 2 && p[0] == 'f' && IsBlank(p[1]))
+		{
+			corners.clear();
+			p++;
+
+			// Read "v", "v/t", "v//n" or "v/t/n" groups until the line runs out
+			while (true)
+			{
+				while (p < lineEnd && IsBlank(*p)) p++;
+
+				int raw[3] = { 0, 0, 0 };
+				const char* next = ParseInt(p, lineEnd, raw[0]);
+				if (next == p) break;
+				p = next;
+
+				if (p < lineEnd && *p == '/')
+				{
+					p = ParseInt(p + 1, lineEnd, raw[1]);
+					if (p < lineEnd && *p == '/')
+						p = ParseInt(p + 1, lineEnd, raw[2]);
+				}
+
+				ObjCorner corner;
+				corner.Indices.Position = ResolveIndex(raw[0], chunk.Positions.size(), corner.Relative[0]);
+				corner.Indices.UV = ResolveIndex(raw[1], chunk.UVs.size(), corner.Relative[1]);
+				corner.Indices.Normal = ResolveIndex(raw[2], chunk.Normals.size(), corner.Relative[2]);
+				corners.push_back(corner);
+			}
+
+			// Fan the polygon into triangles
+			for (size_t c = 2; c < corners.size(); c++)
+			{
+				AddCorner(chunk, corners[0]);
+				AddCorner(chunk, corners[c - 1]);
+				AddCorner(chunk, corners[c]);
+			}
+		}
+
+		p = lineEnd + 1;
+	}
+}
+
+// --------------------------------------------------------
+// Copies one parsed chunk into its slot in the final arrays,
+// applying the chunk's base offsets to any relative indices
+// --------------------------------------------------------
+static void MergeChunk(const ObjChunk& chunk, ObjData& data,
+	size_t positionBase, size_t uvBase, size_t normalBase, size_t triangleBase)
+{
+	std::copy(chunk.Positions.begin(), chunk.Positions.end(), data.Positions.begin() + positionBase);
+	std::copy(chunk.Normals.begin(), chunk.Normals.end(), data.Normals.begin() + normalBase);
+	std::copy(chunk.UVs.begin(), chunk.UVs.end(), data.UVs.begin() + uvBase);
+	std::copy(chunk.Triangles.begin(), chunk.Triangles.end(), data.Triangles.begin() + triangleBase);
+
+	for (const ObjRelativeIndex& r : chunk.RelativeIndices)
+	{
+		ObjFaceVertex& fv = data.Triangles[triangleBase + r.Corner];
+		if (r.Component == 0) fv.Position += (int)positionBase;
+		else if (r.Component == 1) fv.UV += (int)uvBase;
+		else fv.Normal += (int)normalBase;
+	}
+}
+
+// --------------------------------------------------------
+// Parses OBJ text that is already in memory
+//
+// Chunks are handed to one thread each, then merged back in
+// file order so the output never depends on thread timing
+// --------------------------------------------------------
+bool ParseObjText(const char* text, size_t length, ObjData& data, ObjParseStats* stats)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	data = ObjData();
+	if (text == 0 || length == 0)
+		return false;
+
+	// Decide how many pieces to cut the file into
+	size_t threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0) threadCount = 1;
+	size_t chunkCount = length / MinChunkBytes;
+	if (chunkCount > threadCount) chunkCount = threadCount;
+	if (chunkCount == 0) chunkCount = 1;
+
+	// Cut at evenly spaced points, then push each cut forward to
+	// the start of the next line so no line is split in two
+	std::vector<ObjChunk> chunks(chunkCount);
+	const char* end = text + length;
+	const char* cursor = text;
+	for (size_t i = 0; i < chunkCount; i++)
+	{
+		const char* chunkEnd = (i == chunkCount - 1) ? end : text + (length / chunkCount) * (i + 1);
+		if (chunkEnd < cursor) chunkEnd = cursor;
+		while (chunkEnd < end && chunkEnd[-1] != '\n') chunkEnd++;
+
+		chunks[i].Begin = cursor;
+		chunks[i].End = chunkEnd;
+		cursor = chunkEnd;
+	}
+
+	// Parse all chunks, using the calling thread for the first one
+	{
+		std::vector<std::thread> workers;
+		for (size_t i = 1; i < chunkCount; i++)
+			workers.push_back(std::thread(ParseChunk, std::ref(chunks[i])));
+		ParseChunk(chunks[0]);
+		for (auto& w : workers) w.join();
+	}
+
+	// Work out where each chunk lands in the final arrays
+	std::vector<size_t> positionBase(chunkCount), uvBase(chunkCount), normalBase(chunkCount), triangleBase(chunkCount);
+	size_t positions = 0, uvs = 0, normals = 0, triangles = 0;
+	for (size_t i = 0; i < chunkCount; i++)
+	{
+		positionBase[i] = positions;	positions += chunks[i].Positions.size();
+		uvBase[i] = uvs;				uvs += chunks[i].UVs.size();
+		normalBase[i] = normals;		normals += chunks[i].Normals.size();
+		triangleBase[i] = triangles;	triangles += chunks[i].Triangles.size();
+	}
+	data.Positions.resize(positions);
+	data.UVs.resize(uvs);
+	data.Normals.resize(normals);
+	data.Triangles.resize(triangles);
+
+	// Each chunk writes a disjoint range, so the merge can run in parallel too
+	{
+		std::vector<std::thread> workers;
+		for (size_t i = 1; i < chunkCount; i++)
+			workers.push_back(std::thread(MergeChunk, std::cref(chunks[i]), std::ref(data),
+				positionBase[i], uvBase[i], normalBase[i], triangleBase[i]));
+		MergeChunk(chunks[0], data, positionBase[0], uvBase[0], normalBase[0], triangleBase[0]);
+		for (auto& w : workers) w.join();
+	}
+
+	if (stats)
+	{
+		stats->FileBytes = length;
+		stats->ChunkCount = (unsigned int)chunkCount;
+		stats->Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+	}
+
+	return true;
+}
+
+// --------------------------------------------------------
+// Maps the file into memory and parses it
+// --------------------------------------------------------
+bool ParseObjFile(const char* filename, ObjData& data, ObjParseStats* stats)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	MappedFile file;
+	if (!file.Open(filename))
+		return false;
+
+	if (!ParseObjText(file.GetData(), file.GetSize(), data, stats))
+		return false;
+
+	// Include the time spent mapping the file
+	if (stats)
+		stats->Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	return true;
+}
+
+// --------------------------------------------------------
+// Lets an istream read text that's already in memory, so the
+// reference loop sees exactly the bytes the parser does
+// without copying them into a stringstream first
+// --------------------------------------------------------
+struct ObjTextBuffer : std::streambuf
+{
+	ObjTextBuffer(const char* text, size_t length)
+	{
+		char* begin = const_cast<char*>(text);
+		setg(begin, begin, begin + length);
+	}
+};
+
+// --------------------------------------------------------
+// The original loop from Mesh, line for line, except that it
+// fills an ObjData (0-based, no handedness conversion) so the
+// results can be compared
+// --------------------------------------------------------
+bool ParseObjTextReference(const char* text, size_t length, ObjData& data, ObjParseStats* stats)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	data = ObjData();
+	if (text == 0 || length == 0)
+		return false;
+
+	ObjTextBuffer buffer(text, length);
+	std::istream obj(&buffer);
+	char chars[100];
+
+	while (obj.good())
+	{
+		obj.getline(chars, 100);
+
+		if (chars[0] == 'v' && chars[1] == 'n')
+		{
+			XMFLOAT3 norm;
+			sscanf_s(chars, "vn %f %f %f", &norm.x, &norm.y, &norm.z);
+			data.Normals.push_back(norm);
+		}
+		else if (chars[0] == 'v' && chars[1] == 't')
+		{
+			XMFLOAT2 uv;
+			sscanf_s(chars, "vt %f %f", &uv.x, &uv.y);
+			data.UVs.push_back(uv);
+		}
+		else if (chars[0] == 'v')
+		{
+			XMFLOAT3 pos;
+			sscanf_s(chars, "v %f %f %f", &pos.x, &pos.y, &pos.z);
+			data.Positions.push_back(pos);
+		}
+		else if (chars[0] == 'f')
+		{
+			int i[12];
+			int numbersRead = sscanf_s(
+				chars,
+				"f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d",
+				&i[0], &i[1], &i[2],
+				&i[3], &i[4], &i[5],
+				&i[6], &i[7], &i[8],
+				&i[9], &i[10], &i[11]);
+
+			// No uvs, so re-read as "v//n"
+			if (numbersRead == 1)
+			{
+				numbersRead = sscanf_s(
+					chars,
+					"f %d//%d %d//%d %d//%d %d//%d",
+					&i[0], &i[2],
+					&i[3], &i[5],
+					&i[6], &i[8],
+					&i[9], &i[11]);
+				i[1] = i[4] = i[7] = i[10] = 0;
+			}
+
+			ObjFaceVertex corners[4];
+			for (int c = 0; c < 4; c++)
+				corners[c] = { i[c * 3] - 1, i[c * 3 + 1] - 1, i[c * 3 + 2] - 1 };
+
+			data.Triangles.push_back(corners[0]);
+			data.Triangles.push_back(corners[1]);
+			data.Triangles.push_back(corners[2]);
+
+			// A 4th corner, with or without uvs
+			if (numbersRead == 12 || numbersRead == 8)
+			{
+				data.Triangles.push_back(corners[0]);
+				data.Triangles.push_back(corners[2]);
+				data.Triangles.push_back(corners[3]);
+			}
+		}
+	}
+
+	if (stats)
+	{
+		stats->FileBytes = length;
+		stats->ChunkCount = 1;
+		stats->Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+	}
+
+	return true;
+}
+
+// --------------------------------------------------------
+// A (side + 1) x (side + 1) grid of vertices in xz with a
+// sine wave through y, two triangles per cell, written the
+// way a modeling package would
+// --------------------------------------------------------
+void GenerateObjText(unsigned int faces, std::string& text)
+{
+	unsigned int side = (unsigned int)std::ceil(std::sqrt((faces + 1) / 2.0));
+	if (side == 0) side = 1;
+	unsigned int row = side + 1;
+
+	text.clear();
+	text.reserve((size_t)row * row * 90 + (size_t)side * side * 2 * 80);
+
+	char line[128];
+	for (unsigned int z = 0; z <= side; z++)
+	{
+		for (unsigned int x = 0; x <= side; x++)
+		{
+			float u = x / (float)side;
+			float v = z / (float)side;
+			float height = std::sin(u * 20.0f) * std::cos(v * 20.0f) * 0.1f;
+			int length = snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", u * 2 - 1, height, v * 2 - 1);
+			text.append(line, length);
+		}
+	}
+	for (unsigned int z = 0; z <= side; z++)
+	{
+		for (unsigned int x = 0; x <= side; x++)
+		{
+			int length = snprintf(line, sizeof(line), "vt %.6f %.6f\n", x / (float)side, z / (float)side);
+			text.append(line, length);
+		}
+	}
+	for (unsigned int z = 0; z <= side; z++)
+	{
+		for (unsigned int x = 0; x <= side; x++)
+		{
+			// The slope of the wave above
+			float u = x / (float)side;
+			float v = z / (float)side;
+			XMFLOAT3 normal;
+			XMStoreFloat3(&normal, XMVector3Normalize(XMVectorSet(
+				-std::cos(u * 20.0f) * std::cos(v * 20.0f),
+				1.0f,
+				std::sin(u * 20.0f) * std::sin(v * 20.0f),
+				0)));
+			int length = snprintf(line, sizeof(line), "vn %.6f %.6f %.6f\n", normal.x, normal.y, normal.z);
+			text.append(line, length);
+		}
+	}
+
+	for (unsigned int z = 0; z < side; z++)
+	{
+		for (unsigned int x = 0; x < side; x++)
+		{
+			// 1-based, and the same index for position, uv and normal
+			unsigned int a = z * row + x + 1;
+			unsigned int b = a + 1;
+			unsigned int c = a + row;
+			unsigned int d = c + 1;
+			int length = snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, c, c, c, d, d, d);
+			text.append(line, length);
+			length = snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, d, d, d, b, b, b);
+			text.append(line, length);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Runs both parsers over the same text and compares them
+// --------------------------------------------------------
+static ObjParseBenchmarkResult BenchmarkObjText(const std::string& name, const char* text, size_t length)
+{
+	ObjParseBenchmarkResult result;
+	result.Name = name;
+	result.Bytes = length;
+
+	ObjData reference;
+	ObjParseStats referenceStats;
+	ParseObjTextReference(text, length, reference, &referenceStats);
+	result.ReferenceSeconds = referenceStats.Seconds;
+
+	ObjData data;
+	ObjParseStats stats;
+	ParseObjText(text, length, data, &stats);
+	result.ParseSeconds = stats.Seconds;
+	result.ChunkCount = stats.ChunkCount;
+	result.Triangles = (unsigned int)(data.Triangles.size() / 3);
+
+	result.Identical =
+		data.Positions.size() == reference.Positions.size() &&
+		data.UVs.size() == reference.UVs.size() &&
+		data.Normals.size() == reference.Normals.size() &&
+		data.Triangles.size() == reference.Triangles.size();
+	if (!result.Identical)
+		return result;
+
+	for (size_t i = 0; i < data.Triangles.size() && result.Identical; i++)
+	{
+		const ObjFaceVertex& a = data.Triangles[i];
+		const ObjFaceVertex& b = reference.Triangles[i];
+		result.Identical = a.Position == b.Position && a.UV == b.UV && a.Normal == b.Normal;
+	}
+
+	// Both read floats their own way, so these are compared as an error rather than exactly
+	float maxError = 0;
+	for (size_t i = 0; i < data.Positions.size(); i++)
+	{
+		maxError = std::max(maxError, std::fabs(data.Positions[i].x - reference.Positions[i].x));
+		maxError = std::max(maxError, std::fabs(data.Positions[i].y - reference.Positions[i].y));
+		maxError = std::max(maxError, std::fabs(data.Positions[i].z - reference.Positions[i].z));
+	}
+	for (size_t i = 0; i < data.UVs.size(); i++)
+	{
+		maxError = std::max(maxError, std::fabs(data.UVs[i].x - reference.UVs[i].x));
+		maxError = std::max(maxError, std::fabs(data.UVs[i].y - reference.UVs[i].y));
+	}
+	for (size_t i = 0; i < data.Normals.size(); i++)
+	{
+		maxError = std::max(maxError, std::fabs(data.Normals[i].x - reference.Normals[i].x));
+		maxError = std::max(maxError, std::fabs(data.Normals[i].y - reference.Normals[i].y));
+		maxError = std::max(maxError, std::fabs(data.Normals[i].z - reference.Normals[i].z));
+	}
+	result.MaxError = maxError;
+	return result;
+}
+
+ObjParseBenchmarkResult BenchmarkObjFile(const char* filename)
+{
+	MappedFile file;
+	if (!file.Open(filename))
+	{
+		ObjParseBenchmarkResult result;
+		result.Name = filename;
+		return result;
+	}
+
+	return BenchmarkObjText(filename, file.GetData(), file.GetSize());
+}
+
+ObjParseBenchmarkResult BenchmarkObjGenerated(unsigned int faces)
+{
+	std::string text;
+	GenerateObjText(faces, text);
+	return BenchmarkObjText("Generated grid", text.data(), text.size());
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// One corner of an OBJ face as 0-based indices into the
+// position, uv and normal arrays.  A missing uv or normal
+// (like "f 1//1" or "f 1/1") is stored as -1
+// --------------------------------------------------------
+struct ObjFaceVertex
+{
+	int Position;
+	int UV;
+	int Normal;
+};
+
+// --------------------------------------------------------
+// Raw contents of an OBJ file, exactly as written
+//
+// - Faces with more than 3 corners are fanned into triangles
+// - No handedness conversion has been applied yet
+// --------------------------------------------------------
+struct ObjData
+{
+	std::vector<DirectX::XMFLOAT3> Positions;
+	std::vector<DirectX::XMFLOAT3> Normals;
+	std::vector<DirectX::XMFLOAT2> UVs;
+	std::vector<ObjFaceVertex> Triangles; // Three entries per triangle
+};
+
+// --------------------------------------------------------
+// Timing info from a single parse, for profiling
+// --------------------------------------------------------
+struct ObjParseStats
+{
+	size_t FileBytes = 0;
+	unsigned int ChunkCount = 0;
+	double Seconds = 0;
+
+	double MegabytesPerSecond() const
+	{
+		return Seconds > 0 ? (FileBytes / (1024.0 * 1024.0)) / Seconds : 0;
+	}
+};
+
+// --------------------------------------------------------
+// Memory-maps an OBJ file and parses it in parallel
+//
+// The file is split into line-aligned chunks which are parsed
+// on separate threads, then stitched back together in file
+// order, so the result is identical to a serial parse
+// --------------------------------------------------------
+bool ParseObjFile(const char* filename, ObjData& data, ObjParseStats* stats = 0);
+
+// Same as above, for OBJ text that is already in memory
+bool ParseObjText(const char* text, size_t length, ObjData& data, ObjParseStats* stats = 0);
+
+// --------------------------------------------------------
+// The getline/sscanf_s loop Mesh used before ParseObjText,
+// kept as a reference to time the parser against.  It only
+// handles what that loop did: "v/t/n" or "v//n" faces with 3
+// or 4 positive indices, on lines under 100 characters
+// --------------------------------------------------------
+bool ParseObjTextReference(const char* text, size_t length, ObjData& data, ObjParseStats* stats = 0);
+
+// Writes a wavy grid of (at least) faces triangles as OBJ text,
+// with a uv and a normal on every corner
+void GenerateObjText(unsigned int faces, std::string& text);
+
+// --------------------------------------------------------
+// The parser vs the old loop, for the INFO window
+// --------------------------------------------------------
+struct ObjParseBenchmarkResult
+{
+	std::string Name;
+	size_t Bytes = 0;
+	unsigned int Triangles = 0;
+	unsigned int ChunkCount = 0;
+	double ReferenceSeconds = 0;	// ParseObjTextReference()
+	double ParseSeconds = 0;		// ParseObjText()
+	bool Identical = false;			// Same counts and face indices both ways
+	float MaxError = 0;				// Furthest any position, uv or normal is from the reference
+
+	double ReferenceMegabytesPerSecond() const
+	{
+		return ReferenceSeconds > 0 ? (Bytes / (1024.0 * 1024.0)) / ReferenceSeconds : 0;
+	}
+
+	double MegabytesPerSecond() const
+	{
+		return ParseSeconds > 0 ? (Bytes / (1024.0 * 1024.0)) / ParseSeconds : 0;
+	}
+};
+
+// Times both parsers on the same mapped bytes of an OBJ file
+ObjParseBenchmarkResult BenchmarkObjFile(const char* filename);
+
+// Times both parsers on GenerateObjText(faces)
+ObjParseBenchmarkResult BenchmarkObjGenerated(unsigned int faces);
@@ -0,0 +1,4 @@
+// Same as ShadowVertexShader.hlsl, for instances of meshes using PackedVertex
+#define PACKED_VERTICES
+#define INSTANCED
+#include "ShadowVertexShader.hlsl"
@@ -0,0 +1,4 @@
+// Same as VertexShader.hlsl, for instances of meshes using PackedVertex
+#define PACKED_VERTICES
+#define INSTANCED
+#include "VertexShader.hlsl"
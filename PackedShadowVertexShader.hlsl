@@ -0,0 +1,3 @@
+// Same as ShadowVertexShader.hlsl, for meshes using PackedVertex
+#define PACKED_VERTICES
+#include "ShadowVertexShader.hlsl"
@@ -0,0 +1,3 @@
+// Same as VertexShader.hlsl, for meshes using PackedVertex
+#define PACKED_VERTICES
+#include "VertexShader.hlsl"
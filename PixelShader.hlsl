@@ -1,13 +1,10 @@
 #include "ShaderInclude.hlsli"
 
-//Colortint cbuffer
-cbuffer ExternalData : register(b0)
+//Camera and lights, uploaded once per frame
+cbuffer PerFrame : register(b0)
 {
-	float4 colorTint;
 	float3 cameraPos;
-	float roughness;
 	float3 ambient;
-	float2 uvScale;
 
 	Light dirLight1;
 	Light dirLight2;
@@ -17,6 +14,14 @@ cbuffer ExternalData : register(b0)
 	Light pointLight3;
 }
 
+//Uploaded when the material changes
+cbuffer PerMaterial : register(b1)
+{
+	float4 colorTint;
+	float2 uvScale;
+	float roughness;
+}
+
 //Textures
 Texture2D Albedo : register(t0);
 Texture2D NormalMap : register(t1);
@@ -0,0 +1,224 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+// Where each field starts, counting from the least significant bit
+#define DEPTH_SHIFT		0
+#define MESH_SHIFT		(DEPTH_SHIFT + RENDER_KEY_DEPTH_BITS)
+#define MATERIAL_SHIFT	(MESH_SHIFT + RENDER_KEY_MESH_BITS)
+#define SHADER_SHIFT	(MATERIAL_SHIFT + RENDER_KEY_MATERIAL_BITS)
+#define PASS_SHIFT		(SHADER_SHIFT + RENDER_KEY_SHADER_BITS)
+
+#define FIELD_MASK(bits)	((1u << (bits)) - 1)
+
+void RenderQueue::Clear()
+{
+	commands.clear();
+}
+
+void RenderQueue::Add(uint64_t key, unsigned int item)
+{
+	RenderCommand command;
+	command.Key = key;
+	command.Item = item;
+	commands.push_back(command);
+}
+
+// --------------------------------------------------------
+// Counts every byte of every key in one go, then scatters one
+// byte at a time from the lowest, ping-ponging between the two
+// lists.  A byte whose count is the whole list is the same in
+// every key, so that scatter would change nothing
+// --------------------------------------------------------
+void RenderQueue::Sort()
+{
+	unsorted = commands;
+	scratch.resize(commands.size());
+	lastSortPasses = 0;
+	if (commands.empty())
+		return;
+
+	unsigned int counts[8][256] = {};
+	for (const RenderCommand& command : commands)
+	{
+		for (int byte = 0; byte < 8; byte++)
+			counts[byte][(command.Key >> (byte * 8)) & 0xFF]++;
+	}
+
+	RenderCommand* from = commands.data();
+	RenderCommand* to = scratch.data();
+	size_t count = commands.size();
+	for (int byte = 0; byte < 8; byte++)
+	{
+		unsigned int* histogram = counts[byte];
+		if (histogram[(from[0].Key >> (byte * 8)) & 0xFF] == count)
+			continue;
+
+		//Counts to starting offsets
+		unsigned int offset = 0;
+		for (int digit = 0; digit < 256; digit++)
+		{
+			unsigned int digitCount = histogram[digit];
+			histogram[digit] = offset;
+			offset += digitCount;
+		}
+
+		for (size_t i = 0; i < count; i++)
+			to[histogram[(from[i].Key >> (byte * 8)) & 0xFF]++] = from[i];
+		std::swap(from, to);
+		lastSortPasses++;
+	}
+
+	//An odd number of passes leaves the result in scratch
+	if (from != commands.data())
+		commands.swap(scratch);
+}
+
+const std::vector<RenderCommand>& RenderQueue::GetCommands()
+{
+	return commands;
+}
+
+unsigned int RenderQueue::GetLastSortPasses()
+{
+	return lastSortPasses;
+}
+
+uint64_t RenderQueue::MakeKey(unsigned int pass, unsigned int shader, unsigned int material, unsigned int mesh, float depth)
+{
+	depth = depth < 0 ? 0 : (depth > 1 ? 1 : depth);
+	uint64_t quantizedDepth = (uint64_t)(depth * FIELD_MASK(RENDER_KEY_DEPTH_BITS));
+	return
+		((uint64_t)(pass & FIELD_MASK(RENDER_KEY_PASS_BITS)) << PASS_SHIFT) |
+		((uint64_t)(shader & FIELD_MASK(RENDER_KEY_SHADER_BITS)) << SHADER_SHIFT) |
+		((uint64_t)(material & FIELD_MASK(RENDER_KEY_MATERIAL_BITS)) << MATERIAL_SHIFT) |
+		((uint64_t)(mesh & FIELD_MASK(RENDER_KEY_MESH_BITS)) << MESH_SHIFT) |
+		(quantizedDepth << DEPTH_SHIFT);
+}
+
+unsigned int RenderQueue::GetPass(uint64_t key)
+{
+	return (unsigned int)(key >> PASS_SHIFT) & FIELD_MASK(RENDER_KEY_PASS_BITS);
+}
+
+unsigned int RenderQueue::GetShader(uint64_t key)
+{
+	return (unsigned int)(key >> SHADER_SHIFT) & FIELD_MASK(RENDER_KEY_SHADER_BITS);
+}
+
+unsigned int RenderQueue::GetMaterial(uint64_t key)
+{
+	return (unsigned int)(key >> MATERIAL_SHIFT) & FIELD_MASK(RENDER_KEY_MATERIAL_BITS);
+}
+
+unsigned int RenderQueue::GetMesh(uint64_t key)
+{
+	return (unsigned int)(key >> MESH_SHIFT) & FIELD_MASK(RENDER_KEY_MESH_BITS);
+}
+
+// Half the shader field for each stage
+unsigned int RenderQueue::GetShaderId(const void* vertexShader, const void* pixelShader)
+{
+	const unsigned int half = RENDER_KEY_SHADER_BITS / 2;
+	return ((GetId(shaderIds, pixelShader) & FIELD_MASK(half)) << half) | (GetId(shaderIds, vertexShader) & FIELD_MASK(half));
+}
+
+unsigned int RenderQueue::GetMaterialId(const void* material)
+{
+	return GetId(materialIds, material) & FIELD_MASK(RENDER_KEY_MATERIAL_BITS);
+}
+
+unsigned int RenderQueue::GetMeshId(const void* mesh)
+{
+	return GetId(meshIds, mesh) & FIELD_MASK(RENDER_KEY_MESH_BITS);
+}
+
+unsigned int RenderQueue::GetId(std::unordered_map<const void*, unsigned int>& ids, const void* object)
+{
+	auto it = ids.find(object);
+	if (it != ids.end())
+		return it->second;
+
+	unsigned int id = (unsigned int)ids.size();
+	ids[object] = id;
+	return id;
+}
+
+unsigned int RenderQueue::FindPass(unsigned int pass)
+{
+	unsigned int i = 0;
+	while (i < commands.size() && GetPass(commands[i].Key) < pass)
+		i++;
+	return i;
+}
+
+namespace
+{
+	// Adds the switches between consecutive draws of one pass
+	void CountRun(const std::vector<RenderCommand>& commands, unsigned int pass,
+		unsigned int& shaderSwitches, unsigned int& materialSwitches, unsigned int& meshSwitches, unsigned int* draws)
+	{
+		const RenderCommand* last = 0;
+		for (const RenderCommand& command : commands)
+		{
+			if (RenderQueue::GetPass(command.Key) != pass)
+				continue;
+
+			if (!last || RenderQueue::GetShader(command.Key) != RenderQueue::GetShader(last->Key))
+				shaderSwitches++;
+			if (!last || RenderQueue::GetMaterial(command.Key) != RenderQueue::GetMaterial(last->Key))
+				materialSwitches++;
+			if (!last || RenderQueue::GetMesh(command.Key) != RenderQueue::GetMesh(last->Key))
+				meshSwitches++;
+			if (draws)
+				(*draws)++;
+			last = &command;
+		}
+	}
+}
+
+void RenderQueue::CountSwitches(unsigned int pass, RenderQueueStats& stats)
+{
+	CountRun(commands, pass, stats.ShaderSwitches, stats.MaterialSwitches, stats.MeshSwitches, &stats.Draws);
+	CountRun(unsorted, pass, stats.UnsortedShaderSwitches, stats.UnsortedMaterialSwitches, stats.UnsortedMeshSwitches, 0);
+}
+
+RenderQueueBenchmarkResult BenchmarkRenderQueue(unsigned int count)
+{
+	RenderQueueBenchmarkResult result;
+	result.Count = count;
+
+	RenderQueue queue;
+	srand(1234);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		uint64_t key = RenderQueue::MakeKey(rand() % 2, rand() % 8, rand() % 64, rand() % 1024, (float)rand() / RAND_MAX);
+		queue.Add(key, i);
+	}
+	std::vector<RenderCommand> input = queue.GetCommands();
+	std::vector<RenderCommand> reference = input;
+
+	//Sort once untimed, so the queue's lists are already allocated like they would be from frame to frame
+	queue.Sort();
+	queue.Clear();
+	for (const RenderCommand& command : input)
+		queue.Add(command.Key, command.Item);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	std::stable_sort(reference.begin(), reference.end(),
+		[](const RenderCommand& a, const RenderCommand& b) { return a.Key < b.Key; });
+	result.StdSortSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	start = std::chrono::high_resolution_clock::now();
+	queue.Sort();
+	result.RadixSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	result.RadixPasses = queue.GetLastSortPasses();
+
+	const std::vector<RenderCommand>& sorted = queue.GetCommands();
+	result.Identical = sorted.size() == reference.size();
+	for (size_t i = 0; i < sorted.size() && result.Identical; i++)
+		result.Identical = sorted[i].Key == reference[i].Key && sorted[i].Item == reference[i].Item;
+	return result;
+}
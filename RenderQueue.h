@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Bits of each field of a draw's sort key, most significant first
+#define RENDER_KEY_PASS_BITS		4
+#define RENDER_KEY_SHADER_BITS		12
+#define RENDER_KEY_MATERIAL_BITS	16
+#define RENDER_KEY_MESH_BITS		16
+#define RENDER_KEY_DEPTH_BITS		16
+
+// Passes, in the order they're drawn
+#define RENDER_PASS_SHADOW	0
+#define RENDER_PASS_OPAQUE	1
+
+// --------------------------------------------------------
+// One draw: its sort key, and what to draw (an index into
+// whatever list the caller keeps)
+// --------------------------------------------------------
+struct RenderCommand
+{
+	uint64_t Key;
+	unsigned int Item;
+};
+
+// --------------------------------------------------------
+// State changes while drawing one frame's queue, and what
+// drawing the same draws unsorted would have taken
+// --------------------------------------------------------
+struct RenderQueueStats
+{
+	unsigned int Draws = 0;
+	unsigned int ShaderSwitches = 0;
+	unsigned int MaterialSwitches = 0;
+	unsigned int MeshSwitches = 0;
+	unsigned int UnsortedShaderSwitches = 0;
+	unsigned int UnsortedMaterialSwitches = 0;
+	unsigned int UnsortedMeshSwitches = 0;
+	double SortSeconds = 0;
+};
+
+// --------------------------------------------------------
+// Radix sort vs std::stable_sort, for the INFO window
+// --------------------------------------------------------
+struct RenderQueueBenchmarkResult
+{
+	unsigned int Count = 0;
+	double StdSortSeconds = 0;
+	double RadixSeconds = 0;
+	unsigned int RadixPasses = 0;	// Byte passes that weren't skipped
+	bool Identical = false;			// Same order (including ties) both ways
+};
+
+// --------------------------------------------------------
+// A frame's draws, each boiled down to a 64-bit key:
+//
+//   pass | shader | material | mesh | depth
+//
+// Sorting the keys puts every pass's draws together, then
+// groups them by shader, then by material within those, then
+// by mesh, and finally front to back.  Walking the sorted
+// list, shaders and materials only need binding when their
+// field changes, and depth testing rejects more of what's
+// drawn later.
+//
+// The sort is an LSD radix sort, one byte per pass, skipping
+// bytes that are the same in every key (usually the pass and
+// shader ones).  It's stable, so equal keys keep the order
+// they were added in.
+//
+// Shaders, materials and meshes are given small ids the first
+// time they're seen, which stay the same from frame to frame
+// --------------------------------------------------------
+class RenderQueue
+{
+public:
+	void Clear();
+	void Add(uint64_t key, unsigned int item);
+	void Sort();
+
+	const std::vector<RenderCommand>& GetCommands();
+	unsigned int GetLastSortPasses();
+
+	// Depth is 0 (near) to 1 (far), and is clamped
+	static uint64_t MakeKey(unsigned int pass, unsigned int shader, unsigned int material, unsigned int mesh, float depth);
+	static unsigned int GetPass(uint64_t key);
+	static unsigned int GetShader(uint64_t key);
+	static unsigned int GetMaterial(uint64_t key);
+	static unsigned int GetMesh(uint64_t key);
+
+	// Ids small enough for the key (they wrap if there are too many,
+	// which only makes sorting group them less well)
+	unsigned int GetShaderId(const void* vertexShader, const void* pixelShader);
+	unsigned int GetMaterialId(const void* material);
+	unsigned int GetMeshId(const void* mesh);
+
+	// Index of the first sorted command in a pass (or the end, if none are)
+	unsigned int FindPass(unsigned int pass);
+
+	// Adds up the switches between one pass's draws, sorted and in
+	// the order they were added
+	void CountSwitches(unsigned int pass, RenderQueueStats& stats);
+
+private:
+	unsigned int GetId(std::unordered_map<const void*, unsigned int>& ids, const void* object);
+
+	std::vector<RenderCommand> commands;
+	std::vector<RenderCommand> unsorted;	// As added, for the stats
+	std::vector<RenderCommand> scratch;
+	unsigned int lastSortPasses = 0;
+
+	std::unordered_map<const void*, unsigned int> shaderIds;
+	std::unordered_map<const void*, unsigned int> materialIds;
+	std::unordered_map<const void*, unsigned int> meshIds;
+};
+
+// Times sorting count draws spread over a few shaders, more
+// materials and many meshes, at random depths
+RenderQueueBenchmarkResult BenchmarkRenderQueue(unsigned int count);
@@ -0,0 +1,101 @@
+#include "RingAllocator.h"
+
+RingAllocator::RingAllocator(unsigned int capacity, unsigned int alignment)
+{
+	this->alignment = alignment ? alignment : 1;
+	this->capacity = capacity / this->alignment * this->alignment;
+}
+
+bool RingAllocator::Allocate(unsigned int size, unsigned int& offset)
+{
+	size = (size + alignment - 1) / alignment * alignment;
+	if (size == 0 || size > capacity)
+	{
+		failures++;
+		return false;
+	}
+
+	// Nothing's in use, so start over from the front
+	if (used == 0)
+		head = tail = 0;
+
+	// Taken bytes run from tail to head (around the end if head is behind),
+	// so when head is ahead the free space is after it, then before tail
+	if (head > tail || used == 0)
+	{
+		if (head + size <= capacity)
+		{
+			offset = head;
+			head += size;
+			used += size;
+			frameBytes += size;
+			return true;
+		}
+		if (size <= tail)
+		{
+			// The end's too short, so skip it (it's freed with this frame)
+			unsigned int skipped = capacity - head;
+			offset = 0;
+			head = size;
+			used += skipped + size;
+			frameBytes += skipped + size;
+			wraps++;
+			return true;
+		}
+	}
+	else if (head + size <= tail)
+	{
+		offset = head;
+		head += size;
+		used += size;
+		frameBytes += size;
+		return true;
+	}
+
+	failures++;
+	return false;
+}
+
+void RingAllocator::EndFrame(uint64_t fence)
+{
+	frames.push_back({ fence, frameBytes });
+	frameBytes = 0;
+}
+
+void RingAllocator::Retire(uint64_t completedFence)
+{
+	while (!frames.empty() && frames.front().Fence <= completedFence)
+	{
+		// Frames were allocated in order, so the oldest starts at tail
+		tail += frames.front().Bytes;
+		if (tail >= capacity)
+			tail -= capacity;
+		used -= frames.front().Bytes;
+		frames.pop_front();
+	}
+}
+
+unsigned int RingAllocator::GetCapacity() const
+{
+	return capacity;
+}
+
+unsigned int RingAllocator::GetUsed() const
+{
+	return used;
+}
+
+unsigned int RingAllocator::GetFramesInFlight() const
+{
+	return (unsigned int)frames.size();
+}
+
+unsigned int RingAllocator::GetWraps() const
+{
+	return wraps;
+}
+
+unsigned int RingAllocator::GetFailures() const
+{
+	return failures;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+// --------------------------------------------------------
+// Hands out aligned ranges of a fixed size ring, front to
+// back, wrapping to the start when the end won't fit.  Each
+// frame's ranges are fenced with EndFrame(), and stay taken
+// until Retire() is told the GPU finished that fence, so a
+// range is never handed out while something may still read it.
+// When there's no room, Allocate() fails rather than waiting.
+//
+// Only does the bookkeeping (offsets and fences), so it works
+// the same with or without a GPU behind it
+// --------------------------------------------------------
+class RingAllocator
+{
+public:
+	RingAllocator(unsigned int capacity, unsigned int alignment);
+
+	// Offset of size bytes (rounded up to the alignment), false if they don't fit
+	bool Allocate(unsigned int size, unsigned int& offset);
+
+	// Everything allocated since the last EndFrame() belongs to fence
+	void EndFrame(uint64_t fence);
+
+	// The GPU's done with every frame up to and including this fence
+	void Retire(uint64_t completedFence);
+
+	unsigned int GetCapacity() const;
+	unsigned int GetUsed() const;					// Bytes allocated and not retired, counting what wrapping skipped
+	unsigned int GetFramesInFlight() const;		// Fenced and not yet retired
+	unsigned int GetWraps() const;
+	unsigned int GetFailures() const;
+
+private:
+	struct Frame
+	{
+		uint64_t Fence;
+		unsigned int Bytes;
+	};
+
+	unsigned int capacity;
+	unsigned int alignment;
+	unsigned int head = 0;			// Where the next allocation starts
+	unsigned int tail = 0;			// Start of the oldest frame not retired
+	unsigned int used = 0;
+	unsigned int frameBytes = 0;	// Allocated since the last EndFrame()
+	std::deque<Frame> frames;
+
+	unsigned int wraps = 0;
+	unsigned int failures = 0;
+};
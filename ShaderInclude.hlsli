@@ -36,6 +36,51 @@ struct VertexShaderInput
 	float3 tangent			: TANGENT;
 };
 
+// Compressed version of the vertex above (PackedVertex in C++)
+// - The semantic suffixes tell SimpleShader which 16-bit format to use
+// - Everything arrives here already converted to floats
+struct PackedVertexShaderInput
+{
+	float4 localPosition	: POSITION_UNORM16;	// XYZ in 0-1 across the mesh bounds, W unused
+	float2 normal			: NORMAL_SNORM16;	// Octahedral
+	float2 tangent			: TANGENT_SNORM16;	// Octahedral
+	float2 uv				: TEXCOORD_HALF;
+};
+
+// One instance's transform, from the second vertex buffer (TransformPacket in C++)
+// - "_PER_INSTANCE" tells SimpleShader these step once per instance, from slot 1
+// - Rows of the world matrix, then of the normal matrix (.w unused)
+struct InstanceInput
+{
+	float4 world0			: WORLD_PER_INSTANCE0;
+	float4 world1			: WORLD_PER_INSTANCE1;
+	float4 world2			: WORLD_PER_INSTANCE2;
+	float4 normal0			: NORMAL_MATRIX_PER_INSTANCE0;
+	float4 normal1			: NORMAL_MATRIX_PER_INSTANCE1;
+	float4 normal2			: NORMAL_MATRIX_PER_INSTANCE2;
+};
+
+// Unfolds an octahedral encoded unit vector
+float3 OctDecode(float2 e)
+{
+	float3 n = float3(e.x, e.y, 1.0f - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.xy += n.xy >= 0.0f ? -t : t;
+	return normalize(n);
+}
+
+// Turns a packed vertex back into the full precision one
+// - quantizeOffset/quantizeScale map 0-1 back onto the mesh bounds
+VertexShaderInput UnpackVertex(PackedVertexShaderInput packed, float3 quantizeOffset, float3 quantizeScale)
+{
+	VertexShaderInput input;
+	input.localPosition = quantizeOffset + packed.localPosition.xyz * quantizeScale;
+	input.normal = OctDecode(packed.normal);
+	input.uv = packed.uv;
+	input.tangent = OctDecode(packed.tangent);
+	return input;
+}
+
 // Struct representing the data we expect to receive from earlier pipeline stages
 // - The name of the struct itself is unimportant
 // - The variable names don't have to match other shaders (just the semantics)
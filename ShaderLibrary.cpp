@@ -0,0 +1,270 @@
+#include "ShaderLibrary.h"
+#include "Helpers.h"
+#include "MappedFile.h"
+#include "MeshCache.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+ShaderLibrary* ShaderLibrary::instance;
+
+// --------------------------------------------------------
+// Reads back what WriteShaderReflection() saved
+//
+// The file is rejected if the format doesn't match this build,
+// if it wasn't written for this exact code (same size and
+// hash), or if any table or name would run off the end
+// --------------------------------------------------------
+bool ReadShaderReflection(const char* cacheFile, const void* bytecode, size_t size,
+	SimpleShaderReflection& reflection, double& reflectSeconds)
+{
+	MappedFile file;
+	if (!file.Open(cacheFile) || file.GetSize() < sizeof(ShaderReflectionHeader))
+		return false;
+
+	const ShaderReflectionHeader* h = (const ShaderReflectionHeader*)file.GetData();
+	if (h->Magic != SHADER_REFLECTION_MAGIC ||
+		h->Version != SHADER_REFLECTION_VERSION ||
+		h->HeaderSize != sizeof(ShaderReflectionHeader) ||
+		h->ShaderSize != size ||
+		h->ShaderHash != HashBytes(bytecode, size))
+		return false;
+
+	// The tables and strings have to fill the rest of the file exactly
+	uint64_t stringOffset = sizeof(ShaderReflectionHeader) +
+		(uint64_t)h->BufferCount * sizeof(ShaderReflectionBuffer) +
+		(uint64_t)h->VariableCount * sizeof(ShaderReflectionVariable) +
+		((uint64_t)h->TextureCount + h->SamplerCount) * sizeof(ShaderReflectionResource) +
+		(uint64_t)h->InputCount * sizeof(ShaderReflectionInput);
+	if (h->StringBytes == 0 || stringOffset + h->StringBytes != file.GetSize())
+		return false;
+
+	const char* strings = file.GetData() + stringOffset;
+	if (strings[h->StringBytes - 1] != 0)
+		return false;
+	auto GetString = [&](uint32_t offset, std::string& out)
+	{
+		if (offset >= h->StringBytes)
+			return false;
+		out = strings + offset;
+		return true;
+	};
+
+	const ShaderReflectionBuffer* buffers = (const ShaderReflectionBuffer*)(file.GetData() + sizeof(ShaderReflectionHeader));
+	const ShaderReflectionVariable* variables = (const ShaderReflectionVariable*)(buffers + h->BufferCount);
+	const ShaderReflectionResource* resources = (const ShaderReflectionResource*)(variables + h->VariableCount);
+	const ShaderReflectionInput* inputs = (const ShaderReflectionInput*)(resources + h->TextureCount + h->SamplerCount);
+
+	SimpleShaderReflection result;
+	uint32_t variable = 0;
+	for (uint32_t b = 0; b < h->BufferCount; b++)
+	{
+		if (buffers[b].VariableCount > h->VariableCount - variable)
+			return false;
+
+		SimpleReflectedBuffer buffer = {};
+		if (!GetString(buffers[b].Name, buffer.Name))
+			return false;
+		buffer.Type = (D3D_CBUFFER_TYPE)buffers[b].Type;
+		buffer.Size = buffers[b].Size;
+		buffer.BindIndex = buffers[b].BindIndex;
+		for (uint32_t v = 0; v < buffers[b].VariableCount; v++, variable++)
+		{
+			SimpleReflectedVariable var = {};
+			if (!GetString(variables[variable].Name, var.Name))
+				return false;
+			var.ByteOffset = variables[variable].ByteOffset;
+			var.Size = variables[variable].Size;
+			buffer.Variables.push_back(var);
+		}
+		result.Buffers.push_back(buffer);
+	}
+	if (variable != h->VariableCount)
+		return false;
+
+	for (uint32_t r = 0; r < h->TextureCount + h->SamplerCount; r++)
+	{
+		SimpleReflectedResource resource = {};
+		if (!GetString(resources[r].Name, resource.Name))
+			return false;
+		resource.BindIndex = resources[r].BindIndex;
+		(r < h->TextureCount ? result.Textures : result.Samplers).push_back(resource);
+	}
+
+	for (uint32_t i = 0; i < h->InputCount; i++)
+	{
+		SimpleReflectedInput input = {};
+		if (!GetString(inputs[i].SemanticName, input.SemanticName))
+			return false;
+		input.SemanticIndex = inputs[i].SemanticIndex;
+		input.Mask = inputs[i].Mask;
+		input.ComponentType = (D3D_REGISTER_COMPONENT_TYPE)inputs[i].ComponentType;
+		result.Inputs.push_back(input);
+	}
+
+	reflection = result;
+	reflectSeconds = h->ReflectSeconds;
+	return true;
+}
+
+// --------------------------------------------------------
+// Writes the cache file next to a temp name first and then
+// swaps it in, like cooked meshes
+// --------------------------------------------------------
+bool WriteShaderReflection(const char* cacheFile, const void* bytecode, size_t size,
+	const SimpleShaderReflection& reflection, double reflectSeconds)
+{
+	std::vector<char> strings;
+	auto AddString = [&](const std::string& str)
+	{
+		uint32_t offset = (uint32_t)strings.size();
+		strings.insert(strings.end(), str.begin(), str.end());
+		strings.push_back(0);
+		return offset;
+	};
+
+	std::vector<ShaderReflectionBuffer> buffers;
+	std::vector<ShaderReflectionVariable> variables;
+	for (const SimpleReflectedBuffer& buffer : reflection.Buffers)
+	{
+		buffers.push_back({ AddString(buffer.Name), (uint32_t)buffer.Type, buffer.Size, buffer.BindIndex, (uint32_t)buffer.Variables.size() });
+		for (const SimpleReflectedVariable& var : buffer.Variables)
+			variables.push_back({ AddString(var.Name), var.ByteOffset, var.Size });
+	}
+
+	std::vector<ShaderReflectionResource> resources;
+	for (const SimpleReflectedResource& texture : reflection.Textures)
+		resources.push_back({ AddString(texture.Name), texture.BindIndex });
+	for (const SimpleReflectedResource& sampler : reflection.Samplers)
+		resources.push_back({ AddString(sampler.Name), sampler.BindIndex });
+
+	std::vector<ShaderReflectionInput> inputs;
+	for (const SimpleReflectedInput& input : reflection.Inputs)
+		inputs.push_back({ AddString(input.SemanticName), input.SemanticIndex, input.Mask, (uint32_t)input.ComponentType });
+
+	// Never empty, so the reader can always check the last byte
+	if (strings.empty())
+		strings.push_back(0);
+
+	ShaderReflectionHeader header = {};
+	header.Magic = SHADER_REFLECTION_MAGIC;
+	header.Version = SHADER_REFLECTION_VERSION;
+	header.HeaderSize = sizeof(ShaderReflectionHeader);
+	header.StringBytes = (uint32_t)strings.size();
+	header.ShaderSize = size;
+	header.ShaderHash = HashBytes(bytecode, size);
+	header.ReflectSeconds = reflectSeconds;
+	header.BufferCount = (uint32_t)buffers.size();
+	header.VariableCount = (uint32_t)variables.size();
+	header.TextureCount = (uint32_t)reflection.Textures.size();
+	header.SamplerCount = (uint32_t)reflection.Samplers.size();
+	header.InputCount = (uint32_t)inputs.size();
+
+	std::string tempFile = std::string(cacheFile) + ".tmp";
+	{
+		std::ofstream out(tempFile, std::ios::binary | std::ios::trunc);
+		if (!out.is_open())
+			return false;
+
+		out.write((const char*)&header, sizeof(header));
+		out.write((const char*)buffers.data(), buffers.size() * sizeof(ShaderReflectionBuffer));
+		out.write((const char*)variables.data(), variables.size() * sizeof(ShaderReflectionVariable));
+		out.write((const char*)resources.data(), resources.size() * sizeof(ShaderReflectionResource));
+		out.write((const char*)inputs.data(), inputs.size() * sizeof(ShaderReflectionInput));
+		out.write(strings.data(), strings.size());
+		if (!out.good())
+		{
+			out.close();
+			DeleteFileA(tempFile.c_str());
+			return false;
+		}
+	}
+
+	if (!MoveFileExA(tempFile.c_str(), cacheFile, MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileA(tempFile.c_str());
+		return false;
+	}
+	return true;
+}
+
+void ShaderLibrary::Initialize(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	this->device = device;
+	this->context = context;
+}
+
+std::shared_ptr<SimpleVertexShader> ShaderLibrary::GetVertexShader(const std::wstring& shaderFile)
+{
+	return Get(vertexShaders, shaderFile);
+}
+
+std::shared_ptr<SimplePixelShader> ShaderLibrary::GetPixelShader(const std::wstring& shaderFile)
+{
+	return Get(pixelShaders, shaderFile);
+}
+
+const ShaderLibraryStats& ShaderLibrary::GetStats()
+{
+	return stats;
+}
+
+template<class T>
+std::shared_ptr<T> ShaderLibrary::Get(std::unordered_map<std::wstring, std::shared_ptr<T>>& shaders, const std::wstring& shaderFile)
+{
+	auto found = shaders.find(shaderFile);
+	if (found != shaders.end())
+	{
+		stats.Shared++;
+		return found->second;
+	}
+
+	// If the code can't be read or reflected, loading it the usual
+	// way reports whatever went wrong (and gives an invalid shader)
+	auto startTime = std::chrono::high_resolution_clock::now();
+	Microsoft::WRL::ComPtr<ID3DBlob> blob;
+	std::shared_ptr<const SimpleShaderReflection> reflection;
+	std::shared_ptr<T> shader = Load(shaderFile, blob, reflection) ?
+		std::make_shared<T>(device, context, blob, reflection) :
+		std::make_shared<T>(device, context, shaderFile.c_str());
+
+	shaders[shaderFile] = shader;
+	stats.Loaded++;
+	stats.LoadSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+	return shader;
+}
+
+bool ShaderLibrary::Load(const std::wstring& shaderFile, Microsoft::WRL::ComPtr<ID3DBlob>& blob,
+	std::shared_ptr<const SimpleShaderReflection>& reflection)
+{
+	if (FAILED(D3DReadFileToBlob(shaderFile.c_str(), blob.GetAddressOf())))
+		return false;
+
+	std::string cacheFile = WideToNarrow(shaderFile) + ".refl";
+	std::shared_ptr<SimpleShaderReflection> loaded = std::make_shared<SimpleShaderReflection>();
+
+	auto cacheStart = std::chrono::high_resolution_clock::now();
+	double reflectSeconds = 0;
+	if (ReadShaderReflection(cacheFile.c_str(), blob->GetBufferPointer(), blob->GetBufferSize(), *loaded, reflectSeconds))
+	{
+		stats.CacheHits++;
+		stats.CacheSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - cacheStart).count();
+		stats.SavedSeconds += reflectSeconds;
+		reflection = loaded;
+		return true;
+	}
+
+	auto reflectStart = std::chrono::high_resolution_clock::now();
+	if (!loaded->Reflect(blob->GetBufferPointer(), blob->GetBufferSize()))
+		return false;
+	reflectSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - reflectStart).count();
+	stats.Reflected++;
+	stats.ReflectSeconds += reflectSeconds;
+
+	// Failing to write just means reflecting again next time
+	WriteShaderReflection(cacheFile.c_str(), blob->GetBufferPointer(), blob->GetBufferSize(), *loaded, reflectSeconds);
+	reflection = loaded;
+	return true;
+}
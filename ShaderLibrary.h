@@ -0,0 +1,160 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "SimpleShader.h"
+
+// --------------------------------------------------------
+// Reflection cache file layout (x.cso -> x.cso.refl)
+//
+//  [ShaderReflectionHeader]   magic, version, the code's size
+//                             and hash, and the table counts
+//  [ShaderReflectionBuffer]   per constant buffer
+//  [ShaderReflectionVariable] every buffer's variables in order
+//  [ShaderReflectionResource] textures, then samplers
+//  [ShaderReflectionInput]    vertex inputs
+//  [strings]                  null terminated, which the tables
+//                             point into by byte offset
+// --------------------------------------------------------
+#define SHADER_REFLECTION_MAGIC		0x4C464552	// "REFL" when read as bytes
+#define SHADER_REFLECTION_VERSION	1
+
+struct ShaderReflectionHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t HeaderSize;
+	uint32_t StringBytes;
+
+	// Identifies the code this was reflected from
+	uint64_t ShaderSize;
+	uint64_t ShaderHash;
+
+	double ReflectSeconds;	// How long reflecting it took, for the stats
+
+	uint32_t BufferCount;
+	uint32_t VariableCount;
+	uint32_t TextureCount;
+	uint32_t SamplerCount;
+	uint32_t InputCount;
+	uint32_t Padding;
+};
+
+struct ShaderReflectionBuffer
+{
+	uint32_t Name;
+	uint32_t Type;			// D3D_CBUFFER_TYPE
+	uint32_t Size;
+	uint32_t BindIndex;
+	uint32_t VariableCount;
+};
+
+struct ShaderReflectionVariable
+{
+	uint32_t Name;
+	uint32_t ByteOffset;
+	uint32_t Size;
+};
+
+struct ShaderReflectionResource
+{
+	uint32_t Name;
+	uint32_t BindIndex;
+};
+
+struct ShaderReflectionInput
+{
+	uint32_t SemanticName;
+	uint32_t SemanticIndex;
+	uint32_t Mask;
+	uint32_t ComponentType;	// D3D_REGISTER_COMPONENT_TYPE
+};
+
+// Reads a cache file, if it was written for exactly this code
+bool ReadShaderReflection(const char* cacheFile, const void* bytecode, size_t size,
+	SimpleShaderReflection& reflection, double& reflectSeconds);
+
+// Writes a cache file stamped with the code's size and hash
+bool WriteShaderReflection(const char* cacheFile, const void* bytecode, size_t size,
+	const SimpleShaderReflection& reflection, double reflectSeconds);
+
+// --------------------------------------------------------
+// What loading went through, since the library started
+// --------------------------------------------------------
+struct ShaderLibraryStats
+{
+	unsigned int Loaded;		// Distinct .cso files
+	unsigned int Shared;		// Requests handed an already loaded shader
+	unsigned int CacheHits;		// Reflections read from a cache file
+	unsigned int Reflected;		// Reflected (and written to the cache)
+	double LoadSeconds;			// Everything, reading and creating included
+	double ReflectSeconds;		// Reflecting the misses
+	double CacheSeconds;		// Reading the hits' cache files
+	double SavedSeconds;		// What reflecting the hits took when they were cached
+};
+
+// --------------------------------------------------------
+// Loads each compiled shader once and hands the same shader
+// to everyone who asks for that file, so the code, the D3D
+// shader object and its reflected tables exist once however
+// many materials use it.
+//
+// Reflection is saved next to each .cso the first time it's
+// loaded, and read back on later runs instead of reflecting
+// again, as long as the .cso is byte for byte the same.  A
+// cache that's missing, stale or unwritable only costs the
+// reflection it would have saved
+// --------------------------------------------------------
+class ShaderLibrary
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static ShaderLibrary& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new ShaderLibrary();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	ShaderLibrary(ShaderLibrary const&) = delete;
+	void operator=(ShaderLibrary const&) = delete;
+
+private:
+	static ShaderLibrary* instance;
+	ShaderLibrary() {};
+#pragma endregion
+
+public:
+	void Initialize(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// Full paths, as FixPath() gives them
+	std::shared_ptr<SimpleVertexShader> GetVertexShader(const std::wstring& shaderFile);
+	std::shared_ptr<SimplePixelShader> GetPixelShader(const std::wstring& shaderFile);
+
+	const ShaderLibraryStats& GetStats();
+
+private:
+	// The code and its reflection, from the cache when it can be
+	bool Load(const std::wstring& shaderFile, Microsoft::WRL::ComPtr<ID3DBlob>& blob,
+		std::shared_ptr<const SimpleShaderReflection>& reflection);
+
+	template<class T>
+	std::shared_ptr<T> Get(std::unordered_map<std::wstring, std::shared_ptr<T>>& shaders, const std::wstring& shaderFile);
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+
+	std::unordered_map<std::wstring, std::shared_ptr<SimpleVertexShader>> vertexShaders;
+	std::unordered_map<std::wstring, std::shared_ptr<SimplePixelShader>> pixelShaders;
+
+	ShaderLibraryStats stats = {};
+};
@@ -1,13 +1,33 @@
 #include "ShaderInclude.hlsli"
 
-//Create our constant buffer and register it to a slot on the pipeline
-cbuffer ExternalData : register(b0)
+//The light's matrices, uploaded once per shadow pass
+cbuffer PerFrame : register(b0)
 {
-	matrix world;
 	matrix view;
 	matrix projection;
 }
 
+//Uploaded for every draw (instanced draws take world from the instance buffer)
+#if !defined(INSTANCED) || defined(PACKED_VERTICES)
+cbuffer PerObject : register(b1)
+{
+#ifndef INSTANCED
+	row_major float3x4 world;	//Only the rows that aren't always 0 0 0 1
+#endif
+
+#ifdef PACKED_VERTICES
+	float3 quantizeOffset;
+	float3 quantizeScale;
+#endif
+}
+#endif
+
+#ifdef INSTANCED
+#define INSTANCE_INPUT , InstanceInput instance
+#else
+#define INSTANCE_INPUT
+#endif
+
 // VStoPS struct for shadow map creation
 struct VertexToPixelShadow
 {
@@ -15,14 +35,23 @@ struct VertexToPixelShadow
 };
 
 
-VertexToPixelShadow main(VertexShaderInput input)
+#ifdef PACKED_VERTICES
+VertexToPixelShadow main(PackedVertexShaderInput packedInput INSTANCE_INPUT)
+{
+	VertexShaderInput input = UnpackVertex(packedInput, quantizeOffset, quantizeScale);
+#else
+VertexToPixelShadow main(VertexShaderInput input INSTANCE_INPUT)
 {
+#endif
+#ifdef INSTANCED
+	float3x4 world = float3x4(instance.world0, instance.world1, instance.world2);
+#endif
 	VertexToPixelShadow output;
 
 	//Calculate screen position of this pixel
 	//This is the projection of the shadow from the light's point of view
-	matrix wvp = mul(projection, mul(view, world));
-	output.screenPosition = mul(wvp, float4(input.localPosition, 1.0f));
+	float3 worldPosition = mul(world, float4(input.localPosition, 1.0f));
+	output.screenPosition = mul(projection, mul(view, float4(worldPosition, 1.0f)));
 
 	return output;
 }
\ No newline at end of file
@@ -1,9 +1,16 @@
 #include "SimpleShader.h"
+#include "StateCache.h"
 
 // Default error reporting state
 bool ISimpleShader::ReportErrors = false;
 bool ISimpleShader::ReportWarnings = false;
 
+// Upload counters, reset by whoever reads them
+size_t ISimpleShader::BytesUploaded = 0;
+unsigned int ISimpleShader::Uploads = 0;
+unsigned int ISimpleShader::UploadsSkipped = 0;
+SimpleUploadRecorder* ISimpleShader::Recorder = 0;
+
 // To enable error reporting, use either or both 
 // of the following lines somewhere in your program, 
 // preferably before loading/using any shaders.
@@ -12,6 +19,96 @@ bool ISimpleShader::ReportWarnings = false;
 // ISimpleShader::ReportWarnings = true;
 
 
+///////////////////////////////////////////////////////////////////////////////
+// ------ SHADER REFLECTION ---------------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+
+// --------------------------------------------------------
+// Reflects compiled shader code, keeping only what the
+// shader classes use: constant buffers and their variables,
+// textures, samplers and (for vertex shaders) the inputs an
+// input layout has to provide
+//
+// Returns false if the code couldn't be reflected
+// --------------------------------------------------------
+bool SimpleShaderReflection::Reflect(const void* bytecode, size_t size)
+{
+	Buffers.clear();
+	Textures.clear();
+	Samplers.clear();
+	Inputs.clear();
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
+	if (FAILED(D3DReflect(bytecode, size, IID_ID3D11ShaderReflection, (void**)refl.GetAddressOf())))
+		return false;
+
+	// Get the description of the shader
+	D3D11_SHADER_DESC shaderDesc;
+	refl->GetDesc(&shaderDesc);
+
+	// Bound resources (textures, structured buffers and samplers)
+	for (unsigned int r = 0; r < shaderDesc.BoundResources; r++)
+	{
+		D3D11_SHADER_INPUT_BIND_DESC resourceDesc;
+		refl->GetResourceBindingDesc(r, &resourceDesc);
+
+		SimpleReflectedResource resource = { resourceDesc.Name, resourceDesc.BindPoint };
+		switch (resourceDesc.Type)
+		{
+		case D3D_SIT_STRUCTURED: // Treat structured buffers as texture resources
+		case D3D_SIT_TEXTURE:
+			Textures.push_back(resource);
+			break;
+
+		case D3D_SIT_SAMPLER:
+			Samplers.push_back(resource);
+			break;
+		}
+	}
+
+	// Constant buffers, their bind points and their variables
+	for (unsigned int b = 0; b < shaderDesc.ConstantBuffers; b++)
+	{
+		ID3D11ShaderReflectionConstantBuffer* cb = refl->GetConstantBufferByIndex(b);
+		D3D11_SHADER_BUFFER_DESC bufferDesc;
+		cb->GetDesc(&bufferDesc);
+
+		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
+		refl->GetResourceBindingDescByName(bufferDesc.Name, &bindDesc);
+
+		SimpleReflectedBuffer buffer = {};
+		buffer.Name = bufferDesc.Name;
+		buffer.Type = bufferDesc.Type;
+		buffer.Size = bufferDesc.Size;
+		buffer.BindIndex = bindDesc.BindPoint;
+		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
+		{
+			D3D11_SHADER_VARIABLE_DESC varDesc;
+			cb->GetVariableByIndex(v)->GetDesc(&varDesc);
+			buffer.Variables.push_back({ varDesc.Name, varDesc.StartOffset, varDesc.Size });
+		}
+		Buffers.push_back(buffer);
+	}
+
+	// Anything but a vertex shader gets its inputs from the stage before
+	if (D3D11_SHVER_GET_TYPE(shaderDesc.Version) != D3D11_SHVER_VERTEX_SHADER)
+		return true;
+
+	for (unsigned int i = 0; i < shaderDesc.InputParameters; i++)
+	{
+		D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
+		refl->GetInputParameterDesc(i, &paramDesc);
+
+		// System values (like SV_VertexID) come from the pipeline, not a buffer
+		if (paramDesc.SystemValueType != D3D_NAME_UNDEFINED)
+			continue;
+
+		Inputs.push_back({ paramDesc.SemanticName, paramDesc.SemanticIndex, paramDesc.Mask, paramDesc.ComponentType });
+	}
+	return true;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // ------ BASE SIMPLE SHADER --------------------------------------------------
 ///////////////////////////////////////////////////////////////////////////////
@@ -28,7 +125,16 @@ ISimpleShader::ISimpleShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Micros
 	// Set up fields
 	this->constantBufferCount = 0;
 	this->constantBuffers = 0;
+	this->localData = 0;
 	this->shaderValid = false;
+
+	// Partial constant buffer updates need an 11.1 context and driver support
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	if (SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) &&
+		options.ConstantBufferPartialUpdate)
+	{
+		context.As(&deviceContext1);
+	}
 }
 
 // --------------------------------------------------------
@@ -45,23 +151,19 @@ ISimpleShader::~ISimpleShader()
 // --------------------------------------------------------
 void ISimpleShader::CleanUp()
 {
-	// Handle constant buffers and local data buffers
-	for (unsigned int i = 0; i < constantBufferCount; i++)
-	{
-		delete[] constantBuffers[i].LocalDataBuffer;
-	}
-
+	// Handle constant buffers and their (shared) local data
 	if (constantBuffers)
 	{
 		delete[] constantBuffers;
 		constantBufferCount = 0;
 	}
 
-	for (unsigned int i = 0; i < shaderResourceViews.size(); i++)
-		delete shaderResourceViews[i];
-	
-	for (unsigned int i = 0; i < samplerStates.size(); i++)
-		delete samplerStates[i];
+	delete[] localData;
+	localData = 0;
+
+	variables.clear();
+	shaderResourceViews.clear();
+	samplerStates.clear();
 
 	// Clean up tables
 	varTable.clear();
@@ -81,7 +183,8 @@ void ISimpleShader::CleanUp()
 bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 {
 	// Load the shader to a blob and ensure it worked
-	HRESULT hr = D3DReadFileToBlob(shaderFile, shaderBlob.GetAddressOf());
+	Microsoft::WRL::ComPtr<ID3DBlob> blob;
+	HRESULT hr = D3DReadFileToBlob(shaderFile, blob.GetAddressOf());
 	if (hr != S_OK)
 	{
 		if (ReportErrors)
@@ -94,6 +197,34 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		return false;
 	}
 
+	return LoadShaderBlob(blob, 0, shaderFile);
+}
+
+// --------------------------------------------------------
+// Creates the shader from already loaded code and builds the
+// variable table from its reflection, reflecting the code
+// only if no reflection was passed in
+//
+// blob - The compiled shader
+// reflection - What reflecting it gives, or null
+// shaderFile - Where the code came from (for errors), or null
+// 
+// Returns true if shader is loaded properly, false otherwise
+// --------------------------------------------------------
+bool ISimpleShader::LoadShaderBlob(Microsoft::WRL::ComPtr<ID3DBlob> blob, std::shared_ptr<const SimpleShaderReflection> reflection, LPCWSTR shaderFile)
+{
+	shaderBlob = blob;
+
+	// Set up shader reflection to get information about
+	// this shader and its variables,  buffers, etc.
+	if (!reflection)
+	{
+		std::shared_ptr<SimpleShaderReflection> reflected = std::make_shared<SimpleShaderReflection>();
+		reflected->Reflect(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize());
+		reflection = reflected;
+	}
+	this->reflection = reflection;
+
 	// Create the shader - Calls an overloaded version of this abstract
 	// method in the appropriate child class
 	shaderValid = CreateShader(shaderBlob);
@@ -102,129 +233,81 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		if (ReportErrors)
 		{
 			LogError("SimpleShader::LoadShaderFile() - Error creating shader from file '");
-			LogW(shaderFile);
+			LogW(shaderFile ? shaderFile : L"(memory)");
 			LogError("'. Ensure the type of shader (vertex, pixel, etc.) matches the SimpleShader type (SimpleVertexShader, SimplePixelShader, etc.) you're using.\n");
 		}
 
 		return false;
 	}
 
-	// Set up shader reflection to get information about
-	// this shader and its variables,  buffers, etc.
-	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)refl.GetAddressOf());
-	
-	// Get the description of the shader
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
-
-	// Create resource arrays
-	constantBufferCount = shaderDesc.ConstantBuffers;
-	constantBuffers = new SimpleConstantBuffer[constantBufferCount];
-	
 	// Handle bound resources (like shaders and samplers)
-	unsigned int resourceCount = shaderDesc.BoundResources;
-	for (unsigned int r = 0; r < resourceCount; r++)
+	for (const SimpleReflectedResource& resource : reflection->Textures)
 	{
-		// Get this resource's description
-		D3D11_SHADER_INPUT_BIND_DESC resourceDesc;
-		refl->GetResourceBindingDesc(r, &resourceDesc);
+		// Create the SRV wrapper
+		SimpleSRV srv = {};
+		srv.BindIndex = resource.BindIndex;						// Shader bind point
+		srv.Index = (unsigned int)shaderResourceViews.size();	// Raw index
 
-		// Check the type
-		switch (resourceDesc.Type)
-		{
-		case D3D_SIT_STRUCTURED: // Treat structured buffers as texture resources
-		case D3D_SIT_TEXTURE: // A texture resource
-		{
-			// Create the SRV wrapper
-			SimpleSRV* srv = new SimpleSRV();
-			srv->BindIndex = resourceDesc.BindPoint;				// Shader bind point
-			srv->Index = (unsigned int)shaderResourceViews.size();	// Raw index
+		textureTable.insert(std::pair<std::string, unsigned int>(resource.Name, srv.Index));
+		shaderResourceViews.push_back(srv);
+	}
+	for (const SimpleReflectedResource& resource : reflection->Samplers)
+	{
+		// Create the sampler wrapper
+		SimpleSampler samp = {};
+		samp.BindIndex = resource.BindIndex;				// Shader bind point
+		samp.Index = (unsigned int)samplerStates.size();	// Raw index
 
-			textureTable.insert(std::pair<std::string, SimpleSRV*>(resourceDesc.Name, srv));
-			shaderResourceViews.push_back(srv);
-		}
-			break;
+		samplerTable.insert(std::pair<std::string, unsigned int>(resource.Name, samp.Index));
+		samplerStates.push_back(samp);
+	}
 
-		case D3D_SIT_SAMPLER: // A sampler resource
-		{
-			// Create the sampler wrapper
-			SimpleSampler* samp = new SimpleSampler();
-			samp->BindIndex = resourceDesc.BindPoint;			// Shader bind point
-			samp->Index = (unsigned int)samplerStates.size();	// Raw index
+	// Create resource arrays
+	constantBufferCount = (unsigned int)reflection->Buffers.size();
+	constantBuffers = new SimpleConstantBuffer[constantBufferCount];
 
-			samplerTable.insert(std::pair<std::string, SimpleSampler*>(resourceDesc.Name, samp));
-			samplerStates.push_back(samp);
-		}
-			break;
-		}
-	}
+	// Every buffer's local data goes in one allocation, each
+	// starting on a 16 byte boundary like its GPU copy
+	unsigned int localDataSize = 0;
+	for (const SimpleReflectedBuffer& buffer : reflection->Buffers)
+		localDataSize += ((buffer.Size + 15) / 16) * 16;
+	localData = new unsigned char[localDataSize > 0 ? localDataSize : 1];
+	ZeroMemory(localData, localDataSize);
 
 	// Loop through all constant buffers
+	unsigned int localDataOffset = 0;
 	for (unsigned int b = 0; b < constantBufferCount; b++)
 	{
-		// Get this buffer
-		ID3D11ShaderReflectionConstantBuffer* cb =
-			refl->GetConstantBufferByIndex(b);
-		
-		// Get the description of this buffer
-		D3D11_SHADER_BUFFER_DESC bufferDesc;
-		cb->GetDesc(&bufferDesc);
+		const SimpleReflectedBuffer& buffer = reflection->Buffers[b];
 
 		// Save the type, which we reference when setting these buffers
-		constantBuffers[b].Type = bufferDesc.Type;
-		
-		// Get the description of the resource binding, so
-		// we know exactly how it's bound in the shader
-		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
-		refl->GetResourceBindingDescByName(bufferDesc.Name, &bindDesc);
-		
-		// Set up the buffer and put its pointer in the table
-		constantBuffers[b].BindIndex = bindDesc.BindPoint;
-		constantBuffers[b].Name = bufferDesc.Name;
-		cbTable.insert(std::pair<std::string, SimpleConstantBuffer*>(bufferDesc.Name, &constantBuffers[b]));
+		constantBuffers[b].Type = buffer.Type;
 
-		// Create this constant buffer
-		D3D11_BUFFER_DESC newBuffDesc = {};
-		newBuffDesc.Usage = D3D11_USAGE_DEFAULT;
-		newBuffDesc.ByteWidth = ((bufferDesc.Size + 15) / 16) * 16; // Quick and dirty 16-byte alignment using integer division
-		newBuffDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-		newBuffDesc.CPUAccessFlags = 0;
-		newBuffDesc.MiscFlags = 0;
-		newBuffDesc.StructureByteStride = 0;
-		device->CreateBuffer(&newBuffDesc, 0, constantBuffers[b].ConstantBuffer.GetAddressOf());
+		// Set up the buffer and put its pointer in the table
+		constantBuffers[b].BindIndex = buffer.BindIndex;
+		constantBuffers[b].Name = buffer.Name;
+		cbTable.insert(std::pair<std::string, unsigned int>(buffer.Name, b));
 
 		// Set up the data buffer for this constant buffer
-		constantBuffers[b].Size = bufferDesc.Size;
-		constantBuffers[b].LocalDataBuffer = new unsigned char[bufferDesc.Size];
-		ZeroMemory(constantBuffers[b].LocalDataBuffer, bufferDesc.Size);
+		constantBuffers[b].Size = buffer.Size;
+		constantBuffers[b].LocalDataBuffer = localData + localDataOffset;
+		localDataOffset += ((buffer.Size + 15) / 16) * 16;
+
+		// Create this constant buffer
+		CreateConstantBuffer(constantBuffers[b]);
 
 		// Loop through all variables in this buffer
-		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
+		for (const SimpleReflectedVariable& var : buffer.Variables)
 		{
-			// Get this variable
-			ID3D11ShaderReflectionVariable* var =
-				cb->GetVariableByIndex(v);
-			
-			// Get the description of the variable and its type
-			D3D11_SHADER_VARIABLE_DESC varDesc;
-			var->GetDesc(&varDesc);
-
 			// Create the variable struct
 			SimpleShaderVariable varStruct = {};
 			varStruct.ConstantBufferIndex = b;
-			varStruct.ByteOffset = varDesc.StartOffset;
-			varStruct.Size = varDesc.Size;
-			
-			// Get a string version
-			std::string varName(varDesc.Name);
+			varStruct.ByteOffset = var.ByteOffset;
+			varStruct.Size = var.Size;
 
 			// Add this variable to the table and the constant buffer
-			varTable.insert(std::pair<std::string, SimpleShaderVariable>(varName, varStruct));
+			varTable.insert(std::pair<std::string, unsigned int>(var.Name, (unsigned int)variables.size()));
+			variables.push_back(varStruct);
 			constantBuffers[b].Variables.push_back(varStruct);
 		}
 	}
@@ -233,6 +316,118 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 	return true;
 }
 
+// --------------------------------------------------------
+// Creates (or recreates) a constant buffer's GPU copy with
+// its current usage.  Its contents start out undefined, so
+// the whole buffer is dirty
+// --------------------------------------------------------
+bool ISimpleShader::CreateConstantBuffer(SimpleConstantBuffer& cb)
+{
+	D3D11_BUFFER_DESC newBuffDesc = {};
+	newBuffDesc.Usage = cb.Dynamic ? D3D11_USAGE_DYNAMIC : D3D11_USAGE_DEFAULT;
+	newBuffDesc.ByteWidth = ((cb.Size + 15) / 16) * 16; // Quick and dirty 16-byte alignment using integer division
+	newBuffDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	newBuffDesc.CPUAccessFlags = cb.Dynamic ? D3D11_CPU_ACCESS_WRITE : 0;
+	newBuffDesc.MiscFlags = 0;
+	newBuffDesc.StructureByteStride = 0;
+
+	cb.ConstantBuffer.Reset();
+	cb.DirtyStart = 0;
+	cb.DirtyEnd = cb.Size;
+	return SUCCEEDED(device->CreateBuffer(&newBuffDesc, 0, cb.ConstantBuffer.GetAddressOf()));
+}
+
+// --------------------------------------------------------
+// Copies a buffer's local data to the GPU, or as little of
+// it as has changed, or nothing if none has
+// --------------------------------------------------------
+void ISimpleShader::UploadBuffer(SimpleConstantBuffer& cb)
+{
+	// Nothing's changed since the last upload
+	if (cb.DirtyStart >= cb.DirtyEnd)
+	{
+		UploadsSkipped++;
+		if (Recorder)
+			Recorder->Skipped++;
+		return;
+	}
+
+	// Discarding throws the old contents away, so dynamic buffers are
+	// rewritten whole; default ones only from the first dirty register
+	// to the last, when the driver allows it
+	unsigned int offset = 0;
+	unsigned int size = cb.Size;
+	if (!cb.Dynamic && deviceContext1)
+	{
+		unsigned int end = ((cb.DirtyEnd + 15) / 16) * 16;
+		offset = (cb.DirtyStart / 16) * 16;
+		size = (end < cb.Size ? end : cb.Size) - offset;
+	}
+	cb.DirtyStart = 0;
+	cb.DirtyEnd = 0;
+	BytesUploaded += size;
+	Uploads++;
+
+	if (Recorder)
+	{
+		Recorder->Uploads.push_back({ &cb, offset, size, cb.Dynamic });
+		if (!Recorder->Forward)
+			return;
+	}
+
+	if (cb.Dynamic)
+	{
+		D3D11_MAPPED_SUBRESOURCE mapped = {};
+		if (SUCCEEDED(deviceContext->Map(cb.ConstantBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		{
+			memcpy(mapped.pData, cb.LocalDataBuffer, cb.Size);
+			deviceContext->Unmap(cb.ConstantBuffer.Get(), 0);
+		}
+	}
+	else if (size < cb.Size)
+	{
+		// Boxes must cover whole registers (the local data is padded to one)
+		D3D11_BOX box = { offset, 0, 0, ((offset + size + 15) / 16) * 16, 1, 1 };
+		deviceContext1->UpdateSubresource1(
+			cb.ConstantBuffer.Get(), 0, &box,
+			cb.LocalDataBuffer + offset, 0, 0, 0);
+	}
+	else
+	{
+		deviceContext->UpdateSubresource(
+			cb.ConstantBuffer.Get(), 0, 0,
+			cb.LocalDataBuffer, 0, 0);
+	}
+}
+
+// --------------------------------------------------------
+// Copies data into a variable's spot in the local data buffer,
+// marking the bytes dirty if (and only if) that changes them
+// --------------------------------------------------------
+bool ISimpleShader::WriteVariable(const SimpleShaderVariable& var, const void* data, unsigned int size)
+{
+	SimpleConstantBuffer& cb = constantBuffers[var.ConstantBufferIndex];
+	unsigned char* dest = cb.LocalDataBuffer + var.ByteOffset;
+	if (memcmp(dest, data, size) == 0)
+		return true;
+	memcpy(dest, data, size);
+
+	// Grow the dirty range to cover these bytes
+	unsigned int start = var.ByteOffset;
+	unsigned int end = var.ByteOffset + size;
+	if (cb.DirtyStart >= cb.DirtyEnd)
+	{
+		cb.DirtyStart = start;
+		cb.DirtyEnd = end;
+	}
+	else
+	{
+		if (start < cb.DirtyStart) cb.DirtyStart = start;
+		if (end > cb.DirtyEnd) cb.DirtyEnd = end;
+	}
+	return true;
+}
+
 // --------------------------------------------------------
 // Helper for looking up a variable by name and also
 // verifying that it is the requested size
@@ -243,15 +438,15 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 SimpleShaderVariable* ISimpleShader::FindVariable(std::string name, int size)
 {
 	// Look for the key
-	std::unordered_map<std::string, SimpleShaderVariable>::iterator result =
+	std::unordered_map<std::string, unsigned int>::iterator result =
 		varTable.find(name);
 
 	// Did we find the key?
 	if (result == varTable.end())
 		return 0;
 
-	// Grab the result from the iterator
-	SimpleShaderVariable* var = &(result->second);
+	// Grab the variable the key points to
+	SimpleShaderVariable* var = &variables[result->second];
 
 	// Is the data size correct ?
 	if (size > 0 && var->Size != size)
@@ -267,7 +462,7 @@ SimpleShaderVariable* ISimpleShader::FindVariable(std::string name, int size)
 SimpleConstantBuffer* ISimpleShader::FindConstantBuffer(std::string name)
 {
 	// Look for the key
-	std::unordered_map<std::string, SimpleConstantBuffer*>::iterator result =
+	std::unordered_map<std::string, unsigned int>::iterator result =
 		cbTable.find(name);
 
 	// Did we find the key?
@@ -275,7 +470,7 @@ SimpleConstantBuffer* ISimpleShader::FindConstantBuffer(std::string name)
 		return 0;
 
 	// Success
-	return result->second;
+	return &constantBuffers[result->second];
 }
 
 // --------------------------------------------------------
@@ -345,14 +540,9 @@ void ISimpleShader::CopyAllBufferData()
 	// Ensure the shader is valid
 	if (!shaderValid) return;
 
-	// Loop through the constant buffers and copy all data
+	// Loop through the constant buffers and copy whatever changed
 	for (unsigned int i = 0; i < constantBufferCount; i++)
-	{
-		// Copy the entire local data buffer
-		deviceContext->UpdateSubresource(
-			constantBuffers[i].ConstantBuffer.Get(), 0, 0,
-			constantBuffers[i].LocalDataBuffer, 0, 0);
-	}
+		UploadBuffer(constantBuffers[i]);
 }
 
 // --------------------------------------------------------
@@ -375,14 +565,8 @@ void ISimpleShader::CopyBufferData(unsigned int index)
 	if(index >= this->constantBufferCount)
 		return;
 
-	// Check for the buffer
-	SimpleConstantBuffer* cb = &this->constantBuffers[index];
-	if (!cb) return;
-
-	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer.Get(), 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	// Copy the data (if it changed) and get out
+	UploadBuffer(this->constantBuffers[index]);
 }
 
 // --------------------------------------------------------
@@ -401,10 +585,38 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 	SimpleConstantBuffer* cb = this->FindConstantBuffer(bufferName);
 	if (!cb) return;
 
-	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer.Get(), 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	// Copy the data (if it changed) and get out
+	UploadBuffer(*cb);
+}
+
+// --------------------------------------------------------
+// Copies local data to the shader's specified constant buffer
+//
+// buffer - A handle from GetBufferHandle()
+// --------------------------------------------------------
+void ISimpleShader::CopyBufferData(SimpleBufferHandle buffer)
+{
+	CopyBufferData(buffer.Index);
+}
+
+// --------------------------------------------------------
+// Switches a buffer between default usage (UpdateSubresource)
+// and dynamic usage (Map with WRITE_DISCARD).  Dynamic suits
+// buffers rewritten for nearly every draw.  The new buffer is
+// only bound the next time the shader is set
+//
+// Returns false if the handle is invalid or creation fails
+// --------------------------------------------------------
+bool ISimpleShader::SetBufferDynamic(SimpleBufferHandle buffer, bool dynamic)
+{
+	if (buffer.Index >= constantBufferCount)
+		return false;
+
+	SimpleConstantBuffer& cb = constantBuffers[buffer.Index];
+	if (cb.Dynamic == dynamic)
+		return true;
+	cb.Dynamic = dynamic;
+	return CreateConstantBuffer(cb);
 }
 
 
@@ -446,13 +658,7 @@ bool ISimpleShader::SetData(std::string name, const void* data, unsigned int siz
 	}
 
 	// Set the data in the local data buffer
-	memcpy(
-		constantBuffers[var->ConstantBufferIndex].LocalDataBuffer + var->ByteOffset,
-		data,
-		size);
-
-	// Success
-	return true;
+	return WriteVariable(*var, data, size);
 }
 
 // --------------------------------------------------------
@@ -535,6 +741,113 @@ bool ISimpleShader::SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 dat
 	return this->SetData(name, &data, sizeof(float) * 16);
 }
 
+// --------------------------------------------------------
+// Looks up a shader variable once, for the handle setters
+//
+// name - The name of the shader variable
+//
+// Returns an invalid handle if the variable doesn't exist
+// --------------------------------------------------------
+SimpleVariableHandle ISimpleShader::GetVariableHandle(const std::string& name)
+{
+	SimpleVariableHandle handle;
+	std::unordered_map<std::string, unsigned int>::iterator result = varTable.find(name);
+	if (result != varTable.end())
+		handle.Index = result->second;
+	else if (ReportWarnings)
+	{
+		LogWarning("SimpleShader::GetVariableHandle() - Shader variable '");
+		Log(name);
+		LogWarning("' not found. Ensure the name is spelled correctly and that it exists in a constant buffer in the shader.\n");
+	}
+	return handle;
+}
+
+// --------------------------------------------------------
+// Looks up a constant buffer once, for CopyBufferData()
+// --------------------------------------------------------
+SimpleBufferHandle ISimpleShader::GetBufferHandle(const std::string& name)
+{
+	SimpleBufferHandle handle;
+	std::unordered_map<std::string, unsigned int>::iterator result = cbTable.find(name);
+	if (result != cbTable.end())
+		handle.Index = result->second;
+	return handle;
+}
+
+// --------------------------------------------------------
+// Looks up an SRV once, for SetShaderResourceView()
+// --------------------------------------------------------
+SimpleSRVHandle ISimpleShader::GetShaderResourceViewHandle(const std::string& name)
+{
+	SimpleSRVHandle handle;
+	std::unordered_map<std::string, unsigned int>::iterator result = textureTable.find(name);
+	if (result != textureTable.end())
+		handle.Index = result->second;
+	else if (ReportWarnings)
+	{
+		LogWarning("SimpleShader::GetShaderResourceViewHandle() - SRV named '");
+		Log(name);
+		LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
+	}
+	return handle;
+}
+
+// --------------------------------------------------------
+// Looks up a sampler once, for SetSamplerState()
+// --------------------------------------------------------
+SimpleSamplerHandle ISimpleShader::GetSamplerHandle(const std::string& name)
+{
+	SimpleSamplerHandle handle;
+	std::unordered_map<std::string, unsigned int>::iterator result = samplerTable.find(name);
+	if (result != samplerTable.end())
+		handle.Index = result->second;
+	else if (ReportWarnings)
+	{
+		LogWarning("SimpleShader::GetSamplerHandle() - Sampler named '");
+		Log(name);
+		LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
+	}
+	return handle;
+}
+
+// --------------------------------------------------------
+// Sets a variable through its handle with arbitrary data of
+// the specified size.  Nothing is looked up by name, so this
+// is just a bounds check and a copy
+//
+// variable - A handle from GetVariableHandle()
+// data - The data to set in the buffer
+// size - The size of the data (this must be less than or equal to the variable's size)
+//
+// Returns true if data is copied, false if the handle is invalid
+// --------------------------------------------------------
+bool ISimpleShader::SetData(SimpleVariableHandle variable, const void* data, unsigned int size)
+{
+	// Invalid handles were already reported when they were resolved
+	if (variable.Index >= variables.size())
+		return false;
+
+	const SimpleShaderVariable& var = variables[variable.Index];
+	if (size > var.Size)
+	{
+		if (ReportWarnings)
+			LogWarning("SimpleShader::SetData() - Shader variable is smaller than the size of the data being set. Ensure the variable is large enough for the specified data.\n");
+		return false;
+	}
+
+	// Set the data in the local data buffer
+	return WriteVariable(var, data, size);
+}
+
+// Typed setters through handles
+bool ISimpleShader::SetInt(SimpleVariableHandle variable, int data) { return SetData(variable, &data, sizeof(int)); }
+bool ISimpleShader::SetFloat(SimpleVariableHandle variable, float data) { return SetData(variable, &data, sizeof(float)); }
+bool ISimpleShader::SetFloat2(SimpleVariableHandle variable, const DirectX::XMFLOAT2& data) { return SetData(variable, &data, sizeof(float) * 2); }
+bool ISimpleShader::SetFloat3(SimpleVariableHandle variable, const DirectX::XMFLOAT3& data) { return SetData(variable, &data, sizeof(float) * 3); }
+bool ISimpleShader::SetFloat4(SimpleVariableHandle variable, const DirectX::XMFLOAT4& data) { return SetData(variable, &data, sizeof(float) * 4); }
+bool ISimpleShader::SetMatrix4x4(SimpleVariableHandle variable, const DirectX::XMFLOAT4X4& data) { return SetData(variable, &data, sizeof(float) * 16); }
+
 // --------------------------------------------------------
 // Determines if the shader contains the specified
 // variable within one of its constant buffers
@@ -576,7 +889,7 @@ const SimpleShaderVariable* ISimpleShader::GetVariableInfo(std::string name)
 const SimpleSRV* ISimpleShader::GetShaderResourceViewInfo(std::string name)
 {
 	// Look for the key
-	std::unordered_map<std::string, SimpleSRV*>::iterator result =
+	std::unordered_map<std::string, unsigned int>::iterator result =
 		textureTable.find(name);
 
 	// Did we find the key?
@@ -584,7 +897,7 @@ const SimpleSRV* ISimpleShader::GetShaderResourceViewInfo(std::string name)
 		return 0;
 
 	// Success
-	return result->second;
+	return &shaderResourceViews[result->second];
 }
 
 
@@ -599,7 +912,7 @@ const SimpleSRV* ISimpleShader::GetShaderResourceViewInfo(unsigned int index)
 	if (index >= shaderResourceViews.size()) return 0;
 
 	// Grab the bind index
-	return shaderResourceViews[index];
+	return &shaderResourceViews[index];
 }
 
 
@@ -611,7 +924,7 @@ const SimpleSRV* ISimpleShader::GetShaderResourceViewInfo(unsigned int index)
 const SimpleSampler* ISimpleShader::GetSamplerInfo(std::string name)
 {
 	// Look for the key
-	std::unordered_map<std::string, SimpleSampler*>::iterator result =
+	std::unordered_map<std::string, unsigned int>::iterator result =
 		samplerTable.find(name);
 
 	// Did we find the key?
@@ -619,7 +932,7 @@ const SimpleSampler* ISimpleShader::GetSamplerInfo(std::string name)
 		return 0;
 
 	// Success
-	return result->second;
+	return &samplerStates[result->second];
 }
 
 // --------------------------------------------------------
@@ -633,7 +946,7 @@ const SimpleSampler* ISimpleShader::GetSamplerInfo(unsigned int index)
 	if (index >= samplerStates.size()) return 0;
 
 	// Grab the bind index
-	return samplerStates[index];
+	return &samplerStates[index];
 }
 
 
@@ -721,6 +1034,18 @@ SimpleVertexShader::SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> devi
 	this->LoadShaderFile(shaderFile);
 }
 
+// --------------------------------------------------------
+// Constructor overload for code that's already loaded (and
+// maybe already reflected), which ShaderLibrary uses to make
+// shaders without touching the file or reflecting again
+// --------------------------------------------------------
+SimpleVertexShader::SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, std::shared_ptr<const SimpleShaderReflection> reflection)
+	: ISimpleShader(device, context)
+{
+	this->perInstanceCompatible = false;
+	this->LoadShaderBlob(shaderBlob, reflection, 0);
+}
+
 // --------------------------------------------------------
 // Destructor - Clean up actual shader (base will be called automatically)
 // --------------------------------------------------------
@@ -767,32 +1092,17 @@ bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlo
 		return true;
 
 	// Vertex shader was created successfully, so we now use the
-	// shader code to re-reflect and create an input layout that 
+	// shader's reflected inputs to create an input layout that 
 	// matches what the vertex shader expects.  Code adapted from:
 	// https://takinginitiative.wordpress.com/2011/12/11/directx-1011-basic-shader-reflection-automatic-input-layout-creation/
 
-	// Reflect shader info
-	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)refl.GetAddressOf());
-	
-	// Get shader info
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
-
 	// Read input layout description from shader info
 	std::vector<D3D11_INPUT_ELEMENT_DESC> inputLayoutDesc;
-	for (unsigned int i = 0; i< shaderDesc.InputParameters; i++)
+	for (const SimpleReflectedInput& paramDesc : reflection->Inputs)
 	{
-		D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
-		refl->GetInputParameterDesc(i, &paramDesc);
-
 		// Check the semantic name for "_PER_INSTANCE"
 		std::string perInstanceStr = "_PER_INSTANCE";
-		std::string sem = paramDesc.SemanticName;
+		const std::string& sem = paramDesc.SemanticName;
 		int lenDiff = (int)sem.size() - (int)perInstanceStr.size();
 		bool isPerInstance = 
 			lenDiff >= 0 &&
@@ -800,7 +1110,7 @@ bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlo
 
 		// Fill out input element desc
 		D3D11_INPUT_ELEMENT_DESC elementDesc = {};
-		elementDesc.SemanticName = paramDesc.SemanticName;
+		elementDesc.SemanticName = paramDesc.SemanticName.c_str();
 		elementDesc.SemanticIndex = paramDesc.SemanticIndex;
 		elementDesc.InputSlot = 0;
 		elementDesc.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
@@ -817,8 +1127,27 @@ bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlo
 			perInstanceCompatible = true;
 		}
 
+		// Check the semantic name for a packed format suffix, which
+		// the shader can't express (it always sees 32-bit values).
+		// 16-bit formats only come in 2 and 4 component versions
+		std::string packedSuffixes[] = { "_UNORM16", "_SNORM16", "_HALF" };
+		int packedFormat = -1;
+		for (int s = 0; s < 3; s++)
+		{
+			int suffixDiff = (int)sem.size() - (int)packedSuffixes[s].size();
+			if (suffixDiff >= 0 && sem.compare(suffixDiff, packedSuffixes[s].size(), packedSuffixes[s]) == 0)
+				packedFormat = s;
+		}
+
 		// Determine DXGI format
-		if (paramDesc.Mask == 1)
+		if (packedFormat >= 0)
+		{
+			bool fourComponents = paramDesc.Mask > 3;
+			if (packedFormat == 0) elementDesc.Format = fourComponents ? DXGI_FORMAT_R16G16B16A16_UNORM : DXGI_FORMAT_R16G16_UNORM;
+			else if (packedFormat == 1) elementDesc.Format = fourComponents ? DXGI_FORMAT_R16G16B16A16_SNORM : DXGI_FORMAT_R16G16_SNORM;
+			else if (packedFormat == 2) elementDesc.Format = fourComponents ? DXGI_FORMAT_R16G16B16A16_FLOAT : DXGI_FORMAT_R16G16_FLOAT;
+		}
+		else if (paramDesc.Mask == 1)
 		{
 			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) elementDesc.Format = DXGI_FORMAT_R32_UINT;
 			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) elementDesc.Format = DXGI_FORMAT_R32_SINT;
@@ -847,6 +1176,10 @@ bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlo
 		inputLayoutDesc.push_back(elementDesc);
 	}
 
+	// Shaders that read no vertex data (a fullscreen triangle, say) need no layout
+	if (inputLayoutDesc.empty())
+		return true;
+
 	// Try to create Input Layout
 	HRESULT hr = device->CreateInputLayout(
 		&inputLayoutDesc[0], 
@@ -869,8 +1202,8 @@ void SimpleVertexShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader and input layout
-	deviceContext->IASetInputLayout(inputLayout.Get());
-	deviceContext->VSSetShader(shader.Get(), 0, 0);
+	StateCache::GetInstance().SetInputLayout(inputLayout.Get());
+	StateCache::GetInstance().SetShader(STATE_STAGE_VERTEX, shader.Get());
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -880,10 +1213,10 @@ void SimpleVertexShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->VSSetConstantBuffers(
+		StateCache::GetInstance().SetConstantBuffer(
+			STATE_STAGE_VERTEX,
 			constantBuffers[i].BindIndex,
-			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+			constantBuffers[i].ConstantBuffer.Get());
 	}
 }
 
@@ -911,7 +1244,7 @@ bool SimpleVertexShader::SetShaderResourceView(std::string name, Microsoft::WRL:
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	StateCache::GetInstance().SetShaderResource(STATE_STAGE_VERTEX, srvInfo->BindIndex, srv.Get());
 
 	// Success
 	return true;
@@ -941,12 +1274,42 @@ bool SimpleVertexShader::SetSamplerState(std::string name, Microsoft::WRL::ComPt
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	StateCache::GetInstance().SetSampler(STATE_STAGE_VERTEX, sampInfo->BindIndex, samplerState.Get());
 
 	// Success
 	return true;
 }
 
+// --------------------------------------------------------
+// Sets a shader resource view in the vertex shader stage
+// through a handle from GetShaderResourceViewHandle()
+//
+// Returns false if the handle is invalid
+// --------------------------------------------------------
+bool SimpleVertexShader::SetShaderResourceView(SimpleSRVHandle srvHandle, const Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv)
+{
+	if (srvHandle.Index >= shaderResourceViews.size())
+		return false;
+
+	StateCache::GetInstance().SetShaderResource(STATE_STAGE_VERTEX, shaderResourceViews[srvHandle.Index].BindIndex, srv.Get());
+	return true;
+}
+
+// --------------------------------------------------------
+// Sets a sampler state in the vertex shader stage through
+// a handle from GetSamplerHandle()
+//
+// Returns false if the handle is invalid
+// --------------------------------------------------------
+bool SimpleVertexShader::SetSamplerState(SimpleSamplerHandle samplerHandle, const Microsoft::WRL::ComPtr<ID3D11SamplerState>& samplerState)
+{
+	if (samplerHandle.Index >= samplerStates.size())
+		return false;
+
+	StateCache::GetInstance().SetSampler(STATE_STAGE_VERTEX, samplerStates[samplerHandle.Index].BindIndex, samplerState.Get());
+	return true;
+}
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // ------ SIMPLE PIXEL SHADER -------------------------------------------------
@@ -962,6 +1325,16 @@ SimplePixelShader::SimplePixelShader(Microsoft::WRL::ComPtr<ID3D11Device> device
 	this->LoadShaderFile(shaderFile);
 }
 
+// --------------------------------------------------------
+// Constructor overload for code that's already loaded (and
+// maybe already reflected)
+// --------------------------------------------------------
+SimplePixelShader::SimplePixelShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, std::shared_ptr<const SimpleShaderReflection> reflection)
+	: ISimpleShader(device, context)
+{
+	this->LoadShaderBlob(shaderBlob, reflection, 0);
+}
+
 // --------------------------------------------------------
 // Destructor - Clean up actual shader (base will be called automatically)
 // --------------------------------------------------------
@@ -1012,7 +1385,7 @@ void SimplePixelShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 	
 	// Set the shader
-	deviceContext->PSSetShader(shader.Get(), 0, 0);
+	StateCache::GetInstance().SetShader(STATE_STAGE_PIXEL, shader.Get());
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1022,10 +1395,10 @@ void SimplePixelShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->PSSetConstantBuffers(
+		StateCache::GetInstance().SetConstantBuffer(
+			STATE_STAGE_PIXEL,
 			constantBuffers[i].BindIndex,
-			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+			constantBuffers[i].ConstantBuffer.Get());
 	}
 }
 
@@ -1053,7 +1426,7 @@ bool SimplePixelShader::SetShaderResourceView(std::string name, Microsoft::WRL::
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	StateCache::GetInstance().SetShaderResource(STATE_STAGE_PIXEL, srvInfo->BindIndex, srv.Get());
 
 	// Success
 	return true;
@@ -1083,12 +1456,42 @@ bool SimplePixelShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	StateCache::GetInstance().SetSampler(STATE_STAGE_PIXEL, sampInfo->BindIndex, samplerState.Get());
 
 	// Success
 	return true;
 }
 
+// --------------------------------------------------------
+// Sets a shader resource view in the pixel shader stage
+// through a handle from GetShaderResourceViewHandle()
+//
+// Returns false if the handle is invalid
+// --------------------------------------------------------
+bool SimplePixelShader::SetShaderResourceView(SimpleSRVHandle srvHandle, const Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv)
+{
+	if (srvHandle.Index >= shaderResourceViews.size())
+		return false;
+
+	StateCache::GetInstance().SetShaderResource(STATE_STAGE_PIXEL, shaderResourceViews[srvHandle.Index].BindIndex, srv.Get());
+	return true;
+}
+
+// --------------------------------------------------------
+// Sets a sampler state in the pixel shader stage through
+// a handle from GetSamplerHandle()
+//
+// Returns false if the handle is invalid
+// --------------------------------------------------------
+bool SimplePixelShader::SetSamplerState(SimpleSamplerHandle samplerHandle, const Microsoft::WRL::ComPtr<ID3D11SamplerState>& samplerState)
+{
+	if (samplerHandle.Index >= samplerStates.size())
+		return false;
+
+	StateCache::GetInstance().SetSampler(STATE_STAGE_PIXEL, samplerStates[samplerHandle.Index].BindIndex, samplerState.Get());
+	return true;
+}
+
 
 
 
@@ -1233,6 +1636,36 @@ bool SimpleDomainShader::SetSamplerState(std::string name, Microsoft::WRL::ComPt
 	return true;
 }
 
+// --------------------------------------------------------
+// Sets a shader resource view in the domain shader stage
+// through a handle from GetShaderResourceViewHandle()
+//
+// Returns false if the handle is invalid
+// --------------------------------------------------------
+bool SimpleDomainShader::SetShaderResourceView(SimpleSRVHandle srvHandle, const Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv)
+{
+	if (srvHandle.Index >= shaderResourceViews.size())
+		return false;
+
+	deviceContext->DSSetShaderResources(shaderResourceViews[srvHandle.Index].BindIndex, 1, srv.GetAddressOf());
+	return true;
+}
+
+// --------------------------------------------------------
+// Sets a sampler state in the domain shader stage through
+// a handle from GetSamplerHandle()
+//
+// Returns false if the handle is invalid
+// --------------------------------------------------------
+bool SimpleDomainShader::SetSamplerState(SimpleSamplerHandle samplerHandle, const Microsoft::WRL::ComPtr<ID3D11SamplerState>& samplerState)
+{
+	if (samplerHandle.Index >= samplerStates.size())
+		return false;
+
+	deviceContext->DSSetSamplers(samplerStates[samplerHandle.Index].BindIndex, 1, samplerState.GetAddressOf());
+	return true;
+}
+
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1376,6 +1809,36 @@ bool SimpleHullShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr<
 	return true;
 }
 
+// --------------------------------------------------------
+// Sets a shader resource view in the hull shader stage
+// through a handle from GetShaderResourceViewHandle()
+//
+// Returns false if the handle is invalid
+// --------------------------------------------------------
+bool SimpleHullShader::SetShaderResourceView(SimpleSRVHandle srvHandle, const Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv)
+{
+	if (srvHandle.Index >= shaderResourceViews.size())
+		return false;
+
+	deviceContext->HSSetShaderResources(shaderResourceViews[srvHandle.Index].BindIndex, 1, srv.GetAddressOf());
+	return true;
+}
+
+// --------------------------------------------------------
+// Sets a sampler state in the hull shader stage through
+// a handle from GetSamplerHandle()
+//
+// Returns false if the handle is invalid
+// --------------------------------------------------------
+bool SimpleHullShader::SetSamplerState(SimpleSamplerHandle samplerHandle, const Microsoft::WRL::ComPtr<ID3D11SamplerState>& samplerState)
+{
+	if (samplerHandle.Index >= samplerStates.size())
+		return false;
+
+	deviceContext->HSSetSamplers(samplerStates[samplerHandle.Index].BindIndex, 1, samplerState.GetAddressOf());
+	return true;
+}
+
 
 
 
@@ -1650,6 +2113,36 @@ bool SimpleGeometryShader::SetSamplerState(std::string name, Microsoft::WRL::Com
 	return true;
 }
 
+// --------------------------------------------------------
+// Sets a shader resource view in the geometry shader stage
+// through a handle from GetShaderResourceViewHandle()
+//
+// Returns false if the handle is invalid
+// --------------------------------------------------------
+bool SimpleGeometryShader::SetShaderResourceView(SimpleSRVHandle srvHandle, const Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv)
+{
+	if (srvHandle.Index >= shaderResourceViews.size())
+		return false;
+
+	deviceContext->GSSetShaderResources(shaderResourceViews[srvHandle.Index].BindIndex, 1, srv.GetAddressOf());
+	return true;
+}
+
+// --------------------------------------------------------
+// Sets a sampler state in the geometry shader stage through
+// a handle from GetSamplerHandle()
+//
+// Returns false if the handle is invalid
+// --------------------------------------------------------
+bool SimpleGeometryShader::SetSamplerState(SimpleSamplerHandle samplerHandle, const Microsoft::WRL::ComPtr<ID3D11SamplerState>& samplerState)
+{
+	if (samplerHandle.Index >= samplerStates.size())
+		return false;
+
+	deviceContext->GSSetSamplers(samplerStates[samplerHandle.Index].BindIndex, 1, samplerState.GetAddressOf());
+	return true;
+}
+
 // --------------------------------------------------------
 // Calculates the number of components specified by a parameter description mask
 //
@@ -1921,6 +2414,36 @@ bool SimpleComputeShader::SetSamplerState(std::string name, Microsoft::WRL::ComP
 	return true;
 }
 
+// --------------------------------------------------------
+// Sets a shader resource view in the compute shader stage
+// through a handle from GetShaderResourceViewHandle()
+//
+// Returns false if the handle is invalid
+// --------------------------------------------------------
+bool SimpleComputeShader::SetShaderResourceView(SimpleSRVHandle srvHandle, const Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv)
+{
+	if (srvHandle.Index >= shaderResourceViews.size())
+		return false;
+
+	deviceContext->CSSetShaderResources(shaderResourceViews[srvHandle.Index].BindIndex, 1, srv.GetAddressOf());
+	return true;
+}
+
+// --------------------------------------------------------
+// Sets a sampler state in the compute shader stage through
+// a handle from GetSamplerHandle()
+//
+// Returns false if the handle is invalid
+// --------------------------------------------------------
+bool SimpleComputeShader::SetSamplerState(SimpleSamplerHandle samplerHandle, const Microsoft::WRL::ComPtr<ID3D11SamplerState>& samplerState)
+{
+	if (samplerHandle.Index >= samplerStates.size())
+		return false;
+
+	deviceContext->CSSetSamplers(samplerStates[samplerHandle.Index].BindIndex, 1, samplerState.GetAddressOf());
+	return true;
+}
+
 // --------------------------------------------------------
 // Sets an unordered access view in the Compute shader stage
 //
@@ -3,6 +3,7 @@
 #pragma comment(lib, "d3dcompiler.lib")
 
 #include <d3d11.h>
+#include <d3d11_1.h>
 #include <d3dcompiler.h>
 #include <DirectXMath.h>
 #include <wrl/client.h>
@@ -10,6 +11,7 @@
 #include <unordered_map>
 #include <vector>
 #include <string>
+#include <memory>
 
 
 // --------------------------------------------------------
@@ -27,6 +29,12 @@ struct SimpleShaderVariable
 // Contains information about a specific
 // constant buffer in a shader, as well as
 // the local data buffer for it
+//
+// Setters only mark bytes dirty when they actually change
+// them, and copying a buffer with nothing dirty does nothing.
+// Dynamic buffers are mapped and rewritten whole; the rest
+// are updated from the first dirty register to the last when
+// the driver supports partial updates, and whole otherwise
 // --------------------------------------------------------
 struct SimpleConstantBuffer
 {
@@ -37,6 +45,33 @@ struct SimpleConstantBuffer
 	Microsoft::WRL::ComPtr<ID3D11Buffer> ConstantBuffer = 0;
 	unsigned char* LocalDataBuffer = 0;
 	std::vector<SimpleShaderVariable> Variables;
+	bool Dynamic = false;			// D3D11_USAGE_DYNAMIC, uploaded with MAP_WRITE_DISCARD
+	unsigned int DirtyStart = 0;	// Bytes changed since the last upload (none if start == end)
+	unsigned int DirtyEnd = 0;
+};
+
+// --------------------------------------------------------
+// One constant buffer upload, as a recorder saw it
+// --------------------------------------------------------
+struct SimpleUploadRecord
+{
+	const SimpleConstantBuffer* Buffer;
+	unsigned int Offset;
+	unsigned int Size;
+	bool Discard;		// Mapped with WRITE_DISCARD rather than updated
+};
+
+// --------------------------------------------------------
+// Stands in for the device context's end of constant buffer
+// uploads.  While one is set as ISimpleShader::Recorder, every
+// upload (and skipped upload) is written down here, and only
+// reaches the GPU if Forward is true
+// --------------------------------------------------------
+struct SimpleUploadRecorder
+{
+	bool Forward = true;
+	std::vector<SimpleUploadRecord> Uploads;
+	unsigned int Skipped = 0;
 };
 
 // --------------------------------------------------------
@@ -57,6 +92,72 @@ struct SimpleSampler
 	unsigned int BindIndex; // The register of the Sampler
 };
 
+// --------------------------------------------------------
+// A name resolved once to its index in one shader's tables,
+// so setting it again is an array lookup rather than a hash
+// of the name.  Handles stay valid as long as the shader
+// does, and only mean anything to the shader they came from.
+// Names the shader doesn't have give invalid handles, which
+// setters ignore (returning false)
+// --------------------------------------------------------
+struct SimpleShaderHandle
+{
+	unsigned int Index = (unsigned int)-1;
+	bool IsValid() const { return Index != (unsigned int)-1; }
+};
+
+struct SimpleVariableHandle : SimpleShaderHandle {};
+struct SimpleBufferHandle : SimpleShaderHandle {};
+struct SimpleSRVHandle : SimpleShaderHandle {};
+struct SimpleSamplerHandle : SimpleShaderHandle {};
+
+// --------------------------------------------------------
+// Everything a shader's tables (and a vertex shader's input
+// layout) are built from, as plain data.  Reflect() fills it
+// in from the compiled code, but it can just as well come
+// from a file saved earlier, and one copy can be shared by
+// any number of shaders made from the same code
+// --------------------------------------------------------
+struct SimpleReflectedVariable
+{
+	std::string Name;
+	unsigned int ByteOffset;
+	unsigned int Size;
+};
+
+struct SimpleReflectedBuffer
+{
+	std::string Name;
+	D3D_CBUFFER_TYPE Type;
+	unsigned int Size;
+	unsigned int BindIndex;
+	std::vector<SimpleReflectedVariable> Variables;
+};
+
+struct SimpleReflectedResource
+{
+	std::string Name;
+	unsigned int BindIndex;
+};
+
+struct SimpleReflectedInput
+{
+	std::string SemanticName;
+	unsigned int SemanticIndex;
+	unsigned int Mask;
+	D3D_REGISTER_COMPONENT_TYPE ComponentType;
+};
+
+struct SimpleShaderReflection
+{
+	std::vector<SimpleReflectedBuffer> Buffers;		// In the shader's order
+	std::vector<SimpleReflectedResource> Textures;	// Textures and structured buffers
+	std::vector<SimpleReflectedResource> Samplers;
+	std::vector<SimpleReflectedInput> Inputs;		// Minus system values like SV_VertexID
+
+	bool Reflect(const void* bytecode, size_t size);
+};
+
 // --------------------------------------------------------
 // Base abstract class for simplifying shader handling
 // --------------------------------------------------------
@@ -74,6 +175,11 @@ public:
 	void CopyAllBufferData();
 	void CopyBufferData(unsigned int index);
 	void CopyBufferData(std::string bufferName);
+	void CopyBufferData(SimpleBufferHandle buffer);
+
+	// Recreates a buffer as dynamic (or default), taking effect the
+	// next time the shader is set
+	bool SetBufferDynamic(SimpleBufferHandle buffer, bool dynamic);
 
 	// Sets arbitrary shader data
 	bool SetData(std::string name, const void* data, unsigned int size);
@@ -89,9 +195,27 @@ public:
 	bool SetMatrix4x4(std::string name, const float data[16]);
 	bool SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 data);
 
+	// Resolving names to handles, once, for the setters below
+	SimpleVariableHandle GetVariableHandle(const std::string& name);
+	SimpleBufferHandle GetBufferHandle(const std::string& name);
+	SimpleSRVHandle GetShaderResourceViewHandle(const std::string& name);
+	SimpleSamplerHandle GetSamplerHandle(const std::string& name);
+
+	// Sets shader data through a handle
+	bool SetData(SimpleVariableHandle variable, const void* data, unsigned int size);
+
+	bool SetInt(SimpleVariableHandle variable, int data);
+	bool SetFloat(SimpleVariableHandle variable, float data);
+	bool SetFloat2(SimpleVariableHandle variable, const DirectX::XMFLOAT2& data);
+	bool SetFloat3(SimpleVariableHandle variable, const DirectX::XMFLOAT3& data);
+	bool SetFloat4(SimpleVariableHandle variable, const DirectX::XMFLOAT4& data);
+	bool SetMatrix4x4(SimpleVariableHandle variable, const DirectX::XMFLOAT4X4& data);
+
 	// Setting shader resources
 	virtual bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv) = 0;
 	virtual bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState) = 0;
+	virtual bool SetShaderResourceView(SimpleSRVHandle srvHandle, const Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv) = 0;
+	virtual bool SetSamplerState(SimpleSamplerHandle samplerHandle, const Microsoft::WRL::ComPtr<ID3D11SamplerState>& samplerState) = 0;
 
 	// Simple resource checking
 	bool HasVariable(std::string name);
@@ -117,32 +241,54 @@ public:
 	
 	// Misc getters
 	Microsoft::WRL::ComPtr<ID3DBlob> GetShaderBlob() { return shaderBlob; }
+	std::shared_ptr<const SimpleShaderReflection> GetReflection() { return reflection; }
 
 	// Error reporting
 	static bool ReportErrors;
 	static bool ReportWarnings;
 
+	// Constant buffer bytes copied to the GPU by every shader, buffers
+	// copied, and copies skipped because nothing had changed, since
+	// these were last reset (nothing resets them but the caller)
+	static size_t BytesUploaded;
+	static unsigned int Uploads;
+	static unsigned int UploadsSkipped;
+
+	// Sees every upload while set (null by default)
+	static SimpleUploadRecorder* Recorder;
+
 protected:
 	
 	bool shaderValid;
 	Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob;
+	std::shared_ptr<const SimpleShaderReflection> reflection;
 	Microsoft::WRL::ComPtr<ID3D11Device> device;
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> deviceContext1;	// Only if partial constant buffer updates work
 
 	// Resource counts
 	unsigned int constantBufferCount;
 	
-	// Maps for variables and buffers
-	SimpleConstantBuffer*		constantBuffers; // For index-based lookup
-	std::vector<SimpleSRV*>		shaderResourceViews;
-	std::vector<SimpleSampler*>	samplerStates;
-	std::unordered_map<std::string, SimpleConstantBuffer*> cbTable;
-	std::unordered_map<std::string, SimpleShaderVariable> varTable;
-	std::unordered_map<std::string, SimpleSRV*> textureTable;
-	std::unordered_map<std::string, SimpleSampler*> samplerTable;
-
-	// Initialization method
+	// Reflection data, flat: handles index these arrays, and the
+	// tables only map names to the same indices
+	SimpleConstantBuffer*				constantBuffers; // For index-based lookup
+	unsigned char*						localData;		 // Every buffer's LocalDataBuffer, back to back
+	std::vector<SimpleShaderVariable>	variables;
+	std::vector<SimpleSRV>				shaderResourceViews;
+	std::vector<SimpleSampler>			samplerStates;
+	std::unordered_map<std::string, unsigned int> cbTable;
+	std::unordered_map<std::string, unsigned int> varTable;
+	std::unordered_map<std::string, unsigned int> textureTable;
+	std::unordered_map<std::string, unsigned int> samplerTable;
+
+	// Initialization methods (reflecting the code unless given a reflection)
 	bool LoadShaderFile(LPCWSTR shaderFile);
+	bool LoadShaderBlob(Microsoft::WRL::ComPtr<ID3DBlob> blob, std::shared_ptr<const SimpleShaderReflection> reflection, LPCWSTR shaderFile);
+
+	// Constant buffer helpers
+	bool CreateConstantBuffer(SimpleConstantBuffer& cb);
+	void UploadBuffer(SimpleConstantBuffer& cb);
+	bool WriteVariable(const SimpleShaderVariable& var, const void* data, unsigned int size);
 
 	// Pure virtual functions for dealing with shader types
 	virtual bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob) = 0;
@@ -173,6 +319,7 @@ class SimpleVertexShader : public ISimpleShader
 public:
 	SimpleVertexShader( Microsoft::WRL::ComPtr<ID3D11Device> device,  Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile);
 	SimpleVertexShader( Microsoft::WRL::ComPtr<ID3D11Device> device,  Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile, Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout, bool perInstanceCompatible);
+	SimpleVertexShader( Microsoft::WRL::ComPtr<ID3D11Device> device,  Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, std::shared_ptr<const SimpleShaderReflection> reflection);
 	~SimpleVertexShader();
 	Microsoft::WRL::ComPtr<ID3D11VertexShader> GetDirectXShader() { return shader; }
 	Microsoft::WRL::ComPtr<ID3D11InputLayout> GetInputLayout() { return inputLayout; }
@@ -180,6 +327,8 @@ public:
 
 	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	bool SetShaderResourceView(SimpleSRVHandle srvHandle, const Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv);
+	bool SetSamplerState(SimpleSamplerHandle samplerHandle, const Microsoft::WRL::ComPtr<ID3D11SamplerState>& samplerState);
 
 protected:
 	bool perInstanceCompatible;
@@ -198,11 +347,14 @@ class SimplePixelShader : public ISimpleShader
 {
 public:
 	SimplePixelShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile);
+	SimplePixelShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, std::shared_ptr<const SimpleShaderReflection> reflection);
 	~SimplePixelShader();
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> GetDirectXShader() { return shader; }
 
 	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	bool SetShaderResourceView(SimpleSRVHandle srvHandle, const Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv);
+	bool SetSamplerState(SimpleSamplerHandle samplerHandle, const Microsoft::WRL::ComPtr<ID3D11SamplerState>& samplerState);
 
 protected:
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> shader;
@@ -223,6 +375,8 @@ public:
 
 	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	bool SetShaderResourceView(SimpleSRVHandle srvHandle, const Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv);
+	bool SetSamplerState(SimpleSamplerHandle samplerHandle, const Microsoft::WRL::ComPtr<ID3D11SamplerState>& samplerState);
 
 protected:
 	Microsoft::WRL::ComPtr<ID3D11DomainShader> shader;
@@ -243,6 +397,8 @@ public:
 
 	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	bool SetShaderResourceView(SimpleSRVHandle srvHandle, const Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv);
+	bool SetSamplerState(SimpleSamplerHandle samplerHandle, const Microsoft::WRL::ComPtr<ID3D11SamplerState>& samplerState);
 
 protected:
 	Microsoft::WRL::ComPtr<ID3D11HullShader> shader;
@@ -263,6 +419,8 @@ public:
 
 	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	bool SetShaderResourceView(SimpleSRVHandle srvHandle, const Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv);
+	bool SetSamplerState(SimpleSamplerHandle samplerHandle, const Microsoft::WRL::ComPtr<ID3D11SamplerState>& samplerState);
 
 	bool CreateCompatibleStreamOutBuffer(Microsoft::WRL::ComPtr<ID3D11Buffer> buffer, int vertexCount);
 
@@ -304,6 +462,8 @@ public:
 
 	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	bool SetShaderResourceView(SimpleSRVHandle srvHandle, const Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv);
+	bool SetSamplerState(SimpleSamplerHandle samplerHandle, const Microsoft::WRL::ComPtr<ID3D11SamplerState>& samplerState);
 	bool SetUnorderedAccessView(std::string name, Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> uav, unsigned int appendConsumeOffset = -1);
 
 	int GetUnorderedAccessViewIndex(std::string name);
@@ -1,4 +1,5 @@
 #include "Sky.h"
+#include "StateCache.h"
 
 Sky::Sky(
 	std::shared_ptr<Mesh> geometry,
@@ -37,8 +38,8 @@ void Sky::Draw(
 	float totalTime)
 {
 	//Set states
-	deviceContext->RSSetState(rasterizer.Get());
-	deviceContext->OMSetDepthStencilState(depthStencil.Get(), 0);
+	StateCache::GetInstance().SetRasterizerState(rasterizer.Get());
+	StateCache::GetInstance().SetDepthStencilState(depthStencil.Get());
 
 	//Activate shaders
 	vs->SetShader();
@@ -62,7 +63,7 @@ void Sky::Draw(
 	geometry->Draw();
 
 	//Reset render states
-	deviceContext->RSSetState(0);
-	deviceContext->OMSetDepthStencilState(0, 0);
+	StateCache::GetInstance().SetRasterizerState(0);
+	StateCache::GetInstance().SetDepthStencilState(0);
 
 }
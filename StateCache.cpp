@@ -0,0 +1,338 @@
+#include "StateCache.h"
+
+#include <cstring>
+
+StateCache* StateCache::instance;
+
+ContextStateTarget::ContextStateTarget(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	this->context = context;
+	context.As(&context1);
+}
+
+void ContextStateTarget::SetShader(unsigned int stage, ID3D11DeviceChild* shader)
+{
+	if (stage == STATE_STAGE_VERTEX)
+		context->VSSetShader(static_cast<ID3D11VertexShader*>(shader), 0, 0);
+	else
+		context->PSSetShader(static_cast<ID3D11PixelShader*>(shader), 0, 0);
+}
+
+void ContextStateTarget::SetConstantBuffer(unsigned int stage, unsigned int slot, ID3D11Buffer* buffer, UINT firstConstant, UINT constantCount)
+{
+	// Offsets only exist on 11.1 (whoever asks for one has checked)
+	if (constantCount && context1)
+	{
+		if (stage == STATE_STAGE_VERTEX)
+			context1->VSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+		else
+			context1->PSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+		return;
+	}
+
+	if (stage == STATE_STAGE_VERTEX)
+		context->VSSetConstantBuffers(slot, 1, &buffer);
+	else
+		context->PSSetConstantBuffers(slot, 1, &buffer);
+}
+
+void ContextStateTarget::SetShaderResource(unsigned int stage, unsigned int slot, ID3D11ShaderResourceView* srv)
+{
+	if (stage == STATE_STAGE_VERTEX)
+		context->VSSetShaderResources(slot, 1, &srv);
+	else
+		context->PSSetShaderResources(slot, 1, &srv);
+}
+
+void ContextStateTarget::SetSampler(unsigned int stage, unsigned int slot, ID3D11SamplerState* sampler)
+{
+	if (stage == STATE_STAGE_VERTEX)
+		context->VSSetSamplers(slot, 1, &sampler);
+	else
+		context->PSSetSamplers(slot, 1, &sampler);
+}
+
+void ContextStateTarget::SetInputLayout(ID3D11InputLayout* layout)
+{
+	context->IASetInputLayout(layout);
+}
+
+void ContextStateTarget::SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	context->IASetPrimitiveTopology(topology);
+}
+
+void ContextStateTarget::SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, UINT stride, UINT offset)
+{
+	context->IASetVertexBuffers(slot, 1, &buffer, &stride, &offset);
+}
+
+void ContextStateTarget::SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset)
+{
+	context->IASetIndexBuffer(buffer, format, offset);
+}
+
+void ContextStateTarget::SetRenderTargets(unsigned int count, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv)
+{
+	context->OMSetRenderTargets(count, rtvs, dsv);
+}
+
+void ContextStateTarget::SetViewports(unsigned int count, const D3D11_VIEWPORT* viewports)
+{
+	context->RSSetViewports(count, viewports);
+}
+
+void ContextStateTarget::SetRasterizerState(ID3D11RasterizerState* state)
+{
+	context->RSSetState(state);
+}
+
+void ContextStateTarget::SetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef)
+{
+	context->OMSetDepthStencilState(state, stencilRef);
+}
+
+void ContextStateTarget::SetBlendState(ID3D11BlendState* state, const FLOAT blendFactor[4], UINT sampleMask)
+{
+	context->OMSetBlendState(state, blendFactor, sampleMask);
+}
+
+
+void StateCache::Initialize(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	SetTarget(std::make_shared<ContextStateTarget>(context));
+}
+
+void StateCache::SetTarget(std::shared_ptr<StateCacheTarget> target)
+{
+	this->target = target;
+	Invalidate();
+}
+
+void StateCache::BeginFrame()
+{
+	lastFrameStats = frameStats;
+	frameStats = StateCacheStats();
+	Invalidate();
+}
+
+void StateCache::Invalidate()
+{
+	for (StageState& stage : stages)
+	{
+		stage.ShaderKnown = false;
+		memset(stage.ConstantsKnown, 0, sizeof(stage.ConstantsKnown));
+		memset(stage.SRVsKnown, 0, sizeof(stage.SRVsKnown));
+		memset(stage.SamplersKnown, 0, sizeof(stage.SamplersKnown));
+	}
+	layoutKnown = false;
+	topologyKnown = false;
+	memset(vertexBuffersKnown, 0, sizeof(vertexBuffersKnown));
+	indexBufferKnown = false;
+	targetsKnown = false;
+	viewportKnown = false;
+	rasterizerKnown = false;
+	depthStencilKnown = false;
+	blendKnown = false;
+}
+
+void StateCache::SetEnabled(bool enabled)
+{
+	this->enabled = enabled;
+	Invalidate();
+}
+
+bool StateCache::IsEnabled()
+{
+	return enabled;
+}
+
+bool StateCache::Issue(unsigned int kind, bool changed)
+{
+	if (changed || !enabled)
+	{
+		frameStats.Issued[kind]++;
+		return true;
+	}
+	frameStats.Filtered[kind]++;
+	return false;
+}
+
+void StateCache::SetShader(unsigned int stage, ID3D11DeviceChild* shader)
+{
+	StageState& s = stages[stage];
+	if (!Issue(STATE_CALL_SHADER, !s.ShaderKnown || s.Shader != shader))
+		return;
+	s.ShaderKnown = true;
+	s.Shader = shader;
+	target->SetShader(stage, shader);
+}
+
+void StateCache::SetConstantBuffer(unsigned int stage, unsigned int slot, ID3D11Buffer* buffer, UINT firstConstant, UINT constantCount)
+{
+	StageState& s = stages[stage];
+	if (slot < STATE_CACHE_CB_SLOTS)
+	{
+		ConstantBinding& bound = s.Constants[slot];
+		bool changed = !s.ConstantsKnown[slot] || bound.Buffer != buffer ||
+			bound.FirstConstant != firstConstant || bound.ConstantCount != constantCount;
+		if (!Issue(STATE_CALL_CONSTANTS, changed))
+			return;
+		s.ConstantsKnown[slot] = true;
+		bound = { buffer, firstConstant, constantCount };
+	}
+	else
+		Issue(STATE_CALL_CONSTANTS, true);
+	target->SetConstantBuffer(stage, slot, buffer, firstConstant, constantCount);
+}
+
+void StateCache::SetShaderResource(unsigned int stage, unsigned int slot, ID3D11ShaderResourceView* srv)
+{
+	StageState& s = stages[stage];
+	if (slot < STATE_CACHE_SRV_SLOTS)
+	{
+		if (!Issue(STATE_CALL_SRV, !s.SRVsKnown[slot] || s.SRVs[slot] != srv))
+			return;
+		s.SRVsKnown[slot] = true;
+		s.SRVs[slot] = srv;
+	}
+	else
+		Issue(STATE_CALL_SRV, true);
+	target->SetShaderResource(stage, slot, srv);
+}
+
+void StateCache::SetSampler(unsigned int stage, unsigned int slot, ID3D11SamplerState* sampler)
+{
+	StageState& s = stages[stage];
+	if (slot < STATE_CACHE_SAMPLER_SLOTS)
+	{
+		if (!Issue(STATE_CALL_SAMPLER, !s.SamplersKnown[slot] || s.Samplers[slot] != sampler))
+			return;
+		s.SamplersKnown[slot] = true;
+		s.Samplers[slot] = sampler;
+	}
+	else
+		Issue(STATE_CALL_SAMPLER, true);
+	target->SetSampler(stage, slot, sampler);
+}
+
+void StateCache::SetInputLayout(ID3D11InputLayout* layout)
+{
+	if (!Issue(STATE_CALL_INPUT, !layoutKnown || this->layout != layout))
+		return;
+	layoutKnown = true;
+	this->layout = layout;
+	target->SetInputLayout(layout);
+}
+
+void StateCache::SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	if (!Issue(STATE_CALL_INPUT, !topologyKnown || this->topology != topology))
+		return;
+	topologyKnown = true;
+	this->topology = topology;
+	target->SetPrimitiveTopology(topology);
+}
+
+void StateCache::SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, UINT stride, UINT offset)
+{
+	if (slot < STATE_CACHE_VB_SLOTS)
+	{
+		VertexBufferBinding& bound = vertexBuffers[slot];
+		bool changed = !vertexBuffersKnown[slot] || bound.Buffer != buffer || bound.Stride != stride || bound.Offset != offset;
+		if (!Issue(STATE_CALL_INPUT, changed))
+			return;
+		vertexBuffersKnown[slot] = true;
+		bound = { buffer, stride, offset };
+	}
+	else
+		Issue(STATE_CALL_INPUT, true);
+	target->SetVertexBuffer(slot, buffer, stride, offset);
+}
+
+void StateCache::SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset)
+{
+	bool changed = !indexBufferKnown || indexBuffer != buffer || indexFormat != format || indexOffset != offset;
+	if (!Issue(STATE_CALL_INPUT, changed))
+		return;
+	indexBufferKnown = true;
+	indexBuffer = buffer;
+	indexFormat = format;
+	indexOffset = offset;
+	target->SetIndexBuffer(buffer, format, offset);
+}
+
+void StateCache::SetRenderTargets(unsigned int count, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv)
+{
+	if (count > D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT)
+		count = D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT;
+	bool changed = !targetsKnown || targetCount != count || depthTarget != dsv ||
+		(count && memcmp(renderTargets, rtvs, count * sizeof(ID3D11RenderTargetView*)) != 0);
+	if (!Issue(STATE_CALL_TARGETS, changed))
+		return;
+	targetsKnown = true;
+	targetCount = count;
+	if (count)
+		memcpy(renderTargets, rtvs, count * sizeof(ID3D11RenderTargetView*));
+	depthTarget = dsv;
+	target->SetRenderTargets(count, rtvs, dsv);
+
+	// Anything now bound as a target was unbound as a shader resource
+	for (StageState& stage : stages)
+		memset(stage.SRVsKnown, 0, sizeof(stage.SRVsKnown));
+}
+
+void StateCache::SetViewport(const D3D11_VIEWPORT& viewport)
+{
+	bool changed = !viewportKnown || memcmp(&this->viewport, &viewport, sizeof(D3D11_VIEWPORT)) != 0;
+	if (!Issue(STATE_CALL_VIEWPORT, changed))
+		return;
+	viewportKnown = true;
+	this->viewport = viewport;
+	target->SetViewports(1, &viewport);
+}
+
+void StateCache::SetRasterizerState(ID3D11RasterizerState* state)
+{
+	if (!Issue(STATE_CALL_PIPELINE, !rasterizerKnown || rasterizer != state))
+		return;
+	rasterizerKnown = true;
+	rasterizer = state;
+	target->SetRasterizerState(state);
+}
+
+void StateCache::SetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef)
+{
+	if (!Issue(STATE_CALL_PIPELINE, !depthStencilKnown || depthStencil != state || this->stencilRef != stencilRef))
+		return;
+	depthStencilKnown = true;
+	depthStencil = state;
+	this->stencilRef = stencilRef;
+	target->SetDepthStencilState(state, stencilRef);
+}
+
+void StateCache::SetBlendState(ID3D11BlendState* state, const FLOAT blendFactor[4], UINT sampleMask)
+{
+	// A null factor means all ones
+	const FLOAT ones[4] = { 1, 1, 1, 1 };
+	const FLOAT* factor = blendFactor ? blendFactor : ones;
+	bool changed = !blendKnown || blend != state || this->sampleMask != sampleMask ||
+		memcmp(this->blendFactor, factor, sizeof(this->blendFactor)) != 0;
+	if (!Issue(STATE_CALL_PIPELINE, changed))
+		return;
+	blendKnown = true;
+	blend = state;
+	memcpy(this->blendFactor, factor, sizeof(this->blendFactor));
+	this->sampleMask = sampleMask;
+	target->SetBlendState(state, blendFactor, sampleMask);
+}
+
+const StateCacheStats& StateCache::GetFrameStats()
+{
+	return frameStats;
+}
+
+const StateCacheStats& StateCache::GetLastFrameStats()
+{
+	return lastFrameStats;
+}
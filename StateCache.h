@@ -0,0 +1,233 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <wrl/client.h>
+#include <memory>
+
+// Shader stages whose bindings are shadowed
+#define STATE_STAGE_VERTEX		0
+#define STATE_STAGE_PIXEL		1
+#define STATE_STAGE_COUNT		2
+
+// Slots shadowed per stage (higher ones are always passed through)
+#define STATE_CACHE_CB_SLOTS		D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT
+#define STATE_CACHE_SRV_SLOTS		16
+#define STATE_CACHE_SAMPLER_SLOTS	D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT
+#define STATE_CACHE_VB_SLOTS		4
+
+// What the counts are kept for
+#define STATE_CALL_SHADER			0
+#define STATE_CALL_CONSTANTS		1
+#define STATE_CALL_SRV				2
+#define STATE_CALL_SAMPLER			3
+#define STATE_CALL_INPUT			4	// Input layout, topology, vertex and index buffers
+#define STATE_CALL_TARGETS			5
+#define STATE_CALL_VIEWPORT			6
+#define STATE_CALL_PIPELINE			7	// Rasterizer, depth stencil and blend states
+#define STATE_CALL_COUNT			8
+
+// --------------------------------------------------------
+// Where the cache sends the calls it doesn't drop: the device
+// context, or (to check the cache without a GPU) something
+// that just writes them down
+// --------------------------------------------------------
+class StateCacheTarget
+{
+public:
+	virtual ~StateCacheTarget() {}
+
+	virtual void SetShader(unsigned int stage, ID3D11DeviceChild* shader) = 0;
+	// A constantCount of 0 binds the whole buffer
+	virtual void SetConstantBuffer(unsigned int stage, unsigned int slot, ID3D11Buffer* buffer, UINT firstConstant, UINT constantCount) = 0;
+	virtual void SetShaderResource(unsigned int stage, unsigned int slot, ID3D11ShaderResourceView* srv) = 0;
+	virtual void SetSampler(unsigned int stage, unsigned int slot, ID3D11SamplerState* sampler) = 0;
+
+	virtual void SetInputLayout(ID3D11InputLayout* layout) = 0;
+	virtual void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) = 0;
+	virtual void SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, UINT stride, UINT offset) = 0;
+	virtual void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset) = 0;
+
+	virtual void SetRenderTargets(unsigned int count, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv) = 0;
+	virtual void SetViewports(unsigned int count, const D3D11_VIEWPORT* viewports) = 0;
+
+	virtual void SetRasterizerState(ID3D11RasterizerState* state) = 0;
+	virtual void SetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef) = 0;
+	virtual void SetBlendState(ID3D11BlendState* state, const FLOAT blendFactor[4], UINT sampleMask) = 0;
+};
+
+// --------------------------------------------------------
+// The real thing: each call goes to the device context
+// --------------------------------------------------------
+class ContextStateTarget : public StateCacheTarget
+{
+public:
+	ContextStateTarget(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	void SetShader(unsigned int stage, ID3D11DeviceChild* shader);
+	void SetConstantBuffer(unsigned int stage, unsigned int slot, ID3D11Buffer* buffer, UINT firstConstant, UINT constantCount);
+	void SetShaderResource(unsigned int stage, unsigned int slot, ID3D11ShaderResourceView* srv);
+	void SetSampler(unsigned int stage, unsigned int slot, ID3D11SamplerState* sampler);
+
+	void SetInputLayout(ID3D11InputLayout* layout);
+	void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+	void SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, UINT stride, UINT offset);
+	void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset);
+
+	void SetRenderTargets(unsigned int count, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv);
+	void SetViewports(unsigned int count, const D3D11_VIEWPORT* viewports);
+
+	void SetRasterizerState(ID3D11RasterizerState* state);
+	void SetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef);
+	void SetBlendState(ID3D11BlendState* state, const FLOAT blendFactor[4], UINT sampleMask);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context1;	// For constant buffer offsets
+};
+
+// --------------------------------------------------------
+// Calls issued and dropped, per STATE_CALL_ kind
+// --------------------------------------------------------
+struct StateCacheStats
+{
+	unsigned int Issued[STATE_CALL_COUNT] = {};
+	unsigned int Filtered[STATE_CALL_COUNT] = {};
+};
+
+// --------------------------------------------------------
+// Remembers what's bound to the vertex and pixel stages, the
+// input assembler, the output merger and the rasterizer, and
+// drops calls that would bind what's already there.
+//
+// Everything the scene binds goes through here, so what it
+// remembers matches the context.  Anything else that binds
+// state (ImGui, DXCore on resize) does it between frames, and
+// BeginFrame() forgets everything, so the first call of each
+// kind each frame always goes through; so does Invalidate().
+// D3D quietly unbinds shader resources that get bound as
+// render targets, so changing the targets forgets the SRVs
+// --------------------------------------------------------
+class StateCache
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static StateCache& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new StateCache();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	StateCache(StateCache const&) = delete;
+	void operator=(StateCache const&) = delete;
+
+private:
+	static StateCache* instance;
+	StateCache() {};
+#pragma endregion
+
+public:
+	void Initialize(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// Sends calls somewhere other than the context (forgetting what's bound)
+	void SetTarget(std::shared_ptr<StateCacheTarget> target);
+
+	// Forgets what's bound and starts this frame's counts
+	void BeginFrame();
+	void Invalidate();
+
+	// Off, every call goes through (and counts as issued)
+	void SetEnabled(bool enabled);
+	bool IsEnabled();
+
+	void SetShader(unsigned int stage, ID3D11DeviceChild* shader);
+	void SetConstantBuffer(unsigned int stage, unsigned int slot, ID3D11Buffer* buffer, UINT firstConstant = 0, UINT constantCount = 0);
+	void SetShaderResource(unsigned int stage, unsigned int slot, ID3D11ShaderResourceView* srv);
+	void SetSampler(unsigned int stage, unsigned int slot, ID3D11SamplerState* sampler);
+
+	void SetInputLayout(ID3D11InputLayout* layout);
+	void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+	void SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, UINT stride, UINT offset);
+	void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset);
+
+	void SetRenderTargets(unsigned int count, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv);
+	void SetViewport(const D3D11_VIEWPORT& viewport);
+
+	void SetRasterizerState(ID3D11RasterizerState* state);
+	void SetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef = 0);
+	void SetBlendState(ID3D11BlendState* state, const FLOAT blendFactor[4] = 0, UINT sampleMask = 0xffffffff);
+
+	const StateCacheStats& GetFrameStats();		// So far this frame
+	const StateCacheStats& GetLastFrameStats();
+
+private:
+	struct ConstantBinding
+	{
+		ID3D11Buffer* Buffer;
+		UINT FirstConstant;
+		UINT ConstantCount;
+	};
+
+	struct StageState
+	{
+		bool ShaderKnown;
+		ID3D11DeviceChild* Shader;
+		bool ConstantsKnown[STATE_CACHE_CB_SLOTS];
+		ConstantBinding Constants[STATE_CACHE_CB_SLOTS];
+		bool SRVsKnown[STATE_CACHE_SRV_SLOTS];
+		ID3D11ShaderResourceView* SRVs[STATE_CACHE_SRV_SLOTS];
+		bool SamplersKnown[STATE_CACHE_SAMPLER_SLOTS];
+		ID3D11SamplerState* Samplers[STATE_CACHE_SAMPLER_SLOTS];
+	};
+
+	struct VertexBufferBinding
+	{
+		ID3D11Buffer* Buffer;
+		UINT Stride;
+		UINT Offset;
+	};
+
+	// True if the call should go through, counting it either way
+	bool Issue(unsigned int kind, bool changed);
+
+	std::shared_ptr<StateCacheTarget> target;
+	bool enabled = true;
+
+	StageState stages[STATE_STAGE_COUNT] = {};
+
+	bool layoutKnown = false;
+	ID3D11InputLayout* layout = 0;
+	bool topologyKnown = false;
+	D3D11_PRIMITIVE_TOPOLOGY topology = D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	bool vertexBuffersKnown[STATE_CACHE_VB_SLOTS] = {};
+	VertexBufferBinding vertexBuffers[STATE_CACHE_VB_SLOTS] = {};
+	bool indexBufferKnown = false;
+	ID3D11Buffer* indexBuffer = 0;
+	DXGI_FORMAT indexFormat = DXGI_FORMAT_UNKNOWN;
+	UINT indexOffset = 0;
+
+	bool targetsKnown = false;
+	unsigned int targetCount = 0;
+	ID3D11RenderTargetView* renderTargets[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT] = {};
+	ID3D11DepthStencilView* depthTarget = 0;
+	bool viewportKnown = false;
+	D3D11_VIEWPORT viewport = {};
+
+	bool rasterizerKnown = false;
+	ID3D11RasterizerState* rasterizer = 0;
+	bool depthStencilKnown = false;
+	ID3D11DepthStencilState* depthStencil = 0;
+	UINT stencilRef = 0;
+	bool blendKnown = false;
+	ID3D11BlendState* blend = 0;
+	FLOAT blendFactor[4] = {};
+	UINT sampleMask = 0;
+
+	StateCacheStats frameStats;
+	StateCacheStats lastFrameStats;
+};
@@ -2,166 +2,159 @@
 #include <DirectXMath.h>
 using namespace DirectX;
 
-Transform::Transform() :
-	position(0, 0, 0),
-	rotation(0, 0, 0),
-	scale(1, 1, 1),
-	dirty(false)
+Transform::Transform()
 {
-	XMStoreFloat4x4(&worldMatrix, XMMatrixIdentity());
-	XMStoreFloat4x4(&worldInverseTranspose, XMMatrixIdentity());
+	id = TransformSystem::GetInstance().Create();
+}
+
+Transform::Transform(const Transform& other)
+{
+	id = TransformSystem::GetInstance().Create();
+	*this = other;
+}
+
+Transform& Transform::operator=(const Transform& other)
+{
+	//Copy the values, keep our own slot
+	TransformSystem& system = TransformSystem::GetInstance();
+	XMFLOAT3 position = system.GetPosition(other.id);
+	XMFLOAT3 rotation = system.GetRotation(other.id);
+	XMFLOAT3 scale = system.GetScale(other.id);
+	system.SetPosition(id, position.x, position.y, position.z);
+	system.SetRotation(id, rotation.x, rotation.y, rotation.z);
+	system.SetScale(id, scale.x, scale.y, scale.z);
+	system.SetParent(id, system.GetParent(other.id));
+	return *this;
 }
 
 Transform::~Transform()
 {
+	TransformSystem::GetInstance().Destroy(id);
+}
+
+bool Transform::SetParent(Transform* parent)
+{
+	return TransformSystem::GetInstance().SetParent(id, parent ? parent->id : TRANSFORM_NO_PARENT);
 }
 
 void Transform::MoveAbsolute(float x, float y, float z)
 {
-	position.x += x;
-	position.y += y;
-	position.z += z;
-	dirty = true;
+	XMFLOAT3 position = GetPosition();
+	SetPosition(position.x + x, position.y + y, position.z + z);
 }
 
 void Transform::Rotate(float x, float y, float z)
 {
-	rotation.x += x;
-	rotation.y += y;
-	rotation.z += z;
-	dirty = true;
+	XMFLOAT3 rotation = GetRotation();
+	SetRotation(rotation.x + x, rotation.y + y, rotation.z + z);
 }
 
 void Transform::Scale(float x, float y, float z)
 {
-	scale.x *= x;
-	scale.y *= y;
-	scale.z *= z;
-	dirty = true;
+	XMFLOAT3 scale = GetScale();
+	SetScale(scale.x * x, scale.y * y, scale.z * z);
 }
 
 void Transform::MoveRelative(float x, float y, float z)
 {
-	//Get Rotation
-	XMVECTOR move = XMVectorSet(x, y, z, 0);
-	XMVECTOR rotQuat = XMQuaternionRotationRollPitchYaw(rotation.x, rotation.y, rotation.z);
+	//Move along our own axes
+	XMFLOAT3 right = GetRight();
+	XMFLOAT3 up = GetUp();
+	XMFLOAT3 forward = GetForward();
+	XMVECTOR move = XMLoadFloat3(&right) * x + XMLoadFloat3(&up) * y + XMLoadFloat3(&forward) * z;
 
 	//Add values
+	XMFLOAT3 position = GetPosition();
 	XMVECTOR currentPos = XMLoadFloat3(&position);
-	move = XMVector3Rotate(move, rotQuat);
 	currentPos += move;
 
-	//Store new position
+	//Store new position (which also marks the matrices dirty)
 	XMStoreFloat3(&position, currentPos);
+	SetPosition(position.x, position.y, position.z);
+}
+
+void Transform::Rotate(DirectX::XMFLOAT4 quaternion)
+{
+	XMFLOAT4 current = GetOrientation();
+	XMFLOAT4 rotated;
+	XMStoreFloat4(&rotated, XMQuaternionMultiply(XMLoadFloat4(&current), XMLoadFloat4(&quaternion)));
+	SetRotation(rotated);
+}
+
+void Transform::Slerp(DirectX::XMFLOAT4 target, float t)
+{
+	XMFLOAT4 current = GetOrientation();
+	XMFLOAT4 between;
+	XMStoreFloat4(&between, XMQuaternionSlerp(XMLoadFloat4(&current), XMLoadFloat4(&target), t));
+	SetRotation(between);
 }
 
 void Transform::SetPosition(float x, float y, float z)
 {
-	position.x = x;
-	position.y = y;
-	position.z = z;
-	dirty = true;
+	TransformSystem::GetInstance().SetPosition(id, x, y, z);
 }
 
 void Transform::SetRotation(float x, float y, float z)
 {
-	rotation.x = x;
-	rotation.y = y;
-	rotation.z = z;
-	dirty = true;
+	TransformSystem::GetInstance().SetRotation(id, x, y, z);
+}
+
+void Transform::SetRotation(DirectX::XMFLOAT4 quaternion)
+{
+	TransformSystem::GetInstance().SetOrientation(id, quaternion);
 }
 
 void Transform::SetScale(float x, float y, float z)
 {
-	scale.x = x;
-	scale.y = y;
-	scale.z = z;
-	dirty = true;
+	TransformSystem::GetInstance().SetScale(id, x, y, z);
 }
 
 DirectX::XMFLOAT3 Transform::GetPosition()
 {
-	return position;
+	return TransformSystem::GetInstance().GetPosition(id);
 }
 
 DirectX::XMFLOAT3 Transform::GetRotation()
 {
-	return rotation;
+	return TransformSystem::GetInstance().GetRotation(id);
+}
+
+DirectX::XMFLOAT4 Transform::GetOrientation()
+{
+	return TransformSystem::GetInstance().GetOrientation(id);
 }
 
 DirectX::XMFLOAT3 Transform::GetScale()
 {
-	return scale;
+	return TransformSystem::GetInstance().GetScale(id);
 }
 
 DirectX::XMFLOAT3 Transform::GetRight()
 {
-	XMFLOAT3 value;
-
-	XMVECTOR vec = XMVectorSet(0, 0, 1, 0);
-	XMVECTOR rotQuat = XMQuaternionRotationRollPitchYaw(rotation.x, rotation.y, rotation.z);
-
-	//Apply rotation and update value
-	XMStoreFloat3(&value, XMVector3Rotate(vec, rotQuat));
-
-	return value;
+	return TransformSystem::GetInstance().GetRight(id);
 }
 
 DirectX::XMFLOAT3 Transform::GetUp()
 {
-	XMFLOAT3 value;
-
-	XMVECTOR vec = XMVectorSet(0, 0, 1, 0);
-	XMVECTOR rotQuat = XMQuaternionRotationRollPitchYaw(rotation.x, rotation.y, rotation.z);
-
-	//Apply rotation and update value
-	XMStoreFloat3(&value, XMVector3Rotate(vec, rotQuat));
-
-	return value;
+	return TransformSystem::GetInstance().GetUp(id);
 }
 
 DirectX::XMFLOAT3 Transform::GetForward()
 {
-	XMFLOAT3 value;
-
-	XMVECTOR vec = XMVectorSet(0, 0, 1, 0);
-	XMVECTOR rotQuat = XMQuaternionRotationRollPitchYaw(rotation.x, rotation.y, rotation.z);
-
-	//Apply rotation and update value
-	XMStoreFloat3(&value, XMVector3Rotate(vec, rotQuat));
-
-	return value;
+	return TransformSystem::GetInstance().GetForward(id);
 }
 
 DirectX::XMFLOAT4X4 Transform::GetWorldMatrix()
 {
-	UpdateMatrices();
-	return worldMatrix;
+	return TransformSystem::GetInstance().GetWorldMatrix(id);
 }
 
-DirectX::XMFLOAT4X4 Transform::GetInveseTranspose()
+DirectX::XMFLOAT3X3 Transform::GetNormalMatrix()
 {
-	UpdateMatrices();
-	return worldInverseTranspose;
+	return TransformSystem::GetInstance().GetNormalMatrix(id);
 }
 
-void Transform::UpdateMatrices()
+const TransformPacket& Transform::GetPacket()
 {
-	//Check if we even need to be here
-	if (!dirty) {
-		return;
-	}
-
-	//Align matrices
-	XMMATRIX translation = XMMatrixTranslation(position.x, position.y, position.z);
-	XMMATRIX scaling = XMMatrixScaling(scale.x, scale.y, scale.z);
-	XMMATRIX rotational = XMMatrixRotationRollPitchYaw(rotation.x, rotation.y, rotation.z);
-
-	//Put the three matrices together
-	XMMATRIX world = scaling * rotational * translation;
-	
-	//Save as storage type after math is completed
-	XMStoreFloat4x4(&worldMatrix, world);
-	XMStoreFloat4x4(&worldInverseTranspose, XMMatrixInverse(0, XMMatrixTranspose(world))); //Save the inverse
-	dirty = false;
+	return TransformSystem::GetInstance().GetPacket(id);
 }
@@ -1,43 +1,62 @@
 #pragma once
 #include <DirectXMath.h>
-
+#include "TransformSystem.h"
+
+// --------------------------------------------------------
+// A handle to one slot of the TransformSystem, which owns the
+// data and builds the matrices.  Copies get a slot of their
+// own (under the same parent), so a Transform still behaves
+// like a value.  Position, rotation and scale are all local,
+// and rotation is stored as a quaternion (the Euler angles are
+// kept as well, for GetRotation())
+// --------------------------------------------------------
 class Transform
 {
 public:
 	Transform();
+	Transform(const Transform& other);
+	Transform& operator=(const Transform& other);
 	~Transform();
 
+	// Makes this transform relative to parent (nullptr for none).  Fails if
+	// parent is below this one
+	bool SetParent(Transform* parent);
+
 	void MoveAbsolute(float x, float y, float z);
 	void Rotate(float x, float y, float z);
 	void Scale(float x, float y, float z);
 
 	void MoveRelative(float x, float y, float z);
 
+	// Rotates by a quaternion, about the parent's axes (after the current rotation)
+	void Rotate(DirectX::XMFLOAT4 quaternion);
+	// Turns part of the way (t from 0 to 1) towards another orientation
+	void Slerp(DirectX::XMFLOAT4 target, float t);
+
 	void SetPosition(float x, float y, float z);
 	void SetRotation(float x, float y, float z);
+	void SetRotation(DirectX::XMFLOAT4 quaternion);
 	void SetScale(float x, float y, float z);
 
 	DirectX::XMFLOAT3 GetPosition();
 	DirectX::XMFLOAT3 GetRotation();
+	DirectX::XMFLOAT4 GetOrientation();
 	DirectX::XMFLOAT3 GetScale();
 
+	// Cached, so these cost nothing
 	DirectX::XMFLOAT3 GetRight();
 	DirectX::XMFLOAT3 GetUp();
 	DirectX::XMFLOAT3 GetForward();
 
 	DirectX::XMFLOAT4X4 GetWorldMatrix();
-	DirectX::XMFLOAT4X4 GetInveseTranspose();
+	DirectX::XMFLOAT3X3 GetNormalMatrix();
 
-	void UpdateMatrices();
-private:
-	DirectX::XMFLOAT3 position;
-	DirectX::XMFLOAT3 rotation;
-	DirectX::XMFLOAT3 scale;
-
-	DirectX::XMFLOAT4X4 worldMatrix;
-	DirectX::XMFLOAT4X4 worldInverseTranspose;
-
-	bool dirty = true;
+	// World and normal matrices as the vertex shaders take them.
+	// Points into the TransformSystem, which moves it when it
+	// grows, so copy it rather than keeping the reference
+	const TransformPacket& GetPacket();
 
+private:
+	unsigned int id;
 };
 
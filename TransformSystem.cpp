@@ -0,0 +1,749 @@
+#include "TransformSystem.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+using namespace DirectX;
+
+TransformSystem& TransformSystem::GetInstance()
+{
+	static TransformSystem* instance = new TransformSystem();
+	return *instance;
+}
+
+TransformSystem::TransformSystem() :
+	count(0)
+{
+}
+
+unsigned int TransformSystem::Create()
+{
+	unsigned int id;
+	if (!freeSlots.empty())
+	{
+		id = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else
+	{
+		// Grow a group of four at a time, so UpdateGroup() can always load four
+		id = (unsigned int)positionX.size();
+		size_t capacity = id + 4;
+		positionX.resize(capacity, 0); positionY.resize(capacity, 0); positionZ.resize(capacity, 0);
+		orientationX.resize(capacity, 0); orientationY.resize(capacity, 0); orientationZ.resize(capacity, 0); orientationW.resize(capacity, 1);
+		scaleX.resize(capacity, 1); scaleY.resize(capacity, 1); scaleZ.resize(capacity, 1);
+		parent.resize(capacity, TRANSFORM_NO_PARENT);
+		firstChild.resize(capacity, TRANSFORM_NO_PARENT);
+		nextSibling.resize(capacity, TRANSFORM_NO_PARENT);
+		previousSibling.resize(capacity, TRANSFORM_NO_PARENT);
+		depth.resize(capacity, 0);
+		rotation.resize(capacity, XMFLOAT3(0, 0, 0));
+		right.resize(capacity, XMFLOAT3(1, 0, 0));
+		up.resize(capacity, XMFLOAT3(0, 1, 0));
+		forward.resize(capacity, XMFLOAT3(0, 0, 1));
+
+		XMFLOAT4X4 identity;
+		XMStoreFloat4x4(&identity, XMMatrixIdentity());
+		local.resize(capacity, identity);
+		world.resize(capacity, identity);
+
+		XMFLOAT3X3 identityNormal;
+		XMStoreFloat3x3(&identityNormal, XMMatrixIdentity());
+		localNormal.resize(capacity, identityNormal);
+		worldNormal.resize(capacity, identityNormal);
+
+		TransformPacket identityPacket;
+		XMStoreFloat3x4(&identityPacket.World, XMMatrixIdentity());
+		XMStoreFloat3x4(&identityPacket.Normal, XMMatrixIdentity());
+		packets.resize(capacity, identityPacket);
+		localDirty.resize((capacity + 63) / 64, 0);
+		worldDirty.resize((capacity + 63) / 64, 0);
+
+		// The rest of the group waits in the free list, lowest handed out first
+		for (unsigned int i = id + 3; i > id; i--)
+			freeSlots.push_back(i);
+	}
+
+	count++;
+	return id;
+}
+
+void TransformSystem::Destroy(unsigned int id)
+{
+	// Children stay where they are locally, as roots
+	while (firstChild[id] != TRANSFORM_NO_PARENT)
+		SetParent(firstChild[id], TRANSFORM_NO_PARENT);
+	Detach(id);
+
+	// Back to identity, so the slot's lane of its group stays well behaved
+	positionX[id] = positionY[id] = positionZ[id] = 0;
+	orientationX[id] = orientationY[id] = orientationZ[id] = 0;
+	orientationW[id] = 1;
+	rotation[id] = XMFLOAT3(0, 0, 0);
+	right[id] = XMFLOAT3(1, 0, 0);
+	up[id] = XMFLOAT3(0, 1, 0);
+	forward[id] = XMFLOAT3(0, 0, 1);
+	scaleX[id] = scaleY[id] = scaleZ[id] = 1;
+	depth[id] = 0;
+
+	// Its matrices too, since the dirty bits are cleared and a new
+	// transform in this slot would otherwise read the old ones
+	XMStoreFloat4x4(&local[id], XMMatrixIdentity());
+	XMStoreFloat4x4(&world[id], XMMatrixIdentity());
+	XMStoreFloat3x3(&localNormal[id], XMMatrixIdentity());
+	XMStoreFloat3x3(&worldNormal[id], XMMatrixIdentity());
+	XMStoreFloat3x4(&packets[id].World, XMMatrixIdentity());
+	XMStoreFloat3x4(&packets[id].Normal, XMMatrixIdentity());
+	localDirty[id / 64] &= ~(1ull << (id % 64));
+	worldDirty[id / 64] &= ~(1ull << (id % 64));
+
+	freeSlots.push_back(id);
+	count--;
+}
+
+bool TransformSystem::SetParent(unsigned int id, unsigned int parent)
+{
+	if (parent == this->parent[id])
+		return true;
+
+	// Can't go under itself
+	for (unsigned int p = parent; p != TRANSFORM_NO_PARENT; p = this->parent[p])
+	{
+		if (p == id)
+			return false;
+	}
+
+	Detach(id);
+	if (parent != TRANSFORM_NO_PARENT)
+	{
+		this->parent[id] = parent;
+		nextSibling[id] = firstChild[parent];
+		if (firstChild[parent] != TRANSFORM_NO_PARENT)
+			previousSibling[firstChild[parent]] = id;
+		firstChild[parent] = id;
+	}
+
+	SetDepth(id, parent == TRANSFORM_NO_PARENT ? 0 : depth[parent] + 1);
+	return true;
+}
+
+unsigned int TransformSystem::GetParent(unsigned int id)
+{
+	return parent[id];
+}
+
+void TransformSystem::SetPosition(unsigned int id, float x, float y, float z)
+{
+	positionX[id] = x;
+	positionY[id] = y;
+	positionZ[id] = z;
+	MarkDirty(id);
+}
+
+void TransformSystem::SetRotation(unsigned int id, float pitch, float yaw, float roll)
+{
+	XMFLOAT4 q;
+	XMStoreFloat4(&q, XMQuaternionRotationRollPitchYaw(pitch, yaw, roll));
+	orientationX[id] = q.x;
+	orientationY[id] = q.y;
+	orientationZ[id] = q.z;
+	orientationW[id] = q.w;
+	rotation[id] = XMFLOAT3(pitch, yaw, roll);
+	UpdateBasis(id);
+	MarkDirty(id);
+}
+
+// --------------------------------------------------------
+// The angles come from the rows of the rotation, which for
+// pitch p, yaw y and roll r are
+//   right   = (cr cy + sr sp sy, sr cp, sr sp cy - cr sy)
+//   up      = (cr sp sy - sr cy, cr cp, sr sy + cr sp cy)
+//   forward = (cp sy, -sp, cp cy)
+// Looking straight up or down only pitch and one other angle
+// can be told apart, so roll is taken as 0 there
+// --------------------------------------------------------
+void TransformSystem::SetOrientation(unsigned int id, XMFLOAT4 quaternion)
+{
+	XMFLOAT4 q;
+	XMStoreFloat4(&q, XMQuaternionNormalize(XMLoadFloat4(&quaternion)));
+	orientationX[id] = q.x;
+	orientationY[id] = q.y;
+	orientationZ[id] = q.z;
+	orientationW[id] = q.w;
+	UpdateBasis(id);
+
+	const XMFLOAT3& r = right[id];
+	const XMFLOAT3& u = up[id];
+	const XMFLOAT3& f = forward[id];
+	float pitch = asinf(fmaxf(-1.0f, fminf(1.0f, -f.y)));
+	if (fabsf(f.y) < 0.9999f)
+		rotation[id] = XMFLOAT3(pitch, atan2f(f.x, f.z), atan2f(r.y, u.y));
+	else
+		rotation[id] = XMFLOAT3(pitch, atan2f(-r.z, r.x), 0);
+	MarkDirty(id);
+}
+
+void TransformSystem::SetScale(unsigned int id, float x, float y, float z)
+{
+	scaleX[id] = x;
+	scaleY[id] = y;
+	scaleZ[id] = z;
+	MarkDirty(id);
+}
+
+XMFLOAT3 TransformSystem::GetPosition(unsigned int id)
+{
+	return XMFLOAT3(positionX[id], positionY[id], positionZ[id]);
+}
+
+XMFLOAT3 TransformSystem::GetRotation(unsigned int id)
+{
+	return rotation[id];
+}
+
+XMFLOAT4 TransformSystem::GetOrientation(unsigned int id)
+{
+	return XMFLOAT4(orientationX[id], orientationY[id], orientationZ[id], orientationW[id]);
+}
+
+XMFLOAT3 TransformSystem::GetScale(unsigned int id)
+{
+	return XMFLOAT3(scaleX[id], scaleY[id], scaleZ[id]);
+}
+
+const XMFLOAT3& TransformSystem::GetRight(unsigned int id)
+{
+	return right[id];
+}
+
+const XMFLOAT3& TransformSystem::GetUp(unsigned int id)
+{
+	return up[id];
+}
+
+const XMFLOAT3& TransformSystem::GetForward(unsigned int id)
+{
+	return forward[id];
+}
+
+XMFLOAT4X4 TransformSystem::GetWorldMatrix(unsigned int id)
+{
+	Refresh(id);
+	return world[id];
+}
+
+XMFLOAT3X3 TransformSystem::GetNormalMatrix(unsigned int id)
+{
+	Refresh(id);
+	return worldNormal[id];
+}
+
+const TransformPacket& TransformSystem::GetPacket(unsigned int id)
+{
+	Refresh(id);
+	return packets[id];
+}
+
+void TransformSystem::UpdateDirty()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Local matrices, four at a time
+	unsigned int rebuilt = 0;
+	for (unsigned int word = 0; word < localDirty.size(); word++)
+	{
+		uint64_t bits = localDirty[word];
+		for (unsigned int group = 0; bits != 0; group++, bits >>= 4)
+		{
+			if (bits & 0xF)
+			{
+				UpdateGroup(word * 64 + group * 4);
+				rebuilt += 4;
+			}
+		}
+		localDirty[word] = 0;
+	}
+
+	// World matrices, a level at a time.  A queued transform whose depth
+	// has changed since is skipped, as it was queued again at its new depth
+	unsigned int worlds = 0;
+	unsigned int deepest = 0;
+	for (unsigned int level = 0; level < worldQueue.size(); level++)
+	{
+		for (size_t i = 0; i < worldQueue[level].size(); i++)
+		{
+			unsigned int id = worldQueue[level][i];
+			uint64_t bit = 1ull << (id % 64);
+			if (depth[id] != level || !(worldDirty[id / 64] & bit))
+				continue;
+
+			worldDirty[id / 64] &= ~bit;
+			UpdateWorld(id);
+			worlds++;
+			deepest = level;
+
+			for (unsigned int child = firstChild[id]; child != TRANSFORM_NO_PARENT; child = nextSibling[child])
+				Queue(child);
+		}
+		worldQueue[level].clear();
+	}
+
+	lastUpdate.Transforms = rebuilt;
+	lastUpdate.Worlds = worlds;
+	lastUpdate.Depth = deepest;
+	lastUpdate.Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+unsigned int TransformSystem::GetCount()
+{
+	return count;
+}
+
+const TransformUpdateStats& TransformSystem::GetLastUpdateStats()
+{
+	return lastUpdate;
+}
+
+void TransformSystem::MarkDirty(unsigned int id)
+{
+	localDirty[id / 64] |= 1ull << (id % 64);
+	Queue(id);
+}
+
+void TransformSystem::Queue(unsigned int id)
+{
+	uint64_t bit = 1ull << (id % 64);
+	if (worldDirty[id / 64] & bit)
+		return;
+
+	worldDirty[id / 64] |= bit;
+	if (worldQueue.size() <= depth[id])
+		worldQueue.resize(depth[id] + 1);
+	worldQueue[depth[id]].push_back(id);
+}
+
+// --------------------------------------------------------
+// Moves a subtree to a new depth, queueing all of it there
+// (anything queued at its old depth would be skipped)
+// --------------------------------------------------------
+void TransformSystem::SetDepth(unsigned int id, unsigned int depth)
+{
+	std::vector<unsigned int> stack(1, id);
+	this->depth[id] = depth;
+	while (!stack.empty())
+	{
+		unsigned int top = stack.back();
+		stack.pop_back();
+
+		worldDirty[top / 64] &= ~(1ull << (top % 64));
+		Queue(top);
+		for (unsigned int child = firstChild[top]; child != TRANSFORM_NO_PARENT; child = nextSibling[child])
+		{
+			this->depth[child] = this->depth[top] + 1;
+			stack.push_back(child);
+		}
+	}
+}
+
+void TransformSystem::Detach(unsigned int id)
+{
+	unsigned int p = parent[id];
+	if (p == TRANSFORM_NO_PARENT)
+		return;
+
+	if (previousSibling[id] != TRANSFORM_NO_PARENT)
+		nextSibling[previousSibling[id]] = nextSibling[id];
+	else
+		firstChild[p] = nextSibling[id];
+	if (nextSibling[id] != TRANSFORM_NO_PARENT)
+		previousSibling[nextSibling[id]] = previousSibling[id];
+
+	parent[id] = TRANSFORM_NO_PARENT;
+	nextSibling[id] = TRANSFORM_NO_PARENT;
+	previousSibling[id] = TRANSFORM_NO_PARENT;
+}
+
+// --------------------------------------------------------
+// Reading between a change and UpdateDirty() can find this
+// transform or any of its parents stale.  The chain from the
+// highest stale one down is worked out here without clearing
+// anything, since their other children still need the pass
+// --------------------------------------------------------
+void TransformSystem::Refresh(unsigned int id)
+{
+	unsigned int stale = TRANSFORM_NO_PARENT;
+	for (unsigned int p = id; p != TRANSFORM_NO_PARENT; p = parent[p])
+	{
+		if (worldDirty[p / 64] & (1ull << (p % 64)))
+			stale = p;
+	}
+	if (stale == TRANSFORM_NO_PARENT)
+		return;
+
+	std::vector<unsigned int> chain;
+	for (unsigned int p = id; p != stale; p = parent[p])
+		chain.push_back(p);
+	UpdateWorld(stale);
+	for (size_t i = chain.size(); i > 0; i--)
+		UpdateWorld(chain[i - 1]);
+}
+
+// --------------------------------------------------------
+// Rebuilds the local matrices of the four transforms starting
+// at first (a multiple of four), one per lane.  Every vector
+// below holds the same component of four different matrices,
+// and the math is scaling * XMMatrixRotationQuaternion() *
+// translation written out by hand
+// --------------------------------------------------------
+void TransformSystem::UpdateGroup(unsigned int first)
+{
+	XMVECTOR tx = XMLoadFloat4((const XMFLOAT4*)&positionX[first]);
+	XMVECTOR ty = XMLoadFloat4((const XMFLOAT4*)&positionY[first]);
+	XMVECTOR tz = XMLoadFloat4((const XMFLOAT4*)&positionZ[first]);
+	XMVECTOR sx = XMLoadFloat4((const XMFLOAT4*)&scaleX[first]);
+	XMVECTOR sy = XMLoadFloat4((const XMFLOAT4*)&scaleY[first]);
+	XMVECTOR sz = XMLoadFloat4((const XMFLOAT4*)&scaleZ[first]);
+
+	XMVECTOR qx = XMLoadFloat4((const XMFLOAT4*)&orientationX[first]);
+	XMVECTOR qy = XMLoadFloat4((const XMFLOAT4*)&orientationY[first]);
+	XMVECTOR qz = XMLoadFloat4((const XMFLOAT4*)&orientationZ[first]);
+	XMVECTOR qw = XMLoadFloat4((const XMFLOAT4*)&orientationW[first]);
+
+	// Rotation rows, as in XMMatrixRotationQuaternion()
+	XMVECTOR zero = XMVectorZero();
+	XMVECTOR one = XMVectorSplatOne();
+	XMVECTOR x2 = qx + qx, y2 = qy + qy, z2 = qz + qz;
+	XMVECTOR xx = qx * x2, yy = qy * y2, zz = qz * z2;
+	XMVECTOR xy = qx * y2, xz = qx * z2, yz = qy * z2;
+	XMVECTOR wx = qw * x2, wy = qw * y2, wz = qw * z2;
+	XMVECTOR r[3][3] =
+	{
+		{ one - (yy + zz), xy + wz, xz - wy },
+		{ xy - wz, one - (xx + zz), yz + wx },
+		{ xz + wy, yz - wx, one - (xx + yy) }
+	};
+	XMVECTOR s[3] = { sx, sy, sz };
+
+	// World rows are the rotation rows scaled, then the translation.  The
+	// normal matrix (the inverse transpose of scale * rotation, as
+	// translation doesn't touch normals) has the rotation rows divided by
+	// the scale instead
+	for (int row = 0; row < 3; row++)
+	{
+		XMVECTOR inverseScale = XMVectorReciprocal(s[row]);
+
+		// Each transpose turns "one component of four matrices" into "one row of each"
+		XMMATRIX worldRows = XMMatrixTranspose(XMMATRIX(r[row][0] * s[row], r[row][1] * s[row], r[row][2] * s[row], zero));
+		XMMATRIX normalRows = XMMatrixTranspose(XMMATRIX(r[row][0] * inverseScale, r[row][1] * inverseScale, r[row][2] * inverseScale, zero));
+		for (int lane = 0; lane < 4; lane++)
+		{
+			XMStoreFloat4((XMFLOAT4*)local[first + lane].m[row], worldRows.r[lane]);
+			XMStoreFloat3((XMFLOAT3*)localNormal[first + lane].m[row], normalRows.r[lane]);
+		}
+	}
+
+	XMMATRIX translationRows = XMMatrixTranspose(XMMATRIX(tx, ty, tz, one));
+	for (int lane = 0; lane < 4; lane++)
+		XMStoreFloat4((XMFLOAT4*)local[first + lane].m[3], translationRows.r[lane]);
+
+	localDirty[first / 64] &= ~(0xFull << (first % 64));
+}
+
+// Rows of the rotation matrix, from the quaternion
+void TransformSystem::UpdateBasis(unsigned int id)
+{
+	XMFLOAT4 q = GetOrientation(id);
+	XMMATRIX r = XMMatrixRotationQuaternion(XMLoadFloat4(&q));
+	XMStoreFloat3(&right[id], r.r[0]);
+	XMStoreFloat3(&up[id], r.r[1]);
+	XMStoreFloat3(&forward[id], r.r[2]);
+}
+
+// --------------------------------------------------------
+// World is local * the parent's world.  Normal matrices
+// multiply the same way, since (AB)^-T = A^-T B^-T.  The
+// packet is both, transposed for the shader (which multiplies
+// column vectors), with the constant last column of world
+// left off
+// --------------------------------------------------------
+void TransformSystem::UpdateWorld(unsigned int id)
+{
+	if (localDirty[id / 64] & (1ull << (id % 64)))
+		UpdateGroup(id & ~3u);
+
+	XMMATRIX w = XMLoadFloat4x4(&local[id]);
+	XMMATRIX n = XMLoadFloat3x3(&localNormal[id]);
+	unsigned int p = parent[id];
+	if (p != TRANSFORM_NO_PARENT)
+	{
+		w = XMMatrixMultiply(w, XMLoadFloat4x4(&world[p]));
+		n = XMMatrixMultiply(n, XMLoadFloat3x3(&worldNormal[p]));
+	}
+
+	XMStoreFloat4x4(&world[id], w);
+	XMStoreFloat3x3(&worldNormal[id], n);
+	XMStoreFloat3x4(&packets[id].World, w);
+	XMStoreFloat3x4(&packets[id].Normal, n);
+}
+
+// --------------------------------------------------------
+// The old Transform, which built each matrix on its own
+// --------------------------------------------------------
+namespace
+{
+	struct PerObjectTransform
+	{
+		XMFLOAT3 Position;
+		XMFLOAT3 Rotation;
+		XMFLOAT3 Scale;
+		XMFLOAT4X4 World;
+		XMFLOAT4X4 WorldInverseTranspose;
+
+		void UpdateMatrices()
+		{
+			XMMATRIX translation = XMMatrixTranslation(Position.x, Position.y, Position.z);
+			XMMATRIX scaling = XMMatrixScaling(Scale.x, Scale.y, Scale.z);
+			XMMATRIX rotational = XMMatrixRotationRollPitchYaw(Rotation.x, Rotation.y, Rotation.z);
+			XMMATRIX w = scaling * rotational * translation;
+			XMStoreFloat4x4(&World, w);
+			XMStoreFloat4x4(&WorldInverseTranspose, XMMatrixInverse(0, XMMatrixTranspose(w)));
+		}
+	};
+
+	// Largest difference between a packet and the matrices it should
+	// hold (transposed), relative to each element's size
+	float PacketError(const TransformPacket& packet, const PerObjectTransform& expected)
+	{
+		float maxError = 0;
+		for (int row = 0; row < 3; row++)
+		{
+			for (int column = 0; column < 4; column++)
+			{
+				float e = expected.World.m[column][row];
+				float error = fabsf(packet.World.m[row][column] - e) / (1 + fabsf(e));
+				if (error > maxError) maxError = error;
+
+				if (column == 3)
+					continue;
+				e = expected.WorldInverseTranspose.m[column][row];
+				error = fabsf(packet.Normal.m[row][column] - e) / (1 + fabsf(e));
+				if (error > maxError) maxError = error;
+			}
+		}
+		return maxError;
+	}
+
+	float RandomRange(float min, float max)
+	{
+		return min + (max - min) * (float)rand() / RAND_MAX;
+	}
+}
+
+TransformBenchmarkResult BenchmarkTransforms(unsigned int count)
+{
+	TransformBenchmarkResult result;
+	result.Count = count;
+
+	std::vector<PerObjectTransform> perObject(count);
+	TransformSystem system;
+	srand(1234);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		PerObjectTransform& t = perObject[i];
+		t.Position = XMFLOAT3(RandomRange(-100, 100), RandomRange(-100, 100), RandomRange(-100, 100));
+		t.Rotation = XMFLOAT3(RandomRange(-3.14f, 3.14f), RandomRange(-3.14f, 3.14f), RandomRange(-3.14f, 3.14f));
+		t.Scale = XMFLOAT3(RandomRange(0.25f, 4), RandomRange(0.25f, 4), RandomRange(0.25f, 4));
+
+		unsigned int id = system.Create();
+		system.SetPosition(id, t.Position.x, t.Position.y, t.Position.z);
+		system.SetRotation(id, t.Rotation.x, t.Rotation.y, t.Rotation.z);
+		system.SetScale(id, t.Scale.x, t.Scale.y, t.Scale.z);
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (PerObjectTransform& t : perObject)
+		t.UpdateMatrices();
+	result.PerObjectSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	system.UpdateDirty();
+	result.BatchSeconds = system.GetLastUpdateStats().Seconds;
+
+	for (unsigned int i = 0; i < count; i++)
+		result.MaxError = fmaxf(result.MaxError, PacketError(system.GetPacket(i), perObject[i]));
+
+	return result;
+}
+
+BasisBenchmarkResult BenchmarkBasisVectors(unsigned int count)
+{
+	BasisBenchmarkResult result;
+	result.Count = count;
+
+	TransformSystem system;
+	std::vector<XMFLOAT3> angles(count);
+	srand(1234);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		angles[i] = XMFLOAT3(RandomRange(-1.5f, 1.5f), RandomRange(-3.14f, 3.14f), RandomRange(-3.14f, 3.14f));
+		unsigned int id = system.Create();
+		system.SetRotation(id, angles[i].x, angles[i].y, angles[i].z);
+	}
+
+	// Summed so neither loop can be skipped
+	std::vector<XMFLOAT3> rebuilt(count);
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		XMVECTOR q = XMQuaternionRotationRollPitchYaw(angles[i].x, angles[i].y, angles[i].z);
+		XMVECTOR sum = XMVector3Rotate(XMVectorSet(1, 0, 0, 0), q);
+		sum += XMVector3Rotate(XMVectorSet(0, 1, 0, 0), q);
+		sum += XMVector3Rotate(XMVectorSet(0, 0, 1, 0), q);
+		XMStoreFloat3(&rebuilt[i], sum);
+	}
+	result.RebuiltSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	std::vector<XMFLOAT3> cached(count);
+	start = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		XMVECTOR sum = XMLoadFloat3(&system.GetRight(i));
+		sum += XMLoadFloat3(&system.GetUp(i));
+		sum += XMLoadFloat3(&system.GetForward(i));
+		XMStoreFloat3(&cached[i], sum);
+	}
+	result.CachedSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		float error = fmaxf(fabsf(rebuilt[i].x - cached[i].x), fmaxf(fabsf(rebuilt[i].y - cached[i].y), fabsf(rebuilt[i].z - cached[i].z)));
+		if (error > result.MaxError) result.MaxError = error;
+	}
+	return result;
+}
+
+// --------------------------------------------------------
+// A pointer-based scene graph, updated by walking every tree
+// from its root and rebuilding whatever moved (or had a parent
+// that moved)
+// --------------------------------------------------------
+namespace
+{
+	struct SceneNode
+	{
+		PerObjectTransform Transform;
+		bool Dirty = true;
+		std::vector<SceneNode*> Children;
+	};
+
+	void UpdateSceneNode(SceneNode* node, const XMFLOAT4X4* parentWorld, bool parentChanged)
+	{
+		bool changed = node->Dirty || parentChanged;
+		if (changed)
+		{
+			PerObjectTransform& t = node->Transform;
+			t.UpdateMatrices();
+			if (parentWorld)
+			{
+				XMMATRIX w = XMLoadFloat4x4(&t.World) * XMLoadFloat4x4(parentWorld);
+				XMStoreFloat4x4(&t.World, w);
+				XMStoreFloat4x4(&t.WorldInverseTranspose, XMMatrixInverse(0, XMMatrixTranspose(w)));
+			}
+			node->Dirty = false;
+		}
+
+		for (SceneNode* child : node->Children)
+			UpdateSceneNode(child, &node->Transform.World, changed);
+	}
+
+	void RunHierarchyBenchmark(const char* name, const std::vector<unsigned int>& parents, std::vector<HierarchyBenchmarkResult>& results)
+	{
+		const unsigned int frames = 16;
+		unsigned int count = (unsigned int)parents.size();
+
+		HierarchyBenchmarkResult result;
+		result.Name = name;
+		result.Count = count;
+		result.Moved = count / 1000 > 0 ? count / 1000 : 1;
+
+		// The same hierarchy both ways (parents always come before their children)
+		std::vector<SceneNode> nodes(count);
+		std::vector<SceneNode*> roots;
+		TransformSystem system;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			PerObjectTransform& t = nodes[i].Transform;
+			t.Position = XMFLOAT3(RandomRange(-1, 1), RandomRange(-1, 1), RandomRange(-1, 1));
+			t.Rotation = XMFLOAT3(RandomRange(-0.1f, 0.1f), RandomRange(-0.1f, 0.1f), RandomRange(-0.1f, 0.1f));
+			t.Scale = XMFLOAT3(1, 1, 1);
+
+			unsigned int id = system.Create();
+			system.SetPosition(id, t.Position.x, t.Position.y, t.Position.z);
+			system.SetRotation(id, t.Rotation.x, t.Rotation.y, t.Rotation.z);
+			if (parents[i] == TRANSFORM_NO_PARENT)
+			{
+				roots.push_back(&nodes[i]);
+			}
+			else
+			{
+				nodes[parents[i]].Children.push_back(&nodes[i]);
+				system.SetParent(id, parents[i]);
+			}
+		}
+		for (SceneNode* root : roots)
+			UpdateSceneNode(root, 0, false);
+		system.UpdateDirty();
+
+		for (unsigned int frame = 0; frame < frames; frame++)
+		{
+			for (unsigned int i = 0; i < result.Moved; i++)
+			{
+				unsigned int id = (unsigned int)(((uint64_t)rand() * (RAND_MAX + 1ull) + rand()) % count);
+				XMFLOAT3 position(RandomRange(-1, 1), RandomRange(-1, 1), RandomRange(-1, 1));
+				nodes[id].Transform.Position = position;
+				nodes[id].Dirty = true;
+				system.SetPosition(id, position.x, position.y, position.z);
+			}
+
+			auto start = std::chrono::high_resolution_clock::now();
+			for (SceneNode* root : roots)
+				UpdateSceneNode(root, 0, false);
+			result.RecursiveSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+			system.UpdateDirty();
+			result.IncrementalSeconds += system.GetLastUpdateStats().Seconds;
+			result.Worlds += system.GetLastUpdateStats().Worlds;
+		}
+		result.RecursiveSeconds /= frames;
+		result.IncrementalSeconds /= frames;
+		result.Worlds /= frames;
+
+		for (unsigned int i = 0; i < count; i++)
+		{
+			unsigned int depth = 0;
+			for (unsigned int p = system.GetParent(i); p != TRANSFORM_NO_PARENT; p = system.GetParent(p))
+				depth++;
+			if (depth > result.Depth) result.Depth = depth;
+
+			result.MaxError = fmaxf(result.MaxError, PacketError(system.GetPacket(i), nodes[i].Transform));
+		}
+
+		results.push_back(result);
+	}
+}
+
+void BenchmarkHierarchies(unsigned int count, std::vector<HierarchyBenchmarkResult>& results)
+{
+	srand(1234);
+	std::vector<unsigned int> parents(count);
+
+	// Chains 1000 long
+	for (unsigned int i = 0; i < count; i++)
+		parents[i] = i % 1000 == 0 ? TRANSFORM_NO_PARENT : i - 1;
+	RunHierarchyBenchmark("Deep chains", parents, results);
+
+	// One tree, 16 children to a node
+	for (unsigned int i = 0; i < count; i++)
+		parents[i] = i == 0 ? TRANSFORM_NO_PARENT : (i - 1) / 16;
+	RunHierarchyBenchmark("Wide tree", parents, results);
+}
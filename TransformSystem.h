@@ -0,0 +1,198 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+// A transform with no parent
+#define TRANSFORM_NO_PARENT	0xFFFFFFFF
+
+// A float3x3 in a constant buffer fills two whole registers and three floats of a third
+#define TRANSFORM_NORMAL_MATRIX_BYTES	(sizeof(float) * 11)
+
+// --------------------------------------------------------
+// What the vertex shaders need per object: the world matrix
+// and the normal matrix (the inverse transpose of world,
+// without translation), laid out as the shaders'
+// row_major float3x4 world and float3x3 normalMatrix.  That's
+// 96 bytes of constants where two full 4x4s took 128
+// --------------------------------------------------------
+struct TransformPacket
+{
+	DirectX::XMFLOAT3X4 World;
+	DirectX::XMFLOAT3X4 Normal;		// Each row padded to a register (.w unused)
+};
+
+// --------------------------------------------------------
+// How one TransformSystem::UpdateDirty() call went
+// --------------------------------------------------------
+struct TransformUpdateStats
+{
+	unsigned int Transforms = 0;	// Local matrices rebuilt (rounded up to whole groups of four)
+	unsigned int Worlds = 0;		// World matrices recomputed, counting children of moved parents
+	unsigned int Depth = 0;			// Deepest level the pass reached
+	double Seconds = 0;
+};
+
+// --------------------------------------------------------
+// Per-object Transform matrices vs one batched pass, for the
+// INFO window
+// --------------------------------------------------------
+struct TransformBenchmarkResult
+{
+	unsigned int Count = 0;
+	double PerObjectSeconds = 0;	// The old Transform::UpdateMatrices(), once per object
+	double BatchSeconds = 0;		// UpdateDirty() over all of them
+	float MaxError = 0;				// Largest difference in any matrix element, relative to its size
+};
+
+// --------------------------------------------------------
+// A recursive scene graph walk vs the incremental pass, for
+// one shape of hierarchy with a few nodes moved per frame
+// --------------------------------------------------------
+struct HierarchyBenchmarkResult
+{
+	const char* Name = "";
+	unsigned int Count = 0;
+	unsigned int Depth = 0;
+	unsigned int Moved = 0;			// Local changes per frame
+	unsigned int Worlds = 0;		// World matrices that changed as a result
+	double RecursiveSeconds = 0;	// Every world rebuilt from the roots down, per frame
+	double IncrementalSeconds = 0;	// UpdateDirty(), per frame
+	float MaxError = 0;
+};
+
+// --------------------------------------------------------
+// Cached basis vectors vs rebuilding them from Euler angles on
+// every call (as Transform used to), for the INFO window
+// --------------------------------------------------------
+struct BasisBenchmarkResult
+{
+	unsigned int Count = 0;
+	double RebuiltSeconds = 0;		// Quaternion from the angles, then three rotations
+	double CachedSeconds = 0;		// Three reads
+	float MaxError = 0;
+};
+
+// --------------------------------------------------------
+// Every transform's position, rotation and scale, stored as
+// structure-of-arrays (all position x's together, and so on)
+// with a bit per transform saying its matrices are stale
+//
+// UpdateDirty() rebuilds the world and normal matrices of
+// every dirty transform four at a time, one per
+// SIMD lane.  Orientation is kept as a quaternion, so this
+// needs no trig at all, and since world is always
+// scale * rotation * translation its normal matrix is just
+// rotation / scale (no general inverse needed).  Slots
+// are handed out in groups of four, so a group is only ever
+// partly in use, never split.
+//
+// Transforms can have a parent, in which case their world
+// matrix is their local one times the parent's world.  A
+// local change queues just that transform, in a list for its
+// depth.  The world pass then goes through the lists from the
+// roots down, so parents are always done before children,
+// and each transform it recomputes queues its own children on
+// the next level.  Only the moved subtrees are ever touched,
+// and nothing recurses.
+//
+// Right, up and forward (the rows of the rotation) are cached
+// whenever the rotation changes.  Euler angles are kept too,
+// exactly as set, so GetRotation() round trips; quaternion
+// changes work theirs out from the basis
+//
+// Transform is a handle to one slot of the shared instance.
+// Asking for a matrix of a stale transform works out just
+// that transform (and any stale parents), so reading before
+// the batch still gives current data
+// --------------------------------------------------------
+class TransformSystem
+{
+public:
+	// The system every Transform lives in
+	static TransformSystem& GetInstance();
+
+	TransformSystem();
+
+	unsigned int Create();
+	void Destroy(unsigned int id);
+
+	// Keeps the local values, so the world matrix moves with the
+	// new parent.  Fails (returning false) if it would make a loop
+	bool SetParent(unsigned int id, unsigned int parent);
+	unsigned int GetParent(unsigned int id);
+
+	void SetPosition(unsigned int id, float x, float y, float z);
+	void SetRotation(unsigned int id, float pitch, float yaw, float roll);
+	void SetOrientation(unsigned int id, DirectX::XMFLOAT4 quaternion);
+	void SetScale(unsigned int id, float x, float y, float z);
+	DirectX::XMFLOAT3 GetPosition(unsigned int id);
+	DirectX::XMFLOAT3 GetRotation(unsigned int id);
+	DirectX::XMFLOAT4 GetOrientation(unsigned int id);
+	DirectX::XMFLOAT3 GetScale(unsigned int id);
+
+	// These references point into the system's arrays, which the
+	// next Create() can reallocate, so use them right away and
+	// don't hold on to them
+	const DirectX::XMFLOAT3& GetRight(unsigned int id);
+	const DirectX::XMFLOAT3& GetUp(unsigned int id);
+	const DirectX::XMFLOAT3& GetForward(unsigned int id);
+
+	DirectX::XMFLOAT4X4 GetWorldMatrix(unsigned int id);
+	DirectX::XMFLOAT3X3 GetNormalMatrix(unsigned int id);
+	const TransformPacket& GetPacket(unsigned int id);	// Same as above, don't hold on to it
+
+	// Rebuilds the matrices of every dirty transform and their children
+	void UpdateDirty();
+
+	unsigned int GetCount();
+	const TransformUpdateStats& GetLastUpdateStats();
+
+private:
+	void MarkDirty(unsigned int id);
+	void Queue(unsigned int id);
+	void SetDepth(unsigned int id, unsigned int depth);
+	void Detach(unsigned int id);
+	void Refresh(unsigned int id);
+	void UpdateGroup(unsigned int first);
+	void UpdateWorld(unsigned int id);
+	void UpdateBasis(unsigned int id);
+
+	// Inputs, one array per component
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> orientationX, orientationY, orientationZ, orientationW;
+	std::vector<float> scaleX, scaleY, scaleZ;
+
+	// Derived from the orientation, read one transform at a time
+	std::vector<DirectX::XMFLOAT3> rotation;		// Pitch, yaw and roll
+	std::vector<DirectX::XMFLOAT3> right, up, forward;
+
+	// Hierarchy, as linked lists of siblings
+	std::vector<unsigned int> parent, firstChild, nextSibling, previousSibling;
+	std::vector<unsigned int> depth;
+
+	// Outputs
+	std::vector<DirectX::XMFLOAT4X4> local;
+	std::vector<DirectX::XMFLOAT3X3> localNormal;
+	std::vector<DirectX::XMFLOAT4X4> world;
+	std::vector<DirectX::XMFLOAT3X3> worldNormal;
+	std::vector<TransformPacket> packets;
+
+	std::vector<uint64_t> localDirty;
+	std::vector<uint64_t> worldDirty;						// Also means "in worldQueue"
+	std::vector<std::vector<unsigned int>> worldQueue;		// By depth
+	std::vector<unsigned int> freeSlots;
+	unsigned int count;
+	TransformUpdateStats lastUpdate;
+};
+
+// Times count transforms both ways, with every one dirty
+TransformBenchmarkResult BenchmarkTransforms(unsigned int count);
+
+// Times reading the right, up and forward vectors of count transforms
+BasisBenchmarkResult BenchmarkBasisVectors(unsigned int count);
+
+// Times a few deep chains and a few wide trees, moving a small
+// fraction of their transforms each frame
+void BenchmarkHierarchies(unsigned int count, std::vector<HierarchyBenchmarkResult>& results);
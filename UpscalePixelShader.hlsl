@@ -0,0 +1,22 @@
+cbuffer ExternalData : register(b0)
+{
+	float2 uvScale;		// Part of the scene texture that was rendered to
+}
+
+Texture2D Scene : register(t0);
+SamplerState LinearClamp : register(s0);
+
+struct VertexToPixelUpscale
+{
+	float4 screenPosition	: SV_POSITION;
+	float2 uv				: TEXCOORD;
+};
+
+// --------------------------------------------------------
+// Stretches the rendered corner of the scene texture over the
+// whole back buffer
+// --------------------------------------------------------
+float4 main(VertexToPixelUpscale input) : SV_TARGET
+{
+	return Scene.Sample(LinearClamp, input.uv * uvScale);
+}
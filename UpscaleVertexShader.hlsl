@@ -0,0 +1,20 @@
+// Output of the fullscreen triangle
+struct VertexToPixelUpscale
+{
+	float4 screenPosition	: SV_POSITION;
+	float2 uv				: TEXCOORD;
+};
+
+// --------------------------------------------------------
+// One triangle covering the whole screen, made from the vertex
+// id alone (no vertex buffer): ids 0, 1, 2 give UVs (0,0),
+// (2,0) and (0,2), which put the corners of the screen at UV 0
+// and 1
+// --------------------------------------------------------
+VertexToPixelUpscale main(uint id : SV_VertexID)
+{
+	VertexToPixelUpscale output;
+	output.uv = float2((id << 1) & 2, id & 2);
+	output.screenPosition = float4(output.uv * float2(2, -2) + float2(-1, 1), 0, 1);
+	return output;
+}
@@ -0,0 +1,191 @@
+#include "VertexPacking.h"
+
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+static inline int16_t ToSnorm16(float v)
+{
+	v = std::max(-1.0f, std::min(1.0f, v));
+	return (int16_t)lroundf(v * 32767.0f);
+}
+
+static inline float FromSnorm16(int16_t v)
+{
+	// -32768 and -32767 both map to -1, same as the GPU
+	return std::max(v / 32767.0f, -1.0f);
+}
+
+static inline uint16_t ToUnorm16(float v)
+{
+	v = std::max(0.0f, std::min(1.0f, v));
+	return (uint16_t)lroundf(v * 65535.0f);
+}
+
+// Folds the octahedron's lower half over the upper half
+static inline void OctWrap(float& x, float& y)
+{
+	float wx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+	float wy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+	x = wx;
+	y = wy;
+}
+
+static XMFLOAT3 OctDecodeFloat(float x, float y)
+{
+	// Same math as OctDecode() in ShaderInclude.hlsli
+	float z = 1.0f - fabsf(x) - fabsf(y);
+	float t = std::max(-z, 0.0f);
+	x += x >= 0.0f ? -t : t;
+	y += y >= 0.0f ? -t : t;
+
+	XMFLOAT3 result;
+	XMStoreFloat3(&result, XMVector3Normalize(XMVectorSet(x, y, z, 0)));
+	return result;
+}
+
+VertexQuantization GetVertexQuantization(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax)
+{
+	VertexQuantization q;
+	q.Offset = boundsMin;
+	q.Scale = XMFLOAT3(
+		boundsMax.x - boundsMin.x,
+		boundsMax.y - boundsMin.y,
+		boundsMax.z - boundsMin.z);
+	return q;
+}
+
+// --------------------------------------------------------
+// Octahedral encoding (Cigolle et al. 2014)
+//
+// Projects the vector onto an octahedron and unfolds it into
+// a square.  Plain rounding can land on a neighbouring texel
+// that decodes further away, so all four nearby SNORM values
+// are tried and the closest one after decoding is kept
+// --------------------------------------------------------
+void OctEncode(const XMFLOAT3& v, int16_t out[2])
+{
+	float length = fabsf(v.x) + fabsf(v.y) + fabsf(v.z);
+	if (length == 0)
+	{
+		out[0] = 0;
+		out[1] = 0;
+		return;
+	}
+
+	float x = v.x / length;
+	float y = v.y / length;
+	if (v.z < 0)
+		OctWrap(x, y);
+
+	XMVECTOR original = XMVector3Normalize(XMLoadFloat3(&v));
+	float bestDot = -2.0f;
+	float fx = floorf(std::max(-1.0f, std::min(1.0f, x)) * 32767.0f);
+	float fy = floorf(std::max(-1.0f, std::min(1.0f, y)) * 32767.0f);
+	for (int i = 0; i < 4; i++)
+	{
+		int16_t cx = (int16_t)std::max(-32767.0f, std::min(32767.0f, fx + (i & 1)));
+		int16_t cy = (int16_t)std::max(-32767.0f, std::min(32767.0f, fy + (i >> 1)));
+		XMFLOAT3 decoded = OctDecodeFloat(FromSnorm16(cx), FromSnorm16(cy));
+		float d = XMVectorGetX(XMVector3Dot(original, XMLoadFloat3(&decoded)));
+		if (d > bestDot)
+		{
+			bestDot = d;
+			out[0] = cx;
+			out[1] = cy;
+		}
+	}
+}
+
+XMFLOAT3 OctDecode(const int16_t in[2])
+{
+	return OctDecodeFloat(FromSnorm16(in[0]), FromSnorm16(in[1]));
+}
+
+PackedVertex PackVertex(const Vertex& v, const VertexQuantization& q)
+{
+	PackedVertex p;
+	p.Position[0] = ToUnorm16(q.Scale.x > 0 ? (v.Position.x - q.Offset.x) / q.Scale.x : 0);
+	p.Position[1] = ToUnorm16(q.Scale.y > 0 ? (v.Position.y - q.Offset.y) / q.Scale.y : 0);
+	p.Position[2] = ToUnorm16(q.Scale.z > 0 ? (v.Position.z - q.Offset.z) / q.Scale.z : 0);
+	p.Position[3] = 65535;
+	OctEncode(v.Normal, p.Normal);
+	OctEncode(v.Tangent, p.Tangent);
+	p.UV[0] = XMConvertFloatToHalf(v.UV.x);
+	p.UV[1] = XMConvertFloatToHalf(v.UV.y);
+	return p;
+}
+
+Vertex UnpackVertex(const PackedVertex& p, const VertexQuantization& q)
+{
+	Vertex v;
+	v.Position.x = q.Offset.x + (p.Position[0] / 65535.0f) * q.Scale.x;
+	v.Position.y = q.Offset.y + (p.Position[1] / 65535.0f) * q.Scale.y;
+	v.Position.z = q.Offset.z + (p.Position[2] / 65535.0f) * q.Scale.z;
+	v.Normal = OctDecode(p.Normal);
+	v.Tangent = OctDecode(p.Tangent);
+	v.UV.x = XMConvertHalfToFloat(p.UV[0]);
+	v.UV.y = XMConvertHalfToFloat(p.UV[1]);
+	return v;
+}
+
+void PackVertices(const Vertex* vertices, size_t count, const VertexQuantization& q, PackedVertex* out)
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = PackVertex(vertices[i], q);
+}
+
+// Angle between two directions, ignoring their lengths
+static float AngleDegrees(const XMFLOAT3& a, const XMFLOAT3& b)
+{
+	XMVECTOR va = XMLoadFloat3(&a);
+	XMVECTOR vb = XMLoadFloat3(&b);
+	if (XMVectorGetX(XMVector3LengthSq(va)) == 0 || XMVectorGetX(XMVector3LengthSq(vb)) == 0)
+		return 0;
+
+	float d = XMVectorGetX(XMVector3Dot(XMVector3Normalize(va), XMVector3Normalize(vb)));
+	return XMConvertToDegrees(acosf(std::max(-1.0f, std::min(1.0f, d))));
+}
+
+VertexPackingError MeasurePackingError(const Vertex* vertices, size_t count, const VertexQuantization& q)
+{
+	VertexPackingError error;
+	float largestUV = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		const Vertex& v = vertices[i];
+		Vertex u = UnpackVertex(PackVertex(v, q), q);
+		largestUV = std::max(largestUV, std::max(fabsf(v.UV.x), fabsf(v.UV.y)));
+
+		error.Position = std::max(error.Position, fabsf(u.Position.x - v.Position.x));
+		error.Position = std::max(error.Position, fabsf(u.Position.y - v.Position.y));
+		error.Position = std::max(error.Position, fabsf(u.Position.z - v.Position.z));
+		error.NormalDegrees = std::max(error.NormalDegrees, AngleDegrees(u.Normal, v.Normal));
+		error.TangentDegrees = std::max(error.TangentDegrees, AngleDegrees(u.Tangent, v.Tangent));
+		error.UV = std::max(error.UV, fabsf(u.UV.x - v.UV.x));
+		error.UV = std::max(error.UV, fabsf(u.UV.y - v.UV.y));
+	}
+
+	error.WithinBounds =
+		error.Position <= GetPackedPositionMaxError(q) &&
+		error.NormalDegrees <= PACKED_NORMAL_MAX_ERROR_DEGREES &&
+		error.TangentDegrees <= PACKED_NORMAL_MAX_ERROR_DEGREES &&
+		error.UV <= GetPackedUVMaxError(largestUV);
+	return error;
+}
+
+float GetPackedPositionMaxError(const VertexQuantization& q)
+{
+	// Half a step, plus a little for float rounding in the decode
+	float largest = std::max(q.Scale.x, std::max(q.Scale.y, q.Scale.z));
+	return largest / 65535.0f * 0.5f + largest * 1e-6f;
+}
+
+float GetPackedUVMaxError(float largestUV)
+{
+	// 10 stored mantissa bits -> half a step is 2^-11 relative
+	return std::max(fabsf(largestUV), 1.0f / 16384.0f) / 2048.0f;
+}
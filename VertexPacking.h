@@ -0,0 +1,79 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include "Vertex.h"
+
+// --------------------------------------------------------
+// A compressed vertex, 20 bytes instead of 44
+//
+// - Position: 16-bit UNORM relative to the mesh bounds.  w is
+//             padding (always 1), as there's no 3 channel
+//             16-bit format
+// - Normal:   octahedral encoded, 2x 16-bit SNORM
+// - Tangent:  octahedral encoded, 2x 16-bit SNORM
+// - UV:       2x half float
+//
+// Must match PackedVertexShaderInput in ShaderInclude.hlsli
+// --------------------------------------------------------
+struct PackedVertex
+{
+	uint16_t Position[4];
+	int16_t Normal[2];
+	int16_t Tangent[2];
+	uint16_t UV[2];
+};
+
+// --------------------------------------------------------
+// Maps 16-bit positions back to local space:
+//   position = Offset + (quantized / 65535) * Scale
+// --------------------------------------------------------
+struct VertexQuantization
+{
+	DirectX::XMFLOAT3 Offset = DirectX::XMFLOAT3(0, 0, 0);
+	DirectX::XMFLOAT3 Scale = DirectX::XMFLOAT3(0, 0, 0);
+};
+
+// --------------------------------------------------------
+// Largest round trip error over a set of vertices
+// --------------------------------------------------------
+struct VertexPackingError
+{
+	float Position = 0;		// Local space units
+	float NormalDegrees = 0;
+	float TangentDegrees = 0;
+	float UV = 0;
+	bool WithinBounds = true;	// All of the above under the GetPacked*MaxError() bounds
+};
+
+// Quantization that covers the given bounding box
+VertexQuantization GetVertexQuantization(const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax);
+
+// Octahedral encoding of a unit vector into two SNORM16 values
+void OctEncode(const DirectX::XMFLOAT3& v, int16_t out[2]);
+DirectX::XMFLOAT3 OctDecode(const int16_t in[2]);
+
+// Packs/unpacks a single vertex
+PackedVertex PackVertex(const Vertex& v, const VertexQuantization& q);
+Vertex UnpackVertex(const PackedVertex& p, const VertexQuantization& q);
+
+void PackVertices(const Vertex* vertices, size_t count, const VertexQuantization& q, PackedVertex* out);
+
+// Packs and unpacks every vertex, returning the worst error and
+// whether it's within the bounds below
+VertexPackingError MeasurePackingError(const Vertex* vertices, size_t count, const VertexQuantization& q);
+
+// --------------------------------------------------------
+// Worst case error of the encoding, which MeasurePackingError()
+// checks its results against:
+//
+// - Position: half a quantization step of the largest axis
+// - Normal/tangent: octahedral 16-bit measures under 0.035
+//   degrees over random directions, so 0.05 leaves headroom
+// - UV: half float has 11 bits of mantissa, so the error grows
+//   with the magnitude of the coordinate
+// --------------------------------------------------------
+#define PACKED_NORMAL_MAX_ERROR_DEGREES	0.05f
+
+float GetPackedPositionMaxError(const VertexQuantization& q);
+float GetPackedUVMaxError(float largestUV);
@@ -1,18 +1,38 @@
 #include "ShaderInclude.hlsli"
 
-//Create our constant buffer and register it to a slot on the pipeline
-cbuffer ExternalData : register(b0)
+//Constant buffers, split by how often they change
+//Camera and light, uploaded once per frame
+cbuffer PerFrame : register(b0)
 {
-	float4 colorTint;
-	matrix world;
 	matrix view;
 	matrix projection;
-	matrix worldInvTranspose;
-
 	matrix shadowView;
 	matrix shadowProj;
 }
 
+//Uploaded for every draw, so kept small
+//Instanced draws get their matrices from the instance buffer instead
+#if !defined(INSTANCED) || defined(PACKED_VERTICES)
+cbuffer PerObject : register(b1)
+{
+#ifndef INSTANCED
+	row_major float3x4 world;			//Only the rows that aren't always 0 0 0 1
+	row_major float3x3 normalMatrix;	//Inverse transpose of world, without translation
+#endif
+
+#ifdef PACKED_VERTICES
+	float3 quantizeOffset;
+	float3 quantizeScale;
+#endif
+}
+#endif
+
+#ifdef INSTANCED
+#define INSTANCE_INPUT , InstanceInput instance
+#else
+#define INSTANCE_INPUT
+#endif
+
 // --------------------------------------------------------
 // The entry point (main method) for our vertex shader
 // 
@@ -20,8 +40,18 @@ cbuffer ExternalData : register(b0)
 // - Output is a single struct of data to pass down the pipeline
 // - Named "main" because that's the default the shader compiler looks for
 // --------------------------------------------------------
-VertexToPixel main( VertexShaderInput input )
+#ifdef PACKED_VERTICES
+VertexToPixel main( PackedVertexShaderInput packedInput INSTANCE_INPUT )
+{
+	VertexShaderInput input = UnpackVertex(packedInput, quantizeOffset, quantizeScale);
+#else
+VertexToPixel main( VertexShaderInput input INSTANCE_INPUT )
 {
+#endif
+#ifdef INSTANCED
+	float3x4 world = float3x4(instance.world0, instance.world1, instance.world2);
+	float3x3 normalMatrix = float3x3(instance.normal0.xyz, instance.normal1.xyz, instance.normal2.xyz);
+#endif
 	// Set up output struct
 	VertexToPixel output;
 
@@ -33,9 +63,9 @@ VertexToPixel main( VertexShaderInput input )
 	// - Each of these components is then automatically divided by the W component, 
 	//   which we're leaving at 1.0 for now (this is more useful when dealing with 
 	//   a perspective projection matrix, which we'll get to in the future).
-	// Multiply the three matrices together first
-	matrix wvp = mul(projection, mul(view, world));
-	output.screenPosition = mul(wvp, float4(input.localPosition, 1.0f));
+	// World position first, then view and projection
+	float3 worldPosition = mul(world, float4(input.localPosition, 1.0f));
+	output.screenPosition = mul(projection, mul(view, float4(worldPosition, 1.0f)));
 
 	// Pass the color through 
 	// - The values will be interpolated per-pixel by the rasterizer
@@ -44,9 +74,9 @@ VertexToPixel main( VertexShaderInput input )
 
 	//Update normal using the current world Matrix and pass it along
 	//Using inverse transpose accounts for non-uniform scale
-	output.normal = mul((float3x3)worldInvTranspose, input.normal);
+	output.normal = mul(normalMatrix, input.normal);
 	//Multiply local position by world matrix, pass along
-	output.worldPosition = mul(world, float4(input.localPosition, 1)).xyz;
+	output.worldPosition = worldPosition;
 	//Rotate tangent by world matrix
 	output.tangent = mul((float3x3)world, input.tangent);
 
@@ -54,8 +84,7 @@ VertexToPixel main( VertexShaderInput input )
 	//Calculate screen position of this pixel
 	//This takes the shadow we created and applys the world position to it
 	// Calculate where this position is from the light's point of view
-	matrix shadowWVP = mul(shadowProj, mul(shadowView, world));
-	output.shadowPos = mul(shadowWVP, float4(input.localPosition, 1.0f));
+	output.shadowPos = mul(shadowProj, mul(shadowView, float4(worldPosition, 1.0f)));
 
 	// Whatever we return will make its way through the pipeline to the
 	// next programmable stage we're using (the pixel shader for now)